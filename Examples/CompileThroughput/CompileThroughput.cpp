@@ -0,0 +1,128 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+
+using NativeJIT::Allocator;
+using NativeJIT::ExecutionBuffer;
+using NativeJIT::Function;
+using NativeJIT::FunctionBuffer;
+using NativeJIT::Node;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// This example measures how quickly NativeJIT compiles large generated
+// expression trees and how much arena memory each node takes.
+//
+// The generated function computes
+//
+//     sum(values[i % 16] * (i + 1)) for i in [0, leafCount)
+//
+// as a balanced tree of additions, so the tree has roughly 4 * leafCount
+// nodes but stays shallow enough to be evaluated without deep recursion.
+//
+// Usage: CompileThroughput [leafCount] [iterations]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+typedef Function<int64_t, int64_t*> BenchmarkFunction;
+
+
+static Node<int64_t>& BuildTree(BenchmarkFunction& e,
+                                unsigned first,
+                                unsigned count)
+{
+    if (count == 1)
+    {
+        return e.Mul(e.Deref(e.GetP1(), static_cast<int32_t>(first % 16)),
+                     e.Immediate(static_cast<int64_t>(first) + 1));
+    }
+
+    const unsigned half = count / 2;
+
+    return e.Add(BuildTree(e, first, half),
+                 BuildTree(e, first + half, count - half));
+}
+
+
+int main(int argc, char* argv[])
+{
+    const unsigned leafCount = argc > 1 ? static_cast<unsigned>(atoi(argv[1])) : 16384;
+    const unsigned iterations = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 20;
+
+    if (leafCount == 0 || iterations == 0)
+    {
+        std::cout << "Usage: CompileThroughput [leafCount] [iterations]" << std::endl;
+        return 1;
+    }
+
+    // Start with a small arena. It grows on the first iteration and later
+    // iterations run from a single block sized after the first one.
+    ExecutionBuffer codeAllocator(64 * 1024 * 1024);
+    Allocator allocator(64 * 1024);
+    FunctionBuffer code(codeAllocator, 64 * 1024 * 1024);
+
+    std::vector<int64_t> values;
+    for (int64_t i = 0; i < 16; ++i)
+    {
+        values.push_back(i - 5);
+    }
+
+    int64_t expected = 0;
+    for (unsigned i = 0; i < leafCount; ++i)
+    {
+        expected += values[i % 16] * (static_cast<int64_t>(i) + 1);
+    }
+
+    unsigned nodeCount = 0;
+    double buildSeconds = 0;
+    double compileSeconds = 0;
+
+    for (unsigned iteration = 0; iteration < iterations; ++iteration)
+    {
+        allocator.Reset();
+        code.Reset();
+
+        auto start = std::chrono::steady_clock::now();
+
+        BenchmarkFunction expression(allocator, code);
+        auto & sum = BuildTree(expression, 0, leafCount);
+
+        auto built = std::chrono::steady_clock::now();
+
+        auto function = expression.Compile(sum);
+
+        auto compiled = std::chrono::steady_clock::now();
+
+        buildSeconds += std::chrono::duration<double>(built - start).count();
+        compileSeconds += std::chrono::duration<double>(compiled - built).count();
+
+        // Node IDs are assigned sequentially, the return node is the last one.
+        nodeCount = sum.GetId() + 2;
+
+        if (function(values.data()) != expected)
+        {
+            std::cout << "Wrong result from the generated function." << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "sizeof(Node<int64_t>):      " << sizeof(Node<int64_t>) << std::endl;
+    std::cout << "Nodes per tree:             " << nodeCount << std::endl;
+    std::cout << "Arena bytes per node:       "
+              << static_cast<double>(allocator.GetHighWaterMark()) / nodeCount << std::endl;
+    std::cout << "Arena blocks / capacity:    "
+              << allocator.GetBlockCount() << " / " << allocator.GetCapacity() << std::endl;
+    std::cout << "Code bytes:                 " << code.CurrentPosition() << std::endl;
+    std::cout << "Build time per tree (ms):   " << 1000 * buildSeconds / iterations << std::endl;
+    std::cout << "Compile time per tree (ms): " << 1000 * compileSeconds / iterations << std::endl;
+    std::cout << "Compiled nodes per second:  "
+              << static_cast<double>(nodeCount) * iterations / compileSeconds << std::endl;
+
+    return 0;
+}
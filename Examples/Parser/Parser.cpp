@@ -244,8 +244,7 @@ namespace Examples
                 auto& parameter = ParseSum();
                 SkipWhite();
                 Consume(')');
-                auto & sqrtFunction = m_expression.Immediate(sqrtf);
-                return m_expression.Call(sqrtFunction, parameter);
+                return m_expression.Sqrt(parameter);
             }
             else
             {
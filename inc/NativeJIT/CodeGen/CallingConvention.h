@@ -43,6 +43,12 @@ namespace NativeJIT
         // Register masks of registers that can be written to.
         static const unsigned c_rxxWritableRegistersMask = 0xFFFF;    // Everything except RIP.
         static const unsigned c_xmmWritableRegistersMask = 0xFFFF;    // All XMM registers.
+
+        // Number of integer and floating point parameters passed in registers.
+        // Parameters share the registers by position, the rest of them are
+        // passed on the stack after the 4-slot home space.
+        static const unsigned c_rxxParameterRegisterCount = 4;        // RCX, RDX, R8, R9
+        static const unsigned c_xmmParameterRegisterCount = 4;        // XMM0-XMM3
 #else
         // Register masks of volatile integer and floating point registers.
         // TODO: This could be replaced with constexpr: add operator| to Register and use it to define the masks.
@@ -58,8 +64,19 @@ namespace NativeJIT
         // Register masks of registers that can be written to.
         static const unsigned c_rxxWritableRegistersMask = 0xFFFF;    // Everything except RIP.
         static const unsigned c_xmmWritableRegistersMask = 0xFFFF;    // All XMM registers.
+
+        // Number of integer and floating point parameters passed in registers.
+        // Each register class is allocated independently, the parameters that
+        // don't fit are passed on the stack in order.
+        static const unsigned c_rxxParameterRegisterCount = 6;        // RDI, RSI, RDX, RCX, R8, R9
+        static const unsigned c_xmmParameterRegisterCount = 8;        // XMM0-XMM7
 #endif
 
+        // Registers which are used neither to pass parameters nor to return
+        // values in any of the supported calling conventions.
+        static const unsigned c_rxxNonArgumentRegistersMask = 0xfc08; // 1111 1100 0000 1000 (RBX | R10-R15)
+        static const unsigned c_xmmNonArgumentRegistersMask = 0xff00; // 1111 1111 0000 0000 (XMM8-XMM15)
+
     static_assert((c_rxxNonVolatileRegistersMask ^ c_rxxVolatileRegistersMask) == 0xffff,
                   "Each register should appear exactly once in calling convention mask");
     static_assert((c_xmmNonVolatileRegistersMask ^ c_xmmVolatileRegistersMask) == 0xffff,
@@ -111,6 +111,14 @@ namespace NativeJIT
 
         void Fill(unsigned start, unsigned length, uint8_t value);
 
+        // Removes length bytes starting at startPosition by moving the bytes
+        // that follow them, up to CurrentPosition(), to startPosition. The
+        // current position, the labels and the call sites are moved along with
+        // the code. Derived classes which record other position dependent data
+        // (f. ex. RIP-relative displacements) must override this method to
+        // adjust it.
+        virtual void RemoveBytes(unsigned startPosition, unsigned length);
+
         // Patches each call site with the correct offset derived from its resolved label.
         void PatchCallSites();
 
@@ -0,0 +1,158 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <stddef.h>                             // For ::size_t
+#include <vector>                               // Embedded member.
+
+#include "NativeJIT/CodeGen/FunctionBuffer.h"   // RUNTIME_FUNCTION embedded.
+#include "Temporary/NonCopyable.h"              // Base class.
+
+
+namespace NativeJIT
+{
+    // Identifies a compiled function in the code cache. The tree hash
+    // identifies the expression that was compiled (see HashBytes(), f. ex.
+    // applied to the tree serialized with TreeWriter) and the CPU features
+    // ensure that the code is not loaded on a machine that may not support
+    // some of its instructions.
+    struct CodeCacheKey
+    {
+        uint64_t m_treeHash;
+        uint64_t m_cpuFeatures;
+
+        // Creates a key for the tree hash and the CPU features of the host.
+        static CodeCacheKey ForHost(uint64_t treeHash);
+
+        // Returns a 64-bit FNV-1a hash of the data.
+        static uint64_t HashBytes(void const * data, size_t size);
+
+        // Returns a fingerprint of the instruction set extensions supported
+        // by the host CPU.
+        static uint64_t GetHostCpuFeatures();
+    };
+
+
+    // Maps the absolute addresses referenced by compiled code (functions,
+    // models etc.) to symbolic IDs that remain stable across processes. The
+    // table used to load the code must map the same IDs to the equivalent
+    // objects in the loading process.
+    class SymbolTable : private NonCopyable
+    {
+    public:
+        void Add(uint32_t id, void const * address);
+
+        // Return true and set the output parameter if the symbol is found.
+        bool TryGetAddress(uint32_t id, void const *& address) const;
+        bool TryGetId(void const * address, uint32_t& id) const;
+
+    private:
+        struct Symbol
+        {
+            uint32_t m_id;
+            void const * m_address;
+        };
+
+        std::vector<Symbol> m_symbols;
+    };
+
+
+    // CodeCache persists compiled functions to disk so that they can be
+    // loaded by a later process without being recompiled.
+    //
+    // The cache file starts with a header and the relocation table, followed
+    // by a page aligned image of the FunctionBuffer's contents, i.e. the
+    // code, its RIP-relative constants and the unwind information. Since
+    // the x64 code and constants are addressed relative to the buffer, the
+    // only values that need to be patched on load are the absolute addresses
+    // recorded in FunctionBuffer::GetAbsoluteAddressRelocations() and the
+    // displacements of X64CodeGenerator::GetDirectBranchSites().
+    class CodeCache
+    {
+    public:
+        // Alignment of the code image within the cache file. Allows the
+        // image to be mapped and protected directly from the file.
+        static const unsigned c_imageAlignment = 4096;
+
+        // Writes the function compiled in the code buffer to the file at
+        // path. Throws if any of the relocated addresses is not in the
+        // symbol table.
+        static void Save(char const * path,
+                         CodeCacheKey const & key,
+                         FunctionBuffer const & code,
+                         SymbolTable const & symbols);
+    };
+
+
+    // A function loaded from the code cache. The cache file is mapped
+    // copy-on-write, so relocations are patched in private copies of the
+    // pages which are then made executable.
+    class CachedFunction : private NonCopyable
+    {
+    public:
+        CachedFunction();
+        ~CachedFunction();
+
+        // Maps the cache file at path and patches the relocations. Returns
+        // false on cache miss, i.e. if the file does not exist, it was
+        // saved with a different key or it got mapped out of the range of
+        // its direct branches' targets. Throws if the file is corrupt or if
+        // a symbol it references is not in the symbol table.
+        bool Load(char const * path,
+                  CodeCacheKey const & key,
+                  SymbolTable const & symbols);
+
+        // Unmaps the currently loaded function, if any.
+        void Unload();
+
+        bool IsLoaded() const;
+
+        void const * GetEntryPoint() const;
+
+        template <typename FUNCTIONTYPE>
+        FUNCTIONTYPE GetEntryPoint() const;
+
+    private:
+        uint8_t* m_mapping;
+        size_t m_mappingSize;
+        void const * m_entryPoint;
+
+        // Describes the loaded function relative to the start of its image.
+        // On Windows, it is registered to allow stack unwinding.
+        RUNTIME_FUNCTION m_runtimeFunction;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for CachedFunction
+    //
+    //*************************************************************************
+    template <typename FUNCTIONTYPE>
+    FUNCTIONTYPE CachedFunction::GetEntryPoint() const
+    {
+        return reinterpret_cast<FUNCTIONTYPE>(const_cast<void*>(GetEntryPoint()));
+    }
+}
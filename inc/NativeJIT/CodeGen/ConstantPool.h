@@ -0,0 +1,138 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "NativeJIT/AllocatorVector.h"          // Embedded member.
+#include "Temporary/NonCopyable.h"              // Base class.
+
+
+namespace Allocators
+{
+    class IAllocator;
+}
+
+
+namespace NativeJIT
+{
+    class FunctionBuffer;
+
+    // Emits constants accessed through RIP-relative addressing into a
+    // FunctionBuffer, in front of the function body. Constants with the same
+    // size and bit pattern are emitted only once, so f. ex. all the 0.0f and
+    // 1.0f immediates in an expression share the same pool entry.
+    //
+    // The entries are found through an open-addressing hash index on their
+    // contents, so adding a constant takes constant time on average even for
+    // functions with tens of thousands of immediates.
+    //
+    // Each constant is aligned to its natural alignment, up to c_maxAlignment
+    // bytes. This allows 16 and 32-byte packed constants to be loaded directly
+    // from the pool with aligned instructions such as movaps, assuming that
+    // the start of the buffer is aligned accordingly.
+    class ConstantPool : public NonCopyable
+    {
+    public:
+        static const unsigned c_maxAlignment = 32;
+
+        ConstantPool(Allocators::IAllocator& allocator, FunctionBuffer& code);
+
+        // Forgets all entries. Must be called whenever the code buffer is
+        // reset.
+        void Clear();
+
+        // Returns the buffer offset of a constant with the specified contents.
+        // If the pool doesn't contain such constant yet, it is emitted at
+        // the current position of the code buffer, which must thus not be
+        // inside of the function body. The constants marked as absolute
+        // addresses are registered as relocations with the FunctionBuffer and
+        // are never shared with the constants which are not.
+        int32_t Add(void const * data,
+                    unsigned size,
+                    unsigned alignment,
+                    bool isAbsoluteAddress);
+
+        // Typed flavor of the method above which uses the natural alignment of
+        // T. By default, pointers are treated as absolute addresses.
+        template <typename T>
+        int32_t Add(T value, bool isAbsoluteAddress = std::is_pointer<T>::value);
+
+        // Returns the number of distinct constants in the pool.
+        unsigned GetEntryCount() const;
+
+        // Returns the largest power of two which divides size, capped to
+        // c_maxAlignment.
+        static unsigned GetNaturalAlignment(unsigned size);
+
+        // Returns the hash of a constant used by the index. Also used by
+        // FunctionModule to share constants between functions.
+        static uint32_t Hash(void const * data, unsigned size, bool isAbsoluteAddress);
+
+    private:
+        struct Entry
+        {
+            uint32_t m_hash;
+            int32_t m_offset;
+            unsigned m_size;
+            bool m_isAbsoluteAddress;
+        };
+
+        // Inserts the index of the entry into m_buckets, which must have
+        // a free slot.
+        void InsertIntoIndex(unsigned entryIndex);
+
+        // Doubles the size of m_buckets and reinserts all entries.
+        void GrowIndex();
+
+        FunctionBuffer& m_code;
+
+        Allocators::StlAllocator<Entry> m_stlAllocator;
+        AllocatorVector<Entry> m_entries;
+
+        // Open-addressing hash index with linear probing. Each slot holds
+        // an index into m_entries plus one, or zero for an empty slot. The
+        // size is a power of two and the load factor is kept at most 1/2.
+        Allocators::StlAllocator<unsigned> m_bucketAllocator;
+        AllocatorVector<unsigned> m_buckets;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for ConstantPool.
+    //
+    //*************************************************************************
+    template <typename T>
+    int32_t ConstantPool::Add(T value, bool isAbsoluteAddress)
+    {
+        static_assert(std::is_trivial<T>::value, "Invalid constant type.");
+
+        return Add(&value,
+                   sizeof(T),
+                   GetNaturalAlignment(sizeof(T)),
+                   isAbsoluteAddress);
+    }
+}
@@ -0,0 +1,47 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#pragma once
+
+
+namespace NativeJIT
+{
+    // Detects the instruction set extensions of the host CPU. X64CodeGenerator
+    // encodes instructions from any extension; the nodes and factory methods
+    // that rely on an optional extension check for it before emitting them.
+    class CpuFeatures
+    {
+    public:
+        // Executes CPUID for the leaf and subleaf and returns EAX, EBX, ECX
+        // and EDX in the registers array.
+        static void Cpuid(unsigned leaf, unsigned subleaf, unsigned (&registers)[4]);
+
+        static bool HasSSE41();
+        static bool HasSSE42();
+
+        // Returns true only if the OS also preserves the AVX register state,
+        // which the VEX encoded FMA3 instructions require.
+        static bool HasFMA();
+    };
+}
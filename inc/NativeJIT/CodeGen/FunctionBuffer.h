@@ -37,12 +37,16 @@ typedef struct
 } RUNTIME_FUNCTION;
 #endif
 
+#include <string>                                   // Embedded member.
+#include <vector>                                   // Embedded member.
+
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"     // Inherits from X64CodeGenerator.
 
 
 namespace NativeJIT
 {
     class FunctionSpecification;
+    class IFunctionListener;
 
     class FunctionBuffer : public X64CodeGenerator
     {
@@ -81,13 +85,105 @@ namespace NativeJIT
         // Called by clients to mark that generation of function's body has
         // completed. At this point, unwind info and prolog are filled in
         // the space previously reserved by BeginFunctionBodyGeneration().
-        // Then, epilog is written after the function body and all call sites
-        // patched with the actual values.
+        // If more space was reserved than needed, the function body is moved
+        // towards the beginning of the buffer so that unwind info, prolog,
+        // body and epilog are laid out contiguously. Then, epilog is written
+        // after the function body and all call sites patched with the actual
+        // values.
         void EndFunctionBodyGeneration(FunctionSpecification const & spec);
 
+        // Records that the eight bytes at the specified buffer offset hold
+        // an absolute address (f. ex. a function pointer or a pointer to a
+        // Model) rather than position independent data. Together with the
+        // buffer contents, these offsets make the function relocatable: the
+        // code can be copied elsewhere as long as the addresses are patched.
+        void AddAbsoluteAddressRelocation(unsigned offset);
+
+        // Returns the offsets recorded by AddAbsoluteAddressRelocation().
+        std::vector<unsigned> const & GetAbsoluteAddressRelocations() const;
+
+        // Describes a constant of m_size bytes at buffer offset m_offset,
+        // aligned to m_alignment bytes, which is only accessed through
+        // RIP-relative addressing.
+        struct Constant
+        {
+            unsigned m_offset;
+            unsigned m_size;
+            unsigned m_alignment;
+        };
+
+        // Records a constant emitted in front of the function body. Called by
+        // ConstantPool. FunctionModule uses the recorded constants to share
+        // the identical ones between functions.
+        void AddConstant(unsigned offset, unsigned size, unsigned alignment);
+
+        // Returns the constants recorded by AddConstant(), in order of their
+        // offsets.
+        std::vector<Constant> const & GetConstants() const;
+
+        // Reserves space at the current position for a copy of the epilog
+        // without its final RET, to be filled in by EndFunctionBodyGeneration().
+        // A JMP emitted right after it is a tail call: the target is entered
+        // with the stack and the non-volatile registers restored, as if it was
+        // called by the function's caller. EndTailCallJump() must be called
+        // right after the JMP.
+        void ReserveTailCallEpilog();
+
+        // Marks the end of the JMP that follows ReserveTailCallEpilog(). Code
+        // emitted after it runs with the function's frame in place again.
+        void EndTailCallJump();
+
+        // Describes the [m_startOffset, m_endOffset) range of the JMP of a
+        // tail call, which executes with the frame already released.
+        struct TailCallJump
+        {
+            unsigned m_startOffset;
+            unsigned m_endOffset;
+        };
+
+        // Returns the tail call jumps in ascending order. Valid only after the
+        // function body has been generated.
+        std::vector<TailCallJump> const & GetTailCallJumps() const;
+
+        // Name reported to the listener for the functions generated in this
+        // buffer.
+        void SetFunctionName(char const * name);
+        std::string const & GetFunctionName() const;
+
+        // Returns the function name or, if it is not set, a name derived from
+        // the entry point. Valid only after the function body has been generated.
+        std::string GetSymbolName() const;
+
+        // Sets the listener notified whenever a function body is completed or
+        // nullptr to remove it. The listener is not owned by the buffer and
+        // must outlive it or be removed.
+        void SetListener(IFunctionListener* listener);
+
+        // Describes that the code starting at m_offset, up to the offset of
+        // the next entry, was generated by the node with ID m_nodeId.
+        struct DebugInfoEntry
+        {
+            unsigned m_offset;
+            unsigned m_nodeId;
+        };
+
+        // Returns whether the listener asked for debug info. When false,
+        // AddDebugInfo() calls are ignored.
+        bool IsDebugInfoEnabled() const;
+
+        // Records that the code from the offset onward is generated by the
+        // specified node. Replaces the previous entry if the offsets match.
+        void AddDebugInfo(unsigned offset, unsigned nodeId);
+
+        // Returns the debug info entries, sorted by offset.
+        std::vector<DebugInfoEntry> const & GetDebugInfo() const;
+
         // Resets the buffer to the same state it had after its construction.
         virtual void Reset() override;
 
+        // Moves the recorded relocations and debug info along with the code.
+        virtual void RemoveBytes(unsigned startPosition, unsigned length) override;
+
     private:
         // Structure used to register stack unwind information with Windows.
         RUNTIME_FUNCTION m_runtimeFunction;
@@ -102,11 +198,36 @@ namespace NativeJIT
         unsigned m_prologLength;
         bool m_isCodeGenerationCompleted;
 
+        // Offsets of absolute addresses within the buffer. See the DESIGN NOTE
+        // in JumpTable about the use of heap.
+        std::vector<unsigned> m_absoluteAddressRelocations;
+
+        // See the DESIGN NOTE in JumpTable about the use of heap.
+        std::vector<Constant> m_constants;
+
+        // Tail calls in ascending order. Until EndFunctionBodyGeneration()
+        // fills in the epilogs, m_startOffset is the offset of the space
+        // reserved by ReserveTailCallEpilog().
+        std::vector<TailCallJump> m_tailCallJumps;
+
+        std::string m_functionName;
+        IFunctionListener* m_listener;
+        std::vector<DebugInfoEntry> m_debugInfo;
+
         // The callback function for RtlInstallFunctionTableCallback. Context
         // is a poiner to a FunctionBuffer.
 #ifdef NATIVEJIT_PLATFORM_WINDOWS
         static RUNTIME_FUNCTION*
         WindowsGetRuntimeFunctionCallback(DWORD64 controlPc, void* context);
+#else
+        // DWARF call frame information for the generated function, built
+        // from the unwind info and registered with __register_frame() so
+        // that exceptions and profilers can unwind through the function.
+        // Empty if nothing is registered.
+        std::vector<uint8_t> m_ehFrame;
+
+        void RegisterEhFrame();
+        void DeregisterEhFrame();
 #endif
 
         // A helper method used to implement the two public flavors of the method.
@@ -0,0 +1,161 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>                        // Embedded member.
+#include <vector>                               // Embedded member.
+
+#include "NativeJIT/CodeGen/FunctionBuffer.h"   // RUNTIME_FUNCTION embedded.
+#include "Temporary/NonCopyable.h"              // Base class.
+
+
+namespace Allocators
+{
+    class IAllocator;
+}
+
+
+namespace NativeJIT
+{
+    // Packs many compiled functions into a single contiguous code region so
+    // that a large number of live functions doesn't require one FunctionBuffer
+    // (and its unused capacity) per function.
+    //
+    // The region consists of the constant pool, which holds the RIP-relative
+    // data of all functions, followed by the code of the functions. Each
+    // function is copied from the FunctionBuffer it was compiled into, with
+    // its entry point aligned to a cache line. The same FunctionBuffer can
+    // then be reused to compile the next function.
+    //
+    // The constants recorded with FunctionBuffer::AddConstant() (i.e. all the
+    // data emitted by the ConstantPool of an ExpressionTree) are shared by
+    // all functions in the module, so f. ex. a 1.0 used by many functions is
+    // stored only once.
+    //
+    // The module registers the unwind information for all of its functions
+    // and is addressed by the index returned by AddFunction().
+    class FunctionModule : public NonCopyable
+    {
+    public:
+        // The alignment of the function entry points and of the data of the
+        // functions whose constants cannot be shared, see AddFunction().
+        static const unsigned c_functionAlignment = 64;
+
+        // Allocates capacity bytes from the code allocator, the first
+        // constantPoolCapacity of which are reserved for the constant pool.
+        // As with FunctionBuffer, the allocator must return executable memory.
+        FunctionModule(Allocators::IAllocator& codeAllocator,
+                       unsigned capacity,
+                       unsigned constantPoolCapacity);
+
+        // Deregisters the unwind information and frees the region.
+        ~FunctionModule();
+
+        // Copies the function which was most recently generated in the buffer
+        // into the module and returns its index. Everything in front of the
+        // function's unwind info (i.e. the data emitted by Pass0 of the
+        // ExpressionTree) goes to the constant pool and the RIP-relative and
+        // direct branch displacements are adjusted to the new locations.
+        // If all RIP-relative data references point into recorded constants,
+        // each constant is looked up in the pool and only added if missing.
+        // Otherwise the data is copied as a whole. Throws if a direct branch
+        // target is out of range of the module.
+        unsigned AddFunction(FunctionBuffer const & code);
+
+        unsigned GetFunctionCount() const;
+
+        // Returns the untyped entry point of the function with the specified
+        // index.
+        void const * GetEntryPoint(unsigned index) const;
+
+        // Returns the entry point of the function with the specified index
+        // cast to the function pointer type, f. ex. Function<...>::FunctionType.
+        template <typename FUNCTION>
+        FUNCTION GetFunction(unsigned index) const;
+
+        // Returns the number of bytes used in the constant pool and in the code
+        // part of the region, including alignment.
+        unsigned GetConstantPoolSize() const;
+        unsigned GetCodeSize() const;
+
+    private:
+        Allocators::IAllocator& m_codeAllocator;
+        const unsigned m_capacity;
+        const unsigned m_constantPoolCapacity;
+
+        uint8_t* m_bufferStart;
+        unsigned m_constantPoolSize;
+
+        // Offset from m_bufferStart where the next function can be placed.
+        unsigned m_codeEnd;
+
+        // Describes the functions, with offsets relative to m_bufferStart.
+        // The entries are sorted by address since the functions are placed in
+        // order. See the DESIGN NOTE in JumpTable about the use of heap.
+        std::vector<RUNTIME_FUNCTION> m_functions;
+
+        // A constant in the pool, with the offset relative to m_bufferStart.
+        struct Constant
+        {
+            unsigned m_offset;
+            unsigned m_size;
+        };
+
+        // Looks for a constant in the pool with the contents and alignment of
+        // the specified constant from the code buffer. Returns whether it was
+        // found and, if so, its offset.
+        bool FindConstant(uint8_t const * data,
+                          uint32_t hash,
+                          FunctionBuffer::Constant const & constant,
+                          unsigned& offset) const;
+
+        // The shared constants, indexed by ConstantPool::Hash(). See the
+        // DESIGN NOTE in JumpTable about the use of heap.
+        std::unordered_multimap<uint32_t, Constant> m_constants;
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        // The callback function for RtlInstallFunctionTableCallback. Context
+        // is a pointer to a FunctionModule.
+        static RUNTIME_FUNCTION*
+        WindowsGetRuntimeFunctionCallback(DWORD64 controlPc, void* context);
+#else
+        // DWARF call frame information for each function, registered with the
+        // unwinder. See FunctionBuffer::m_ehFrame.
+        std::vector<std::vector<uint8_t>> m_ehFrames;
+#endif
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for FunctionModule.
+    //
+    //*************************************************************************
+    template <typename FUNCTION>
+    FUNCTION FunctionModule::GetFunction(unsigned index) const
+    {
+        return reinterpret_cast<FUNCTION>(const_cast<void*>(GetEntryPoint(index)));
+    }
+}
@@ -47,6 +47,23 @@ namespace NativeJIT
         // first instruction of the prolog started executing.
         enum class BaseRegisterType { Unused, SetRbpToOriginalRsp };
 
+        // Specifies how the stack frame is allocated. Standard adjusts RSP to
+        // allocate space for the stack slots, register saves and parameters
+        // for called functions. RedZone leaves RSP unchanged and places the
+        // stack slots and the register saves below RSP, in the red zone. Only
+        // functions which make no calls can use the RedZone frame.
+        enum class FrameType { Standard, RedZone };
+
+        // The size of the area below RSP which is not modified by signal or
+        // interrupt handlers. The System V ABI defines a 128 byte red zone
+        // whereas Windows x64 has none, so only frames which need no stack
+        // space at all can be of RedZone type there.
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        static const unsigned c_redZoneSize = 0;
+#else
+        static const unsigned c_redZoneSize = 128;
+#endif
+
         // The maximum size for the unwind buffer that needs to be reserved
         // if the number of unwind codes is not known in advance.
         // DESIGN NOTE: not defined inline to avoid inclusion of UnwindCode.h.
@@ -56,14 +73,21 @@ namespace NativeJIT
         // Larger values allow for more extreme prolog sizes, but lead to more
         // wasted space in common case (in the scenario when prolog space is
         // reserved and then filled in). Close to 144 bytes is needed when all
-        // 8 RXX (plus RSP separately) and 10 XMM non-volatiles need to be saved.
-        static const size_t c_maxPrologOrEpilogSize = 144;
+        // 8 RXX (plus RSP separately) and 10 XMM non-volatiles need to be saved
+        // and up to 32 more bytes for the stack probe loop.
+        static const size_t c_maxPrologOrEpilogSize = 176;
         static_assert(c_maxPrologOrEpilogSize <= 256,
                       "Prolog/epilog cannot be larger than 256 bytes");
 
-        // A value larger than 4096 would require the generated code to call _chkstk.
-        static const unsigned c_maxStackSize = 4096;
-        static_assert(c_maxStackSize <= 4096, "Cannot have stack larger than 4096 bytes");
+        // Stacks grow one guard page at a time, so frames larger than a page
+        // must touch each page in order before RSP is moved past it. The
+        // prolog of such frames starts with a probe loop which does the same
+        // as _chkstk.
+        static const unsigned c_stackProbePageSize = 4096;
+
+        // The largest allocation that can be described by the two-code version
+        // of UWOP_ALLOC_LARGE, i.e. 65535 quadword slots.
+        static const unsigned c_maxStackSize = 0xffff * 8;
 
         // Builds unwind info, prolog and epilog code from the information about
         // function's behavior: maximum number of parameters for the functions
@@ -89,6 +113,20 @@ namespace NativeJIT
                               BaseRegisterType baseRegisterType,
                               std::ostream* diagnosticStream);
 
+        // Same as above, but allows to specify the frame type. For the RedZone
+        // frame, maxFunctionCallParameters must be negative and the stack slots
+        // and the RXX register saves must fit into c_redZoneSize. The stack
+        // slots are accessed the same way as with the Standard frame, f. ex.
+        // [rbp - 8] is the first slot, but RSP is not modified by the prolog.
+        FunctionSpecification(Allocators::IAllocator& allocator,
+                              int maxFunctionCallParameters,
+                              unsigned localStackSlotCount,
+                              unsigned savedRxxNonVolatilesMask,
+                              unsigned savedXmmNonVolatilesMask,
+                              BaseRegisterType baseRegisterType,
+                              FrameType frameType,
+                              std::ostream* diagnosticStream);
+
         // Returns the offset that can be added to the current RSP to get the
         // value of RSP that was effective before the prolog started executing.
         // This offset can then be used to access the return address as
@@ -128,6 +166,26 @@ namespace NativeJIT
                                              AllocatorVector<uint8_t>& unwindInfoBuffer,
                                              int32_t& m_offsetToOriginalRsp);
 
+        // Emits the loop which touches each page of the stack between RSP and
+        // RSP - stackBytes, top to bottom, without modifying RSP or any
+        // non-volatile registers.
+        static void EmitStackProbe(X64CodeGenerator& prologCode, unsigned stackBytes);
+
+        // Equivalent of BuildUnwindInfoAndProlog() for the RedZone frame. The
+        // register saves are described with UWOP_SAVE_NONVOL codes whose
+        // frame offsets are negative, i.e. relative to RSP but pointing
+        // below it. Such unwind info is valid only for System V, where
+        // NativeJIT is its only consumer.
+        static void BuildRedZoneUnwindInfoAndProlog(int maxFunctionCallParameters,
+                                                    unsigned localStackSlotCount,
+                                                    unsigned savedRxxNonVolatilesMask,
+                                                    unsigned savedXmmNonVolatilesMask,
+                                                    BaseRegisterType baseRegisterType,
+                                                    // Out parameters:
+                                                    X64CodeGenerator& prologCode,
+                                                    AllocatorVector<uint8_t>& unwindInfoBuffer,
+                                                    int32_t& m_offsetToOriginalRsp);
+
         // Uses the unwind information to generate epilog code into the current
         // position of the provided code generator.
         static void BuildEpilog(UnwindInfo const & unwindInfo,
@@ -0,0 +1,118 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>                                   // std::unique_ptr embedded.
+#include <vector>                                   // Embedded member.
+
+#include "NativeJIT/CodeGen/IFunctionListener.h"    // Inherits from IFunctionListener.
+#include "Temporary/NonCopyable.h"                  // Base class.
+
+
+// The GDB JIT compilation interface. GDB sets a breakpoint in
+// __jit_debug_register_code() and reads the symbol files from the list
+// in __jit_debug_descriptor whenever it is hit. The names and the layout
+// are defined by GDB, see
+// https://sourceware.org/gdb/current/onlinedocs/gdb/JIT-Interface.html
+//
+// There can only be one descriptor per process, so NativeJIT defines both
+// symbols weak and defers to another JIT's definition if there is one. The
+// list is then shared between the JITs but each of them serializes its
+// updates with its own lock, so at most one JIT in the process should
+// register code with GDB concurrently.
+extern "C"
+{
+    struct jit_code_entry
+    {
+        jit_code_entry* next_entry;
+        jit_code_entry* prev_entry;
+        char const * symfile_addr;
+        uint64_t symfile_size;
+    };
+
+
+    struct jit_descriptor
+    {
+        uint32_t version;
+        uint32_t action_flag;
+        jit_code_entry* relevant_entry;
+        jit_code_entry* first_entry;
+    };
+
+
+    extern jit_descriptor __jit_debug_descriptor;
+
+    void __jit_debug_register_code();
+}
+
+
+namespace NativeJIT
+{
+    class FunctionBuffer;
+
+    //*************************************************************************
+    //
+    // GdbJitListener registers each generated function with the GDB JIT
+    // interface as an in-memory ELF object which contains the function's
+    // symbol and the .eh_frame built from its unwind information. This
+    // allows debuggers to symbolize and unwind through the generated code.
+    //
+    // Each FunctionBuffer has at most one registration: compiling another
+    // function into the same buffer replaces the previous one. Registrations
+    // are global to the process and thread safe.
+    //
+    //*************************************************************************
+    class GdbJitListener : public IFunctionListener, private NonCopyable
+    {
+    public:
+        GdbJitListener();
+
+        // Unregisters all functions registered by this listener.
+        ~GdbJitListener();
+
+        // Unregisters the function generated in the buffer, if any. Must be
+        // called before a FunctionBuffer is destroyed or its code reused
+        // without the listener.
+        void Unregister(FunctionBuffer const & code);
+
+        //
+        // IFunctionListener methods.
+        //
+        virtual bool IsDebugInfoRequested() const override;
+        virtual void OnFunctionGenerated(FunctionBuffer const & code) override;
+
+    private:
+        struct Registration
+        {
+            FunctionBuffer const * m_code;
+            jit_code_entry m_entry;
+            std::vector<uint8_t> m_symbolFile;
+        };
+
+        void Unregister(Registration& registration);
+
+        std::vector<std::unique_ptr<Registration>> m_registrations;
+    };
+}
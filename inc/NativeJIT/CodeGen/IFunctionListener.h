@@ -0,0 +1,50 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+namespace NativeJIT
+{
+    class FunctionBuffer;
+
+    //*************************************************************************
+    //
+    // IFunctionListener is an interface for classes which need to be notified
+    // about functions generated in a FunctionBuffer, f. ex. to make the code
+    // visible to profilers and debuggers.
+    //
+    //*************************************************************************
+    class IFunctionListener
+    {
+    public:
+        virtual ~IFunctionListener() {}
+
+        // Returns whether the FunctionBuffer should record which node
+        // generated each part of the code. See FunctionBuffer::GetDebugInfo().
+        virtual bool IsDebugInfoRequested() const = 0;
+
+        // Called at the end of FunctionBuffer::EndFunctionBodyGeneration(),
+        // i.e. when the function is complete and its entry point is known.
+        virtual void OnFunctionGenerated(FunctionBuffer const & code) = 0;
+    };
+}
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 #include <vector> // Embedded member.
@@ -67,6 +68,11 @@ namespace NativeJIT
         // Patches each call site with the correct offset derived from its resolved label.
         void PatchCallSites();
 
+        // Moves the labels and the call sites located at or after the start
+        // address by delta bytes. Used when the tail of the code is moved
+        // within the buffer before the call sites are patched.
+        void Relocate(uint8_t const * start, ptrdiff_t delta);
+
         bool LabelIsDefined(Label label) const;
         const uint8_t* AddressOfLabel(Label label) const;
 
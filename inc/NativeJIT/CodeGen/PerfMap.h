@@ -0,0 +1,109 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>                                   // FILE embedded.
+#include <string>
+
+#include "NativeJIT/CodeGen/IFunctionListener.h"    // Inherits from IFunctionListener.
+#include "Temporary/NonCopyable.h"                  // Base class.
+
+
+namespace NativeJIT
+{
+    // Listeners which make the generated functions visible to Linux perf.
+    // Attach them with FunctionBuffer::SetListener() before compiling. The
+    // functions are named after FunctionBuffer::GetSymbolName().
+
+    //*************************************************************************
+    //
+    // PerfMapWriter appends an entry for each generated function to the
+    // <directory>/perf-<pid>.map file which perf report uses to symbolize
+    // samples in anonymous executable memory.
+    //
+    //*************************************************************************
+    class PerfMapWriter : public IFunctionListener, private NonCopyable
+    {
+    public:
+        // perf looks for the map in /tmp. Other directories are useful for
+        // testing.
+        explicit PerfMapWriter(char const * directory = "/tmp");
+        ~PerfMapWriter();
+
+        std::string const & GetPath() const;
+
+        //
+        // IFunctionListener methods.
+        //
+        virtual bool IsDebugInfoRequested() const override;
+        virtual void OnFunctionGenerated(FunctionBuffer const & code) override;
+
+    private:
+        std::string m_path;
+        FILE* m_file;
+    };
+
+
+    //*************************************************************************
+    //
+    // JitDumpWriter writes the <directory>/jit-<pid>.dump file in the jitdump
+    // format. In addition to the symbols, the dump contains a copy of each
+    // function's code so that perf annotate can disassemble it even after the
+    // buffer has been reused. Optionally, JIT_CODE_DEBUG_INFO records map the
+    // instructions to the IDs of the nodes that generated them; the IDs are
+    // reported as line numbers in a file named after the function.
+    //
+    // Usage: perf record -k mono ...; perf inject --jit -i perf.data -o out.data
+    //
+    //*************************************************************************
+    class JitDumpWriter : public IFunctionListener, private NonCopyable
+    {
+    public:
+        JitDumpWriter(bool includeDebugInfo = false, char const * directory = "/tmp");
+        ~JitDumpWriter();
+
+        std::string const & GetPath() const;
+
+        //
+        // IFunctionListener methods.
+        //
+        virtual bool IsDebugInfoRequested() const override;
+        virtual void OnFunctionGenerated(FunctionBuffer const & code) override;
+
+    private:
+        void Write(void const * data, size_t size);
+        void WriteRecordHeader(uint32_t id, size_t totalSize);
+
+        const bool m_includeDebugInfo;
+        std::string m_path;
+        int m_file;
+
+        // perf record notices the dump file by the executable mapping of it.
+        void* m_marker;
+        size_t m_markerSize;
+
+        uint64_t m_codeIndex;
+    };
+}
@@ -28,6 +28,7 @@
 // http://felixcloutier.com/x86/
 
 #include <ostream>                              // Debugging output.
+#include <vector>                               // Embedded member.
 
 #include "NativeJIT/BitOperations.h"
 #include "NativeJIT/CodeGen/CodeBuffer.h"       // Inherits from CodeBuffer.
@@ -88,29 +89,43 @@ namespace NativeJIT
         Bts,
         Call,
         Cmp,
+        Crc32,      // SSE4.2. The source may be narrower than the accumulator.
         CvtFP2FP,
         CvtFP2SI,
         CvtSI2FP,
         Dec,
-        IMul,
+        Div,        // Unsigned division of rdx:rax (integer) or DivSS/DivSD (float).
+        FMAdd,      // VFMAdd231SS/SD (FMA3): dest += src1 * src2.
+        IDiv,       // Signed division of rdx:rax.
+        IMul,       // One-operand form multiplies rax into rdx:rax.
         Inc,
         Lea,
+        Max,        // MaxSS/MaxSD.
+        Min,        // MinSS/MinSD.
         Mov,
         MovSX,
         MovZX,
         MovAP,      // Aligned 128-bit SSE move.
+        Mul,        // Unsigned multiplication of rax into rdx:rax.
         Neg,
         Nop,
         Not,
         Or,
         Pop,
+        PrefetchNTA,    // Prefetch hints, memory operand only.
+        PrefetchT0,
+        PrefetchT1,
+        PrefetchT2,
         Push,
         Rep,
         Ret,
         Rol,
+        Round,      // RoundSS/RoundSD (SSE4.1) with the rounding mode immediate.
+        Sar,
         Shl,        // Note: Shl and Sal are aliases, unlike Shr and Sar.
         Shld,
         Shr,
+        Sqrt,       // SqrtSS/SqrtSD.
         Stosq,
         Sub,
         Xor,
@@ -145,9 +160,52 @@ namespace NativeJIT
         // This override allows for printing of debugging information.
         virtual void PlaceLabel(Label l) override;
 
+        // These overrides keep the recorded RIP-relative and direct branch
+        // displacements consistent with the buffer contents. When the code
+        // which contains a displacement is moved by RemoveBytes() while its
+        // target is not, the displacement is adjusted accordingly.
+        virtual void RemoveBytes(unsigned startPosition, unsigned length) override;
+        virtual void Reset() override;
+
+        // Returns the buffer offsets of the 32-bit displacements of the
+        // instructions which use RIP-relative addressing, in emission order.
+        std::vector<unsigned> const & GetRIPRelativeSites() const;
+
+        // Describes a CALL or JMP with a 32-bit displacement to an address
+        // outside of the buffer, f. ex. a C++ function.
+        struct DirectBranchSite
+        {
+            // Buffer offset of the displacement.
+            unsigned m_offset;
+            void const * m_target;
+        };
+
+        // Returns the direct branches emitted by Call(void const *) and
+        // Jmp(void const *), in emission order.
+        std::vector<DirectBranchSite> const & GetDirectBranchSites() const;
+
+        // Returns whether a direct branch anywhere within the buffer can
+        // reach the target, i.e. whether the target is within +/-2 GB.
+        bool IsInDirectBranchRange(void const * target) const;
+
         void Call(Label l);
         void Jmp(Label l);
-        void Jmp(void* functionPtr);
+
+        // Emit a CALL or JMP with a 32-bit displacement to the target, which
+        // must be within IsInDirectBranchRange().
+        void Call(void const * target);
+        void Jmp(void const * target);
+
+        // Emits an indirect JMP to the address in the register.
+        void Jmp(Register<8, false> r);
+
+        // Loads the address of the label into the register using RIP-relative
+        // addressing.
+        void Lea(Register<8, false> dest, Label l);
+
+        // Emits a 32-bit jump table entry holding the distance from the end of
+        // the entry to the label.
+        void EmitLabelOffset(Label l);
 
         // These two methods are public in order to allow access for BinaryNode debugging text.
         static char const * OpCodeName(OpCode op);
@@ -175,6 +233,10 @@ namespace NativeJIT
         template <OpCode OP, unsigned SIZE, bool ISFLOAT>
         void Emit(Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src);
 
+        // Three register operands with the same type and size (e.g. vfmadd231ss).
+        template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+        void Emit(Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src1, Register<SIZE, ISFLOAT> src2);
+
         // Base register and offset.
         template <OpCode OP, unsigned SIZE>
         void Emit(Register<8u, false> dest, int32_t offset);
@@ -249,6 +311,15 @@ namespace NativeJIT
         void IMulImmediate(Register<SIZE, false> dest,
                            T value);
 
+        // Crc32 is encoded as F2 0F 38 F0 /r for a byte source and as
+        // F2 0F 38 F1 /r otherwise. The accumulator is 64-bit only with a
+        // 64-bit source.
+        template <unsigned SIZE1, unsigned SIZE2>
+        void Crc32(Register<SIZE1, false> dest, Register<SIZE2, false> src);
+
+        template <unsigned SIZE1, unsigned SIZE2>
+        void Crc32(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset);
+
         template <unsigned SIZE>
         void Lea(Register<SIZE, false> dest,
                  Register<8, false> src,
@@ -288,6 +359,19 @@ namespace NativeJIT
         template <unsigned SIZE>
         void Shld(Register<SIZE, false> dest, Register<SIZE, false> src);
 
+        // PrefetchNTA/T0/T1/T2, encoded as 0F 18 /hint.
+        void Prefetch(uint8_t hint, Register<8, false> base, int32_t offset);
+
+        // RoundSS/RoundSD, encoded as 66 0F 3A OPCODE /r ib.
+        template <unsigned SIZE>
+        void Round(Register<SIZE, true> dest, Register<SIZE, true> src, uint8_t mode);
+
+        // FMA3 instructions, encoded with the three byte VEX prefix as
+        // VEX.LIG.66.0F38.W OPCODE /r. VEX.W selects double precision and
+        // VEX.vvvv holds the inverted first source.
+        template <uint8_t OPCODE, unsigned SIZE>
+        void VexFMA(Register<SIZE, true> dest, Register<SIZE, true> src1, Register<SIZE, true> src2);
+
         // Scalar SSE instructions are encoded as XX 0F OPCODE, where XX is
         // either 0xF2 or 0xF3 depending on the register size. Used for
         // instructions operating on scalars (f. ex. MovSS/SD, AddSS/SD) rather
@@ -528,6 +612,12 @@ namespace NativeJIT
                 template <unsigned SIZE>
                 static void Emit(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src);
 
+                template <unsigned SIZE>
+                static void Emit(X64CodeGenerator& code,
+                                 Register<SIZE, ISFLOAT> dest,
+                                 Register<SIZE, ISFLOAT> src1,
+                                 Register<SIZE, ISFLOAT> src2);
+
                 template <unsigned SIZE>
                 static void Emit(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<8, false> src, int32_t srcOffset);
 
@@ -597,8 +687,12 @@ namespace NativeJIT
             // the starting point to the end of the buffer followed by the
             // X64CodeGenerator opcodes and operands.
 
-            void PrintJump(void *function);
+            void PrintJump(void const * function);
             void PrintJump(Label label);
+            void PrintCall(void const * function);
+            void PrintJump(Register<8, false> r);
+            void PrintLea(Register<8, false> dest, Label label);
+            void PrintLabelOffset(Label label);
 
             template <JccType JCC>
             void Print(Label l);
@@ -614,6 +708,12 @@ namespace NativeJIT
             template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
             void Print(OpCode op, Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src);
 
+            template <unsigned SIZE, bool ISFLOAT>
+            void Print(OpCode op,
+                       Register<SIZE, ISFLOAT> dest,
+                       Register<SIZE, ISFLOAT> src1,
+                       Register<SIZE, ISFLOAT> src2);
+
             template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
             void Print(OpCode op, Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset);
 
@@ -674,6 +774,16 @@ namespace NativeJIT
         };
 
         std::ostream* m_diagnosticsStream;
+
+        // Emits the displacement of a direct CALL or JMP and records the site.
+        void EmitDirectBranchSite(void const * target);
+
+        // Buffer offsets of the 32-bit displacements of instructions using
+        // RIP-relative addressing. See the DESIGN NOTE in JumpTable about the
+        // use of heap.
+        std::vector<unsigned> m_ripRelativeSites;
+
+        std::vector<DirectBranchSite> m_directBranchSites;
     };
 
 
@@ -984,6 +1094,25 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::CodePrinter::Print(OpCode op,
+                                              Register<SIZE, ISFLOAT> dest,
+                                              Register<SIZE, ISFLOAT> src1,
+                                              Register<SIZE, ISFLOAT> src2)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << OpCodeName(op)
+                   << ' ' << dest.GetName()
+                   << ", " << src1.GetName()
+                   << ", " << src2.GetName()
+                   << std::endl;
+        }
+    }
+
+
     template <unsigned SIZE, bool ISFLOAT, typename T>
     void X64CodeGenerator::CodePrinter::PrintImmediate(OpCode op,
                                                        Register<SIZE, ISFLOAT> dest,
@@ -1057,6 +1186,19 @@ namespace NativeJIT
     }
 
 
+    template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::Emit(Register<SIZE, ISFLOAT> dest,
+                                Register<SIZE, ISFLOAT> src1,
+                                Register<SIZE, ISFLOAT> src2)
+    {
+        CodePrinter printer(*this);
+
+        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(*this, dest, src1, src2);
+
+        printer.Print(OP, dest, src1, src2);
+    }
+
+
     template <OpCode OP, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
     void X64CodeGenerator::Emit(Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src)
     {
@@ -1330,6 +1472,39 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE1, unsigned SIZE2>
+    void X64CodeGenerator::Crc32(Register<SIZE1, false> dest, Register<SIZE2, false> src)
+    {
+        static_assert((SIZE1 == 4 && SIZE2 < 8) || (SIZE1 == 8 && SIZE2 == 8),
+                      "Invalid operand sizes.");
+
+        // The operand size override prefix precedes the mandatory F2 prefix.
+        EmitOpSizeOverrideDirect(dest, src);
+        Emit8(0xf2);
+        EmitRexDirect(dest, src);
+        Emit8(0x0f);
+        Emit8(0x38);
+        Emit8(SIZE2 == 1 ? 0xf0 : 0xf1);
+        EmitModRM(dest, src);
+    }
+
+
+    template <unsigned SIZE1, unsigned SIZE2>
+    void X64CodeGenerator::Crc32(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset)
+    {
+        static_assert((SIZE1 == 4 && SIZE2 < 8) || (SIZE1 == 8 && SIZE2 == 8),
+                      "Invalid operand sizes.");
+
+        EmitOpSizeOverrideIndirect<SIZE2, false>(dest, src);
+        Emit8(0xf2);
+        EmitRexIndirect<SIZE2, false>(dest, src);
+        Emit8(0x0f);
+        Emit8(0x38);
+        Emit8(SIZE2 == 1 ? 0xf0 : 0xf1);
+        EmitModRMOffset(dest, src, srcOffset);
+    }
+
+
     template <unsigned SIZE1, unsigned SIZE2>
     void X64CodeGenerator::MovZX(Register<SIZE1, false> dest, Register<SIZE2, false> src)
     {
@@ -1462,6 +1637,43 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE>
+    void X64CodeGenerator::Round(Register<SIZE, true> dest,
+                                 Register<SIZE, true> src,
+                                 uint8_t mode)
+    {
+        Emit8(0x66);
+        EmitRexDirect(dest, src);
+        Emit8(0x0f);
+        Emit8(0x3a);
+        Emit8(SIZE == 8 ? 0x0b : 0x0a);
+        EmitModRM(dest, src);
+        Emit8(mode);
+    }
+
+
+    template <uint8_t OPCODE, unsigned SIZE>
+    void X64CodeGenerator::VexFMA(Register<SIZE, true> dest,
+                                  Register<SIZE, true> src1,
+                                  Register<SIZE, true> src2)
+    {
+        // The R, X and B bits of the VEX prefix are inverted REX bits. The
+        // 0F38 opcode map is selected with mmmmm = 00010.
+        Emit8(0xc4);
+        Emit8((dest.IsExtended() ? 0 : 0x80)
+              | 0x40
+              | (src2.IsExtended() ? 0 : 0x20)
+              | 0x02);
+
+        // W, inverted vvvv, L = 0 (scalar) and pp = 01 (the 66 prefix).
+        Emit8((SIZE == 8 ? 0x80 : 0)
+              | ((~src1.GetId() & 0xf) << 3)
+              | 0x01);
+        Emit8(OPCODE);
+        EmitModRM(dest, src2);
+    }
+
+
     //
     // Scalar SSE instructions
     //
@@ -2197,6 +2409,7 @@ namespace NativeJIT
 
             Emit8((mod << 6) | (regField << 3) | rmField);
 
+            m_ripRelativeSites.push_back(CurrentPosition());
             Emit32(offset - CurrentPosition() - 4);
         }
         else
@@ -2397,6 +2610,63 @@ namespace NativeJIT
     }
 
 
+    //
+    // Mul, Div and IDiv with the implicit rax/rdx operands.
+    //
+
+#define DEFINE_GROUP3_IMPLICIT(name, extensionOpCode)                                           \
+    template <>                                                                                 \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes1<false>::Emit(                        \
+        X64CodeGenerator& code,                                                                 \
+        Register<SIZE, false> src)                                                              \
+    {                                                                                           \
+        code.Group3And5(0xf6, extensionOpCode, src);                                            \
+    }                                                                                           \
+                                                                                                \
+                                                                                                \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes0::Emit(                               \
+        X64CodeGenerator& code,                                                                 \
+        Register<8u, false> base,                                                               \
+        int32_t offset)                                                                         \
+    {                                                                                           \
+        code.Group3And5<SIZE>(0xf6, extensionOpCode, base, offset);                             \
+    }
+
+    DEFINE_GROUP3_IMPLICIT(Mul, 4);
+    DEFINE_GROUP3_IMPLICIT(Div, 6);
+    DEFINE_GROUP3_IMPLICIT(IDiv, 7);
+
+#undef DEFINE_GROUP3_IMPLICIT
+
+
+    //
+    // Prefetch
+    //
+
+#define DEFINE_PREFETCH(name, hint)                                                             \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes0::Emit(                               \
+        X64CodeGenerator& code,                                                                 \
+        Register<8u, false> base,                                                               \
+        int32_t offset)                                                                         \
+    {                                                                                           \
+        static_assert(SIZE == 1, "Prefetch operates on a byte address.");                       \
+        code.Prefetch(hint, base, offset);                                                      \
+    }
+
+    DEFINE_PREFETCH(PrefetchNTA, 0);
+    DEFINE_PREFETCH(PrefetchT0, 1);
+    DEFINE_PREFETCH(PrefetchT1, 2);
+    DEFINE_PREFETCH(PrefetchT2, 3);
+
+#undef DEFINE_PREFETCH
+
+
     //
     // Not
     //
@@ -2554,6 +2824,17 @@ namespace NativeJIT
     // Mul
     //
 
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::IMul>::ArgTypes1<false>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, false> src)
+    {
+        code.Group3And5(0xf6, 5, src);
+    }
+
+
     template <>
     template <>
     template <unsigned SIZE>
@@ -2620,6 +2901,60 @@ namespace NativeJIT
     }
 
 
+    //
+    // Crc32
+    //
+
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::Crc32>::ArgTypes1<false>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, false> dest,
+        Register<SIZE, false> src)
+    {
+        code.Crc32(dest, src);
+    }
+
+
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::Crc32>::ArgTypes1<false>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, false> dest,
+        Register<8, false> src,
+        int32_t srcOffset)
+    {
+        code.Crc32<SIZE, SIZE>(dest, src, srcOffset);
+    }
+
+
+    template <>
+    template <>
+    template <unsigned SIZE1, unsigned SIZE2>
+    void X64CodeGenerator::Helper<OpCode::Crc32>::ArgTypes2<false, false>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE1, false> dest,
+        Register<SIZE2, false> src)
+    {
+        code.Crc32(dest, src);
+    }
+
+
+    template <>
+    template <>
+    template <unsigned SIZE1, unsigned SIZE2>
+    void X64CodeGenerator::Helper<OpCode::Crc32>::ArgTypes2<false, false>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE1, false> dest,
+        Register<8, false> src,
+        int32_t srcOffset)
+    {
+        code.Crc32<SIZE1, SIZE2>(dest, src, srcOffset);
+    }
+
+
     //
     // MovZX
     //
@@ -2813,6 +3148,7 @@ namespace NativeJIT
     }
 
     DEFINE_GROUP2(Rol, 0);
+    DEFINE_GROUP2(Sar, 7);
     DEFINE_GROUP2(Shl, 4);
     DEFINE_GROUP2(Shr, 5);
 
@@ -2846,14 +3182,50 @@ namespace NativeJIT
     }                                                                                   \
 
     DEFINE_SSE_ARGS1(Add,            ScalarSSE, 0x58);  // AddSS/AddSD.
+    DEFINE_SSE_ARGS1(And,            SSEx66,    0x54);  // AndPS/AndPD.
     DEFINE_SSE_ARGS1(Cmp,            SSEx66,    0x2f);  // ComISS/ComISD.
+    DEFINE_SSE_ARGS1(Div,            ScalarSSE, 0x5e);  // DivSS/DivSD.
     DEFINE_SSE_ARGS1(IMul,           ScalarSSE, 0x59);  // MulSS/MulSD.
+    DEFINE_SSE_ARGS1(Max,            ScalarSSE, 0x5f);  // MaxSS/MaxSD.
+    DEFINE_SSE_ARGS1(Min,            ScalarSSE, 0x5d);  // MinSS/MinSD.
     DEFINE_SSE_ARGS1(Mov,            ScalarSSE, 0x10);  // MovSS/MovSD.
     DEFINE_SSE_ARGS1(MovAP,          SSEx66,    0x28);  // MovAPS/MovAPD.
+    DEFINE_SSE_ARGS1(Sqrt,           ScalarSSE, 0x51);  // SqrtSS/SqrtSD.
     DEFINE_SSE_ARGS1(Sub,            ScalarSSE, 0x5c);  // SubSS/SubSD.
 
 #undef DEFINE_SSE_ARGS1
 
+
+    //
+    // FMAdd and Round
+    //
+
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::FMAdd>::ArgTypes1<true>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, true> dest,
+        Register<SIZE, true> src1,
+        Register<SIZE, true> src2)
+    {
+        code.VexFMA<0xb9>(dest, src1, src2);
+    }
+
+
+    template <>
+    template <>
+    template <unsigned SIZE, typename T>
+    void X64CodeGenerator::Helper<OpCode::Round>::ArgTypes1<true>::EmitImmediate(
+        X64CodeGenerator& code,
+        Register<SIZE, true> dest,
+        Register<SIZE, true> src,
+        T value)
+    {
+        static_assert(sizeof(T) == 1, "The rounding mode must be a byte.");
+        code.Round(dest, src, static_cast<uint8_t>(value));
+    }
+
     // Unlike others, MovAPS/MovAPD also have the "mov [rxx + 16], xmm" form
     // of the instruction with a different opcode.
     template <>
@@ -60,7 +60,8 @@ namespace NativeJIT
     class ExecuteOnlyIfStatement : public ExecutionPreconditionTest
     {
     public:
-        ExecuteOnlyIfStatement(FlagExpressionNode<JCC>& condition,
+        ExecuteOnlyIfStatement(ExpressionTree& tree,
+                               FlagExpressionNode<JCC>& condition,
                                ImmediateNode<T>& otherwiseValue);
 
         //
@@ -80,15 +81,20 @@ namespace NativeJIT
 
     template <typename T, JccType JCC>
     ExecuteOnlyIfStatement<T, JCC>::ExecuteOnlyIfStatement(
+        ExpressionTree& tree,
         FlagExpressionNode<JCC>& condition,
         ImmediateNode<T>& otherwiseValue)
         : m_condition(condition),
           m_otherwiseValue(otherwiseValue)
     {
-        m_otherwiseValue.IncrementParentCount();
+        // The tests are not nodes and are evaluated ahead of the nodes
+        // which read and assign local variables.
+        LogThrowAssert(!condition.IsSequenced(), "Execution preconditions cannot depend on local variables");
+
+        m_otherwiseValue.IncrementParentCount(tree);
 
         // Use the CodeGenFlags()-related call.
-        m_condition.IncrementFlagsParentCount();
+        m_condition.IncrementFlagsParentCount(tree);
     }
 
 
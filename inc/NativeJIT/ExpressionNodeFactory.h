@@ -32,23 +32,34 @@
 // Implementation includes
 //
 #include <cstdint>
+#include <vector>
 
 #include "NativeJIT/BitOperations.h"
+#include "NativeJIT/IntrinsicRegistry.h"
 #include "NativeJIT/Nodes/BinaryImmediateNode.h"
 #include "NativeJIT/Nodes/BinaryNode.h"
 #include "NativeJIT/Nodes/CallNode.h"
 #include "NativeJIT/Nodes/CastNode.h"
 #include "NativeJIT/Nodes/ConditionalNode.h"
 #include "NativeJIT/Nodes/DependentNode.h"
+#include "NativeJIT/Nodes/DivNode.h"
 #include "NativeJIT/Nodes/FieldPointerNode.h"
+#include "NativeJIT/Nodes/FloatIntrinsicNode.h"
+#include "NativeJIT/Nodes/HashNode.h"
 #include "NativeJIT/Nodes/ImmediateNode.h"
 #include "NativeJIT/Nodes/IndirectNode.h"
+#include "NativeJIT/Nodes/LocalVariableNode.h"
+#include "NativeJIT/Nodes/LogicalNode.h"
 #include "NativeJIT/Nodes/Node.h"
 #include "NativeJIT/Nodes/PackedMinMaxNode.h"
+#include "NativeJIT/Nodes/PrefetchNode.h"
 #include "NativeJIT/Nodes/ParameterNode.h"
+#include "NativeJIT/Nodes/ReduceNode.h"
 #include "NativeJIT/Nodes/ReturnNode.h"
+#include "NativeJIT/Nodes/SequenceNode.h"
 #include "NativeJIT/Nodes/ShldNode.h"
 #include "NativeJIT/Nodes/StackVariableNode.h"
+#include "NativeJIT/Nodes/SwitchNode.h"
 #include "Temporary/Allocator.h"
 
 
@@ -84,6 +95,20 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    LocalVariable<T>& ExpressionNodeFactory::Local()
+    {
+        return PlacementConstruct<LocalVariable<T>>(*this);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Load(LocalVariable<T>& variable)
+    {
+        return PlacementConstruct<LoadNode<T>>(*this, variable);
+    }
+
+
     //
     // Unary operators
     //
@@ -191,6 +216,28 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Assign(LocalVariable<T>& variable,
+                                           Node<T>& value)
+    {
+        return PlacementConstruct<AssignNode<T>>(*this, variable, value);
+    }
+
+
+    template <typename S, typename T>
+    Node<T>& ExpressionNodeFactory::Sequence(Node<S>& first, Node<T>& second)
+    {
+        return PlacementConstruct<SequenceNode<S, T>>(*this, first, second);
+    }
+
+
+    template <typename T>
+    Node<T*>& ExpressionNodeFactory::Prefetch(Node<T*>& address, PrefetchHint hint)
+    {
+        return PlacementConstruct<PrefetchNode<T>>(*this, address, hint);
+    }
+
+
     template <typename T>
     NodeBase& ExpressionNodeFactory::Return(Node<T>& value)
     {
@@ -215,6 +262,40 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Div(Node<T>& left, Node<T>& right)
+    {
+        return Division<DivisionResult::Quotient>(left, right, std::is_floating_point<T>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::DivImmediate(Node<T>& left, T right)
+    {
+        static_assert(std::is_integral<T>::value, "DivImmediate requires an integral type");
+
+        return IntegerDivisionImmediate<DivisionResult::Quotient>(
+            left, right, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Mod(Node<T>& left, Node<T>& right)
+    {
+        return Division<DivisionResult::Remainder>(left, right, std::is_floating_point<T>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::ModImmediate(Node<T>& left, T right)
+    {
+        static_assert(std::is_integral<T>::value, "ModImmediate requires an integral type");
+
+        return IntegerDivisionImmediate<DivisionResult::Remainder>(
+            left, right, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
     template <typename L, typename R>
     Node<L>& ExpressionNodeFactory::Sub(Node<L>& left, Node<R>& right)
     {
@@ -288,6 +369,13 @@ namespace NativeJIT
     }
 
 
+    template <typename L, typename R>
+    Node<L>& ExpressionNodeFactory::Xor(Node<L>& left, Node<R>& right)
+    {
+        return Binary<OpCode::Xor>(left, right);
+    }
+
+
     template <typename T>
     Node<T>& ExpressionNodeFactory::Shld(Node<T>& shiftee, Node<T>& filler, uint8_t bitCount)
     {
@@ -295,6 +383,103 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Abs(Node<T>& value)
+    {
+        return PlacementConstruct<AbsNode<T>>(*this, value);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Max(Node<T>& left, Node<T>& right)
+    {
+        static_assert(std::is_floating_point<T>::value, "Max requires a floating point type");
+
+        return Binary<OpCode::Max>(left, right);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Min(Node<T>& left, Node<T>& right)
+    {
+        static_assert(std::is_floating_point<T>::value, "Min requires a floating point type");
+
+        return Binary<OpCode::Min>(left, right);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Sqrt(Node<T>& value)
+    {
+        return PlacementConstruct<SqrtNode<T>>(*this, value);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Round(Node<T>& value, RoundingMode mode)
+    {
+        return PlacementConstruct<RoundNode<T>>(*this, value, mode);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::MulAdd(Node<T>& left, Node<T>& right, Node<T>& addend)
+    {
+        static_assert(std::is_floating_point<T>::value, "MulAdd requires a floating point type");
+
+        if (CpuFeatures::HasFMA())
+        {
+            return PlacementConstruct<MulAddNode<T>>(*this, left, right, addend);
+        }
+
+        return Add(Mul(left, right), addend);
+    }
+
+
+    template <typename T>
+    Node<uint32_t>& ExpressionNodeFactory::Crc32(Node<uint32_t>& crc, Node<T>& value)
+    {
+        return PlacementConstruct<Crc32Node<T>>(*this, crc, value);
+    }
+
+
+    template <typename T>
+    Node<uint64_t>& ExpressionNodeFactory::MultiplyXorShiftHash(Node<T>& key)
+    {
+        static_assert(std::is_integral<T>::value, "MultiplyXorShiftHash requires an integral type");
+
+        auto & x0 = Cast<uint64_t>(key);
+        auto & x1 = Xor(x0, Shr(x0, Hashing::c_mixShift));
+        auto & x2 = Mul(x1, Immediate(Hashing::c_mixMultiplier1));
+        auto & x3 = Xor(x2, Shr(x2, Hashing::c_mixShift));
+        auto & x4 = Mul(x3, Immediate(Hashing::c_mixMultiplier2));
+
+        return Xor(x4, Shr(x4, Hashing::c_mixShift));
+    }
+
+
+    template <typename SLOT, typename KEY, typename SLOT1>
+    Node<SLOT*>& ExpressionNodeFactory::HashLookup(Node<SLOT*>& slots,
+                                                   Node<uint64_t>& slotMask,
+                                                   KEY SLOT1::*keyField,
+                                                   typename std::common_type<KEY>::type emptyKey,
+                                                   Node<KEY>& key,
+                                                   Node<uint64_t>& hash)
+    {
+        static_assert(std::is_same<typename std::remove_const<SLOT>::type,
+                                   typename std::remove_const<SLOT1>::type>::value,
+                      "Mismatch between the provided slot type and key field's parent type");
+
+        return PlacementConstruct<HashLookupNode<SLOT, KEY>>(*this,
+                                                             slots,
+                                                             slotMask,
+                                                             keyField,
+                                                             emptyKey,
+                                                             key,
+                                                             hash);
+    }
+
+
     template <typename T, typename INDEX>
     Node<T*>& ExpressionNodeFactory::Add(Node<T*>& array, Node<INDEX>& index)
     {
@@ -342,6 +527,24 @@ namespace NativeJIT
     }
 
 
+    template <JccType LEFTJCC, JccType RIGHTJCC>
+    FlagExpressionNode<LogicalJcc<LEFTJCC, RIGHTJCC>::c_value>&
+    ExpressionNodeFactory::LogicalAnd(FlagExpressionNode<LEFTJCC>& left,
+                                      FlagExpressionNode<RIGHTJCC>& right)
+    {
+        return PlacementConstruct<LogicalNode<LogicalOperator::And, LEFTJCC, RIGHTJCC>>(*this, left, right);
+    }
+
+
+    template <JccType LEFTJCC, JccType RIGHTJCC>
+    FlagExpressionNode<LogicalJcc<LEFTJCC, RIGHTJCC>::c_value>&
+    ExpressionNodeFactory::LogicalOr(FlagExpressionNode<LEFTJCC>& left,
+                                     FlagExpressionNode<RIGHTJCC>& right)
+    {
+        return PlacementConstruct<LogicalNode<LogicalOperator::Or, LEFTJCC, RIGHTJCC>>(*this, left, right);
+    }
+
+
     //
     // Conditional operators
     //
@@ -370,52 +573,232 @@ namespace NativeJIT
     }
 
 
-    //
-    // Call external function
-    //
-    template <typename R>
-    Node<R>& ExpressionNodeFactory::Call(Node<R (*)()>& function)
+    template <typename K, typename T>
+    Node<T>& ExpressionNodeFactory::Switch(Node<K>& key,
+                                           K const * caseKeys,
+                                           Node<T>* const * caseValues,
+                                           unsigned caseCount,
+                                           Node<T>& defaultValue)
     {
-        return PlacementConstruct<CallNode<R>>(*this, function);
+        return PlacementConstruct<SwitchNode<K, T>>(*this,
+                                                    key,
+                                                    caseKeys,
+                                                    caseValues,
+                                                    caseCount,
+                                                    defaultValue);
     }
 
 
-    template <typename R, typename P1>
-    Node<R>& ExpressionNodeFactory::Call(Node<R (*)(P1)>& function,
-                                         Node<P1>& param1)
+    template <typename K, typename T, unsigned N>
+    Node<T>& ExpressionNodeFactory::Switch(Node<K>& key,
+                                           K const (&caseKeys)[N],
+                                           Node<T>* const (&caseValues)[N],
+                                           Node<T>& defaultValue)
     {
-        return PlacementConstruct<CallNode<R, P1>>(*this, function, param1);
+        return Switch(key, caseKeys, caseValues, N, defaultValue);
     }
 
 
-    template <typename R, typename P1, typename P2>
-    Node<R>& ExpressionNodeFactory::Call(Node<R (*)(P1, P2)>& function,
-                                         Node<P1>& param1,
-                                         Node<P2>& param2)
-    {
-        return PlacementConstruct<CallNode<R, P1, P2>>(*this, function, param1, param2);
+    //
+    // Loops
+    //
+    template <typename A, typename T, typename C, typename BODY>
+    Node<A>& ExpressionNodeFactory::Reduce(Node<T*>& elements,
+                                           Node<C>& count,
+                                           Node<A>& initial,
+                                           BODY body,
+                                           unsigned unrollCount,
+                                           unsigned prefetchDistance)
+    {
+        // With a single accumulator, there is nothing to combine.
+        auto combine = [](Node<A>& left, Node<A>& /* right */) -> Node<A>&
+        {
+            return left;
+        };
+
+        return Loop(elements,
+                    count,
+                    initial,
+                    static_cast<Node<A>*>(nullptr),
+                    body,
+                    combine,
+                    1,
+                    unrollCount,
+                    prefetchDistance);
+    }
+
+
+    template <typename A, typename T, typename C, typename BODY, typename COMBINE>
+    Node<A>& ExpressionNodeFactory::Reduce(Node<T*>& elements,
+                                           Node<C>& count,
+                                           Node<A>& initial,
+                                           Node<A>& identity,
+                                           BODY body,
+                                           COMBINE combine,
+                                           unsigned accumulatorCount,
+                                           unsigned unrollCount,
+                                           unsigned prefetchDistance)
+    {
+        return Loop(elements,
+                    count,
+                    initial,
+                    accumulatorCount > 1 ? &identity : nullptr,
+                    body,
+                    combine,
+                    accumulatorCount,
+                    unrollCount,
+                    prefetchDistance);
+    }
+
+
+    template <typename R, typename T, typename C, typename BODY>
+    Node<R>& ExpressionNodeFactory::ForEach(Node<T*>& elements,
+                                            Node<C>& count,
+                                            Node<R>& defaultValue,
+                                            BODY body,
+                                            unsigned unrollCount,
+                                            unsigned prefetchDistance)
+    {
+        typedef typename ReduceNode<R, T>::ElementType E;
+
+        // The accumulator holds the value for the previous element.
+        return Reduce(elements,
+                      count,
+                      defaultValue,
+                      [&body](Node<R>& /* previous */, Node<E>& element) -> Node<R>&
+                      {
+                          return body(element);
+                      },
+                      unrollCount,
+                      prefetchDistance);
+    }
+
+
+    template <typename A, typename T, typename C, typename BODY, typename COMBINE>
+    Node<A>& ExpressionNodeFactory::Loop(Node<T*>& elements,
+                                         Node<C>& count,
+                                         Node<A>& initial,
+                                         Node<A>* identity,
+                                         BODY body,
+                                         COMBINE combine,
+                                         unsigned accumulatorCount,
+                                         unsigned unrollCount,
+                                         unsigned prefetchDistance)
+    {
+        typedef typename ReduceNode<A, T>::ElementType E;
+
+        LogThrowAssert(accumulatorCount > 0 && unrollCount % accumulatorCount == 0,
+                       "Unroll count %u must be a multiple of accumulator count %u",
+                       unrollCount,
+                       accumulatorCount);
+
+        auto & elementCount = Cast<int64_t>(count);
+
+        std::vector<LoopElementNode<E>*> mainElements;
+        std::vector<LoopAccumulatorNode<A>*> mainAccumulators;
+        std::vector<Node<A>*> mainResults;
+        std::vector<LoopAccumulatorNode<A>*> combineAccumulators;
+
+        BeginLoopBody();
+
+        // Unrolled copies of the body for the main loop. Copy i updates the
+        // accumulator i % accumulatorCount.
+        if (unrollCount > 1)
+        {
+            for (unsigned i = 0; i < accumulatorCount; ++i)
+            {
+                mainAccumulators.push_back(&PlacementConstruct<LoopAccumulatorNode<A>>(*this));
+                mainResults.push_back(mainAccumulators.back());
+            }
+
+            for (unsigned i = 0; i < unrollCount; ++i)
+            {
+                const int32_t offset = static_cast<int32_t>(i * sizeof(E));
+                mainElements.push_back(&PlacementConstruct<LoopElementNode<E>>(*this, offset));
+
+                Node<A>*& result = mainResults[i % accumulatorCount];
+                result = &body(*result, static_cast<Node<E>&>(*mainElements.back()));
+            }
+        }
+
+        // A single copy of the body for the remaining elements.
+        auto & remainderElement = PlacementConstruct<LoopElementNode<E>>(*this, 0);
+        auto & remainderAccumulator = PlacementConstruct<LoopAccumulatorNode<A>>(*this);
+        Node<A>& remainderResult = body(static_cast<Node<A>&>(remainderAccumulator),
+                                        static_cast<Node<E>&>(remainderElement));
+
+        // Merging of the accumulators after the loop.
+        for (unsigned i = 0; i < accumulatorCount; ++i)
+        {
+            combineAccumulators.push_back(&PlacementConstruct<LoopAccumulatorNode<A>>(*this));
+        }
+
+        Node<A>* combined = combineAccumulators[0];
+
+        for (unsigned i = 1; i < accumulatorCount; ++i)
+        {
+            combined = &combine(*combined, static_cast<Node<A>&>(*combineAccumulators[i]));
+        }
+
+        EndLoopBody();
+
+        return PlacementConstruct<ReduceNode<A, T>>(*this,
+                                                    elements,
+                                                    elementCount,
+                                                    initial,
+                                                    identity,
+                                                    accumulatorCount,
+                                                    unrollCount,
+                                                    prefetchDistance,
+                                                    mainElements.data(),
+                                                    mainAccumulators.data(),
+                                                    mainResults.data(),
+                                                    remainderElement,
+                                                    remainderAccumulator,
+                                                    remainderResult,
+                                                    combineAccumulators.data(),
+                                                    *combined);
     }
 
 
-    template <typename R, typename P1, typename P2, typename P3>
-    Node<R>& ExpressionNodeFactory::Call(Node<R (*)(P1, P2, P3)>& function,
-                                         Node<P1>& param1,
-                                         Node<P2>& param2,
-                                         Node<P3>& param3)
+    //
+    // Call external function
+    //
+    template <typename R, typename... P>
+    Node<R>& ExpressionNodeFactory::Call(Node<R (*)(P...)>& function,
+                                         Node<P>&... parameters)
     {
-        return PlacementConstruct<CallNode<R, P1, P2, P3>>(*this, function, param1, param2, param3);
+        void const * address = nullptr;
+
+        if (m_intrinsics != nullptr && function.GetConstantAddress(address))
+        {
+            auto intrinsic = m_intrinsics->Find(address);
+
+            if (intrinsic != nullptr)
+            {
+                // The function node is left without parents and won't be
+                // evaluated.
+                function.MarkReferenced();
+
+                return intrinsic->Expand<R, P...>(*this, parameters...);
+            }
+        }
+
+        return PlacementConstruct<CallNode<R, P...>>(*this, function, parameters...);
     }
 
 
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    Node<R>& ExpressionNodeFactory::Call(Node<R (*)(P1, P2, P3, P4)>& function,
-                                         Node<P1>& param1,
-                                         Node<P2>& param2,
-                                         Node<P3>& param3,
-                                         Node<P4>& param4)
+    template <typename R, typename... P>
+    Node<R>& ExpressionNodeFactory::Call(R (*function)(P...),
+                                         Node<P>&... parameters)
     {
-        return PlacementConstruct<CallNode<R, P1, P2, P3, P4>>(
-            *this, function, param1, param2, param3, param4);
+        auto intrinsic = m_intrinsics != nullptr
+                         ? m_intrinsics->Find(reinterpret_cast<void const *>(function))
+                         : nullptr;
+
+        return intrinsic != nullptr
+            ? intrinsic->Expand<R, P...>(*this, parameters...)
+            : Call(Immediate(function), parameters...);
     }
 
 
@@ -451,4 +834,64 @@ namespace NativeJIT
     {
         return PlacementConstruct<BinaryImmediateNode<OP, L, R>>(*this, left, right);
     }
+
+
+    template <DivisionResult RESULT, typename T>
+    Node<T>& ExpressionNodeFactory::Division(Node<T>& left, Node<T>& right, std::true_type /* isFloat */)
+    {
+        static_assert(RESULT == DivisionResult::Quotient,
+                      "Mod is not supported for floating point types");
+
+        return Binary<OpCode::Div>(left, right);
+    }
+
+
+    template <DivisionResult RESULT, typename T>
+    Node<T>& ExpressionNodeFactory::Division(Node<T>& left, Node<T>& right, std::false_type /* isFloat */)
+    {
+        static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value,
+                      "Division requires an arithmetic type");
+
+        return IntegerDivision<RESULT>(left,
+                                       right,
+                                       std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <DivisionResult RESULT, typename T>
+    Node<T>& ExpressionNodeFactory::IntegerDivision(Node<T>& left, Node<T>& right, std::true_type /* isNarrow */)
+    {
+        typedef typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type W;
+
+        auto & result = IntegerDivision<RESULT>(Cast<W>(left), Cast<W>(right), std::false_type());
+
+        return Cast<T>(result);
+    }
+
+
+    template <DivisionResult RESULT, typename T>
+    Node<T>& ExpressionNodeFactory::IntegerDivision(Node<T>& left, Node<T>& right, std::false_type /* isNarrow */)
+    {
+        return PlacementConstruct<DivNode<T, RESULT>>(*this, left, right);
+    }
+
+
+    template <DivisionResult RESULT, typename T>
+    Node<T>& ExpressionNodeFactory::IntegerDivisionImmediate(Node<T>& left, T right, std::true_type /* isNarrow */)
+    {
+        typedef typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type W;
+
+        auto & result = IntegerDivisionImmediate<RESULT>(Cast<W>(left),
+                                                         static_cast<W>(right),
+                                                         std::false_type());
+
+        return Cast<T>(result);
+    }
+
+
+    template <DivisionResult RESULT, typename T>
+    Node<T>& ExpressionNodeFactory::IntegerDivisionImmediate(Node<T>& left, T right, std::false_type /* isNarrow */)
+    {
+        return PlacementConstruct<DivImmediateNode<T, RESULT>>(*this, left, right);
+    }
 }
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <cstdint>
+#include <type_traits>
 
 #include "NativeJIT/CodeGen/X64CodeGenerator.h" // JccType.
 #include "NativeJIT/ExpressionTreeDecls.h"      // Base class.
@@ -33,12 +34,24 @@
 
 namespace NativeJIT
 {
+    enum class DivisionResult;
+    enum class PrefetchHint : uint8_t;
+    enum class RoundingMode : uint8_t;
+
     template <JccType JCC>
     class FlagExpressionNode;
 
+    template <JccType LEFTJCC, JccType RIGHTJCC>
+    struct LogicalJcc;
+
     template <typename T>
     class Node;
 
+    class IntrinsicRegistry;
+
+    template <typename T>
+    class LocalVariable;
+
     class NodeBase;
 
     class ParameterSlotAllocator;
@@ -51,6 +64,11 @@ namespace NativeJIT
     public:
         ExpressionNodeFactory(Allocators::IAllocator& allocator, FunctionBuffer& code);
 
+        // Makes Call() expand the calls to the functions in the registry
+        // rather than emitting CallNodes. The registry must outlive the
+        // construction of the tree.
+        void SetIntrinsics(IntrinsicRegistry const & intrinsics);
+
         //
         // Leaf nodes
         //
@@ -61,6 +79,11 @@ namespace NativeJIT
         // lifetime.
         template <typename T> Node<T&>& StackVariable();
 
+        // See LocalVariable for the order in which local variables are
+        // assigned and read.
+        template <typename T> LocalVariable<T>& Local();
+        template <typename T> Node<T>& Load(LocalVariable<T>& variable);
+
 
         //
         // Unary operators
@@ -102,6 +125,20 @@ namespace NativeJIT
         template <typename T> Node<T>& Dependent(Node<T>& dependentNode,
                                                  NodeBase& prerequisiteNode);
 
+        // Returns the assigned value.
+        template <typename T> Node<T>& Assign(LocalVariable<T>& variable,
+                                              Node<T>& value);
+
+        // Evaluates the first node, discards its value and returns the value
+        // of the second node.
+        template <typename S, typename T> Node<T>& Sequence(Node<S>& first,
+                                                            Node<T>& second);
+
+        // Prefetches the cache line at the address and returns the address.
+        // Use it as the first node of Sequence() to issue the prefetch ahead
+        // of the computation which hides its latency.
+        template <typename T> Node<T*>& Prefetch(Node<T*>& address, PrefetchHint hint);
+
         template <typename T> NodeBase& Return(Node<T>& value);
 
 
@@ -110,6 +147,17 @@ namespace NativeJIT
         //
         template <typename L, typename R> Node<L>& Add(Node<L>& left, Node<R>& right);
         template <typename L, typename R> Node<L>& And(Node<L>& left, Node<R>& right);
+
+        // Integer division truncates towards zero and the remainder has the
+        // sign of the dividend, as in C++. Division by a register uses
+        // div/idiv, division by a constant is lowered to shifts or to a
+        // multiplication by the reciprocal. Floating point values can only
+        // be divided with Div().
+        template <typename T> Node<T>& Div(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& DivImmediate(Node<T>& left, T right);
+        template <typename T> Node<T>& Mod(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& ModImmediate(Node<T>& left, T right);
+
         template <typename L, typename R> Node<L>& Mul(Node<L>& left, Node<R>& right);
         template <typename L, typename R> Node<L>& MulImmediate(Node<L>& left, R right);
         template <typename L, typename R> Node<L>& Or(Node<L>& left, Node<R>& right);
@@ -117,6 +165,7 @@ namespace NativeJIT
         template <typename L, typename R> Node<L>& Shl(Node<L>& left, R right);
         template <typename L, typename R> Node<L>& Shr(Node<L>& left, R right);
         template <typename L, typename R> Node<L>& Sub(Node<L>& left, Node<R>& right);
+        template <typename L, typename R> Node<L>& Xor(Node<L>& left, Node<R>& right);
 
         template <typename T, size_t SIZE, typename INDEX>
         Node<T*>& Add(Node<T(*)[SIZE]>& array, Node<INDEX>& index);
@@ -128,6 +177,50 @@ namespace NativeJIT
         template <typename T>
         Node<T>& Shld(Node<T>& shiftee, Node<T>& filler, uint8_t bitCount);
 
+        //
+        // Floating point intrinsics
+        //
+
+        // Max() and Min() follow MaxSS/MinSS: if either operand is NaN or
+        // both are zero, the right operand is returned.
+        template <typename T> Node<T>& Abs(Node<T>& value);
+        template <typename T> Node<T>& Max(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& Min(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& Sqrt(Node<T>& value);
+
+        // Requires SSE4.1.
+        template <typename T> Node<T>& Round(Node<T>& value, RoundingMode mode);
+
+        // Computes left * right + addend. Uses a fused multiply-add with a
+        // single rounding when the CPU supports FMA3, otherwise falls back to
+        // a separate multiplication and addition which round twice.
+        template <typename T>
+        Node<T>& MulAdd(Node<T>& left, Node<T>& right, Node<T>& addend);
+
+        //
+        // Hashing
+        //
+
+        // Accumulates the bytes of the value into a CRC-32C. Requires SSE4.2.
+        template <typename T>
+        Node<uint32_t>& Crc32(Node<uint32_t>& crc, Node<T>& value);
+
+        // The MurmurHash3 64-bit finalizer, a series of multiplications and
+        // xor-shifts. Hashing::MultiplyXorShift() computes the same value.
+        template <typename T>
+        Node<uint64_t>& MultiplyXorShiftHash(Node<T>& key);
+
+        // Returns the pointer to the slot whose key field is equal to the key
+        // or nullptr if there is none. See HashLookupNode for the table
+        // layout. The hash may be computed with any of the nodes above.
+        template <typename SLOT, typename KEY, typename SLOT1 = SLOT>
+        Node<SLOT*>& HashLookup(Node<SLOT*>& slots,
+                                Node<uint64_t>& slotMask,
+                                KEY SLOT1::*keyField,
+                                typename std::common_type<KEY>::type emptyKey,
+                                Node<KEY>& key,
+                                Node<uint64_t>& hash);
+
         //
         // Model related.
         //
@@ -140,6 +233,19 @@ namespace NativeJIT
         template <JccType JCC, typename T>
         FlagExpressionNode<JCC>& Compare(Node<T>& left, Node<T>& right);
 
+        // Short-circuit logical operators: the right condition is evaluated
+        // only if the left one doesn't determine the result. See LogicalNode
+        // for the restrictions on the nodes used by the right condition.
+        template <JccType LEFTJCC, JccType RIGHTJCC>
+        FlagExpressionNode<LogicalJcc<LEFTJCC, RIGHTJCC>::c_value>&
+        LogicalAnd(FlagExpressionNode<LEFTJCC>& left,
+                   FlagExpressionNode<RIGHTJCC>& right);
+
+        template <JccType LEFTJCC, JccType RIGHTJCC>
+        FlagExpressionNode<LogicalJcc<LEFTJCC, RIGHTJCC>::c_value>&
+        LogicalOr(FlagExpressionNode<LEFTJCC>& left,
+                  FlagExpressionNode<RIGHTJCC>& right);
+
 
         //
         // Conditional operators
@@ -163,31 +269,92 @@ namespace NativeJIT
         template <typename T>
         Node<T>& If(Node<bool>& conditionValue, Node<T>& thenValue, Node<T>& elseValue);
 
+        // Returns the value of the case whose key is equal to the value of the
+        // key node, or the default value if there is no such case. The case
+        // keys must be unique.
+        // WARNING: All the values are evaluated before the dispatch so all must
+        // be legal to evaluate regardless of the key. See the TODO note in
+        // ConditionalNode::CodeGenValue.
+        template <typename K, typename T>
+        Node<T>& Switch(Node<K>& key,
+                        K const * caseKeys,
+                        Node<T>* const * caseValues,
+                        unsigned caseCount,
+                        Node<T>& defaultValue);
+
+        template <typename K, typename T, unsigned N>
+        Node<T>& Switch(Node<K>& key,
+                        K const (&caseKeys)[N],
+                        Node<T>* const (&caseValues)[N],
+                        Node<T>& defaultValue);
+
 
         //
         // Call node
         //
-        template <typename R>
-        Node<R>& Call(Node<R (*)()>& function);
-
-        template <typename R, typename P1>
-        Node<R>& Call(Node<R (*)(P1)>& function, Node<P1>& param1);
-
-        template <typename R, typename P1, typename P2>
-        Node<R>& Call(Node<R (*)(P1, P2)>& function, Node<P1>& param1, Node<P2>& param2);
+        // Parameters that don't fit into registers are passed on the stack.
+        // Calls to constant functions registered as intrinsics are replaced
+        // with their expansions.
+        template <typename R, typename... P>
+        Node<R>& Call(Node<R (*)(P...)>& function, Node<P>&... parameters);
 
-        template <typename R, typename P1, typename P2, typename P3>
-        Node<R>& Call(Node<R (*)(P1, P2, P3)>& function,
-                      Node<P1>& param1,
-                      Node<P2>& param2,
-                      Node<P3>& param3);
+        template <typename R, typename... P>
+        Node<R>& Call(R (*function)(P...), Node<P>&... parameters);
 
-        template <typename R, typename P1, typename P2, typename P3, typename P4>
-        Node<R>& Call(Node<R (*)(P1, P2, P3, P4)>& function,
-                      Node<P1>& param1,
-                      Node<P2>& param2,
-                      Node<P3>& param3,
-                      Node<P4>& param4);
+        //
+        // Loops
+        //
+        // The body of a loop is a callable which constructs the expression
+        // for one element from the nodes it receives. It is called once for
+        // each unrolled copy of the body and the nodes it constructs are
+        // evaluated once per iteration, so they must not be used outside of
+        // it. Nodes constructed outside of the body may be used in it. Those
+        // with several parents are evaluated before the loop, the others in
+        // each iteration. The exception are the nodes which read or assign a
+        // local variable: those are evaluated where their parents first need
+        // them, so they can't be used both in the body and after the loop.
+        //
+        // With a non-zero prefetchDistance, each iteration prefetches the
+        // data for the element prefetchDistance elements ahead. For arrays
+        // of pointers, that is the first cache line of the record the
+        // element points to.
+
+        // Folds count elements of the array into the initial value through
+        // accumulator = body(accumulator, element). With unrolling, the loop
+        // processes unrollCount elements per iteration.
+        template <typename A, typename T, typename C, typename BODY>
+        Node<A>& Reduce(Node<T*>& elements,
+                        Node<C>& count,
+                        Node<A>& initial,
+                        BODY body,
+                        unsigned unrollCount = 1,
+                        unsigned prefetchDistance = 0);
+
+        // Like above, but the unrolled elements are distributed among
+        // accumulatorCount independent accumulators so that their updates
+        // don't wait for each other. The first accumulator starts with the
+        // initial value, the others with the identity. At the end, they are
+        // merged through combine(left, right).
+        template <typename A, typename T, typename C, typename BODY, typename COMBINE>
+        Node<A>& Reduce(Node<T*>& elements,
+                        Node<C>& count,
+                        Node<A>& initial,
+                        Node<A>& identity,
+                        BODY body,
+                        COMBINE combine,
+                        unsigned accumulatorCount,
+                        unsigned unrollCount,
+                        unsigned prefetchDistance = 0);
+
+        // Evaluates body(element) for count elements of the array. Returns the
+        // value for the last element or defaultValue if there are none.
+        template <typename R, typename T, typename C, typename BODY>
+        Node<R>& ForEach(Node<T*>& elements,
+                         Node<C>& count,
+                         Node<R>& defaultValue,
+                         BODY body,
+                         unsigned unrollCount = 1,
+                         unsigned prefetchDistance = 0);
 
         //
         // Packed operators
@@ -202,5 +369,35 @@ namespace NativeJIT
     private:
         template <OpCode OP, typename L, typename R> Node<L>& Binary(Node<L>& left, Node<R>& right);
         template <OpCode OP, typename L, typename R> Node<L>& BinaryImmediate(Node<L>& left, R right);
+
+        // Helpers for Div(), Mod() and their immediate flavors. Integers
+        // narrower than 32 bits are divided as their 32-bit extensions.
+        template <DivisionResult RESULT, typename T>
+        Node<T>& Division(Node<T>& left, Node<T>& right, std::true_type isFloat);
+        template <DivisionResult RESULT, typename T>
+        Node<T>& Division(Node<T>& left, Node<T>& right, std::false_type isFloat);
+
+        template <DivisionResult RESULT, typename T>
+        Node<T>& IntegerDivision(Node<T>& left, Node<T>& right, std::true_type isNarrow);
+        template <DivisionResult RESULT, typename T>
+        Node<T>& IntegerDivision(Node<T>& left, Node<T>& right, std::false_type isNarrow);
+
+        template <DivisionResult RESULT, typename T>
+        Node<T>& IntegerDivisionImmediate(Node<T>& left, T right, std::true_type isNarrow);
+        template <DivisionResult RESULT, typename T>
+        Node<T>& IntegerDivisionImmediate(Node<T>& left, T right, std::false_type isNarrow);
+
+        template <typename A, typename T, typename C, typename BODY, typename COMBINE>
+        Node<A>& Loop(Node<T*>& elements,
+                      Node<C>& count,
+                      Node<A>& initial,
+                      Node<A>* identity,
+                      BODY body,
+                      COMBINE combine,
+                      unsigned accumulatorCount,
+                      unsigned unrollCount,
+                      unsigned prefetchDistance);
+
+        IntrinsicRegistry const * m_intrinsics;
     };
 }
@@ -118,9 +118,6 @@ namespace NativeJIT
     ExpressionTree::Storage<T>
     ExpressionTree::Direct(typename Storage<T>::DirectRegister r)
     {
-        typedef typename Storage<T>::FullRegister FullRegister;
-
-        auto & code = GetCodeGenerator();
         auto & freeList = FreeListForType<T>::Get(*this);
 
         LogThrowAssert(!IsPinned(r), "Attempted to obtain the pinned register %s", r.GetName());
@@ -129,57 +126,140 @@ namespace NativeJIT
 
         if (!freeList.IsAvailable(src))
         {
-            typedef typename CanonicalRegisterType<FullRegister>::Type FullType;
-            // DESIGN NOTE: If the storage is indirect, FullType may not be the correct
-            // size. It will still get the right data due to the little endian
-            // architecture, but if the process doesn't have access to the
-            // additional bytes (f. ex. at the end of the allocated memory
-            // block) it will trigger access violation. See also the comment
-            // for the indirect Data constructor.
-            auto registerStorage = Storage<FullType>
-                ::ForAdditionalReferenceToRegister(*this, FullRegister(src));
+            BumpRegister<T>(r, BumpDestination::AnyRegister);
+        }
 
-            // Use another register if available or a temporary otherwise to
-            // bump the current contents of the register.
-            if (freeList.GetFreeCount() > 0)
+        return Storage<T>::ForFreeRegister(*this, r);
+    }
+
+
+    template <typename T>
+    ExpressionTree::Storage<T> ExpressionTree::DirectUnusedByCalls()
+    {
+        auto & freeList = FreeListForType<T>::Get(*this);
+        const unsigned nonArgumentMask = RegisterStorage<T>::c_isFloat
+            ? CallingConvention::c_xmmNonArgumentRegistersMask
+            : CallingConvention::c_rxxNonArgumentRegistersMask;
+        unsigned id;
+
+        // Prefer the highest numbered registers. For integer registers, these
+        // are non-volatile and don't need to be preserved around the calls.
+        if (BitOp::GetHighestBitSet(freeList.GetFreeMask() & nonArgumentMask, &id))
+        {
+            return Storage<T>::ForFreeRegister(*this, typename Storage<T>::DirectRegister(id));
+        }
+
+        return Direct<T>();
+    }
+
+
+    template <bool ISFLOAT>
+    void ExpressionTree::EvictVolatileRegister(unsigned id)
+    {
+        typedef typename std::conditional<ISFLOAT, double, uint64_t>::type T;
+        typename Storage<T>::DirectRegister r(id);
+
+        LogThrowAssert(!IsPinned(r), "Attempted to evict the pinned register %s", r.GetName());
+        LogThrowAssert(!FreeListForType<T>::Get(*this).IsAvailable(id),
+                       "Register %s is not allocated",
+                       r.GetName());
+
+        BumpRegister<T>(r, BumpDestination::NonVolatileRegister);
+    }
+
+
+    template <typename T>
+    void ExpressionTree::BumpRegister(typename Storage<T>::DirectRegister r, BumpDestination destination)
+    {
+        typedef typename Storage<T>::FullRegister FullRegister;
+        typedef typename CanonicalRegisterType<FullRegister>::Type FullType;
+
+        LogThrowAssert(CanBumpRegisters(),
+                       "Cannot move the contents of %s in conditional code which doesn't allow it",
+                       r.GetName());
+
+        auto & code = GetCodeGenerator();
+        auto & freeList = FreeListForType<T>::Get(*this);
+        const unsigned src = r.GetId();
+
+        // DESIGN NOTE: If the storage is indirect, FullType may not be the correct
+        // size. It will still get the right data due to the little endian
+        // architecture, but if the process doesn't have access to the
+        // additional bytes (f. ex. at the end of the allocated memory
+        // block) it will trigger access violation. See also the comment
+        // for the indirect Data constructor.
+        auto registerStorage = Storage<FullType>
+            ::ForAdditionalReferenceToRegister(*this, FullRegister(src));
+
+        unsigned dest = 0;
+        bool isRegisterAvailable = false;
+
+        switch (destination)
+        {
+        case BumpDestination::AnyRegister:
+            isRegisterAvailable = freeList.GetFreeCount() > 0;
+            break;
+
+        case BumpDestination::NonVolatileRegister:
+            isRegisterAvailable = BitOp::GetHighestBitSet(freeList.GetFreeNonVolatileMask(), &dest);
+            break;
+
+        case BumpDestination::Temporary:
+            break;
+        }
+
+        // Use another register if available or a temporary otherwise to
+        // bump the current contents of the register.
+        if (isRegisterAvailable)
+        {
+            auto destStorage = destination == BumpDestination::NonVolatileRegister
+                ? Storage<FullType>::ForFreeRegister(*this, FullRegister(dest))
+                : Storage<FullType>::ForAnyFreeRegister(*this);
+            CodeGenHelpers::Emit<OpCode::Mov>(code,
+                                              destStorage.GetDirectRegister(),
+                                              registerStorage);
+
+            // Swap storages for the target storage and for the register
+            // (including all the references to it). Once the destStorage
+            // variable goes out of scope, the register will be free.
+            registerStorage.Swap(destStorage, Storage<FullType>::SwapType::AllReferences);
+        }
+        else
+        {
+            // IMPORTANT: the spilling code must not affect and CPU flags
+            // since many nodes (e.g. ConditionalNode) assume that they
+            // can modify flags, allocate a register and then act on flags.
+            // The MOV instruction does not affect any flags.
+            //
+            // It is not possible to spill an indirect to stack in one
+            // step, so ensure that the source storage is direct.
+            // If it was previously indirect, its register will be reused
+            // because the conversion is not for modification and because
+            // the register is not one of the base registers.
+            registerStorage.ConvertToDirect(false);
+            auto fullReg = registerStorage.GetDirectRegister();
+            LogThrowAssert(fullReg.IsSameHardwareRegister(r),
+                           "Converting %s to direct without modification should "
+                           "not have moved into a different register (%s)",
+                           r.GetName(),
+                           fullReg.GetName());
+
+            if (destination != BumpDestination::AnyRegister)
             {
-                auto destStorage = Storage<FullType>::ForAnyFreeRegister(*this);
-                CodeGenHelpers::Emit<OpCode::Mov>(code,
-                                                  destStorage.GetDirectRegister(),
-                                                  registerStorage);
+                // Spill straight to a temporary since TakeSoleOwnershipOfDirect()
+                // could pick another register.
+                auto destStorage = Temporary<FullType>();
+                CodeGenHelpers::Emit<OpCode::Mov>(code, destStorage, fullReg);
 
-                // Swap storages for the target storage and for the register
-                // (including all the references to it). Once the destStorage
-                // variable goes out of scope, the register will be free.
                 registerStorage.Swap(destStorage, Storage<FullType>::SwapType::AllReferences);
             }
             else
             {
-                // IMPORTANT: the spilling code must not affect and CPU flags
-                // since many nodes (e.g. ConditionalNode) assume that they
-                // can modify flags, allocate a register and then act on flags.
-                // The MOV instruction does not affect any flags.
-                //
-                // It is not possible to spill an indirect to stack in one
-                // step, so ensure that the source storage is direct.
-                // If it was previously indirect, its register will be reused
-                // because the conversion is not for modification and because
-                // the register is not one of the base registers.
-                registerStorage.ConvertToDirect(false);
-                auto fullReg = registerStorage.GetDirectRegister();
-                LogThrowAssert(fullReg.IsSameHardwareRegister(r),
-                               "Converting %s to direct without modification should "
-                               "not have moved into a different register (%s)",
-                               r.GetName(),
-                               fullReg.GetName());
-
                 // Make registerStorage the only owner. After it goes out of
                 // scope, the register will be free.
                 registerStorage.TakeSoleOwnershipOfDirect();
             }
         }
-
-        return Storage<T>::ForFreeRegister(*this, r);
     }
 
 
@@ -216,6 +296,16 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    ExpressionTree::Storage<T> ExpressionTree::StackParameter(int32_t offset)
+    {
+        LogThrowAssert(m_hasStackParameters, "Stack parameters have not been reported");
+        LogThrowAssert(offset > 0, "Invalid stack parameter offset %d", offset);
+
+        return Storage<T>::ForSharedBaseRegister(*this, GetBasePointer(), offset);
+    }
+
+
     template <typename T>
     ExpressionTree::Storage<T> ExpressionTree::Immediate(T value)
     {
@@ -271,11 +361,11 @@ namespace NativeJIT
     ExpressionTree::Data::Data(ExpressionTree& tree,
                                Register<SIZE, ISFLOAT> r)
         : m_tree(tree),
-          m_storageClass(StorageClass::Direct),
+          m_storageClass(static_cast<unsigned>(StorageClass::Direct)),
           m_isFloat(ISFLOAT),
           m_registerId(r.GetId()),
-          m_offset(0),
-          m_refCount(0)
+          m_refCount(0),
+          m_immediate(0)
     {
         NotifyDataRegisterChange(RegisterChangeType::Initialize);
     }
@@ -285,10 +375,9 @@ namespace NativeJIT
     ExpressionTree::Data::Data(ExpressionTree& tree,
                                T value)
         : m_tree(tree),
-          m_storageClass(StorageClass::Immediate),
+          m_storageClass(static_cast<unsigned>(StorageClass::Immediate)),
           m_isFloat(false),
           m_registerId(0),
-          m_offset(0),
           m_refCount(0)
     {
         static_assert(CanBeInImmediateStorage<T>::value, "Invalid immediate type");
@@ -305,7 +394,7 @@ namespace NativeJIT
     {
         static_assert(CanBeInImmediateStorage<T>::value, "Invalid immediate type");
         static_assert(sizeof(T) <= sizeof(m_immediate), "Unsupported type.");
-        LogThrowAssert(m_storageClass == StorageClass::Immediate, "GetImmediate() called for non-immediate storage!");
+        LogThrowAssert(GetStorageClass() == StorageClass::Immediate, "GetImmediate() called for non-immediate storage!");
 
         return convertType<size_t, T>(m_immediate);
     }
@@ -314,7 +403,7 @@ namespace NativeJIT
     template <bool ISFLOAT>
     void ExpressionTree::Data::NotifyDataRegisterChange(RegisterChangeType type)
     {
-        LogThrowAssert(m_storageClass != StorageClass::Immediate, "Invalid storage class");
+        LogThrowAssert(GetStorageClass() != StorageClass::Immediate, "Invalid storage class");
         auto & freeList = FreeListForRegister<ISFLOAT>::Get(m_tree);
 
         switch (type)
@@ -323,7 +412,7 @@ namespace NativeJIT
             // The free list doesn't need to keep data for indirects relative
             // to shared base registers since there can be many of them for
             // the same register.
-            if (!(m_storageClass == StorageClass::Indirect
+            if (!(GetStorageClass() == StorageClass::Indirect
                   && IsSharedBaseRegister()))
             {
                 freeList.InitializeData(m_registerId, this);
@@ -332,7 +421,7 @@ namespace NativeJIT
 
         case RegisterChangeType::Update:
             // Only initialization is allowed for the direct shared registers.
-            LogThrowAssert(!(m_storageClass == StorageClass::Direct
+            LogThrowAssert(!(GetStorageClass() == StorageClass::Direct
                              && IsSharedBaseRegister()),
                            "Cannot update data for shared register %u",
                            m_registerId);
@@ -655,7 +744,7 @@ namespace NativeJIT
                     // Let every owner benefit from moving to direct storage if
                     // possible. This is also necessary for the register to be
                     // fully released during spilling.
-                    Swap(dest, forModification
+                    Swap(dest, forModification || tree.IsInConditionalCode()
                                ? Storage<T>::SwapType::Single
                                : Storage<T>::SwapType::AllReferences);
                 }
@@ -684,7 +773,7 @@ namespace NativeJIT
         code.EmitImmediate<OpCode::Mov>(dest.GetDirectRegister(), m_data->GetImmediate<T>());
 
         // Let every owner benefit from moving to direct storage if possible.
-        Swap(dest, forModification
+        Swap(dest, forModification || tree.IsInConditionalCode()
                    ? Storage<T>::SwapType::Single
                    : Storage<T>::SwapType::AllReferences);
     }
@@ -930,6 +1019,7 @@ namespace NativeJIT
           m_nonVolatileRegisterMask(ISFLOAT ?
             CallingConvention::c_xmmNonVolatileRegistersMask :
             CallingConvention::c_rxxNonVolatileRegistersMask),
+          m_isNonVolatilePreferred(false),
           m_data(),
           m_allocatedRegisters(Allocators::StlAllocator<uint8_t>(allocator)),
           m_pinCount()
@@ -989,20 +1079,27 @@ namespace NativeJIT
     {
         unsigned id;
 
-        const bool volatileRegisterFound =
-            BitOp::GetHighestBitSet(~m_usedMask & m_volatileRegisterMask, &id);
+        const unsigned preferredMask = m_isNonVolatilePreferred
+                                       ? m_nonVolatileRegisterMask
+                                       : m_volatileRegisterMask;
+        const unsigned otherMask = m_isNonVolatilePreferred
+                                   ? m_volatileRegisterMask
+                                   : m_nonVolatileRegisterMask;
 
-        if (volatileRegisterFound)
+        const bool preferredRegisterFound =
+            BitOp::GetHighestBitSet(~m_usedMask & preferredMask, &id);
+
+        if (preferredRegisterFound)
         {
             Allocate(id);
             return id;
         }
         else
         {
-            const bool nonVolatileRegisterFound =
-                BitOp::GetHighestBitSet(~m_usedMask & m_nonVolatileRegisterMask, &id);
+            const bool otherRegisterFound =
+                BitOp::GetHighestBitSet(~m_usedMask & otherMask, &id);
 
-            LogThrowAssert(nonVolatileRegisterFound, "No free registers available");
+            LogThrowAssert(otherRegisterFound, "No free registers available");
 
             Allocate(id);
             return id;
@@ -1095,6 +1192,20 @@ namespace NativeJIT
     }
 
 
+    template <unsigned REGISTER_COUNT, bool ISFLOAT>
+    unsigned ExpressionTree::FreeList<REGISTER_COUNT, ISFLOAT>::GetFreeNonVolatileMask() const
+    {
+        return GetFreeMask() & m_nonVolatileRegisterMask;
+    }
+
+
+    template <unsigned REGISTER_COUNT, bool ISFLOAT>
+    void ExpressionTree::FreeList<REGISTER_COUNT, ISFLOAT>::PreferNonVolatiles()
+    {
+        m_isNonVolatilePreferred = true;
+    }
+
+
     template <unsigned REGISTER_COUNT, bool ISFLOAT>
     unsigned ExpressionTree::FreeList<REGISTER_COUNT, ISFLOAT>::GetAllocatedSpillable() const
     {
@@ -26,8 +26,10 @@
 #include <array>                // For arrays in FreeList.
 #include <cstdint>
 #include <iosfwd>               // For debugging output.
+#include <utility>              // For std::pair in m_guardTests and m_conditionalCaches.
 
 #include "NativeJIT/AllocatorVector.h"                  // Embedded member.
+#include "NativeJIT/CodeGen/ConstantPool.h"             // Embedded member.
 #include "NativeJIT/CodeGen/JumpTable.h"                // ExpressionTree embeds Label.
 #include "NativeJIT/CodeGen/Register.h"
 #include "NativeJIT/TypePredicates.h"                   // RegisterStorage used in typedef.
@@ -105,6 +107,9 @@ namespace NativeJIT
         Allocators::IAllocator& GetAllocator() const;
         FunctionBuffer& GetCodeGenerator() const;
 
+        // Returns the pool used to emit the RIP-relative constants in Pass0.
+        ConstantPool& GetConstantPool();
+
         void EnableDiagnostics(std::ostream& out);
         void DisableDiagnostics();
 
@@ -128,8 +133,84 @@ namespace NativeJIT
 
         void AddRIPRelative(RIPRelativeImmediate& node);
         void ReportFunctionCallNode(unsigned parameterCount);
+
+        // Called for parameters passed on the stack. They are accessed
+        // through the base pointer, so it needs to be set up by the prolog
+        // even if there are no temporaries.
+        void ReportStackParameter();
+
+        // Called for stack variables. Their addresses may be passed to called
+        // functions, so the frame must stay alive during the calls and the
+        // calls can't be compiled as tail calls.
+        void ReportStackVariable();
+        bool HasStackVariables() const;
+
+        // Nodes created between BeginLoopBody() and the matching EndLoopBody()
+        // belong to the body of a loop. The loop node evaluates them once for
+        // each iteration, so they are not evaluated ahead of their parents as
+        // common subexpressions in Pass2.
+        void BeginLoopBody();
+        void EndLoopBody();
+        unsigned GetLoopDepth() const;
+
+        // Called for local variables. Guards can't be used in the same tree.
+        void ReportLocalVariable();
+        bool HasLocalVariables() const;
+
+        // Called by NodeBase::IncrementParentCount() for children which are
+        // sequenced or may bump registers. Marks their parent, i.e. the node
+        // being constructed, which is the one most recently added, the same
+        // way. See NodeBase::IsSequenced() and NodeBase::MayBumpRegisters().
+        void ReportChild(NodeBase const & child);
+
+        // The code generated between BeginConditionalCode() and the matching
+        // EndConditionalCode() may be skipped at runtime (e.g. the right side
+        // of a short-circuit operator or a loop body). Such code must not
+        // change where the values computed before it are stored, so loading a
+        // shared storage into a register there only affects the storage which
+        // is being converted. Such code must not move the live registers to
+        // other registers or to the stack either, so the caller either spills
+        // them beforehand or passes false for canBumpRegisters, in which case
+        // BumpRegister() throws until the matching EndConditionalCode().
+        //
+        // The values of the nodes evaluated in such code are not available
+        // after it, EndConditionalCode() throws if any of them still has
+        // parents which have not been evaluated.
+        void BeginConditionalCode(bool canBumpRegisters);
+        void EndConditionalCode();
+        bool IsInConditionalCode() const;
+
+        // Returns whether the code being generated may move the contents of
+        // registers, see BeginConditionalCode().
+        bool CanBumpRegisters() const;
+
+        // Returns whether at least count general purpose registers and count
+        // XMM registers are free.
+        bool HasFreeRegisters(unsigned count) const;
+
+        // Returns an identifier of the innermost region of conditional code
+        // being generated, or zero outside of conditional code.
+        unsigned GetConditionalCodeRegion() const;
+
+        // Returns whether the code generated now is executed whenever the
+        // code generated in the given region was, i.e. whether the region
+        // is still open. Always true for zero.
+        bool IsInConditionalCodeRegion(unsigned region) const;
+
+        // Called by Node<T>::CodeGenCache() for the nodes with several parents
+        // which are evaluated in conditional code.
+        void ReportConditionalCache(NodeBase& node);
+
         void Compile();
 
+        // Called by Node<T>::CodeGenCache() around the generation of each
+        // node's code to attribute the generated instructions to nodes in
+        // FunctionBuffer's debug info. The code emitted after a child node
+        // is done is attributed back to the parent. No-ops unless debug info
+        // is enabled in the FunctionBuffer.
+        void BeginNodeCodeGen(NodeBase const & node);
+        void EndNodeCodeGen();
+
         //
         // Storage allocation.
         //
@@ -140,6 +221,13 @@ namespace NativeJIT
         template <typename T>
         Storage<T> Direct(typename Storage<T>::DirectRegister r);
 
+        // Returns a direct storage in a free register which function calls
+        // use neither for parameters nor for the return value, if there is
+        // one. A value in such register can stay pinned while code that
+        // makes function calls is generated.
+        template <typename T>
+        Storage<T> DirectUnusedByCalls();
+
         template <typename T>
         Storage<T> RIPRelative(int32_t offset);
 
@@ -149,6 +237,12 @@ namespace NativeJIT
         template <typename T>
         Storage<T> Temporary();
 
+        // Returns indirect storage relative to the base pointer for a function
+        // parameter passed on the stack at the specified offset from the
+        // original RSP. Requires ReportStackParameter() to have been called.
+        template <typename T>
+        Storage<T> StackParameter(int32_t offset);
+
         template <typename T>
         Storage<T> Immediate(T value);
 
@@ -169,6 +263,20 @@ namespace NativeJIT
         template <unsigned SIZE, bool ISFLOAT>
         bool IsPinned(Register<SIZE, ISFLOAT> reg);
 
+        // Moves the contents of an allocated, unpinned volatile register into
+        // a free non-volatile register or, if there are none, into a
+        // temporary, so that it survives a function call. Unlike saving and
+        // restoring the register around the call, the value is reloaded only
+        // when it's used again, which is never the case for the following
+        // calls.
+        template <bool ISFLOAT>
+        void EvictVolatileRegister(unsigned id);
+
+        // Moves the contents of all allocated, unpinned registers into
+        // temporaries. Code generated afterwards can then allocate and spill
+        // registers without moving the values which were live before.
+        void SpillAllRegisters();
+
         unsigned GetRXXUsedMask() const;
         unsigned GetXMMUsedMask() const;
 
@@ -184,6 +292,10 @@ namespace NativeJIT
         // m_preconditionTests variable for more information.
         void AddExecutionPreconditionTest(ExecutionPreconditionTest& test);
 
+        // Adds a test which is evaluated in Pass2 before any of the nodes
+        // created after it. See the m_guardTests variable for more information.
+        void AddGuardTest(ExecutionPreconditionTest& test);
+
         void const * GetUntypedEntryPoint() const;
 
     private:
@@ -244,6 +356,13 @@ namespace NativeJIT
             // Returns the bit-mask for used and allocated registers.
             unsigned GetUsedMask() const;
             unsigned GetFreeMask() const;
+            unsigned GetFreeNonVolatileMask() const;
+
+            // By default, Allocate() returns volatile registers first since
+            // non-volatile ones need to be saved by the prolog. In trees with
+            // several function calls it's cheaper to save them once than to
+            // preserve the volatile ones around each call.
+            void PreferNonVolatiles();
 
             // Returns a register mask specifying which registers were touched
             // at any point of time, regardless of whether they were later
@@ -270,6 +389,8 @@ namespace NativeJIT
             const unsigned m_volatileRegisterMask;
             const unsigned m_nonVolatileRegisterMask;
 
+            bool m_isNonVolatilePreferred;
+
             // See the class description for more details.
             std::array<Data*, REGISTER_COUNT> m_data;
 
@@ -289,6 +410,16 @@ namespace NativeJIT
         bool IsBasePointer(PointerRegister r) const;
         PointerRegister GetBasePointer() const;
 
+        // Specifies where BumpRegister() moves the contents of a register.
+        // Unless the destination is a temporary, a temporary is used only if
+        // there are no suitable free registers.
+        enum class BumpDestination { AnyRegister, NonVolatileRegister, Temporary };
+
+        // Moves the contents of an allocated register out of the way, into a
+        // free register or into a temporary.
+        template <typename T>
+        void BumpRegister(typename Storage<T>::DirectRegister r, BumpDestination destination);
+
         // Returns whether the register is one of the reserved/shared base
         // registers (instruction, stack or base pointer).
         template <unsigned SIZE>
@@ -332,12 +463,20 @@ namespace NativeJIT
         AllocatorVector<NodeBase*> m_topologicalSort;
         AllocatorVector<NodeBase*> m_parameters;
         AllocatorVector<RIPRelativeImmediate*> m_ripRelatives;
+        ConstantPool m_constantPool;
 
         // Preconditions for evaluating the whole expression. The preconditions
         // are evaluated right after the parameters and will cause the function
         // to return early if any of them is not met.
         AllocatorVector<ExecutionPreconditionTest*> m_preconditionTests;
 
+        // Tests which cause the function to return early like the preconditions,
+        // but are evaluated after the common subexpressions they may depend on.
+        // Each test is paired with the number of nodes which had been created
+        // before it, i.e. the position in m_topologicalSort at which Pass2
+        // evaluates it.
+        AllocatorVector<std::pair<unsigned, ExecutionPreconditionTest*>> m_guardTests;
+
         FreeList<RegisterBase::c_maxIntegerRegisterID + 1, false> m_rxxFreeList;
         FreeList<RegisterBase::c_maxFloatRegisterID + 1, true> m_xmmFreeList;
 
@@ -348,10 +487,44 @@ namespace NativeJIT
         unsigned m_temporaryCount;
         AllocatorVector<int32_t> m_temporaries;
 
+        // IDs of the nodes whose code is being generated, innermost last.
+        // Used only when FunctionBuffer's debug info is enabled.
+        AllocatorVector<unsigned> m_nodeCodeGenStack;
+
         // Maximum number of parameters used in function calls done by the tree.
         // Negative value signifies no function calls made.
         int m_maxFunctionCallParameters;
 
+        // Number of function calls done by the tree.
+        unsigned m_functionCallCount;
+
+        // Whether any of the function's parameters is passed on the stack.
+        bool m_hasStackParameters;
+
+        // Whether the tree contains any StackVariableNodes.
+        bool m_hasStackVariables;
+
+        // Number of loop bodies currently being constructed.
+        unsigned m_loopDepth;
+
+        // Whether the tree contains any LocalVariables.
+        bool m_hasLocalVariables;
+
+        // Identifiers of the nested regions of conditionally executed code
+        // currently being generated, innermost last, and the number of
+        // regions started so far.
+        AllocatorVector<unsigned> m_conditionalCodeRegions;
+        unsigned m_conditionalCodeRegionCount;
+
+        // Identifiers of the open regions of conditional code which must not
+        // move the contents of registers, innermost last.
+        AllocatorVector<unsigned> m_noBumpRegions;
+
+        // Nodes with cached values which were evaluated in conditional code,
+        // paired with the number of regions open at the time. See
+        // ReportConditionalCache().
+        AllocatorVector<std::pair<unsigned, NodeBase*>> m_conditionalCaches;
+
         PointerRegister m_basePointer;
 
         Label m_startOfEpilogue;
@@ -423,19 +596,23 @@ namespace NativeJIT
 
         ExpressionTree& m_tree;
 
-        // How the data is stored.
-        StorageClass m_storageClass;
-
-        // Which register.
-        bool m_isFloat;
-        unsigned m_registerId;
-        int32_t m_offset;
-
-        // Holds the immediate value for Data whose storage class is Immediate.
-        size_t m_immediate;
+        // How the data is stored (a StorageClass value) and which register.
+        // Packed into one word together with the reference count below since
+        // a Data object is allocated for most of the nodes in the tree.
+        unsigned m_storageClass : 2;
+        unsigned m_isFloat : 1;
+        unsigned m_registerId : 5;
 
         // Who is using it.
         unsigned m_refCount;
+
+        // The offset is used only by Indirect and the immediate only by
+        // Immediate storage.
+        union
+        {
+            int32_t m_offset;
+            size_t m_immediate;
+        };
     };
 
 
@@ -23,6 +23,9 @@
 
 #pragma once
 
+#include <tuple>                                // Embedded member.
+#include <type_traits>
+
 #include "NativeJIT/ExecutionPreconditionTest.h"
 #include "NativeJIT/ExpressionNodeFactory.h"
 #include "NativeJIT/TypePredicates.h"
@@ -40,110 +43,54 @@ namespace NativeJIT
         void AddExecuteOnlyIfStatement(FlagExpressionNode<JCC>& condition,
                                        ImmediateNode<R>& otherwiseValue);
 
+        // Like AddExecuteOnlyIfStatement(), but the test is evaluated at the
+        // point of the tree where it is added: after the nodes created before
+        // it which have multiple parents have been evaluated and before any
+        // nodes created after it. The condition may thus depend on computed
+        // intermediate values and the function returns otherwiseValue without
+        // computing the rest of the tree if the condition is not satisfied.
+        template <JccType JCC>
+        void AddGuardStatement(FlagExpressionNode<JCC>& condition,
+                               ImmediateNode<R>& otherwiseValue);
+
     private:
         Allocators::IAllocator& m_allocator;
     };
 
 
-    template <typename R, typename P1 = void, typename P2 = void, typename P3 = void, typename P4 = void>
+    // A function with return type R and any number of parameters of types P.
+    // The parameters that don't fit into registers are passed on the stack as
+    // specified by the platform ABI (see ParameterSlotAllocator).
+    template <typename R, typename... P>
     class Function : public FunctionBase<R>
     {
     public:
         Function(Allocators::IAllocator& allocator, FunctionBuffer& code);
 
-        ParameterNode<P1>& GetP1() const;
-        ParameterNode<P2>& GetP2() const;
-        ParameterNode<P3>& GetP3() const;
-        ParameterNode<P4>& GetP4() const;
-
-        typedef R (*FunctionType)(P1, P2, P3, P4);
-
-        FunctionType Compile(Node<R>& expression);
-
-        FunctionType GetEntryPoint() const;
-
-    private:
-        ParameterNode<P1>* m_p1;
-        ParameterNode<P2>* m_p2;
-        ParameterNode<P3>* m_p3;
-        ParameterNode<P4>* m_p4;
-    };
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    class Function<R, P1, P2, P3> : public FunctionBase<R>
-    {
-    public:
-        Function(Allocators::IAllocator& allocator, FunctionBuffer& code);
-
-        ParameterNode<P1>& GetP1() const;
-        ParameterNode<P2>& GetP2() const;
-        ParameterNode<P3>& GetP3() const;
-
-        typedef R (*FunctionType)(P1, P2, P3);
-
-        FunctionType Compile(Node<R>& expression);
-
-        FunctionType GetEntryPoint() const;
+        // The type of the parameter at the zero-based INDEX.
+        template <unsigned INDEX>
+        using ParameterType = typename std::tuple_element<INDEX, std::tuple<P...>>::type;
 
-    private:
-        ParameterNode<P1>* m_p1;
-        ParameterNode<P2>* m_p2;
-        ParameterNode<P3>* m_p3;
-    };
+        // Returns the parameter at the zero-based INDEX.
+        template <unsigned INDEX>
+        ParameterNode<ParameterType<INDEX>>& GetParameter() const;
 
+        // Shorthands for GetParameter<0>() to GetParameter<3>(). The return
+        // types are declared through a padded list so that the declarations
+        // are valid for functions with fewer than four parameters.
+        ParameterNode<typename std::tuple_element<0, std::tuple<P..., void, void, void, void>>::type>& GetP1() const;
+        ParameterNode<typename std::tuple_element<1, std::tuple<P..., void, void, void, void>>::type>& GetP2() const;
+        ParameterNode<typename std::tuple_element<2, std::tuple<P..., void, void, void, void>>::type>& GetP3() const;
+        ParameterNode<typename std::tuple_element<3, std::tuple<P..., void, void, void, void>>::type>& GetP4() const;
 
-    template <typename R, typename P1, typename P2>
-    class Function<R, P1, P2> : public FunctionBase<R>
-    {
-    public:
-        Function(Allocators::IAllocator& allocator, FunctionBuffer& code);
-
-        ParameterNode<P1>& GetP1() const;
-        ParameterNode<P2>& GetP2() const;
-
-        typedef R (*FunctionType)(P1, P2);
+        typedef R (*FunctionType)(P...);
 
         FunctionType Compile(Node<R>& expression);
 
         FunctionType GetEntryPoint() const;
 
     private:
-        ParameterNode<P1>* m_p1;
-        ParameterNode<P2>* m_p2;
-    };
-
-
-    template <typename R, typename P1>
-    class Function<R, P1> : public FunctionBase<R>
-    {
-    public:
-        Function(Allocators::IAllocator& allocator, FunctionBuffer& code);
-
-        ParameterNode<P1>& GetP1() const;
-
-        typedef R (*FunctionType)(P1);
-
-        FunctionType Compile(Node<R>& expression);
-
-        FunctionType GetEntryPoint() const;
-
-    private:
-        ParameterNode<P1>* m_p1;
-    };
-
-
-    template <typename R>
-    class Function<R> : public FunctionBase<R>
-    {
-    public:
-        Function(Allocators::IAllocator& allocator, FunctionBuffer& code);
-
-        typedef R (*FunctionType)();
-
-        FunctionType Compile(Node<R>& expression);
-
-        FunctionType GetEntryPoint() const;
+        std::tuple<ParameterNode<P>*...> m_parameters;
     };
 
 
@@ -167,219 +114,88 @@ namespace NativeJIT
     void FunctionBase<R>::AddExecuteOnlyIfStatement(FlagExpressionNode<JCC>& condition,
                                                     ImmediateNode<R>& otherwiseValue)
     {
-        auto & test = PlacementConstruct<ExecuteOnlyIfStatement<R, JCC>>(condition, otherwiseValue);
+        auto & test = PlacementConstruct<ExecuteOnlyIfStatement<R, JCC>>(*this, condition, otherwiseValue);
 
         AddExecutionPreconditionTest(test);
     }
 
 
-    //*************************************************************************
-    //
-    // Function<R, P1, P2, P3, P4> template definitions.
-    //
-    //*************************************************************************
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    Function<R, P1, P2, P3, P4>::Function(Allocators::IAllocator& allocator,
-                                          FunctionBuffer& code)
-        : FunctionBase<R>(allocator, code)
-    {
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-        static_assert(IsValidParameter<P2>::c_value, "P2 is an invalid type.");
-        static_assert(IsValidParameter<P3>::c_value, "P3 is an invalid type.");
-        static_assert(IsValidParameter<P4>::c_value, "P4 is an invalid type.");
-
-        ParameterSlotAllocator slotAllocator;
-        m_p1 = &this->template Parameter<P1>(slotAllocator);
-        m_p2 = &this->template Parameter<P2>(slotAllocator);
-        m_p3 = &this->template Parameter<P3>(slotAllocator);
-        m_p4 = &this->template Parameter<P4>(slotAllocator);
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    ParameterNode<P1>& Function<R, P1, P2, P3, P4>::GetP1() const
-    {
-        return *m_p1;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    ParameterNode<P2>& Function<R, P1, P2, P3, P4>::GetP2() const
-    {
-        return *m_p2;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    ParameterNode<P3>& Function<R, P1, P2, P3, P4>::GetP3() const
-    {
-        return *m_p3;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    ParameterNode<P4>& Function<R, P1, P2, P3, P4>::GetP4() const
-    {
-        return *m_p4;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    typename Function<R, P1, P2, P3, P4>::FunctionType
-    Function<R, P1, P2, P3, P4>::Compile(Node<R>& value)
-    {
-        this->template Return<R>(value);
-        ExpressionTree::Compile();
-        return GetEntryPoint();
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    typename Function<R, P1, P2, P3, P4>::FunctionType
-    Function<R, P1, P2, P3, P4>::GetEntryPoint() const
-    {
-        return reinterpret_cast<FunctionType>(const_cast<void*>(this->GetUntypedEntryPoint()));
-    }
-
-
-    //*************************************************************************
-    //
-    // Function<R, P1, P2, P3> template definitions.
-    //
-    //*************************************************************************
-    template <typename R, typename P1, typename P2, typename P3>
-    Function<R, P1, P2, P3>::Function(Allocators::IAllocator& allocator,
-                                      FunctionBuffer& code)
-        : FunctionBase<R>(allocator, code)
-    {
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-        static_assert(IsValidParameter<P2>::c_value, "P2 is an invalid type.");
-        static_assert(IsValidParameter<P3>::c_value, "P3 is an invalid type.");
-
-        ParameterSlotAllocator slotAllocator;
-        m_p1 = &this->template Parameter<P1>(slotAllocator);
-        m_p2 = &this->template Parameter<P2>(slotAllocator);
-        m_p3 = &this->template Parameter<P3>(slotAllocator);
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    ParameterNode<P1>& Function<R, P1, P2, P3>::GetP1() const
-    {
-        return *m_p1;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    ParameterNode<P2>& Function<R, P1, P2, P3>::GetP2() const
-    {
-        return *m_p2;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    ParameterNode<P3>& Function<R, P1, P2, P3>::GetP3() const
-    {
-        return *m_p3;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    typename Function<R, P1, P2, P3>::FunctionType
-    Function<R, P1, P2, P3>::Compile(Node<R>& value)
+    template <typename R>
+    template <JccType JCC>
+    void FunctionBase<R>::AddGuardStatement(FlagExpressionNode<JCC>& condition,
+                                            ImmediateNode<R>& otherwiseValue)
     {
-        this->template Return<R>(value);
-        ExpressionTree::Compile();
-        return GetEntryPoint();
-    }
-
+        auto & test = PlacementConstruct<ExecuteOnlyIfStatement<R, JCC>>(*this, condition, otherwiseValue);
 
-    template <typename R, typename P1, typename P2, typename P3>
-    typename Function<R, P1, P2, P3>::FunctionType
-    Function<R, P1, P2, P3>::GetEntryPoint() const
-    {
-        return reinterpret_cast<FunctionType>(const_cast<void*>(this->GetUntypedEntryPoint()));
+        AddGuardTest(test);
     }
 
 
     //*************************************************************************
     //
-    // Function<R, P1, P2> template definitions.
+    // Function<R, P...> template definitions.
     //
     //*************************************************************************
-    template <typename R, typename P1, typename P2>
-    Function<R, P1, P2>::Function(Allocators::IAllocator& allocator,
-                                  FunctionBuffer& code)
+    template <typename R, typename... P>
+    Function<R, P...>::Function(Allocators::IAllocator& allocator,
+                                FunctionBuffer& code)
         : FunctionBase<R>(allocator, code)
     {
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-        static_assert(IsValidParameter<P2>::c_value, "P2 is an invalid type.");
+        static_assert(AreValidParameters<P...>::c_value, "One of the parameters has an invalid type.");
 
+        // The elements of a braced initializer list are evaluated in order,
+        // so the parameter slots get allocated from left to right.
         ParameterSlotAllocator slotAllocator;
-        m_p1 = &this->template Parameter<P1>(slotAllocator);
-        m_p2 = &this->template Parameter<P2>(slotAllocator);
+        m_parameters = std::tuple<ParameterNode<P>*...> { &this->template Parameter<P>(slotAllocator)... };
     }
 
 
-    template <typename R, typename P1, typename P2>
-    ParameterNode<P1>& Function<R, P1, P2>::GetP1() const
+    template <typename R, typename... P>
+    template <unsigned INDEX>
+    ParameterNode<typename Function<R, P...>::template ParameterType<INDEX>>&
+    Function<R, P...>::GetParameter() const
     {
-        return *m_p1;
-    }
-
+        static_assert(INDEX < sizeof...(P), "Invalid parameter index.");
 
-    template <typename R, typename P1, typename P2>
-    ParameterNode<P2>& Function<R, P1, P2>::GetP2() const
-    {
-        return *m_p2;
+        return *std::get<INDEX>(m_parameters);
     }
 
 
-    template <typename R, typename P1, typename P2>
-    typename Function<R, P1, P2>::FunctionType
-    Function<R, P1, P2>::Compile(Node<R>& value)
+    template <typename R, typename... P>
+    ParameterNode<typename std::tuple_element<0, std::tuple<P..., void, void, void, void>>::type>&
+    Function<R, P...>::GetP1() const
     {
-        this->template Return<R>(value);
-        ExpressionTree::Compile();
-        return GetEntryPoint();
+        return GetParameter<0>();
     }
 
 
-    template <typename R, typename P1, typename P2>
-    typename Function<R, P1, P2>::FunctionType
-    Function<R, P1, P2>::GetEntryPoint() const
+    template <typename R, typename... P>
+    ParameterNode<typename std::tuple_element<1, std::tuple<P..., void, void, void, void>>::type>&
+    Function<R, P...>::GetP2() const
     {
-        return reinterpret_cast<FunctionType>(const_cast<void*>(this->GetUntypedEntryPoint()));
+        return GetParameter<1>();
     }
 
 
-    //*************************************************************************
-    //
-    // Function<R, P1> template definitions.
-    //
-    //*************************************************************************
-    template <typename R, typename P1>
-    Function<R, P1>::Function(Allocators::IAllocator& allocator,
-                              FunctionBuffer& code)
-        : FunctionBase<R>(allocator, code)
+    template <typename R, typename... P>
+    ParameterNode<typename std::tuple_element<2, std::tuple<P..., void, void, void, void>>::type>&
+    Function<R, P...>::GetP3() const
     {
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-
-        ParameterSlotAllocator slotAllocator;
-        m_p1 = &this->template Parameter<P1>(slotAllocator);
+        return GetParameter<2>();
     }
 
 
-    template <typename R, typename P1>
-    ParameterNode<P1>& Function<R, P1>::GetP1() const
+    template <typename R, typename... P>
+    ParameterNode<typename std::tuple_element<3, std::tuple<P..., void, void, void, void>>::type>&
+    Function<R, P...>::GetP4() const
     {
-        return *m_p1;
+        return GetParameter<3>();
     }
 
 
-    template <typename R, typename P1>
-    typename Function<R, P1>::FunctionType
-    Function<R, P1>::Compile(Node<R>& value)
+    template <typename R, typename... P>
+    typename Function<R, P...>::FunctionType
+    Function<R, P...>::Compile(Node<R>& value)
     {
         this->template Return<R>(value);
         ExpressionTree::Compile();
@@ -387,38 +203,9 @@ namespace NativeJIT
     }
 
 
-    template <typename R, typename P1>
-    typename Function<R, P1>::FunctionType
-    Function<R, P1>::GetEntryPoint() const
-    {
-        return reinterpret_cast<FunctionType>(const_cast<void*>(this->GetUntypedEntryPoint()));
-    }
-
-
-    //*************************************************************************
-    //
-    // Function<R> template definitions.
-    //
-    //*************************************************************************
-    template <typename R>
-    Function<R>::Function(Allocators::IAllocator& allocator,
-                          FunctionBuffer& code)
-        : FunctionBase<R>(allocator, code)
-    {
-    }
-
-
-    template <typename R>
-    typename Function<R>::FunctionType  Function<R>::Compile(Node<R>& value)
-    {
-        this->template Return<R>(value);
-        ExpressionTree::Compile();
-        return GetEntryPoint();
-    }
-
-
-    template <typename R>
-    typename Function<R>::FunctionType Function<R>::GetEntryPoint() const
+    template <typename R, typename... P>
+    typename Function<R, P...>::FunctionType
+    Function<R, P...>::GetEntryPoint() const
     {
         return reinterpret_cast<FunctionType>(const_cast<void*>(this->GetUntypedEntryPoint()));
     }
@@ -0,0 +1,172 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#pragma once
+
+#include <type_traits>      // For std::common_type.
+#include <typeinfo>         // For std::type_info.
+#include <utility>          // For std::index_sequence.
+#include <vector>           // Embedded member.
+
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    class ExpressionNodeFactory;
+
+
+    // Maps C++ functions to the expansions that ExpressionNodeFactory::Call()
+    // builds in place of a CallNode. An expansion is a function (or a lambda
+    // without captures) which builds the equivalent tree from the parameter
+    // nodes, f. ex.
+    //
+    //    registry.Register(Clamp,
+    //                      [](ExpressionNodeFactory& e, Node<int>& value) -> Node<int>&
+    //                      { ... });
+    //
+    // The expanded nodes are regular nodes of the tree, so parameters used more
+    // than once are evaluated once and the registers are allocated across the
+    // expansion like for any other subtree. The registry can be shared by any
+    // number of trees, see ExpressionNodeFactory::SetIntrinsics().
+    class IntrinsicRegistry : private NonCopyable
+    {
+    public:
+        template <typename R, typename... P>
+        using Expansion = Node<R>& (*)(ExpressionNodeFactory& factory, Node<P>&... parameters);
+
+        // The expansion type is not deduced so that lambdas convert to it.
+        template <typename R, typename... P>
+        void Register(R (*function)(P...),
+                      typename std::common_type<Expansion<R, P...>>::type expansion);
+
+        class Intrinsic
+        {
+        public:
+            // Builds the expansion from the parameters. The signature must be
+            // the one of the registered function.
+            template <typename R, typename... P>
+            Node<R>& Expand(ExpressionNodeFactory& factory, Node<P>&... parameters) const;
+
+        private:
+            friend class IntrinsicRegistry;
+
+            typedef void (*GenericExpansion)();
+            typedef NodeBase& (*ExpandFunction)(ExpressionNodeFactory& factory,
+                                                GenericExpansion expansion,
+                                                NodeBase* const * parameters);
+
+            void const * m_function;
+            std::type_info const * m_signature;
+            GenericExpansion m_expansion;
+            ExpandFunction m_expander;
+        };
+
+        // Returns the intrinsic registered for the given function or nullptr.
+        Intrinsic const * Find(void const * function) const;
+
+    private:
+        template <typename R, typename... P>
+        class Expander
+        {
+        public:
+            static NodeBase& Expand(ExpressionNodeFactory& factory,
+                                    Intrinsic::GenericExpansion expansion,
+                                    NodeBase* const * parameters);
+
+        private:
+            template <size_t... INDEX>
+            static NodeBase& Expand(ExpressionNodeFactory& factory,
+                                    Intrinsic::GenericExpansion expansion,
+                                    NodeBase* const * parameters,
+                                    std::index_sequence<INDEX...>);
+        };
+
+        void Register(Intrinsic const & intrinsic);
+
+        std::vector<Intrinsic> m_intrinsics;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for IntrinsicRegistry
+    //
+    //*************************************************************************
+    template <typename R, typename... P>
+    void IntrinsicRegistry::Register(R (*function)(P...),
+                                     typename std::common_type<Expansion<R, P...>>::type expansion)
+    {
+        LogThrowAssert(expansion != nullptr, "Invalid expansion");
+
+        Intrinsic intrinsic;
+        intrinsic.m_function = reinterpret_cast<void const *>(function);
+        intrinsic.m_signature = &typeid(R (*)(P...));
+        intrinsic.m_expansion = reinterpret_cast<Intrinsic::GenericExpansion>(expansion);
+        intrinsic.m_expander = &Expander<R, P...>::Expand;
+
+        Register(intrinsic);
+    }
+
+
+    template <typename R, typename... P>
+    Node<R>& IntrinsicRegistry::Intrinsic::Expand(ExpressionNodeFactory& factory,
+                                                  Node<P>&... parameters) const
+    {
+        LogThrowAssert(*m_signature == typeid(R (*)(P...)),
+                       "Intrinsic called with a different signature: %s",
+                       m_signature->name());
+
+        NodeBase* const nodes[] = { &parameters..., nullptr };
+
+        return static_cast<Node<R>&>(m_expander(factory, m_expansion, nodes));
+    }
+
+
+    template <typename R, typename... P>
+    NodeBase& IntrinsicRegistry::Expander<R, P...>::Expand(ExpressionNodeFactory& factory,
+                                                           Intrinsic::GenericExpansion expansion,
+                                                           NodeBase* const * parameters)
+    {
+        return Expand(factory, expansion, parameters, std::index_sequence_for<P...>());
+    }
+
+
+    template <typename R, typename... P>
+    template <size_t... INDEX>
+    NodeBase& IntrinsicRegistry::Expander<R, P...>::Expand(ExpressionNodeFactory& factory,
+                                                           Intrinsic::GenericExpansion expansion,
+                                                           NodeBase* const * parameters,
+                                                           std::index_sequence<INDEX...>)
+    {
+        // The parameters array is unused when there are no parameters.
+        (void)parameters;
+
+        auto typedExpansion = reinterpret_cast<Expansion<R, P...>>(expansion);
+
+        return typedExpansion(factory, static_cast<Node<P>&>(*parameters[INDEX])...);
+    }
+}
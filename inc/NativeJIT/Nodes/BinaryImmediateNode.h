@@ -70,7 +70,7 @@ namespace NativeJIT
           m_left(left),
           m_right(right)
     {
-        m_left.IncrementParentCount();
+        m_left.IncrementParentCount(tree);
         // m_right is not a Node, so no IncrementParentCount() call.
     }
 
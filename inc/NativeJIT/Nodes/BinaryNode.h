@@ -64,8 +64,8 @@ namespace NativeJIT
           m_left(left),
           m_right(right)
     {
-        left.IncrementParentCount();
-        right.IncrementParentCount();
+        left.IncrementParentCount(tree);
+        right.IncrementParentCount(tree);
     }
 
 
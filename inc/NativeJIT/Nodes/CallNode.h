@@ -23,11 +23,13 @@
 
 #pragma once
 
+#include <algorithm>                   // For std::copy.
 #include <iostream>                    // Accessed by template definition for Print().
 
 #include "NativeJIT/AllocatorVector.h" // Embedded member.
 #include "NativeJIT/CodeGenHelpers.h"
 #include "NativeJIT/Nodes/Node.h"      // Base class.
+#include "NativeJIT/Nodes/ParameterNode.h"
 #include "NativeJIT/TypePredicates.h"
 
 // https://software.intel.com/en-us/articles/introduction-to-x64-assembly
@@ -53,6 +55,11 @@ namespace NativeJIT
         template <unsigned SIZE, bool ISFLOAT>
         void RecordCallRegister(Register<SIZE, ISFLOAT> r, bool isSoleOwner);
 
+        // Returns whether SaveVolatiles() saved the register, i.e. whether
+        // RestoreVolatiles() will overwrite it.
+        template <unsigned SIZE, bool ISFLOAT>
+        bool IsSaved(Register<SIZE, ISFLOAT> r) const;
+
     protected:
         // WARNING: This class is designed to be allocated by an arena allocator,
         // so its destructor will never be called. Therefore, it should hold no
@@ -72,6 +79,13 @@ namespace NativeJIT
         unsigned m_rxxCallExclusiveRegisterMask;
         unsigned m_xmmCallExclusiveRegisterMask;
 
+        // A bit-mask of registers that SaveVolatiles() stored into
+        // m_preservationStorage and RestoreVolatiles() needs to reload. Only
+        // the registers pinned by the call are saved and restored. The rest
+        // are evicted from the volatile registers before the call.
+        unsigned m_rxxSavedRegisterMask;
+        unsigned m_xmmSavedRegisterMask;
+
         // Temporary storage used to preserve volatile registers.
         AllocatorVector<Storage<void*>> m_preservationStorage;
     };
@@ -89,6 +103,17 @@ namespace NativeJIT
         virtual ExpressionTree::Storage<R> CodeGenValue(ExpressionTree& tree) override;
         virtual void Print(std::ostream& out) const override;
 
+        //
+        // Overrides of NodeBase methods.
+        //
+
+        // Stages the parameters, leaves the function's frame and jumps to the
+        // target. Calls with parameters passed on the stack are not compiled
+        // as tail calls since the caller's frame may not have room for them.
+        // Neither are calls in trees with stack variables since the called
+        // function may reference them.
+        virtual bool CompileAsTailCall(ExpressionTree& tree) override;
+
     protected:
         // WARNING: This class is designed to be allocated by an arena allocator,
         // so its destructor will never be called. Therefore, it should hold no
@@ -113,6 +138,11 @@ namespace NativeJIT
             // be evaluated before it can be staged.
             virtual void EmitStaging(ExpressionTree& tree, SaveRestoreVolatilesHelper& volatiles) = 0;
 
+            // Returns whether EmitStaging() stores the child into the stack
+            // area for the outgoing parameters. Such children are staged
+            // before the ones placed into registers.
+            virtual bool IsPassedOnStack() const = 0;
+
             // Releases any registers used during the evaluation of the child
             // expression in Evaluate().
             virtual void Release() = 0;
@@ -126,7 +156,7 @@ namespace NativeJIT
         class TypedChild : public Child
         {
         public:
-            TypedChild(Node<T>& expression);
+            TypedChild(ExpressionTree& tree, Node<T>& expression);
 
             //
             // Overrides of Child methods.
@@ -144,13 +174,16 @@ namespace NativeJIT
         };
 
 
+        // The parameters are placed into registers or onto the stack in the
+        // same way as the parameters of the compiled function, see
+        // ParameterSlotAllocator.
         template <typename T>
         class ParameterChild : public TypedChild<T>
         {
         public:
-            ParameterChild(Node<T>& expression, unsigned position);
-
-            typename ExpressionTree::Storage<T>::DirectRegister GetRegister() const;
+            ParameterChild(ExpressionTree& tree,
+                           Node<T>& expression,
+                           ParameterSlotAllocator& slotAllocator);
 
             //
             // Overrides of Child methods.
@@ -158,10 +191,17 @@ namespace NativeJIT
             virtual void Evaluate(ExpressionTree& tree) override;
             virtual void EmitStaging(ExpressionTree& tree,
                                      SaveRestoreVolatilesHelper& volatiles) override;
+            virtual bool IsPassedOnStack() const override;
             virtual void Print(std::ostream& out) const override;
 
         private:
+            bool m_isInRegister;
+
+            // Valid if m_isInRegister is true.
             typename ExpressionTree::Storage<T>::DirectRegister m_destination;
+
+            // Offset from RSP. Valid if m_isInRegister is false.
+            int32_t m_stackOffset;
         };
 
 
@@ -169,6 +209,13 @@ namespace NativeJIT
         {
         public:
             virtual void EmitCall(ExpressionTree& tree) = 0;
+
+            // Moves the function pointer (if any) into the register used for
+            // the tail jump, after the parameters have been staged.
+            virtual void EmitTailCallStaging(ExpressionTree& tree) = 0;
+
+            // Emits the epilog and the jump to the function.
+            virtual void EmitTailJump(ExpressionTree& tree) = 0;
         };
 
 
@@ -176,7 +223,8 @@ namespace NativeJIT
         class FunctionChild : public FunctionChildBase, public TypedChild<T>
         {
         public:
-            FunctionChild(Node<T>& expression,
+            FunctionChild(ExpressionTree& tree,
+                          Node<T>& expression,
                           typename Storage<R>::DirectRegister resultRegister);
 
             //
@@ -185,17 +233,30 @@ namespace NativeJIT
             virtual void Evaluate(ExpressionTree& tree) override;
             virtual void EmitStaging(ExpressionTree& tree,
                                      SaveRestoreVolatilesHelper& volatiles) override;
+            virtual bool IsPassedOnStack() const override;
 
             //
             // Overrides of FunctionChildBase methods.
             //
             virtual void EmitCall(ExpressionTree& tree) override;
+            virtual void EmitTailCallStaging(ExpressionTree& tree) override;
+            virtual void EmitTailJump(ExpressionTree& tree) override;
             virtual void Print(std::ostream& out) const override;
 
         private:
             typename Storage<R>::DirectRegister m_resultRegister;
+
+            // If the function pointer is known in advance and within the range
+            // of a direct branch from the code buffer, the function is called
+            // directly rather than through a register. Null otherwise.
+            void const * m_directTarget;
         };
 
+        // The register holding the function pointer for an indirect tail jump.
+        // It's volatile and not used for parameters in either calling
+        // convention, so the epilog and the parameter staging leave it intact.
+        static Register<8, false> GetTailJumpRegister();
+
         // One child for each parameter plus one for the function pointer.
         static const unsigned c_childCount = PARAMETERCOUNT + 1;
         Child* m_children[c_childCount];
@@ -206,84 +267,17 @@ namespace NativeJIT
     };
 
 
-    template <typename R, typename P1 = void, typename P2 = void, typename P3 = void, typename P4 = void>
-    class CallNode;
-
-
-    template <typename R>
-    class CallNode<R> : public CallNodeBase<R, 0>
-    {
-    public:
-        typedef R (*FunctionPointer)();
-
-        CallNode(ExpressionTree& tree,
-                 Node<FunctionPointer>& function);
-
-    private:
-        // WARNING: This class is designed to be allocated by an arena allocator,
-        // so its destructor will never be called. Therefore, it should hold no
-        // resources other than memory from the arena allocator.
-        ~CallNode();
-
-        typename CallNodeBase<R, 0>::template FunctionChild<FunctionPointer> m_f;
-    };
-
-
-    template <typename R, typename P1>
-    class CallNode<R, P1> : public CallNodeBase<R, 1>
-    {
-    public:
-        typedef R (*FunctionPointer)(P1);
-
-        CallNode(ExpressionTree& tree,
-                 Node<FunctionPointer>& function,
-                 Node<P1>& p1);
-
-    private:
-        // WARNING: This class is designed to be allocated by an arena allocator,
-        // so its destructor will never be called. Therefore, it should hold no
-        // resources other than memory from the arena allocator.
-        ~CallNode();
-
-        typename CallNodeBase<R, 1>::template FunctionChild<FunctionPointer> m_f;
-        typename CallNodeBase<R, 1>::template ParameterChild<P1> m_p1;
-    };
-
-
-    template <typename R, typename P1, typename P2>
-    class CallNode<R, P1, P2> : public CallNodeBase<R, 2>
-    {
-    public:
-        typedef R (*FunctionPointer)(P1, P2);
-
-        CallNode(ExpressionTree& tree,
-                 Node<FunctionPointer>& function,
-                 Node<P1>& p1,
-                 Node<P2>& p2);
-
-    private:
-        // WARNING: This class is designed to be allocated by an arena allocator,
-        // so its destructor will never be called. Therefore, it should hold no
-        // resources other than memory from the arena allocator.
-        ~CallNode();
-
-        typename CallNodeBase<R, 2>::template FunctionChild<FunctionPointer> m_f;
-        typename CallNodeBase<R, 2>::template ParameterChild<P1> m_p1;
-        typename CallNodeBase<R, 2>::template ParameterChild<P2> m_p2;
-    };
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    class CallNode<R, P1, P2, P3> : public CallNodeBase<R, 3>
+    // Calls a function with any number of parameters. The parameter children
+    // are allocated from the arena and referenced through m_children.
+    template <typename R, typename... P>
+    class CallNode : public CallNodeBase<R, sizeof...(P)>
     {
     public:
-        typedef R (*FunctionPointer)(P1, P2, P3);
+        typedef R (*FunctionPointer)(P...);
 
         CallNode(ExpressionTree& tree,
                  Node<FunctionPointer>& function,
-                 Node<P1>& p1,
-                 Node<P2>& p2,
-                 Node<P3>& p3);
+                 Node<P>&... parameters);
 
     private:
         // WARNING: This class is designed to be allocated by an arena allocator,
@@ -291,37 +285,7 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~CallNode();
 
-        typename CallNodeBase<R, 3>::template FunctionChild<FunctionPointer> m_f;
-        typename CallNodeBase<R, 3>::template ParameterChild<P1> m_p1;
-        typename CallNodeBase<R, 3>::template ParameterChild<P2> m_p2;
-        typename CallNodeBase<R, 3>::template ParameterChild<P3> m_p3;
-    };
-
-
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    class CallNode : public CallNodeBase<R, 4>
-    {
-    public:
-        typedef R (*FunctionPointer)(P1, P2, P3, P4);
-
-        CallNode(ExpressionTree& tree,
-                 Node<FunctionPointer>& function,
-                 Node<P1>& p1,
-                 Node<P2>& p2,
-                 Node<P3>& p3,
-                 Node<P4>& p4);
-
-    private:
-        // WARNING: This class is designed to be allocated by an arena allocator,
-        // so its destructor will never be called. Therefore, it should hold no
-        // resources other than memory from the arena allocator.
-        ~CallNode();
-
-        typename CallNodeBase<R, 4>::template FunctionChild<FunctionPointer> m_f;
-        typename CallNodeBase<R, 4>::template ParameterChild<P1> m_p1;
-        typename CallNodeBase<R, 4>::template ParameterChild<P2> m_p2;
-        typename CallNodeBase<R, 4>::template ParameterChild<P3> m_p3;
-        typename CallNodeBase<R, 4>::template ParameterChild<P4> m_p4;
+        typename CallNodeBase<R, sizeof...(P)>::template FunctionChild<FunctionPointer> m_f;
     };
 
 
@@ -341,6 +305,14 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE, bool ISFLOAT>
+    bool SaveRestoreVolatilesHelper::IsSaved(Register<SIZE, ISFLOAT> r) const
+    {
+        return BitOp::TestBit(ISFLOAT ? m_xmmSavedRegisterMask : m_rxxSavedRegisterMask,
+                              r.GetId());
+    }
+
+
     //*************************************************************************
     //
     // Template definitions for CallNodeBase<R, PARAMETERCOUNT>
@@ -353,6 +325,7 @@ namespace NativeJIT
     {
         static_assert(IsValidParameter<R>::c_value, "R is an invalid type.");
         tree.ReportFunctionCallNode(PARAMETERCOUNT);
+        this->MarkMayBumpRegisters();
     }
 
 
@@ -369,11 +342,22 @@ namespace NativeJIT
             child->Evaluate(tree);
         }
 
+        // Store the parameters passed on the stack first. Their registers are
+        // released right away, so they can't interfere with the registers
+        // reserved for the rest of the parameters.
+        for (Child* child : m_children)
+        {
+            if (child->IsPassedOnStack())
+            {
+                child->EmitStaging(tree, *this);
+            }
+        }
+
         for (Child* child : m_children)
         {
             // Stage the parameters first since they need to be placed into
             // fixed registers.
-            if (child != m_functionChild)
+            if (child != m_functionChild && !child->IsPassedOnStack())
             {
                 child->EmitStaging(tree, *this);
             }
@@ -394,6 +378,18 @@ namespace NativeJIT
 
         SaveVolatiles(tree);
         m_functionBase->EmitCall(tree);
+
+        // If the result register holds a parameter which is also referenced
+        // elsewhere, it was saved and restoring it would overwrite the result.
+        // Move the result to another register first.
+        ExpressionTree::Storage<R> result;
+
+        if (IsSaved(resultRegister))
+        {
+            result = tree.Direct<R>();
+            tree.GetCodeGenerator().Emit<OpCode::Mov>(result.GetDirectRegister(), resultRegister);
+        }
+
         RestoreVolatiles(tree);
 
         // Free up registers used for function pointer and parameters.
@@ -405,7 +401,64 @@ namespace NativeJIT
         // At this point, the result register was either used by a parameter or
         // the function pointer and then released, or it was empty after the
         // explicit bump further above so the following call will bump nothing.
-        return tree.Direct<R>(resultRegister);
+        return result.IsNull() ? tree.Direct<R>(resultRegister) : result;
+    }
+
+
+    template <typename R, unsigned PARAMETERCOUNT>
+    bool CallNodeBase<R, PARAMETERCOUNT>::CompileAsTailCall(ExpressionTree& tree)
+    {
+        // The frame is released before the jump, so the called function must
+        // not be able to reference anything in it.
+        if (tree.HasStackVariables())
+        {
+            return false;
+        }
+
+        for (Child* child : m_children)
+        {
+            if (child->IsPassedOnStack())
+            {
+                return false;
+            }
+        }
+
+        this->MarkEvaluated();
+        tree.BeginNodeCodeGen(*this);
+
+        for (Child* child : m_children)
+        {
+            child->Evaluate(tree);
+        }
+
+        for (Child* child : m_children)
+        {
+            if (child != m_functionChild)
+            {
+                child->EmitStaging(tree, *this);
+            }
+        }
+
+        // There is no need to preserve the volatiles since nothing in this
+        // function executes after the call.
+        m_functionBase->EmitTailCallStaging(tree);
+        m_functionBase->EmitTailJump(tree);
+
+        for (Child* child : m_children)
+        {
+            child->Release();
+        }
+
+        tree.EndNodeCodeGen();
+
+        return true;
+    }
+
+
+    template <typename R, unsigned PARAMETERCOUNT>
+    Register<8, false> CallNodeBase<R, PARAMETERCOUNT>::GetTailJumpRegister()
+    {
+        return r11;
     }
 
 
@@ -430,10 +483,11 @@ namespace NativeJIT
     //*************************************************************************
     template <typename R, unsigned PARAMETERCOUNT>
     template <typename T>
-    CallNodeBase<R, PARAMETERCOUNT>::TypedChild<T>::TypedChild(Node<T>& expression)
+    CallNodeBase<R, PARAMETERCOUNT>::TypedChild<T>::TypedChild(ExpressionTree& tree,
+                                                                   Node<T>& expression)
         : m_expression(expression)
     {
-        m_expression.IncrementParentCount();
+        m_expression.IncrementParentCount(tree);
     }
 
 
@@ -469,10 +523,12 @@ namespace NativeJIT
     template <typename R, unsigned PARAMETERCOUNT>
     template <typename F>
     CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::FunctionChild(
+        ExpressionTree& tree,
         Node<F>& expression,
         typename Storage<R>::DirectRegister resultRegister)
-        : TypedChild<F>(expression),
-          m_resultRegister(resultRegister)
+        : TypedChild<F>(tree, expression),
+          m_resultRegister(resultRegister),
+          m_directTarget(nullptr)
     {
     }
 
@@ -482,6 +538,16 @@ namespace NativeJIT
     void CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::Evaluate(ExpressionTree& tree)
     {
         this->m_storage = this->m_expression.CodeGen(tree);
+
+        void const * target = nullptr;
+
+        if (this->m_expression.GetConstantAddress(target)
+            && tree.GetCodeGenerator().IsInDirectBranchRange(target))
+        {
+            // The function pointer doesn't need to be loaded.
+            m_directTarget = target;
+            this->m_storage.Reset();
+        }
     }
 
 
@@ -490,6 +556,11 @@ namespace NativeJIT
     void CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::EmitStaging(ExpressionTree& /* tree */,
                                                                         SaveRestoreVolatilesHelper& volatiles)
     {
+        if (m_directTarget != nullptr)
+        {
+            return;
+        }
+
         auto & storage = this->m_storage;
 
         // The CALL instruction requires a direct register, ensure that's the case.
@@ -520,11 +591,71 @@ namespace NativeJIT
     }
 
 
+    template <typename R, unsigned PARAMETERCOUNT>
+    template <typename F>
+    bool CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::IsPassedOnStack() const
+    {
+        return false;
+    }
+
+
     template <typename R, unsigned PARAMETERCOUNT>
     template <typename F>
     void CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::EmitCall(ExpressionTree& tree)
     {
-        tree.GetCodeGenerator().Emit<OpCode::Call>(this->m_storage.GetDirectRegister());
+        if (m_directTarget != nullptr)
+        {
+            tree.GetCodeGenerator().Call(m_directTarget);
+        }
+        else
+        {
+            tree.GetCodeGenerator().Emit<OpCode::Call>(this->m_storage.GetDirectRegister());
+        }
+    }
+
+
+    template <typename R, unsigned PARAMETERCOUNT>
+    template <typename F>
+    void CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::EmitTailCallStaging(ExpressionTree& tree)
+    {
+        if (m_directTarget != nullptr)
+        {
+            return;
+        }
+
+        auto & storage = this->m_storage;
+        const auto jumpRegister = GetTailJumpRegister();
+
+        if (storage.GetStorageClass() != StorageClass::Direct
+            || !storage.GetDirectRegister().IsSameHardwareRegister(jumpRegister))
+        {
+            ExpressionTree::Storage<F> regStorage = tree.Direct<F>(jumpRegister);
+            CodeGenHelpers::Emit<OpCode::Mov>(tree.GetCodeGenerator(), jumpRegister, storage);
+            storage = regStorage;
+        }
+
+        this->PinStorageRegister();
+    }
+
+
+    template <typename R, unsigned PARAMETERCOUNT>
+    template <typename F>
+    void CallNodeBase<R, PARAMETERCOUNT>::FunctionChild<F>::EmitTailJump(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        code.ReserveTailCallEpilog();
+
+        if (m_directTarget != nullptr)
+        {
+            code.Jmp(m_directTarget);
+        }
+        else
+        {
+            code.Jmp(GetTailJumpRegister());
+        }
+
+        code.EndTailCallJump();
     }
 
 
@@ -544,10 +675,24 @@ namespace NativeJIT
     //*************************************************************************
     template <typename R, unsigned PARAMETERCOUNT>
     template <typename T>
-    CallNodeBase<R, PARAMETERCOUNT>::ParameterChild<T>::ParameterChild(Node<T>& expression, unsigned position)
-        : TypedChild<T>(expression)
+    CallNodeBase<R, PARAMETERCOUNT>::ParameterChild<T>::ParameterChild(ExpressionTree& tree,
+                                                                       Node<T>& expression,
+                                                                       ParameterSlotAllocator& slotAllocator)
+        : TypedChild<T>(tree, expression),
+          m_stackOffset(0)
     {
-        GetParameterRegister(position, m_destination);
+        slotAllocator.Allocate<T>();
+        m_isInRegister = slotAllocator.IsInRegister();
+
+        if (m_isInRegister)
+        {
+            GetParameterRegister(slotAllocator.GetLogicalRegister(), m_destination);
+        }
+        else
+        {
+            // The outgoing parameters are at the bottom of the stack frame.
+            m_stackOffset = static_cast<int32_t>(slotAllocator.GetStackSlot() * sizeof(void*));
+        }
     }
 
 
@@ -564,6 +709,23 @@ namespace NativeJIT
     void CallNodeBase<R, PARAMETERCOUNT>::ParameterChild<T>::EmitStaging(ExpressionTree& tree,
                                                                          SaveRestoreVolatilesHelper& volatiles)
     {
+        if (!m_isInRegister)
+        {
+            if (this->m_storage.GetStorageClass() != StorageClass::Direct)
+            {
+                this->m_storage.ConvertToDirect(false);
+            }
+
+            tree.GetCodeGenerator().Emit<OpCode::Mov>(rsp,
+                                                      m_stackOffset,
+                                                      this->m_storage.GetDirectRegister());
+
+            // The value is not needed in the register anymore.
+            this->m_storage.Reset();
+
+            return;
+        }
+
         if (this->m_storage.GetStorageClass() != StorageClass::Direct
             || !this->m_storage.GetDirectRegister().IsSameHardwareRegister(m_destination))
         {
@@ -587,6 +749,14 @@ namespace NativeJIT
     }
 
 
+    template <typename R, unsigned PARAMETERCOUNT>
+    template <typename T>
+    bool CallNodeBase<R, PARAMETERCOUNT>::ParameterChild<T>::IsPassedOnStack() const
+    {
+        return !m_isInRegister;
+    }
+
+
     template <typename R, unsigned PARAMETERCOUNT>
     template <typename T>
     void CallNodeBase<R, PARAMETERCOUNT>::ParameterChild<T>::Print(std::ostream& out) const
@@ -597,115 +767,32 @@ namespace NativeJIT
 
     //*************************************************************************
     //
-    // Template definitions for CallNode<R, P1, P2>
+    // Template definitions for CallNode<R, P...>
     //
     //*************************************************************************
-    template <typename R>
-    CallNode<R>::CallNode(ExpressionTree& tree,
-                          Node<FunctionPointer>& function)
-        : CallNodeBase<R, 0>(tree),
-          m_f(function, tree.GetResultRegister<R>())
+    template <typename R, typename... P>
+    CallNode<R, P...>::CallNode(ExpressionTree& tree,
+                                Node<FunctionPointer>& function,
+                                Node<P>&... parameters)
+        : CallNodeBase<R, sizeof...(P)>(tree),
+          m_f(tree, function, tree.GetResultRegister<R>())
     {
         static_assert(IsValidParameter<R>::c_value, "R is an invalid type.");
+        static_assert(AreValidParameters<P...>::c_value, "One of the parameters has an invalid type.");
 
-        this->m_functionBase = &m_f;
-        this->m_functionChild = &m_f;
-        this->m_children[0] = this->m_functionChild;
-    }
-
-
-    template <typename R, typename P1>
-    CallNode<R, P1>::CallNode(ExpressionTree& tree,
-                                  Node<FunctionPointer>& function,
-                                  Node<P1>& p1)
-        : CallNodeBase<R, 1>(tree),
-          m_f(function, tree.GetResultRegister<R>()),
-          m_p1(p1, 0)
-    {
-        static_assert(IsValidParameter<R>::c_value, "R is an invalid type.");
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-
-        this->m_functionBase = &m_f;
-        this->m_functionChild = &m_f;
-        this->m_children[0] = this->m_functionChild;
-        this->m_children[1] = &m_p1;
-    }
-
-
-    template <typename R, typename P1, typename P2>
-    CallNode<R, P1, P2>::CallNode(ExpressionTree& tree,
-                                  Node<FunctionPointer>& function,
-                                  Node<P1>& p1,
-                                  Node<P2>& p2)
-        : CallNodeBase<R, 2>(tree),
-          m_f(function, tree.GetResultRegister<R>()),
-          m_p1(p1, 0),
-          m_p2(p2, 1)
-    {
-        static_assert(IsValidParameter<R>::c_value, "R is an invalid type.");
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-        static_assert(IsValidParameter<P2>::c_value, "P2 is an invalid type.");
-
-        this->m_functionBase = &m_f;
-        this->m_functionChild = &m_f;
-        this->m_children[0] = this->m_functionChild;
-        this->m_children[1] = &m_p1;
-        this->m_children[2] = &m_p2;
-    }
-
-
-    template <typename R, typename P1, typename P2, typename P3>
-    CallNode<R, P1, P2, P3>::CallNode(ExpressionTree& tree,
-                                      Node<FunctionPointer>& function,
-                                      Node<P1>& p1,
-                                      Node<P2>& p2,
-                                      Node<P3>& p3)
-        : CallNodeBase<R, 3>(tree),
-          m_f(function, tree.GetResultRegister<R>()),
-          m_p1(p1, 0),
-          m_p2(p2, 1),
-          m_p3(p3, 2)
-    {
-        static_assert(IsValidParameter<R>::c_value, "R is an invalid type.");
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-        static_assert(IsValidParameter<P2>::c_value, "P2 is an invalid type.");
-        static_assert(IsValidParameter<P3>::c_value, "P3 is an invalid type.");
-
-        this->m_functionBase = &m_f;
-        this->m_functionChild = &m_f;
-        this->m_children[0] = this->m_functionChild;
-        this->m_children[1] = &m_p1;
-        this->m_children[2] = &m_p2;
-        this->m_children[3] = &m_p3;
-    }
+        typedef CallNodeBase<R, sizeof...(P)> Base;
 
+        // The elements of a braced initializer list are evaluated in order,
+        // so the parameter slots get allocated from left to right.
+        ParameterSlotAllocator slotAllocator;
+        typename Base::Child* children[] = {
+            &m_f,
+            &tree.template PlacementConstruct<typename Base::template ParameterChild<P>>(tree, parameters, slotAllocator)...
+        };
 
-    template <typename R, typename P1, typename P2, typename P3, typename P4>
-    CallNode<R, P1, P2, P3, P4>::CallNode(ExpressionTree& tree,
-                                          Node<FunctionPointer>& function,
-                                          Node<P1>& p1,
-                                          Node<P2>& p2,
-                                          Node<P3>& p3,
-                                          Node<P4>& p4)
-        : CallNodeBase<R, 4>(tree),
-          m_f(function, tree.GetResultRegister<R>()),
-          m_p1(p1, 0),
-          m_p2(p2, 1),
-          m_p3(p3, 2),
-          m_p4(p4, 3)
-    {
-        static_assert(IsValidParameter<R>::c_value, "R is an invalid type.");
-        static_assert(IsValidParameter<P1>::c_value, "P1 is an invalid type.");
-        static_assert(IsValidParameter<P2>::c_value, "P2 is an invalid type.");
-        static_assert(IsValidParameter<P3>::c_value, "P3 is an invalid type.");
-        static_assert(IsValidParameter<P4>::c_value, "P4 is an invalid type.");
+        std::copy(std::begin(children), std::end(children), this->m_children);
 
         this->m_functionBase = &m_f;
         this->m_functionChild = &m_f;
-        this->m_children[0] = this->m_functionChild;
-        this->m_children[1] = &m_p1;
-        this->m_children[2] = &m_p2;
-        this->m_children[3] = &m_p3;
-        this->m_children[4] = &m_p4;
     }
 }
@@ -245,7 +245,7 @@ namespace NativeJIT
         : Node<TO>(tree),
           m_from(from)
     {
-        m_from.IncrementParentCount();
+        m_from.IncrementParentCount(tree);
     }
 
 
@@ -282,7 +282,7 @@ namespace NativeJIT
                            ::CompositeCastNodeBuilder<Casting::Traits<TO, FROM>::c_castType>
                            ::template Build<TO, FROM>(tree, from))
     {
-        m_conversionNode.IncrementParentCount();
+        m_conversionNode.IncrementParentCount(tree);
     }
 
 
@@ -54,7 +54,8 @@ namespace NativeJIT
 
         // Increments the number of parents that use the node's CodeGenFlags()
         // method rather than the usual CodeGen() method.
-        void IncrementFlagsParentCount();
+        // See NodeBase::IncrementParentCount().
+        void IncrementFlagsParentCount(ExpressionTree& tree);
 
     protected:
         // WARNING: This class is designed to be allocated by an arena allocator,
@@ -161,10 +162,15 @@ namespace NativeJIT
 
 
     template <JccType JCC>
-    void FlagExpressionNode<JCC>::IncrementFlagsParentCount()
+    void FlagExpressionNode<JCC>::IncrementFlagsParentCount(ExpressionTree& tree)
     {
         ++m_flagsParentCount;
         MarkReferenced();
+
+        if (this->IsSequenced() || this->MayBumpRegisters())
+        {
+            tree.ReportChild(*this);
+        }
     }
 
 
@@ -183,11 +189,11 @@ namespace NativeJIT
           m_trueExpression(trueExpression),
           m_falseExpression(falseExpression)
     {
-        m_trueExpression.IncrementParentCount();
-        m_falseExpression.IncrementParentCount();
+        m_trueExpression.IncrementParentCount(tree);
+        m_falseExpression.IncrementParentCount(tree);
 
         // Use the CodeGenFlags()-related call.
-        m_condition.IncrementFlagsParentCount();
+        m_condition.IncrementFlagsParentCount(tree);
     }
 
 
@@ -324,8 +330,8 @@ namespace NativeJIT
           m_left(left),
           m_right(right)
     {
-        m_left.IncrementParentCount();
-        m_right.IncrementParentCount();
+        m_left.IncrementParentCount(tree);
+        m_right.IncrementParentCount(tree);
     }
 
 
@@ -73,7 +73,7 @@ namespace NativeJIT
           m_dependentNode(dependentNode),
           m_prerequisiteNode(prerequisiteNode)
     {
-        m_dependentNode.IncrementParentCount();
+        m_dependentNode.IncrementParentCount(tree);
         // Note: not increasing parent count on prerequisite node as DependentNode
         // is not using its value but only ensuring that it has been evaluated.
     }
@@ -0,0 +1,603 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    enum class DivisionResult { Quotient, Remainder };
+
+
+    // Divides two integers with div/idiv. The instructions divide rdx:rax by
+    // the operand and place the quotient into rax and the remainder into rdx,
+    // so both registers are taken over for the duration of the division.
+    //
+    // 8 and 16-bit types are not supported directly: ExpressionNodeFactory
+    // divides their 32-bit extensions instead.
+    template <typename T, DivisionResult RESULT>
+    class DivNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "DivNode requires a 32 or 64-bit integral type");
+
+        DivNode(ExpressionTree& tree, Node<T>& left, Node<T>& right);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~DivNode();
+
+        Node<T>& m_left;
+        Node<T>& m_right;
+    };
+
+
+    // Divides an integer by a constant without div/idiv. Powers of two are
+    // handled with shifts, the other divisors with a multiplication by their
+    // fixed point reciprocal (the "magic number") followed by a shift. The
+    // multiplier and the shift are computed as described in chapter 10 of
+    // Hacker's Delight by Henry S. Warren. Remainders are computed from the
+    // quotient as dividend - quotient * divisor.
+    template <typename T, DivisionResult RESULT>
+    class DivImmediateNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "DivImmediateNode requires a 32 or 64-bit integral type");
+
+        DivImmediateNode(ExpressionTree& tree, Node<T>& left, T right);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~DivImmediateNode();
+
+        typedef typename std::make_unsigned<T>::type U;
+        typedef typename Storage<T>::DirectRegister RegisterType;
+
+        static const unsigned c_bitCount = sizeof(T) * 8;
+
+        // Compute m_multiplier, m_shift and m_add for m_magnitude, which must
+        // not be a power of two.
+        void ComputeSignedMagic();
+        void ComputeUnsignedMagic();
+
+        // Generate the quotient into a newly allocated register.
+        Storage<T> CodeGenShift(ExpressionTree& tree, RegisterType dividend);
+        Storage<T> CodeGenMultiply(ExpressionTree& tree, RegisterType dividend);
+
+        // Replaces the quotient with the remainder.
+        void CodeGenRemainder(ExpressionTree& tree,
+                              RegisterType quotient,
+                              RegisterType dividend);
+
+        // Emits dest = dest OP value. Values which don't fit into a
+        // sign-extended 32-bit immediate are loaded into a scratch register.
+        template <OpCode OP>
+        static void EmitWithImmediate(ExpressionTree& tree, RegisterType dest, U value);
+
+        Node<T>& m_left;
+        const T m_right;
+
+        const bool m_isNegative;
+        const U m_magnitude;
+        bool m_isPowerOfTwo;
+
+        U m_multiplier;
+        uint8_t m_shift;
+
+        // For unsigned divisors whose multiplier doesn't fit into the type,
+        // the multiplier is reduced by 2^bitCount and the dividend is added
+        // back after the multiplication.
+        bool m_add;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for DivNode
+    //
+    //*************************************************************************
+    template <typename T, DivisionResult RESULT>
+    DivNode<T, RESULT>::DivNode(ExpressionTree& tree,
+                                Node<T>& left,
+                                Node<T>& right)
+        : Node<T>(tree),
+          m_left(left),
+          m_right(right)
+    {
+        // Division uses rax and rdx.
+        this->MarkMayBumpRegisters();
+
+        m_left.IncrementParentCount(tree);
+        m_right.IncrementParentCount(tree);
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    Storage<T> DivNode<T, RESULT>::CodeGenValue(ExpressionTree& tree)
+    {
+        typedef typename Storage<T>::DirectRegister RegisterType;
+
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<T> dividend;
+        Storage<T> divisor;
+
+        this->CodeGenInOrder(tree,
+                             m_left, dividend,
+                             m_right, divisor);
+
+        // Take over rax and rdx. Whatever else was in them, including the
+        // operands, gets moved elsewhere.
+        Storage<T> low = tree.Direct<T>(RegisterType(0));
+        ReferenceCounter lowPin = low.GetPin();
+        Storage<T> high = tree.Direct<T>(RegisterType(2));
+        ReferenceCounter highPin = high.GetPin();
+
+        const auto lowRegister = low.GetDirectRegister();
+        const auto highRegister = high.GetDirectRegister();
+
+        CodeGenHelpers::Emit<OpCode::Mov>(code, lowRegister, dividend);
+
+        if (std::is_signed<T>::value)
+        {
+            // Sign-extend rax into rdx.
+            code.Emit<OpCode::Mov>(highRegister, lowRegister);
+            code.EmitImmediate<OpCode::Sar>(highRegister,
+                                            static_cast<uint8_t>(sizeof(T) * 8 - 1));
+        }
+        else
+        {
+            code.Emit<OpCode::Xor>(highRegister, highRegister);
+        }
+
+        const OpCode op = std::is_signed<T>::value ? OpCode::IDiv : OpCode::Div;
+
+        if (divisor.GetStorageClass() == StorageClass::Indirect)
+        {
+            if (op == OpCode::IDiv)
+            {
+                code.Emit<OpCode::IDiv, sizeof(T)>(divisor.GetBaseRegister(), divisor.GetOffset());
+            }
+            else
+            {
+                code.Emit<OpCode::Div, sizeof(T)>(divisor.GetBaseRegister(), divisor.GetOffset());
+            }
+        }
+        else
+        {
+            const auto divisorRegister = divisor.ConvertToDirect(false);
+
+            if (op == OpCode::IDiv)
+            {
+                code.Emit<OpCode::IDiv>(divisorRegister);
+            }
+            else
+            {
+                code.Emit<OpCode::Div>(divisorRegister);
+            }
+        }
+
+        return RESULT == DivisionResult::Quotient ? low : high;
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    void DivNode<T, RESULT>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out,
+                                  RESULT == DivisionResult::Quotient ? "DivNode" : "ModNode");
+
+        out << ", left = " << m_left.GetId()
+            << ", right = " << m_right.GetId();
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for DivImmediateNode
+    //
+    //*************************************************************************
+    template <typename T, DivisionResult RESULT>
+    DivImmediateNode<T, RESULT>::DivImmediateNode(ExpressionTree& tree,
+                                                  Node<T>& left,
+                                                  T right)
+        : Node<T>(tree),
+          m_left(left),
+          m_right(right),
+          m_isNegative(std::is_signed<T>::value && static_cast<int64_t>(right) < 0),
+          m_magnitude(m_isNegative ? U(0) - static_cast<U>(right) : static_cast<U>(right)),
+          m_isPowerOfTwo(false),
+          m_multiplier(0),
+          m_shift(0),
+          m_add(false)
+    {
+        LogThrowAssert(right != 0, "Division by zero");
+
+        // The multiplication by the magic number uses rax and rdx.
+        this->MarkMayBumpRegisters();
+
+        m_left.IncrementParentCount(tree);
+        // m_right is not a Node, so no IncrementParentCount() call.
+
+        m_isPowerOfTwo = (m_magnitude & (m_magnitude - 1)) == 0;
+
+        if (m_isPowerOfTwo)
+        {
+            while ((U(1) << m_shift) != m_magnitude)
+            {
+                ++m_shift;
+            }
+        }
+        else if (std::is_signed<T>::value)
+        {
+            ComputeSignedMagic();
+        }
+        else
+        {
+            ComputeUnsignedMagic();
+        }
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    void DivImmediateNode<T, RESULT>::ComputeSignedMagic()
+    {
+        // See Hacker's Delight, figure 10-1.
+        const U signBit = U(1) << (c_bitCount - 1);
+        const U ad = m_magnitude;
+        const U t = signBit + (m_isNegative ? 1 : 0);
+        const U anc = t - 1 - t % ad;
+
+        unsigned p = c_bitCount - 1;
+        U q1 = signBit / anc;
+        U r1 = signBit - q1 * anc;
+        U q2 = signBit / ad;
+        U r2 = signBit - q2 * ad;
+        U delta;
+
+        do
+        {
+            ++p;
+
+            q1 = 2 * q1;
+            r1 = 2 * r1;
+            if (r1 >= anc)
+            {
+                ++q1;
+                r1 -= anc;
+            }
+
+            q2 = 2 * q2;
+            r2 = 2 * r2;
+            if (r2 >= ad)
+            {
+                ++q2;
+                r2 -= ad;
+            }
+
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+
+        m_multiplier = m_isNegative ? U(0) - (q2 + 1) : q2 + 1;
+        m_shift = static_cast<uint8_t>(p - c_bitCount);
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    void DivImmediateNode<T, RESULT>::ComputeUnsignedMagic()
+    {
+        // See Hacker's Delight, figure 10-2.
+        const U signBit = U(1) << (c_bitCount - 1);
+        const U d = m_magnitude;
+        const U nc = U(~U(0)) - (U(0) - d) % d;
+
+        unsigned p = c_bitCount - 1;
+        U q1 = signBit / nc;
+        U r1 = signBit - q1 * nc;
+        U q2 = (signBit - 1) / d;
+        U r2 = (signBit - 1) - q2 * d;
+        U delta;
+
+        do
+        {
+            ++p;
+
+            if (r1 >= nc - r1)
+            {
+                q1 = 2 * q1 + 1;
+                r1 = 2 * r1 - nc;
+            }
+            else
+            {
+                q1 = 2 * q1;
+                r1 = 2 * r1;
+            }
+
+            if (r2 + 1 >= d - r2)
+            {
+                if (q2 >= signBit - 1)
+                {
+                    m_add = true;
+                }
+                q2 = 2 * q2 + 1;
+                r2 = 2 * r2 + 1 - d;
+            }
+            else
+            {
+                if (q2 >= signBit)
+                {
+                    m_add = true;
+                }
+                q2 = 2 * q2;
+                r2 = 2 * r2 + 1;
+            }
+
+            delta = d - 1 - r2;
+        } while (p < 2 * c_bitCount
+                 && (q1 < delta || (q1 == delta && r1 == 0)));
+
+        m_multiplier = q2 + 1;
+        m_shift = static_cast<uint8_t>(p - c_bitCount);
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    Storage<T> DivImmediateNode<T, RESULT>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<T> dividend = m_left.CodeGen(tree);
+
+        if (m_isPowerOfTwo
+            && !std::is_signed<T>::value
+            && RESULT == DivisionResult::Remainder)
+        {
+            // The remainder is just the low bits.
+            dividend.ConvertToDirect(true);
+            ReferenceCounter pin = dividend.GetPin();
+            EmitWithImmediate<OpCode::And>(tree,
+                                           dividend.GetDirectRegister(),
+                                           m_magnitude - 1);
+            return dividend;
+        }
+
+        Storage<T> result;
+
+        if (m_isPowerOfTwo)
+        {
+            const auto dividendRegister = dividend.ConvertToDirect(false);
+            ReferenceCounter dividendPin = dividend.GetPin();
+
+            result = CodeGenShift(tree, dividendRegister);
+        }
+        else
+        {
+            // The multiplication needs rax and rdx, so they are obtained before
+            // the dividend is placed into a register.
+            Storage<T> low = tree.Direct<T>(RegisterType(0));
+            ReferenceCounter lowPin = low.GetPin();
+            Storage<T> high = tree.Direct<T>(RegisterType(2));
+            ReferenceCounter highPin = high.GetPin();
+
+            const auto dividendRegister = dividend.ConvertToDirect(false);
+            ReferenceCounter dividendPin = dividend.GetPin();
+
+            code.EmitImmediate<OpCode::Mov>(low.GetDirectRegister(), m_multiplier);
+
+            if (std::is_signed<T>::value)
+            {
+                // The high half of the signed product, corrected for the
+                // multiplier having been interpreted with the wrong sign.
+                code.Emit<OpCode::IMul>(dividendRegister);
+
+                const bool isMultiplierNegative = (m_multiplier & (U(1) << (c_bitCount - 1))) != 0;
+
+                if (!m_isNegative && isMultiplierNegative)
+                {
+                    code.Emit<OpCode::Add>(high.GetDirectRegister(), dividendRegister);
+                }
+                else if (m_isNegative && !isMultiplierNegative)
+                {
+                    code.Emit<OpCode::Sub>(high.GetDirectRegister(), dividendRegister);
+                }
+
+                if (m_shift > 0)
+                {
+                    code.EmitImmediate<OpCode::Sar>(high.GetDirectRegister(), m_shift);
+                }
+
+                // Round towards zero by adding one to negative quotients.
+                code.Emit<OpCode::Mov>(low.GetDirectRegister(), high.GetDirectRegister());
+                code.EmitImmediate<OpCode::Shr>(low.GetDirectRegister(),
+                                                static_cast<uint8_t>(c_bitCount - 1));
+                code.Emit<OpCode::Add>(high.GetDirectRegister(), low.GetDirectRegister());
+
+                result = high;
+            }
+            else
+            {
+                code.Emit<OpCode::Mul>(dividendRegister);
+
+                if (m_add)
+                {
+                    // quotient = (((dividend - high) >> 1) + high) >> (shift - 1)
+                    code.Emit<OpCode::Mov>(low.GetDirectRegister(), dividendRegister);
+                    code.Emit<OpCode::Sub>(low.GetDirectRegister(), high.GetDirectRegister());
+                    code.EmitImmediate<OpCode::Shr>(low.GetDirectRegister(), static_cast<uint8_t>(1));
+                    code.Emit<OpCode::Add>(low.GetDirectRegister(), high.GetDirectRegister());
+
+                    if (m_shift > 1)
+                    {
+                        code.EmitImmediate<OpCode::Shr>(low.GetDirectRegister(),
+                                                        static_cast<uint8_t>(m_shift - 1));
+                    }
+
+                    result = low;
+                }
+                else
+                {
+                    if (m_shift > 0)
+                    {
+                        code.EmitImmediate<OpCode::Shr>(high.GetDirectRegister(), m_shift);
+                    }
+
+                    result = high;
+                }
+            }
+
+            if (RESULT == DivisionResult::Remainder)
+            {
+                ReferenceCounter resultPin = result.GetPin();
+                CodeGenRemainder(tree, result.GetDirectRegister(), dividendRegister);
+            }
+
+            return result;
+        }
+
+        if (RESULT == DivisionResult::Remainder)
+        {
+            const auto dividendRegister = dividend.ConvertToDirect(false);
+            ReferenceCounter dividendPin = dividend.GetPin();
+            ReferenceCounter resultPin = result.GetPin();
+
+            CodeGenRemainder(tree, result.GetDirectRegister(), dividendRegister);
+        }
+
+        return result;
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    Storage<T> DivImmediateNode<T, RESULT>::CodeGenShift(ExpressionTree& tree,
+                                                         RegisterType dividend)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<T> result = tree.Direct<T>();
+        const auto resultRegister = result.GetDirectRegister();
+
+        code.Emit<OpCode::Mov>(resultRegister, dividend);
+
+        if (m_shift > 0)
+        {
+            if (std::is_signed<T>::value)
+            {
+                // Negative dividends are biased by divisor - 1 so that the
+                // arithmetic shift rounds towards zero.
+                if (m_shift > 1)
+                {
+                    code.EmitImmediate<OpCode::Sar>(resultRegister,
+                                                    static_cast<uint8_t>(m_shift - 1));
+                }
+                code.EmitImmediate<OpCode::Shr>(resultRegister,
+                                                static_cast<uint8_t>(c_bitCount - m_shift));
+                code.Emit<OpCode::Add>(resultRegister, dividend);
+                code.EmitImmediate<OpCode::Sar>(resultRegister, m_shift);
+            }
+            else
+            {
+                code.EmitImmediate<OpCode::Shr>(resultRegister, m_shift);
+            }
+        }
+
+        if (m_isNegative)
+        {
+            code.Emit<OpCode::Neg>(resultRegister);
+        }
+
+        return result;
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    void DivImmediateNode<T, RESULT>::CodeGenRemainder(ExpressionTree& tree,
+                                                       RegisterType quotient,
+                                                       RegisterType dividend)
+    {
+        // remainder = dividend + quotient * -divisor. The low half of the
+        // product is the same for signed and unsigned values.
+        EmitWithImmediate<OpCode::IMul>(tree, quotient, U(0) - static_cast<U>(m_right));
+        tree.GetCodeGenerator().Emit<OpCode::Add>(quotient, dividend);
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    template <OpCode OP>
+    void DivImmediateNode<T, RESULT>::EmitWithImmediate(ExpressionTree& tree,
+                                                        RegisterType dest,
+                                                        U value)
+    {
+        typedef typename std::make_signed<T>::type S;
+
+        auto & code = tree.GetCodeGenerator();
+        const int64_t extended = static_cast<S>(value);
+
+        if (extended >= INT32_MIN && extended <= INT32_MAX)
+        {
+            code.EmitImmediate<OP>(dest, static_cast<int32_t>(extended));
+        }
+        else
+        {
+            Storage<T> scratch = tree.Direct<T>();
+
+            code.EmitImmediate<OpCode::Mov>(scratch.GetDirectRegister(), value);
+            code.Emit<OP>(dest, scratch.GetDirectRegister());
+        }
+    }
+
+
+    template <typename T, DivisionResult RESULT>
+    void DivImmediateNode<T, RESULT>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out,
+                                  RESULT == DivisionResult::Quotient
+                                      ? "DivImmediateNode"
+                                      : "ModImmediateNode");
+
+        out << ", left = " << m_left.GetId()
+            << ", right = " << m_right;
+    }
+}
@@ -34,6 +34,11 @@ namespace NativeJIT
     public:
         FieldPointerNode(ExpressionTree& tree, Node<OBJECT*>& base, FIELD OBJECT::*field);
 
+        // Constructs the node from a raw byte offset rather than a pointer to
+        // member. Used when the field is known only by its offset, f. ex. when
+        // loading a serialized tree where OBJECT is an opaque type.
+        FieldPointerNode(ExpressionTree& tree, Node<OBJECT*>& base, int32_t offset);
+
         //
         // Overrides of Node methods
         //
@@ -52,6 +57,9 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~FieldPointerNode();
 
+        // Collapses the base/offset if possible and updates parent counts.
+        void Initialize(ExpressionTree& tree, Node<OBJECT*>& base);
+
         static int32_t Offset(FIELD OBJECT::*field)
         {
             return static_cast<int32_t>(reinterpret_cast<uint64_t>(&((static_cast<OBJECT*>(nullptr))->*field)));
@@ -86,6 +94,28 @@ namespace NativeJIT
           // Note: there is constructor order dependency for these two.
           m_collapsedBase(&m_base),
           m_collapsedOffset(m_originalOffset)
+    {
+        Initialize(tree, base);
+    }
+
+
+    template <typename OBJECT, typename FIELD>
+    FieldPointerNode<OBJECT, FIELD>::FieldPointerNode(ExpressionTree& tree,
+                                                      Node<OBJECT*>& base,
+                                                      int32_t offset)
+        : Node<FIELD*>(tree),
+          m_base(base),
+          m_originalOffset(offset),
+          // Note: there is constructor order dependency for these two.
+          m_collapsedBase(&m_base),
+          m_collapsedOffset(m_originalOffset)
+    {
+        Initialize(tree, base);
+    }
+
+
+    template <typename OBJECT, typename FIELD>
+    void FieldPointerNode<OBJECT, FIELD>::Initialize(ExpressionTree& tree, Node<OBJECT*>& base)
     {
         NodeBase* grandparent;
         int32_t parentOffset;
@@ -99,7 +129,7 @@ namespace NativeJIT
             base.MarkReferenced();
         }
 
-        m_collapsedBase->IncrementParentCount();
+        m_collapsedBase->IncrementParentCount(tree);
     }
 
 
@@ -0,0 +1,366 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/ImmediateNodeDecls.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // Rounding modes of the RoundSS/RoundSD instructions.
+    enum class RoundingMode : uint8_t
+    {
+        Nearest = 0,    // To the nearest integer, ties to even.
+        Down = 1,
+        Up = 2,
+        Truncate = 3
+    };
+
+
+    // Computes the square root with SqrtSS/SqrtSD.
+    template <typename T>
+    class SqrtNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_floating_point<T>::value, "SqrtNode requires a floating point type");
+
+        SqrtNode(ExpressionTree& tree, Node<T>& value);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~SqrtNode();
+
+        Node<T>& m_value;
+    };
+
+
+    // Clears the sign bit with AndPS/AndPD. The 16-byte mask is emitted into
+    // the constant pool, which aligns it for the packed memory operand.
+    template <typename T>
+    class AbsNode : public Node<T>,
+                    public RIPRelativeImmediate
+    {
+    public:
+        static_assert(std::is_floating_point<T>::value, "AbsNode requires a floating point type");
+
+        AbsNode(ExpressionTree& tree, Node<T>& value);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of RIPRelativeImmediate methods
+        //
+        virtual void EmitStaticData(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~AbsNode();
+
+        Node<T>& m_value;
+
+        // Offset of the mask in the constant pool, set by EmitStaticData().
+        int32_t m_maskOffset;
+    };
+
+
+    // Rounds to an integral value with RoundSS/RoundSD. Requires SSE4.1.
+    template <typename T>
+    class RoundNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_floating_point<T>::value, "RoundNode requires a floating point type");
+
+        RoundNode(ExpressionTree& tree, Node<T>& value, RoundingMode mode);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~RoundNode();
+
+        // Bit 3 of the immediate suppresses the precision exception.
+        static const uint8_t c_suppressPrecisionException = 0x8;
+
+        Node<T>& m_value;
+        const RoundingMode m_mode;
+    };
+
+
+    // Computes left * right + addend with a single rounding using the FMA3
+    // VFMAdd231SS/SD instruction. Requires FMA3 support, see
+    // ExpressionNodeFactory::MulAdd() for the fallback.
+    template <typename T>
+    class MulAddNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_floating_point<T>::value, "MulAddNode requires a floating point type");
+
+        MulAddNode(ExpressionTree& tree, Node<T>& left, Node<T>& right, Node<T>& addend);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~MulAddNode();
+
+        Node<T>& m_left;
+        Node<T>& m_right;
+        Node<T>& m_addend;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for SqrtNode
+    //
+    //*************************************************************************
+    template <typename T>
+    SqrtNode<T>::SqrtNode(ExpressionTree& tree, Node<T>& value)
+        : Node<T>(tree),
+          m_value(value)
+    {
+        m_value.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    Storage<T> SqrtNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<T> value = m_value.CodeGen(tree);
+
+        if (value.GetStorageClass() == StorageClass::Direct)
+        {
+            auto valueRegister = value.ConvertToDirect(true);
+            code.Emit<OpCode::Sqrt>(valueRegister, valueRegister);
+
+            return value;
+        }
+
+        // Read the operand directly from memory.
+        Storage<T> result = tree.Direct<T>();
+        CodeGenHelpers::Emit<OpCode::Sqrt>(code, result.GetDirectRegister(), value);
+
+        return result;
+    }
+
+
+    template <typename T>
+    void SqrtNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "SqrtNode");
+
+        out << ", value = " << m_value.GetId();
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for AbsNode
+    //
+    //*************************************************************************
+    template <typename T>
+    AbsNode<T>::AbsNode(ExpressionTree& tree, Node<T>& value)
+        : Node<T>(tree),
+          m_value(value),
+          m_maskOffset(0)
+    {
+        tree.AddRIPRelative(*this);
+        m_value.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    Storage<T> AbsNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        Storage<T> value = m_value.CodeGen(tree);
+        auto valueRegister = value.ConvertToDirect(true);
+
+        tree.GetCodeGenerator().Emit<OpCode::And>(valueRegister, rip, m_maskOffset);
+
+        return value;
+    }
+
+
+    template <typename T>
+    void AbsNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "AbsNode");
+
+        out << ", value = " << m_value.GetId();
+    }
+
+
+    template <typename T>
+    void AbsNode<T>::EmitStaticData(ExpressionTree& tree)
+    {
+        typedef typename std::conditional<sizeof(T) == 8, uint64_t, uint32_t>::type BitsType;
+
+        if (this->GetParentCount() == 0)
+        {
+            return;
+        }
+
+        // AndPS/AndPD read all 16 bytes, so the mask is repeated in each lane.
+        BitsType mask[16 / sizeof(BitsType)];
+        std::fill(std::begin(mask), std::end(mask), std::numeric_limits<BitsType>::max() >> 1);
+
+        m_maskOffset = tree.GetConstantPool().Add(mask,
+                                                  sizeof(mask),
+                                                  ConstantPool::GetNaturalAlignment(sizeof(mask)),
+                                                  false);
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for RoundNode
+    //
+    //*************************************************************************
+    template <typename T>
+    RoundNode<T>::RoundNode(ExpressionTree& tree, Node<T>& value, RoundingMode mode)
+        : Node<T>(tree),
+          m_value(value),
+          m_mode(mode)
+    {
+        LogThrowAssert(CpuFeatures::HasSSE41(), "RoundNode requires SSE4.1");
+
+        m_value.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    Storage<T> RoundNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        Storage<T> value = m_value.CodeGen(tree);
+        auto valueRegister = value.ConvertToDirect(true);
+
+        tree.GetCodeGenerator().EmitImmediate<OpCode::Round>(
+            valueRegister,
+            valueRegister,
+            static_cast<uint8_t>(static_cast<uint8_t>(m_mode) | c_suppressPrecisionException));
+
+        return value;
+    }
+
+
+    template <typename T>
+    void RoundNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "RoundNode");
+
+        out << ", value = " << m_value.GetId()
+            << ", mode = " << static_cast<unsigned>(m_mode);
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for MulAddNode
+    //
+    //*************************************************************************
+    template <typename T>
+    MulAddNode<T>::MulAddNode(ExpressionTree& tree,
+                              Node<T>& left,
+                              Node<T>& right,
+                              Node<T>& addend)
+        : Node<T>(tree),
+          m_left(left),
+          m_right(right),
+          m_addend(addend)
+    {
+        LogThrowAssert(CpuFeatures::HasFMA(), "MulAddNode requires FMA3");
+
+        m_left.IncrementParentCount(tree);
+        m_right.IncrementParentCount(tree);
+        m_addend.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    Storage<T> MulAddNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        Storage<T> left;
+        Storage<T> right;
+
+        this->CodeGenInOrder(tree,
+                             m_left, left,
+                             m_right, right);
+
+        Storage<T> addend = m_addend.CodeGen(tree);
+
+        // The result accumulates into the addend's register.
+        auto addendRegister = addend.ConvertToDirect(true);
+        ReferenceCounter addendPin = addend.GetPin();
+        auto leftRegister = left.ConvertToDirect(false);
+        ReferenceCounter leftPin = left.GetPin();
+        auto rightRegister = right.ConvertToDirect(false);
+
+        tree.GetCodeGenerator().Emit<OpCode::FMAdd>(addendRegister, leftRegister, rightRegister);
+
+        return addend;
+    }
+
+
+    template <typename T>
+    void MulAddNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "MulAddNode");
+
+        out << ", left = " << m_left.GetId()
+            << ", right = " << m_right.GetId()
+            << ", addend = " << m_addend.GetId();
+    }
+}
@@ -0,0 +1,342 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "NativeJIT/BitOperations.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // C++ equivalents of the hashes computed by the generated code. Used to
+    // build the tables probed by HashLookupNode.
+    namespace Hashing
+    {
+        // The reflected CRC-32C (Castagnoli) polynomial used by the CRC32
+        // instruction.
+        const uint32_t c_crc32Polynomial = 0x82f63b78;
+
+        // Multipliers of the MurmurHash3 64-bit finalizer.
+        const uint64_t c_mixMultiplier1 = 0xff51afd7ed558ccdull;
+        const uint64_t c_mixMultiplier2 = 0xc4ceb9fe1a85ec53ull;
+        const uint8_t c_mixShift = 33;
+
+        // Accumulates the sizeof(T) bytes of value into crc like the CRC32
+        // instruction, without the initial and final inversions of the
+        // CRC-32C standard.
+        template <typename T>
+        uint32_t Crc32(uint32_t crc, T value)
+        {
+            static_assert(std::is_integral<T>::value, "Crc32 requires an integral type");
+
+            const uint64_t bits = static_cast<uint64_t>(value);
+
+            for (unsigned i = 0; i < sizeof(T) * 8; ++i)
+            {
+                crc ^= (bits >> i) & 1;
+                crc = (crc & 1) != 0 ? (crc >> 1) ^ c_crc32Polynomial : crc >> 1;
+            }
+
+            return crc;
+        }
+
+
+        inline uint64_t MultiplyXorShift(uint64_t key)
+        {
+            key ^= key >> c_mixShift;
+            key *= c_mixMultiplier1;
+            key ^= key >> c_mixShift;
+            key *= c_mixMultiplier2;
+            key ^= key >> c_mixShift;
+
+            return key;
+        }
+    }
+
+
+    // Accumulates a value into a CRC-32C with the SSE4.2 CRC32 instruction.
+    template <typename T>
+    class Crc32Node : public Node<uint32_t>
+    {
+    public:
+        static_assert(std::is_integral<T>::value, "Crc32Node requires an integral type");
+
+        Crc32Node(ExpressionTree& tree, Node<uint32_t>& crc, Node<T>& value);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of Node<uint32_t> methods.
+        //
+        virtual ExpressionTree::Storage<uint32_t> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~Crc32Node();
+
+        // The instruction accumulates into the 64-bit register for a 64-bit
+        // value. The upper half of the result is zero in that case.
+        static const unsigned c_accumulatorSize = sizeof(T) == 8 ? 8 : 4;
+
+        Node<uint32_t>& m_crc;
+        Node<T>& m_value;
+    };
+
+
+    // Probes an open addressing hash table with linear probing. The table is
+    // an array of slotMask + 1 slots, where the number of slots is a power of
+    // two. The probe starts at the slot hash & slotMask and ends at the slot
+    // whose key field is equal to the key or to emptyKey. The node evaluates
+    // to the pointer to the matching slot or to nullptr if the key is not in
+    // the table. The table must have at least one empty slot.
+    template <typename SLOT, typename KEY>
+    class HashLookupNode : public Node<SLOT*>
+    {
+    public:
+        typedef typename std::remove_const<SLOT>::type SlotType;
+
+        HashLookupNode(ExpressionTree& tree,
+                       Node<SLOT*>& slots,
+                       Node<uint64_t>& slotMask,
+                       KEY SlotType::*keyField,
+                       KEY emptyKey,
+                       Node<KEY>& key,
+                       Node<uint64_t>& hash);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of Node<SLOT*> methods.
+        //
+        virtual ExpressionTree::Storage<SLOT*> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~HashLookupNode();
+
+        static int32_t Offset(KEY SlotType::*field)
+        {
+            return static_cast<int32_t>(reinterpret_cast<uint64_t>(&((static_cast<SlotType*>(nullptr))->*field)));
+        }
+
+        Node<SLOT*>& m_slots;
+        Node<uint64_t>& m_slotMask;
+        Node<KEY>& m_key;
+        Node<uint64_t>& m_hash;
+        const int32_t m_keyOffset;
+        const KEY m_emptyKey;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for Crc32Node
+    //
+    //*************************************************************************
+    template <typename T>
+    Crc32Node<T>::Crc32Node(ExpressionTree& tree, Node<uint32_t>& crc, Node<T>& value)
+        : Node<uint32_t>(tree),
+          m_crc(crc),
+          m_value(value)
+    {
+        LogThrowAssert(CpuFeatures::HasSSE42(), "Crc32Node requires SSE4.2");
+
+        m_crc.IncrementParentCount(tree);
+        m_value.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    void Crc32Node<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "Crc32Node");
+
+        out << ", crc = " << m_crc.GetId()
+            << ", value = " << m_value.GetId();
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<uint32_t> Crc32Node<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<uint32_t> crc;
+        Storage<T> value;
+
+        this->CodeGenInOrder(tree,
+                             m_crc, crc,
+                             m_value, value);
+
+        const Register<c_accumulatorSize, false> crcRegister(crc.ConvertToDirect(true));
+        ReferenceCounter crcPin = crc.GetPin();
+
+        if (value.GetStorageClass() == StorageClass::Indirect)
+        {
+            code.Emit<OpCode::Crc32, c_accumulatorSize, false, sizeof(T), false>(
+                crcRegister,
+                value.GetBaseRegister(),
+                value.GetOffset());
+        }
+        else
+        {
+            code.Emit<OpCode::Crc32>(crcRegister, value.ConvertToDirect(false));
+        }
+
+        return crc;
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for HashLookupNode
+    //
+    //*************************************************************************
+    template <typename SLOT, typename KEY>
+    HashLookupNode<SLOT, KEY>::HashLookupNode(ExpressionTree& tree,
+                                              Node<SLOT*>& slots,
+                                              Node<uint64_t>& slotMask,
+                                              KEY SlotType::*keyField,
+                                              KEY emptyKey,
+                                              Node<KEY>& key,
+                                              Node<uint64_t>& hash)
+        : Node<SLOT*>(tree),
+          m_slots(slots),
+          m_slotMask(slotMask),
+          m_key(key),
+          m_hash(hash),
+          m_keyOffset(Offset(keyField)),
+          m_emptyKey(emptyKey)
+    {
+        m_slots.IncrementParentCount(tree);
+        m_slotMask.IncrementParentCount(tree);
+        m_key.IncrementParentCount(tree);
+        m_hash.IncrementParentCount(tree);
+    }
+
+
+    template <typename SLOT, typename KEY>
+    void HashLookupNode<SLOT, KEY>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "HashLookupNode");
+
+        out << ", slots = " << m_slots.GetId()
+            << ", slotMask = " << m_slotMask.GetId()
+            << ", key = " << m_key.GetId()
+            << ", hash = " << m_hash.GetId()
+            << ", keyOffset = " << m_keyOffset;
+    }
+
+
+    template <typename SLOT, typename KEY>
+    typename ExpressionTree::Storage<SLOT*> HashLookupNode<SLOT, KEY>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        auto slots = m_slots.CodeGen(tree);
+        auto slotMask = m_slotMask.CodeGen(tree);
+        auto key = m_key.CodeGen(tree);
+        auto index = m_hash.CodeGen(tree);
+
+        // Each register is pinned as soon as it's known so that the
+        // registers allocated for the others don't spill it.
+        auto slotsRegister = slots.ConvertToDirect(false);
+        ReferenceCounter slotsPin = slots.GetPin();
+        auto slotMaskRegister = slotMask.ConvertToDirect(false);
+        ReferenceCounter slotMaskPin = slotMask.GetPin();
+        auto keyRegister = key.ConvertToDirect(false);
+        ReferenceCounter keyPin = key.GetPin();
+        auto indexRegister = index.ConvertToDirect(true);
+        ReferenceCounter indexPin = index.GetPin();
+
+        auto emptyKey = tree.Direct<KEY>();
+        ReferenceCounter emptyKeyPin = emptyKey.GetPin();
+        code.EmitImmediate<OpCode::Mov>(emptyKey.GetDirectRegister(), m_emptyKey);
+
+        auto result = tree.Direct<SLOT*>();
+        auto resultRegister = result.GetDirectRegister();
+
+        const Label probe = code.AllocateLabel();
+        const Label found = code.AllocateLabel();
+        const Label notFound = code.AllocateLabel();
+
+        code.Emit<OpCode::And>(indexRegister, slotMaskRegister);
+
+        code.PlaceLabel(probe);
+
+        // Address of the slot, with a shift instead of the multiplication
+        // for the slot sizes which are powers of two.
+        code.Emit<OpCode::Mov>(resultRegister, indexRegister);
+
+        unsigned slotShift;
+
+        if ((sizeof(SLOT) & (sizeof(SLOT) - 1)) == 0
+            && BitOp::GetLowestBitSet(sizeof(SLOT), &slotShift))
+        {
+            if (slotShift != 0)
+            {
+                code.EmitImmediate<OpCode::Shl>(resultRegister, static_cast<uint8_t>(slotShift));
+            }
+        }
+        else
+        {
+            code.EmitImmediate<OpCode::IMul>(resultRegister, static_cast<int32_t>(sizeof(SLOT)));
+        }
+
+        code.Emit<OpCode::Add>(resultRegister, slotsRegister);
+
+        code.Emit<OpCode::Cmp>(keyRegister, resultRegister, m_keyOffset);
+        code.EmitConditionalJump<JccType::JE>(found);
+        code.Emit<OpCode::Cmp>(emptyKey.GetDirectRegister(), resultRegister, m_keyOffset);
+        code.EmitConditionalJump<JccType::JE>(notFound);
+
+        code.EmitImmediate<OpCode::Add>(indexRegister, 1);
+        code.Emit<OpCode::And>(indexRegister, slotMaskRegister);
+        code.Jmp(probe);
+
+        code.PlaceLabel(notFound);
+        code.Emit<OpCode::Xor>(resultRegister, resultRegister);
+
+        code.PlaceLabel(found);
+
+        return result;
+    }
+}
@@ -44,6 +44,13 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    void ImmediateNode<T, ImmediateCategory::InlineImmediate>::ReleaseReferencesToChildren()
+    {
+        // No children to release.
+    }
+
+
     template <typename T>
     void ImmediateNode<T, ImmediateCategory::InlineImmediate>::Print(std::ostream& out) const
     {
@@ -80,6 +87,13 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    void ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::ReleaseReferencesToChildren()
+    {
+        // No children to release.
+    }
+
+
     template <typename T>
     void ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::Print(std::ostream& out) const
     {
@@ -97,17 +111,53 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    bool ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::GetConstantAddress(void const *& address) const
+    {
+        return GetConstantAddress(address, typename std::is_pointer<T>::type());
+    }
+
+
+    template <typename T>
+    bool ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::GetConstantAddress(void const *& address,
+                                                                                       std::true_type) const
+    {
+        // Go through an integer since function pointers can't be cast to
+        // object pointers directly.
+        address = reinterpret_cast<void const *>(reinterpret_cast<uintptr_t>(m_value));
+
+        return true;
+    }
+
+
+    template <typename T>
+    bool ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::GetConstantAddress(void const *& /* address */,
+                                                                                       std::false_type) const
+    {
+        return false;
+    }
+
+
     template <typename T>
     void ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::EmitStaticData(ExpressionTree& tree)
     {
-        auto & code = tree.GetCodeGenerator();
-        code.AdvanceToAlignment<T>();
-        m_offset = code.CurrentPosition();
+        // Nodes without parents (f. ex. functions of expanded intrinsic calls)
+        // are never evaluated.
+        if (this->GetParentCount() == 0)
+        {
+            return;
+        }
 
         // Emit the value using a canonical type since the EmitValueBytes
         // method intentionally has a limited number of input types. Basic
         // types will be unchanged, but f. ex. function pointers will be
         // emitted as uint64_t.
-        code.EmitBytes(ForcedCast<typename CanonicalRegisterStorageType<T>::Type>(m_value));
+        //
+        // Pointers, including function pointers used by CallNode and Model
+        // pointers, are absolute addresses which must be patched if the code
+        // is loaded into a different process.
+        m_offset = tree.GetConstantPool().Add(
+            ForcedCast<typename CanonicalRegisterStorageType<T>::Type>(m_value),
+            std::is_pointer<T>::value);
     }
 }
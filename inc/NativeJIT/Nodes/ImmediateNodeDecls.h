@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include <type_traits>                  // std::true_type used in declarations.
+
 #include "NativeJIT/Nodes/Node.h"
 #include "NativeJIT/TypePredicates.h"
 
@@ -47,6 +49,7 @@ namespace NativeJIT
         //
         // Overrides of Node methods
         //
+        virtual void ReleaseReferencesToChildren() override;
         virtual void Print(std::ostream& out) const override;
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
 
@@ -84,9 +87,17 @@ namespace NativeJIT
         //
         // Overrides of Node methods
         //
+        virtual void ReleaseReferencesToChildren() override;
         virtual void Print(std::ostream& out) const override;
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
 
+        //
+        // Overrides of NodeBase methods
+        //
+
+        // Returns true and the value for pointer types.
+        virtual bool GetConstantAddress(void const *& address) const override;
+
 
         //
         // Overrides of RIPRelativeImmediate methods
@@ -99,6 +110,10 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~ImmediateNode();
 
+        // Helpers for GetConstantAddress(), selected by whether T is a pointer.
+        bool GetConstantAddress(void const *& address, std::true_type) const;
+        bool GetConstantAddress(void const *& address, std::false_type) const;
+
         T m_value;
         int32_t m_offset;
     };
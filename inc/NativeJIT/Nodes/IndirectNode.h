@@ -93,7 +93,7 @@ namespace NativeJIT
             base.MarkReferenced();
         }
 
-        m_collapsedBase->IncrementParentCount();
+        m_collapsedBase->IncrementParentCount(tree);
     }
 
 
@@ -0,0 +1,269 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#pragma once
+
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    // A mutable variable local to the function being compiled. Its value is
+    // set by AssignNodes and read by LoadNodes, which take effect in the order
+    // in which their parents evaluate them. Use SequenceNode to order
+    // assignments relative to the rest of the expression.
+    //
+    // Each assignment leaves the value in a register owned by the variable,
+    // so subsequent loads share the register instead of reading the value back
+    // from the stack. The register is only spilled under register pressure,
+    // like any other value, and is released after the last load or assignment
+    // has been evaluated.
+    //
+    // A LoadNode is evaluated once: if it has several parents, all of them
+    // observe the value the variable had when the first of them evaluated it.
+    // Assignments to a variable can't be made from inside the body of a loop
+    // that doesn't also contain the variable, and a variable assigned in code
+    // which may be skipped at runtime (e.g. the right side of LogicalAnd/Or)
+    // can't be read after that code. See ExpressionTree::BeginConditionalCode().
+    template <typename T>
+    class LocalVariable : public NonCopyable
+    {
+    public:
+        LocalVariable(ExpressionTree& tree);
+
+        // Called by the constructors of AssignNodes and LoadNodes.
+        void AddUse();
+
+        unsigned GetLoopDepth() const;
+
+        // Makes the value the current contents of the variable and returns it.
+        Storage<T> Assign(ExpressionTree& tree, Storage<T> value);
+
+        // Returns the current contents of the variable.
+        Storage<T> Load(ExpressionTree& tree);
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~LocalVariable();
+
+        // Releases the storage once all users have been evaluated.
+        void ReleaseUse();
+
+        const unsigned m_loopDepth;
+        unsigned m_remainingUseCount;
+        Storage<T> m_storage;
+
+        // The region of conditional code in which the variable was last
+        // assigned, see ExpressionTree::GetConditionalCodeRegion().
+        unsigned m_region;
+    };
+
+
+    template <typename T>
+    class AssignNode : public Node<T>
+    {
+    public:
+        AssignNode(ExpressionTree& tree,
+                   LocalVariable<T>& variable,
+                   Node<T>& value);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~AssignNode();
+
+        LocalVariable<T>& m_variable;
+        Node<T>& m_value;
+    };
+
+
+    template <typename T>
+    class LoadNode : public Node<T>
+    {
+    public:
+        LoadNode(ExpressionTree& tree, LocalVariable<T>& variable);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~LoadNode();
+
+        LocalVariable<T>& m_variable;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for LocalVariable
+    //
+    //*************************************************************************
+    template <typename T>
+    LocalVariable<T>::LocalVariable(ExpressionTree& tree)
+        : m_loopDepth(tree.GetLoopDepth()),
+          m_remainingUseCount(0),
+          m_region(0)
+    {
+        tree.ReportLocalVariable();
+    }
+
+
+    template <typename T>
+    void LocalVariable<T>::AddUse()
+    {
+        ++m_remainingUseCount;
+    }
+
+
+    template <typename T>
+    unsigned LocalVariable<T>::GetLoopDepth() const
+    {
+        return m_loopDepth;
+    }
+
+
+    template <typename T>
+    Storage<T> LocalVariable<T>::Assign(ExpressionTree& tree, Storage<T> value)
+    {
+        // Outstanding loads keep sharing the previous register (or get a copy
+        // of the value if it was shared), the variable takes over a register
+        // nobody else refers to.
+        value.ConvertToDirect(true);
+        m_storage = value;
+        m_region = tree.GetConditionalCodeRegion();
+
+        ReleaseUse();
+
+        return value;
+    }
+
+
+    template <typename T>
+    Storage<T> LocalVariable<T>::Load(ExpressionTree& tree)
+    {
+        LogThrowAssert(!m_storage.IsNull(), "Local variable was read before it was assigned");
+        LogThrowAssert(tree.IsInConditionalCodeRegion(m_region),
+                       "Local variable was read after the conditional code which assigned it");
+
+        auto result = m_storage;
+        ReleaseUse();
+
+        return result;
+    }
+
+
+    template <typename T>
+    void LocalVariable<T>::ReleaseUse()
+    {
+        LogThrowAssert(m_remainingUseCount > 0, "Unexpected use of a local variable");
+
+        if (--m_remainingUseCount == 0)
+        {
+            m_storage.Reset();
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for AssignNode
+    //
+    //*************************************************************************
+    template <typename T>
+    AssignNode<T>::AssignNode(ExpressionTree& tree,
+                              LocalVariable<T>& variable,
+                              Node<T>& value)
+        : Node<T>(tree),
+          m_variable(variable),
+          m_value(value)
+    {
+        LogThrowAssert(tree.GetLoopDepth() == variable.GetLoopDepth(),
+                       "Local variable must be assigned in the loop body it was created in");
+
+        this->MarkSequenced();
+        m_variable.AddUse();
+        m_value.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    Storage<T> AssignNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        return m_variable.Assign(tree, m_value.CodeGen(tree));
+    }
+
+
+    template <typename T>
+    void AssignNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "AssignNode");
+
+        out << ", value = " << m_value.GetId();
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for LoadNode
+    //
+    //*************************************************************************
+    template <typename T>
+    LoadNode<T>::LoadNode(ExpressionTree& tree, LocalVariable<T>& variable)
+        : Node<T>(tree),
+          m_variable(variable)
+    {
+        this->MarkSequenced();
+        m_variable.AddUse();
+    }
+
+
+    template <typename T>
+    Storage<T> LoadNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        return m_variable.Load(tree);
+    }
+
+
+    template <typename T>
+    void LoadNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "LoadNode");
+    }
+}
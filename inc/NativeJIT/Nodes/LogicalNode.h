@@ -0,0 +1,234 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#pragma once
+
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/ConditionalNode.h"
+
+
+namespace NativeJIT
+{
+    enum class LogicalOperator { And, Or };
+
+
+    // The condition code of a LogicalNode. When both conditions use the same
+    // one, the node produces the flags for it directly, otherwise it tests the
+    // bool it materializes.
+    template <JccType LEFTJCC, JccType RIGHTJCC>
+    struct LogicalJcc
+    {
+        static const JccType c_value = LEFTJCC == RIGHTJCC ? LEFTJCC : JccType::JNZ;
+    };
+
+
+    // Combines two conditions with short-circuit evaluation: the right
+    // condition is evaluated at runtime only if the left one doesn't decide
+    // the result on its own.
+    //
+    // When the node is used as a condition and both conditions use the same
+    // condition code, the code is a chain of jumps which ends with the flags
+    // of whichever condition decided the result, so no register is needed.
+    // Otherwise, and when the value is needed, the result is materialized as
+    // a bool and the flags correspond to JccType::JNZ.
+    //
+    // The code of the right condition may be skipped, so it must not move the
+    // registers which are live before it. If the right condition may bump
+    // registers (see NodeBase::MayBumpRegisters()) or few registers are free,
+    // the live registers are spilled beforehand. Otherwise they stay in place
+    // and the code generation throws if the right condition moves one.
+    //
+    // Nodes used by the right condition which also have parents outside of it
+    // need to be evaluated before the LogicalNode. Pass2 does that for common
+    // subexpressions outside of loop bodies, except for the ones which read or
+    // assign a local variable: the code generation throws if such node is
+    // first evaluated by the right condition. Local variables assigned by the
+    // right condition can't be read after it.
+    template <LogicalOperator OP, JccType LEFTJCC, JccType RIGHTJCC>
+    class LogicalNode : public FlagExpressionNode<LogicalJcc<LEFTJCC, RIGHTJCC>::c_value>
+    {
+    public:
+        LogicalNode(ExpressionTree& tree,
+                    FlagExpressionNode<LEFTJCC>& left,
+                    FlagExpressionNode<RIGHTJCC>& right);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of Node<T> methods.
+        //
+        virtual ExpressionTree::Storage<bool> CodeGenValue(ExpressionTree& tree) override;
+
+        //
+        // Overrides of FlagExpression methods.
+        //
+        virtual void CodeGenFlags(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~LogicalNode();
+
+        static constexpr JccType Negate(JccType jcc)
+        {
+            // Jcc condition codes come in pairs which differ in the lowest bit.
+            return static_cast<JccType>(static_cast<unsigned>(jcc) ^ 1);
+        }
+
+        static constexpr bool c_isAnd = OP == LogicalOperator::And;
+
+        // The conditions under which the left and the right condition
+        // determine the result of the operator: false for And, true for Or.
+        static constexpr JccType c_leftDecides = c_isAnd ? Negate(LEFTJCC) : LEFTJCC;
+        static constexpr JccType c_rightDecides = c_isAnd ? Negate(RIGHTJCC) : RIGHTJCC;
+
+        // The number of free registers of each kind below which the live
+        // registers are spilled even if the right condition is not expected
+        // to bump any.
+        static const unsigned c_minFreeRegisters = 4;
+
+        // Generates the left condition and the jump to resultKnown if it
+        // decides the result, then begins the conditional code for the right
+        // condition. The caller ends it.
+        void CodeGenLeft(ExpressionTree& tree, Label resultKnown);
+
+        FlagExpressionNode<LEFTJCC>& m_left;
+        FlagExpressionNode<RIGHTJCC>& m_right;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for LogicalNode
+    //
+    //*************************************************************************
+    template <LogicalOperator OP, JccType LEFTJCC, JccType RIGHTJCC>
+    LogicalNode<OP, LEFTJCC, RIGHTJCC>::LogicalNode(ExpressionTree& tree,
+                                                    FlagExpressionNode<LEFTJCC>& left,
+                                                    FlagExpressionNode<RIGHTJCC>& right)
+        : FlagExpressionNode<LogicalJcc<LEFTJCC, RIGHTJCC>::c_value>(tree),
+          m_left(left),
+          m_right(right)
+    {
+        // Use the CodeGenFlags()-related call.
+        m_left.IncrementFlagsParentCount(tree);
+        m_right.IncrementFlagsParentCount(tree);
+    }
+
+
+    template <LogicalOperator OP, JccType LEFTJCC, JccType RIGHTJCC>
+    void LogicalNode<OP, LEFTJCC, RIGHTJCC>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, c_isAnd ? "LogicalAnd" : "LogicalOr");
+
+        out << ", left = " << m_left.GetId();
+        out << ", right = " << m_right.GetId();
+    }
+
+
+    template <LogicalOperator OP, JccType LEFTJCC, JccType RIGHTJCC>
+    typename ExpressionTree::Storage<bool>
+    LogicalNode<OP, LEFTJCC, RIGHTJCC>::CodeGenValue(ExpressionTree& tree)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+        Label resultKnown = code.AllocateLabel();
+
+        // Start with the result the left condition decides. Neither the
+        // allocation nor the MOV of the immediate affect the flags of the
+        // left condition, which are only generated afterwards.
+        auto result = tree.Direct<bool>();
+        ReferenceCounter resultPin = result.GetPin();
+        code.EmitImmediate<OpCode::Mov>(result.GetDirectRegister(), !c_isAnd);
+
+        CodeGenLeft(tree, resultKnown);
+
+        m_right.CodeGenFlags(tree);
+        code.EmitConditionalJump<c_rightDecides>(resultKnown);
+        code.EmitImmediate<OpCode::Mov>(result.GetDirectRegister(), c_isAnd);
+
+        tree.EndConditionalCode();
+
+        code.PlaceLabel(resultKnown);
+
+        return result;
+    }
+
+
+    template <LogicalOperator OP, JccType LEFTJCC, JccType RIGHTJCC>
+    void LogicalNode<OP, LEFTJCC, RIGHTJCC>::CodeGenFlags(ExpressionTree& tree)
+    {
+        if (LEFTJCC != RIGHTJCC)
+        {
+            auto result = CodeGenValue(tree);
+            const auto resultRegister = result.GetDirectRegister();
+
+            // Sets ZF if and only if the result is false.
+            tree.GetCodeGenerator().Emit<OpCode::Or>(resultRegister, resultRegister);
+            return;
+        }
+
+        // The flags of the left condition reach resultKnown only when they
+        // decide the result and then tell it through LEFTJCC. Otherwise, the
+        // flags of the right condition, which use the same condition code,
+        // tell the result.
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+        Label resultKnown = code.AllocateLabel();
+
+        CodeGenLeft(tree, resultKnown);
+        m_right.CodeGenFlags(tree);
+        tree.EndConditionalCode();
+
+        code.PlaceLabel(resultKnown);
+    }
+
+
+    template <LogicalOperator OP, JccType LEFTJCC, JccType RIGHTJCC>
+    void LogicalNode<OP, LEFTJCC, RIGHTJCC>::CodeGenLeft(ExpressionTree& tree,
+                                                         Label resultKnown)
+    {
+        m_left.CodeGenFlags(tree);
+
+        // Spilling doesn't affect the flags. Inside conditional code which
+        // must leave the registers in place, the registers can't be spilled
+        // either, but then the right condition of the enclosing LogicalNode
+        // doesn't bump registers.
+        const bool spill = tree.CanBumpRegisters()
+                           && (m_right.MayBumpRegisters()
+                               || !tree.HasFreeRegisters(c_minFreeRegisters));
+
+        if (spill)
+        {
+            tree.SpillAllRegisters();
+        }
+
+        tree.GetCodeGenerator().EmitConditionalJump<c_leftDecides>(resultKnown);
+
+        tree.BeginConditionalCode(spill);
+    }
+}
@@ -57,17 +57,39 @@ namespace NativeJIT
         // only once, but the result will also be stored in cache with a
         // matching number of references. The cache will be released once all
         // parents evaluate the node.
+        // Must be called from the constructor of the parent, i.e. the node
+        // most recently added to the tree (see ExpressionTree::ReportChild()).
         // IMPORTANT: Currently, there's an assumption that if a node is created,
         // it must be placed inside the tree. Remove this assumption and
         // allow for optimizing away unused nodes. See bug#29.
-        void IncrementParentCount();
+        void IncrementParentCount(ExpressionTree& tree);
 
         // Decrements the number of node's parents as set through
         // IncrementParentCount(). Used only when nodes are optimized away.
         void DecrementParentCount();
 
+        // Once the node has been evaluated, returns the number of parents
+        // which have yet to take its value from the cache.
         unsigned GetParentCount() const;
 
+        // Returns whether the node belongs to the body of a loop. See
+        // ExpressionTree::BeginLoopBody().
+        bool IsInLoopBody() const;
+
+        // Returns whether the node reads or assigns a local variable, either
+        // itself or through its children. Such nodes are evaluated when their
+        // parents first need them rather than ahead of them as common
+        // subexpressions. See ExpressionTree::ReportChild().
+        bool IsSequenced() const;
+        void MarkSequenced();
+
+        // Returns whether evaluating the node may move the values held in
+        // registers by other nodes, either because the node itself or one of
+        // its children needs specific registers, calls functions, spills the
+        // registers or needs several registers for itself.
+        bool MayBumpRegisters() const;
+        void MarkMayBumpRegisters();
+
         // Returns whether the node has been evaluated through the Node<T>::CodeGen
         // method.
         bool HasBeenEvaluated() const;
@@ -109,6 +131,17 @@ namespace NativeJIT
         // ReleaseReferencesToChildren().
         virtual bool GetBaseAndOffset(NodeBase*& base, int32_t& offset) const;
 
+        // For nodes whose value is an address known at tree construction time,
+        // populates the address out parameter and returns true. Otherwise
+        // returns false (default implementation). Used to call functions
+        // directly rather than through a register.
+        virtual bool GetConstantAddress(void const *& address) const;
+
+        // Compiles the node as the root's child when its value is returned
+        // directly by the function and returns true. Returns false (default
+        // implementation) when the node has no special handling for such case.
+        virtual bool CompileAsTailCall(ExpressionTree& tree);
+
         //
         // Pure virtual methods.
         //
@@ -143,13 +176,27 @@ namespace NativeJIT
                                    Node<T1>& n1, Storage<T1>& s1,
                                    Node<T2>& n2, Storage<T2>& s2);
 
+        // Called by Node<T> when a parent takes the cached value of the
+        // evaluated node. Returns the number of parents which have yet to
+        // take it.
+        unsigned ReleaseCacheReference();
+
     private:
+        static const unsigned c_maxParentCount = (1u << 27) - 1;
+
         unsigned m_id;
 
-        // See the comments for the related accessor methods above for more information.
-        unsigned m_parentCount;
-        bool m_isReferenced;
-        bool m_hasBeenEvaluated;
+        // See the comments for the related accessor methods above for more
+        // information. The parent count shares a word with the flags so that,
+        // together with the vtable pointer, NodeBase occupies 16 bytes and
+        // Node<T> 24 bytes. After the evaluation, the parent count doubles as
+        // the reference count of the cached value.
+        unsigned m_parentCount : 27;
+        unsigned m_isInLoopBody : 1;
+        unsigned m_isReferenced : 1;
+        unsigned m_hasBeenEvaluated : 1;
+        unsigned m_isSequenced : 1;
+        unsigned m_mayBumpRegisters : 1;
     };
 
 
@@ -183,7 +230,6 @@ namespace NativeJIT
         void PrintCoreProperties(std::ostream& out, char const *nodeName) const;
 
     private:
-        unsigned m_cacheReferenceCount;
         ExpressionTree::Storage<T> m_cache;
 
         virtual Storage<T> CodeGenValue(ExpressionTree& tree) = 0;
@@ -217,8 +263,7 @@ namespace NativeJIT
 
     template <typename T>
     Node<T>::Node(ExpressionTree& tree)
-        : NodeBase(tree),
-          m_cacheReferenceCount(0)
+        : NodeBase(tree)
     {
     }
 
@@ -229,7 +274,6 @@ namespace NativeJIT
         LogThrowAssert(!IsCached(), "Cache is already set for node with ID %u", GetId());
         LogThrowAssert(GetParentCount() > 0, "Cannot set cache for node %u with zero parents", GetId());
 
-        m_cacheReferenceCount = GetParentCount();
         m_cache = s;
     }
 
@@ -240,9 +284,8 @@ namespace NativeJIT
         LogThrowAssert(IsCached(), "Cache has not been set for node ID %u", GetId());
 
         auto result = m_cache;
-        --m_cacheReferenceCount;
 
-        if (m_cacheReferenceCount == 0)
+        if (ReleaseCacheReference() == 0)
         {
             m_cache.Reset();
         }
@@ -254,13 +297,13 @@ namespace NativeJIT
     template <typename T>
     bool Node<T>::IsCached() const
     {
-        // If cache is present, reference count cannot be zero. Similarly, when
-        // the cache is empty, reference count must be zero.
-        LogThrowAssert(m_cache.IsNull() == (m_cacheReferenceCount == 0),
+        // If cache is present, the node must have been evaluated and some of
+        // its parents must still be waiting for the value.
+        LogThrowAssert(m_cache.IsNull() || (HasBeenEvaluated() && GetParentCount() > 0),
                        "Mismatch in cached storage and cache reference count: "
-                       "have cache %u, reference count: %u",
-                       m_cache.IsNull(),
-                       m_cacheReferenceCount);
+                       "evaluated %u, reference count: %u",
+                       HasBeenEvaluated(),
+                       GetParentCount());
 
         return !m_cache.IsNull();
     }
@@ -299,7 +342,14 @@ namespace NativeJIT
                        GetId());
         MarkEvaluated();
 
+        tree.BeginNodeCodeGen(*this);
         SetCache(CodeGenValue(tree));
+        tree.EndNodeCodeGen();
+
+        if (IsCached() && tree.IsInConditionalCode())
+        {
+            tree.ReportConditionalCache(*this);
+        }
     }
 
 
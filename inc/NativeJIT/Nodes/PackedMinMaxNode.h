@@ -90,8 +90,8 @@ namespace NativeJIT
           m_right(right)
     {
         static_assert(std::is_pod<PACKED>::value, "PACKED must be a POD type.");
-        left.IncrementParentCount();
-        right.IncrementParentCount();
+        left.IncrementParentCount(tree);
+        right.IncrementParentCount(tree);
     }
 
 
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include "NativeJIT/CodeGen/CallingConvention.h"
 #include "NativeJIT/ExpressionTree.h"
 #include "NativeJIT/Nodes/Node.h"
 #include "Temporary/Assert.h"
@@ -60,6 +61,11 @@ namespace NativeJIT
 
         unsigned m_position;
         unsigned m_logicalRegister;
+
+        // Parameters that don't fit into registers are read from the caller's
+        // frame at the offset from the original RSP.
+        bool m_isInRegister;
+        int32_t m_stackOffset;
     };
 
 
@@ -74,14 +80,23 @@ namespace NativeJIT
     // one for integer types and one for floating point types. Given the
     // function definition above, on System V, the parameter indexes would be
     //    a:0, b:0, c:1, d:1
+    //
+    // Parameters whose index exceeds the number of parameter registers for
+    // their type are passed on the stack. On Windows, the stack slot is equal
+    // to the position since the caller reserves the home space for the
+    // register parameters. On System V, the stack slots are allocated in order
+    // to the parameters that didn't get a register, regardless of type.
     class ParameterSlotAllocator
     {
     public:
         ParameterSlotAllocator()
             : m_ints(0),
               m_floats(0),
+              m_stackSlots(0),
               m_position(0),
-              m_register(0)
+              m_register(0),
+              m_isInRegister(true),
+              m_stackSlot(0)
         {
         }
 
@@ -98,36 +113,73 @@ namespace NativeJIT
         }
 
 
+        bool IsInRegister() const
+        {
+            return m_isInRegister;
+        }
+
+
+        // Returns the index of the 8-byte stack slot of the stack-passed
+        // parameter, counting from the first parameter slot.
+        unsigned GetStackSlot() const
+        {
+            LogThrowAssert(!m_isInRegister, "Parameter %u is passed in a register", m_position);
+
+            return m_stackSlot;
+        }
+
+
+        // Returns the offset of the stack-passed parameter from the RSP value
+        // at function entry, i.e. past the return address.
+        int32_t GetStackOffset() const
+        {
+            return static_cast<int32_t>((GetStackSlot() + 1) * sizeof(void*));
+        }
+
+
         template <class T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
         void Allocate()
         {
-            m_position = m_ints + m_floats;
-#ifdef NATIVEJIT_PLATFORM_WINDOWS
-            m_register = m_position;
-#else
-            m_register = m_floats;
-#endif
-            m_floats++;
+            AllocateNext(m_floats, CallingConvention::c_xmmParameterRegisterCount);
         }
 
 
         template <class T, typename std::enable_if<!std::is_floating_point<T>::value>::type * = nullptr>
         void Allocate()
+        {
+            AllocateNext(m_ints, CallingConvention::c_rxxParameterRegisterCount);
+        }
+
+    private:
+        // Allocates the next parameter from the sequence for its type.
+        void AllocateNext(unsigned& typeCount, unsigned registerCount)
         {
             m_position = m_ints + m_floats;
 #ifdef NATIVEJIT_PLATFORM_WINDOWS
             m_register = m_position;
+            m_isInRegister = m_register < registerCount;
+            m_stackSlot = m_position;
 #else
-            m_register = m_ints;
+            m_register = typeCount;
+            m_isInRegister = m_register < registerCount;
+            m_stackSlot = m_stackSlots;
+
+            if (!m_isInRegister)
+            {
+                m_stackSlots++;
+            }
 #endif
-            m_ints++;
+            typeCount++;
         }
 
-    private:
         unsigned m_ints;
         unsigned m_floats;
+        unsigned m_stackSlots;
+
         unsigned m_position;
         unsigned m_register;
+        bool m_isInRegister;
+        unsigned m_stackSlot;
     };
 
 
@@ -140,9 +192,10 @@ namespace NativeJIT
     template <unsigned SIZE>
     void GetParameterRegister(unsigned id, Register<SIZE, false>& r)
     {
-        // For now we only support the four parameters that are passed in registers.
-        // No support for memory parameters.
-        LogThrowAssert(id < 4, "Exceeded maximum number of register parameters.");
+        // Parameters passed on the stack don't have a register, see
+        // ParameterSlotAllocator.
+        LogThrowAssert(id < CallingConvention::c_rxxParameterRegisterCount,
+                       "Exceeded maximum number of register parameters.");
 
         // Integer parameters are passed in RCX, RDX, R8, and R9.
         // Use constants to encode registers. See #31.
@@ -159,11 +212,13 @@ namespace NativeJIT
     template <unsigned SIZE>
     void GetParameterRegister(unsigned id, Register<SIZE, true>& r)
     {
-        // For now we only support the four parameters that are passed in registers.
-        // No support for memory parameters.
-        LogThrowAssert(id < 4, "Exceeded maximum number of register parameters.");
+        // Parameters passed on the stack don't have a register, see
+        // ParameterSlotAllocator.
+        LogThrowAssert(id < CallingConvention::c_xmmParameterRegisterCount,
+                       "Exceeded maximum number of register parameters.");
 
-        // Floating point parameters are passed in XMM0-XMM3.
+        // Floating point parameters are passed in XMM0-XMM3 on Windows and
+        // XMM0-XMM7 on System V.
         r = Register<SIZE, true>(id);
     }
 
@@ -175,6 +230,13 @@ namespace NativeJIT
         slotAllocator.Allocate<T>();
         m_position = slotAllocator.GetPosition();
         m_logicalRegister = slotAllocator.GetLogicalRegister();
+        m_isInRegister = slotAllocator.IsInRegister();
+        m_stackOffset = m_isInRegister ? 0 : slotAllocator.GetStackOffset();
+
+        if (!m_isInRegister)
+        {
+            tree.ReportStackParameter();
+        }
 
         // Parameter nodes are always considered to be referenced (as a part of
         // the function being compiled) even when they are not referenced
@@ -201,6 +263,11 @@ namespace NativeJIT
     template <typename T>
     typename ExpressionTree::Storage<T> ParameterNode<T>::CodeGenValue(ExpressionTree& tree)
     {
+        if (!m_isInRegister)
+        {
+            return tree.StackParameter<T>(m_stackOffset);
+        }
+
         typename Storage<T>::DirectRegister reg;
         GetParameterRegister(m_logicalRegister, reg);
 
@@ -214,5 +281,10 @@ namespace NativeJIT
         this->PrintCoreProperties(out, "ParameterNode");
 
         out << ", position = " << m_position;
+
+        if (!m_isInRegister)
+        {
+            out << ", stack offset = " << m_stackOffset;
+        }
     }
 }
@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // The cache level a prefetch brings the line into.
+    enum class PrefetchHint : uint8_t
+    {
+        NonTemporal,    // Close to the processor, minimizing cache pollution.
+        T0,             // All cache levels.
+        T1,             // Second level cache and up.
+        T2              // Third level cache and up.
+    };
+
+
+    // Emits a prefetch of the address its child evaluates to and returns the
+    // address unchanged. A prefetch never faults, so the address may be
+    // invalid. The prefetch is issued where the node is evaluated, i.e. when
+    // its value is first needed or, for a node with several parents, early
+    // in Pass2. To issue it ahead of an unrelated computation, use the node
+    // as the first node of a SequenceNode.
+    template <typename T>
+    class PrefetchNode : public Node<T*>
+    {
+    public:
+        PrefetchNode(ExpressionTree& tree, Node<T*>& address, PrefetchHint hint);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of Node<T*> methods.
+        //
+        virtual ExpressionTree::Storage<T*> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~PrefetchNode();
+
+        static void Emit(X64CodeGenerator& code, PrefetchHint hint, Register<8, false> base);
+
+        Node<T*>& m_address;
+        const PrefetchHint m_hint;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for PrefetchNode
+    //
+    //*************************************************************************
+    template <typename T>
+    PrefetchNode<T>::PrefetchNode(ExpressionTree& tree,
+                                  Node<T*>& address,
+                                  PrefetchHint hint)
+        : Node<T*>(tree),
+          m_address(address),
+          m_hint(hint)
+    {
+        m_address.IncrementParentCount(tree);
+    }
+
+
+    template <typename T>
+    void PrefetchNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "PrefetchNode");
+
+        out << ", address = " << m_address.GetId()
+            << ", hint = " << static_cast<unsigned>(m_hint);
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T*> PrefetchNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto address = m_address.CodeGen(tree);
+        auto base = address.ConvertToDirect(false);
+
+        Emit(tree.GetCodeGenerator(), m_hint, base);
+
+        return address;
+    }
+
+
+    template <typename T>
+    void PrefetchNode<T>::Emit(X64CodeGenerator& code, PrefetchHint hint, Register<8, false> base)
+    {
+        switch (hint)
+        {
+        case PrefetchHint::NonTemporal:
+            code.Emit<OpCode::PrefetchNTA, 1>(base, 0);
+            break;
+        case PrefetchHint::T0:
+            code.Emit<OpCode::PrefetchT0, 1>(base, 0);
+            break;
+        case PrefetchHint::T1:
+            code.Emit<OpCode::PrefetchT1, 1>(base, 0);
+            break;
+        case PrefetchHint::T2:
+            code.Emit<OpCode::PrefetchT2, 1>(base, 0);
+            break;
+        default:
+            LogThrowAbort("Invalid prefetch hint %u", static_cast<unsigned>(hint));
+        }
+    }
+}
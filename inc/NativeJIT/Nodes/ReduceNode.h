@@ -0,0 +1,616 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <type_traits>  // For std::remove_const.
+#include <vector>
+
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "NativeJIT/Nodes/PrefetchNode.h"
+
+
+namespace NativeJIT
+{
+    // A leaf of a loop body which loads an element of the array processed
+    // by the loop. The offset is relative to the loop's element pointer,
+    // which is bound by the loop node before it generates the body's code.
+    template <typename T>
+    class LoopElementNode : public Node<T>
+    {
+    public:
+        LoopElementNode(ExpressionTree& tree, int32_t offset);
+
+        void Bind(Register<8, false> elementPointer);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+        virtual void ReleaseReferencesToChildren() override;
+
+        //
+        // Overrides of Node<T> methods.
+        //
+        virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~LoopElementNode();
+
+        const int32_t m_offset;
+        Register<8, false> m_elementPointer;
+        bool m_isBound;
+    };
+
+
+    // A leaf of a loop body which refers to the register of one of the loop's
+    // accumulators, bound by the loop node before it generates the body's
+    // code.
+    template <typename T>
+    class LoopAccumulatorNode : public Node<T>
+    {
+    public:
+        typedef typename ExpressionTree::Storage<T>::DirectRegister DirectRegister;
+
+        LoopAccumulatorNode(ExpressionTree& tree);
+
+        void Bind(DirectRegister accumulator);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+        virtual void ReleaseReferencesToChildren() override;
+
+        //
+        // Overrides of Node<T> methods.
+        //
+        virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~LoopAccumulatorNode();
+
+        DirectRegister m_accumulator;
+        bool m_isBound;
+    };
+
+
+    // Folds the elements of an array into one or more accumulators in a
+    // counted loop. The main loop processes several elements per iteration
+    // with the body unrolled, each copy updating the accumulator of its slot.
+    // The remaining elements are folded into the first accumulator one by one
+    // and the accumulators are merged by the combining expression at the end.
+    //
+    // The body expressions and their leaves are constructed by the factory
+    // between ExpressionTree::BeginLoopBody() and EndLoopBody(), so the node
+    // evaluates them on its own for each iteration.
+    //
+    // With a non-zero prefetch distance, each iteration prefetches the data
+    // for the element that many elements ahead: the record it points to when
+    // the elements are pointers, the array itself otherwise.
+    template <typename A, typename T>
+    class ReduceNode : public Node<A>
+    {
+    public:
+        // The type of the elements as seen by the loop body.
+        typedef typename std::remove_const<T>::type ElementType;
+
+        // The arrays are copied. There are unrollCount main elements and
+        // accumulatorCount main accumulators, main results and combining
+        // accumulators. The identity is used only with several accumulators
+        // and the main elements and main results only when unrollCount is
+        // greater than one.
+        ReduceNode(ExpressionTree& tree,
+                   Node<T*>& elements,
+                   Node<int64_t>& count,
+                   Node<A>& initial,
+                   Node<A>* identity,
+                   unsigned accumulatorCount,
+                   unsigned unrollCount,
+                   unsigned prefetchDistance,
+                   LoopElementNode<ElementType>* const * mainElements,
+                   LoopAccumulatorNode<A>* const * mainAccumulators,
+                   Node<A>* const * mainResults,
+                   LoopElementNode<ElementType>& remainderElement,
+                   LoopAccumulatorNode<A>& remainderAccumulator,
+                   Node<A>& remainderResult,
+                   LoopAccumulatorNode<A>* const * combineAccumulators,
+                   Node<A>& combined);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of Node<A> methods.
+        //
+        virtual ExpressionTree::Storage<A> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        typedef typename ExpressionTree::Storage<A>::DirectRegister AccumulatorRegister;
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~ReduceNode();
+
+        template <typename U>
+        static U* CopyArray(ExpressionTree& tree, U const * source, unsigned count);
+
+        // Evaluates the result of the loop body and moves it into the
+        // accumulator for the next iteration.
+        static void CodeGenUpdate(ExpressionTree& tree,
+                                  Node<A>& result,
+                                  AccumulatorRegister accumulator);
+
+        // Prefetches the data for the elementCount elements prefetch distance
+        // ahead of the ones processed by the current iteration.
+        void CodeGenPrefetch(ExpressionTree& tree,
+                             Register<8, false> pointer,
+                             Register<8, false> remaining,
+                             unsigned elementCount,
+                             std::true_type elementIsPointer);
+
+        void CodeGenPrefetch(ExpressionTree& tree,
+                             Register<8, false> pointer,
+                             Register<8, false> remaining,
+                             unsigned elementCount,
+                             std::false_type elementIsPointer);
+
+        Node<T*>& m_elements;
+        Node<int64_t>& m_count;
+        Node<A>& m_initial;
+        Node<A>* m_identity;
+
+        const unsigned m_accumulatorCount;
+        const unsigned m_unrollCount;
+        const unsigned m_prefetchDistance;
+
+        LoopElementNode<ElementType>** m_mainElements;
+        LoopAccumulatorNode<A>** m_mainAccumulators;
+        Node<A>** m_mainResults;
+
+        LoopElementNode<ElementType>& m_remainderElement;
+        LoopAccumulatorNode<A>& m_remainderAccumulator;
+        Node<A>& m_remainderResult;
+
+        LoopAccumulatorNode<A>** m_combineAccumulators;
+        Node<A>& m_combined;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for LoopElementNode
+    //
+    //*************************************************************************
+    template <typename T>
+    LoopElementNode<T>::LoopElementNode(ExpressionTree& tree, int32_t offset)
+        : Node<T>(tree),
+          m_offset(offset),
+          m_isBound(false)
+    {
+        // The element is referenced by the loop node even if the body
+        // ignores it.
+        this->MarkReferenced();
+    }
+
+
+    template <typename T>
+    void LoopElementNode<T>::Bind(Register<8, false> elementPointer)
+    {
+        m_elementPointer = elementPointer;
+        m_isBound = true;
+    }
+
+
+    template <typename T>
+    void LoopElementNode<T>::ReleaseReferencesToChildren()
+    {
+        // No children to release.
+    }
+
+
+    template <typename T>
+    void LoopElementNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "LoopElementNode");
+
+        out << ", offset = " << m_offset;
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T> LoopElementNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        LogThrowAssert(m_isBound,
+                       "Loop element node %u used outside of its loop body",
+                       this->GetId());
+
+        auto result = tree.Direct<T>();
+        tree.GetCodeGenerator().template Emit<OpCode::Mov>(result.GetDirectRegister(),
+                                                           m_elementPointer,
+                                                           m_offset);
+
+        return result;
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for LoopAccumulatorNode
+    //
+    //*************************************************************************
+    template <typename T>
+    LoopAccumulatorNode<T>::LoopAccumulatorNode(ExpressionTree& tree)
+        : Node<T>(tree),
+          m_isBound(false)
+    {
+        // The accumulator is referenced by the loop node even if the body
+        // ignores it.
+        this->MarkReferenced();
+    }
+
+
+    template <typename T>
+    void LoopAccumulatorNode<T>::Bind(DirectRegister accumulator)
+    {
+        m_accumulator = accumulator;
+        m_isBound = true;
+    }
+
+
+    template <typename T>
+    void LoopAccumulatorNode<T>::ReleaseReferencesToChildren()
+    {
+        // No children to release.
+    }
+
+
+    template <typename T>
+    void LoopAccumulatorNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "LoopAccumulatorNode");
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T> LoopAccumulatorNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        LogThrowAssert(m_isBound,
+                       "Loop accumulator node %u used outside of its loop body",
+                       this->GetId());
+
+        // The register is pinned by the loop, so the parents which modify
+        // the value will work on a copy.
+        return ExpressionTree::Storage<T>::ForAdditionalReferenceToRegister(tree, m_accumulator);
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for ReduceNode
+    //
+    //*************************************************************************
+    template <typename A, typename T>
+    ReduceNode<A, T>::ReduceNode(ExpressionTree& tree,
+                                 Node<T*>& elements,
+                                 Node<int64_t>& count,
+                                 Node<A>& initial,
+                                 Node<A>* identity,
+                                 unsigned accumulatorCount,
+                                 unsigned unrollCount,
+                                 unsigned prefetchDistance,
+                                 LoopElementNode<ElementType>* const * mainElements,
+                                 LoopAccumulatorNode<A>* const * mainAccumulators,
+                                 Node<A>* const * mainResults,
+                                 LoopElementNode<ElementType>& remainderElement,
+                                 LoopAccumulatorNode<A>& remainderAccumulator,
+                                 Node<A>& remainderResult,
+                                 LoopAccumulatorNode<A>* const * combineAccumulators,
+                                 Node<A>& combined)
+        : Node<A>(tree),
+          m_elements(elements),
+          m_count(count),
+          m_initial(initial),
+          m_identity(identity),
+          m_accumulatorCount(accumulatorCount),
+          m_unrollCount(unrollCount),
+          m_prefetchDistance(prefetchDistance),
+          m_mainElements(CopyArray(tree, mainElements, unrollCount > 1 ? unrollCount : 0)),
+          m_mainAccumulators(CopyArray(tree, mainAccumulators, unrollCount > 1 ? accumulatorCount : 0)),
+          m_mainResults(CopyArray(tree, mainResults, unrollCount > 1 ? accumulatorCount : 0)),
+          m_remainderElement(remainderElement),
+          m_remainderAccumulator(remainderAccumulator),
+          m_remainderResult(remainderResult),
+          m_combineAccumulators(CopyArray(tree, combineAccumulators, accumulatorCount)),
+          m_combined(combined)
+    {
+        LogThrowAssert((m_accumulatorCount > 1) == (m_identity != nullptr),
+                       "Identity is required exactly when there are several accumulators");
+
+        // The loop spills the registers before it starts.
+        this->MarkMayBumpRegisters();
+
+        m_elements.IncrementParentCount(tree);
+        m_count.IncrementParentCount(tree);
+        m_initial.IncrementParentCount(tree);
+
+        if (m_identity != nullptr)
+        {
+            m_identity->IncrementParentCount(tree);
+        }
+
+        if (m_unrollCount > 1)
+        {
+            for (unsigned i = 0; i < m_accumulatorCount; ++i)
+            {
+                m_mainResults[i]->IncrementParentCount(tree);
+            }
+        }
+
+        m_remainderResult.IncrementParentCount(tree);
+        m_combined.IncrementParentCount(tree);
+    }
+
+
+    template <typename A, typename T>
+    template <typename U>
+    U* ReduceNode<A, T>::CopyArray(ExpressionTree& tree, U const * source, unsigned count)
+    {
+        U* copy = static_cast<U*>(tree.GetAllocator().Allocate(sizeof(U) * count));
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            copy[i] = source[i];
+        }
+
+        return copy;
+    }
+
+
+    template <typename A, typename T>
+    void ReduceNode<A, T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "ReduceNode");
+
+        out << ", elements = " << m_elements.GetId()
+            << ", count = " << m_count.GetId()
+            << ", initial = " << m_initial.GetId()
+            << ", accumulators = " << m_accumulatorCount
+            << ", unroll = " << m_unrollCount
+            << ", prefetch = " << m_prefetchDistance
+            << ", remainder = " << m_remainderResult.GetId()
+            << ", combined = " << m_combined.GetId();
+    }
+
+
+    template <typename A, typename T>
+    typename ExpressionTree::Storage<A> ReduceNode<A, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        auto elements = m_elements.CodeGen(tree);
+        auto count = m_count.CodeGen(tree);
+        auto initial = m_initial.CodeGen(tree);
+        Storage<A> identity;
+
+        if (m_identity != nullptr)
+        {
+            identity = m_identity->CodeGen(tree);
+        }
+
+        // The code of the body runs once per iteration, so it must not move
+        // the values which live across the iterations. Those which were
+        // computed before the loop are spilled here. The loop state is kept
+        // in pinned registers which function calls in the body don't use.
+        tree.SpillAllRegisters();
+
+        auto pointer = tree.DirectUnusedByCalls<T*>();
+        ReferenceCounter pointerPin = pointer.GetPin();
+        CodeGenHelpers::Emit<OpCode::Mov>(code, pointer.GetDirectRegister(), elements);
+        elements.Reset();
+
+        auto remaining = tree.DirectUnusedByCalls<int64_t>();
+        ReferenceCounter remainingPin = remaining.GetPin();
+        CodeGenHelpers::Emit<OpCode::Mov>(code, remaining.GetDirectRegister(), count);
+        count.Reset();
+
+        std::vector<Storage<A>> accumulators;
+        std::vector<ReferenceCounter> accumulatorPins;
+
+        for (unsigned i = 0; i < m_accumulatorCount; ++i)
+        {
+            accumulators.push_back(tree.DirectUnusedByCalls<A>());
+            accumulatorPins.push_back(accumulators.back().GetPin());
+            CodeGenHelpers::Emit<OpCode::Mov>(code,
+                                              accumulators.back().GetDirectRegister(),
+                                              i == 0 ? initial : identity);
+        }
+
+        initial.Reset();
+        identity.Reset();
+
+        const auto pointerRegister = pointer.GetDirectRegister();
+        const auto remainingRegister = remaining.GetDirectRegister();
+        const Label loopCompleted = code.AllocateLabel();
+
+        // The loops may run zero times.
+        tree.BeginConditionalCode(true);
+
+        if (m_unrollCount > 1)
+        {
+            const Label mainLoop = code.AllocateLabel();
+            const Label mainLoopCompleted = code.AllocateLabel();
+            const int32_t unrollCount = static_cast<int32_t>(m_unrollCount);
+
+            code.EmitImmediate<OpCode::Cmp>(remainingRegister, unrollCount);
+            code.EmitConditionalJump<JccType::JL>(mainLoopCompleted);
+
+            code.PlaceLabel(mainLoop);
+
+            CodeGenPrefetch(tree,
+                            pointerRegister,
+                            remainingRegister,
+                            m_unrollCount,
+                            std::is_pointer<ElementType>());
+
+            for (unsigned i = 0; i < m_unrollCount; ++i)
+            {
+                m_mainElements[i]->Bind(Register<8, false>(pointerRegister));
+            }
+
+            for (unsigned i = 0; i < m_accumulatorCount; ++i)
+            {
+                m_mainAccumulators[i]->Bind(accumulators[i].GetDirectRegister());
+            }
+
+            for (unsigned i = 0; i < m_accumulatorCount; ++i)
+            {
+                CodeGenUpdate(tree, *m_mainResults[i], accumulators[i].GetDirectRegister());
+            }
+
+            code.EmitImmediate<OpCode::Add>(pointerRegister,
+                                            static_cast<int32_t>(m_unrollCount * sizeof(T)));
+            code.EmitImmediate<OpCode::Sub>(remainingRegister, unrollCount);
+            code.EmitImmediate<OpCode::Cmp>(remainingRegister, unrollCount);
+            code.EmitConditionalJump<JccType::JGE>(mainLoop);
+
+            code.PlaceLabel(mainLoopCompleted);
+        }
+
+        {
+            const Label remainderLoop = code.AllocateLabel();
+
+            code.EmitImmediate<OpCode::Cmp>(remainingRegister, 0);
+            code.EmitConditionalJump<JccType::JLE>(loopCompleted);
+
+            code.PlaceLabel(remainderLoop);
+
+            CodeGenPrefetch(tree,
+                            pointerRegister,
+                            remainingRegister,
+                            1,
+                            std::is_pointer<ElementType>());
+
+            m_remainderElement.Bind(Register<8, false>(pointerRegister));
+            m_remainderAccumulator.Bind(accumulators[0].GetDirectRegister());
+            CodeGenUpdate(tree, m_remainderResult, accumulators[0].GetDirectRegister());
+
+            code.EmitImmediate<OpCode::Add>(pointerRegister, static_cast<int32_t>(sizeof(T)));
+            code.EmitImmediate<OpCode::Sub>(remainingRegister, 1);
+            code.EmitConditionalJump<JccType::JG>(remainderLoop);
+        }
+
+        code.PlaceLabel(loopCompleted);
+        tree.EndConditionalCode();
+
+        for (unsigned i = 0; i < m_accumulatorCount; ++i)
+        {
+            m_combineAccumulators[i]->Bind(accumulators[i].GetDirectRegister());
+        }
+
+        return m_combined.CodeGen(tree);
+    }
+
+
+    template <typename A, typename T>
+    void ReduceNode<A, T>::CodeGenUpdate(ExpressionTree& tree,
+                                         Node<A>& result,
+                                         AccumulatorRegister accumulator)
+    {
+        auto value = result.CodeGen(tree);
+
+        CodeGenHelpers::Emit<OpCode::Mov>(tree.GetCodeGenerator(), accumulator, value);
+    }
+
+
+    template <typename A, typename T>
+    void ReduceNode<A, T>::CodeGenPrefetch(ExpressionTree& tree,
+                                           Register<8, false> pointer,
+                                           Register<8, false> remaining,
+                                           unsigned elementCount,
+                                           std::true_type /* elementIsPointer */)
+    {
+        if (m_prefetchDistance == 0)
+        {
+            return;
+        }
+
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        // Loading an element beyond the end of the array could fault, so the
+        // prefetches are skipped for the last iterations. The register is
+        // allocated before the branch since the allocation may spill.
+        auto target = tree.Direct<ElementType>();
+        const Label skip = code.AllocateLabel();
+
+        code.EmitImmediate<OpCode::Cmp>(remaining,
+                                        static_cast<int32_t>(m_prefetchDistance + elementCount - 1));
+        code.EmitConditionalJump<JccType::JLE>(skip);
+
+        for (unsigned i = 0; i < elementCount; ++i)
+        {
+            const int32_t offset = static_cast<int32_t>((m_prefetchDistance + i) * sizeof(T));
+
+            code.Emit<OpCode::Mov>(target.GetDirectRegister(), pointer, offset);
+            code.Emit<OpCode::PrefetchT0, 1>(target.GetDirectRegister(), 0);
+        }
+
+        code.PlaceLabel(skip);
+    }
+
+
+    template <typename A, typename T>
+    void ReduceNode<A, T>::CodeGenPrefetch(ExpressionTree& tree,
+                                           Register<8, false> pointer,
+                                           Register<8, false> /* remaining */,
+                                           unsigned elementCount,
+                                           std::false_type /* elementIsPointer */)
+    {
+        // Prefetching past the end of the array is harmless. One prefetch per
+        // cache line is enough.
+        const unsigned c_cacheLineSize = 64;
+
+        if (m_prefetchDistance == 0)
+        {
+            return;
+        }
+
+        for (unsigned offset = 0; offset < elementCount * sizeof(T); offset += c_cacheLineSize)
+        {
+            tree.GetCodeGenerator().Emit<OpCode::PrefetchT0, 1>(
+                pointer,
+                static_cast<int32_t>(m_prefetchDistance * sizeof(T) + offset));
+        }
+    }
+}
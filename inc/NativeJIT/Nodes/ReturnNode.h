@@ -64,8 +64,8 @@ namespace NativeJIT
           m_child(child)
     {
         // There's an implicit parent to the return node: the function it's used by.
-        this->IncrementParentCount();
-        child.IncrementParentCount();
+        this->IncrementParentCount(tree);
+        child.IncrementParentCount(tree);
     }
 
 
@@ -83,6 +83,17 @@ namespace NativeJIT
     template <typename T>
     void ReturnNode<T>::CompileAsRoot(ExpressionTree& tree)
     {
+        // If the value comes straight from a function call, the call can
+        // replace the return. The called function then returns directly to
+        // the caller.
+        if (m_child.GetParentCount() == 1
+            && !m_child.HasBeenEvaluated()
+            && m_child.CompileAsTailCall(tree))
+        {
+            this->MarkEvaluated();
+            return;
+        }
+
         ExpressionTree::Storage<T> s = this->CodeGen(tree);
 
         auto resultRegister = tree.GetResultRegister<T>();
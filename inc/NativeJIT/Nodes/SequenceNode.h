@@ -0,0 +1,96 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#pragma once
+
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // The SequenceNode evaluates its first node, discards its value and then
+    // evaluates the second node. Unlike DependentNode, it is the only parent
+    // needed for the first node, which makes it suitable for chaining
+    // statements such as assignments to local variables.
+    template <typename S, typename T>
+    class SequenceNode : public Node<T>
+    {
+    public:
+        SequenceNode(ExpressionTree& tree, Node<S>& first, Node<T>& second);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~SequenceNode();
+
+        Node<S>& m_first;
+        Node<T>& m_second;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for SequenceNode
+    //
+    //*************************************************************************
+    template <typename S, typename T>
+    SequenceNode<S, T>::SequenceNode(ExpressionTree& tree,
+                                     Node<S>& first,
+                                     Node<T>& second)
+        : Node<T>(tree),
+          m_first(first),
+          m_second(second)
+    {
+        m_first.IncrementParentCount(tree);
+        m_second.IncrementParentCount(tree);
+    }
+
+
+    template <typename S, typename T>
+    Storage<T> SequenceNode<S, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        // The storage of the first node is released before the second node
+        // is evaluated.
+        m_first.CodeGen(tree);
+
+        return m_second.CodeGen(tree);
+    }
+
+
+    template <typename S, typename T>
+    void SequenceNode<S, T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "SequenceNode");
+
+        out << ", first = " << m_first.GetId();
+        out << ", second = " << m_second.GetId();
+    }
+}
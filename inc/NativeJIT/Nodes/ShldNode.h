@@ -67,8 +67,8 @@ namespace NativeJIT
           m_filler(filler),
           m_bitCount(bitCount)
     {
-        m_shiftee.IncrementParentCount();
-        m_filler.IncrementParentCount();
+        m_shiftee.IncrementParentCount(tree);
+        m_filler.IncrementParentCount(tree);
     }
 
 
@@ -60,6 +60,7 @@ namespace NativeJIT
     StackVariableNode<T>::StackVariableNode(ExpressionTree& tree)
         : Node<T&>(tree)
     {
+        tree.ReportStackVariable();
     }
 
 
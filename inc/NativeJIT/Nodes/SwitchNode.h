@@ -0,0 +1,551 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>    // For std::sort.
+#include <type_traits>  // For std::integral_constant.
+#include <vector>
+
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // Selects the value of the case whose key matches the value of the key
+    // node, or the default value if there is no such case. Dense sets of keys
+    // are dispatched through a table of 32-bit label offsets that is emitted
+    // behind an indirect jump, sparse sets through a binary search tree of
+    // comparisons.
+    template <typename K, typename T>
+    class SwitchNode : public Node<T>
+    {
+    public:
+        SwitchNode(ExpressionTree& tree,
+                   Node<K>& key,
+                   K const * caseKeys,
+                   Node<T>* const * caseValues,
+                   unsigned caseCount,
+                   Node<T>& defaultValue);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of Node<T> methods.
+        //
+        virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+
+    private:
+        static_assert(std::is_integral<K>::value && !std::is_same<K, bool>::value,
+                      "Switch keys must be integers.");
+
+        typedef typename ExpressionTree::Storage<K>::DirectRegister KeyRegister;
+        typedef std::integral_constant<bool, sizeof(K) == 8> IsQuadword;
+
+        // The minimum number of cases and the maximum number of table entries
+        // per case for which a jump table is used. Below the density, the
+        // holes in the table would cost more than the comparisons saved.
+        static const unsigned c_minJumpTableCaseCount = 4;
+        static const unsigned c_maxJumpTableEntriesPerCase = 2;
+
+        // Ranges of cases with fewer than this many keys are searched linearly.
+        static const unsigned c_maxLinearSearchCaseCount = 4;
+
+        struct Case
+        {
+            K m_key;
+            Node<T>* m_value;
+        };
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~SwitchNode();
+
+        bool IsDense() const;
+
+        // Returns the index of the first case whose value node is the same as
+        // the one of the case at the specified index.
+        unsigned FindFirstCaseWithValue(unsigned index) const;
+
+        // Emits the comparisons dispatching the cases in [first, last) to
+        // their labels and the remaining keys to the default label.
+        void EmitSearch(X64CodeGenerator& code,
+                        KeyRegister key,
+                        KeyRegister scratch,
+                        unsigned first,
+                        unsigned last,
+                        std::vector<Label> const & caseLabels,
+                        Label defaultLabel) const;
+
+        // Dispatches the key, which is clobbered, through the jump table.
+        void EmitJumpTable(X64CodeGenerator& code,
+                           KeyRegister key,
+                           KeyRegister scratch,
+                           Register<8, false> table,
+                           std::vector<Label> const & caseLabels,
+                           Label defaultLabel) const;
+
+        // Emits an instruction with the key register and an immediate. 64-bit
+        // immediates which cannot be sign-extended from 32 bits are loaded
+        // into the scratch register first.
+        template <OpCode OP>
+        static void EmitImmediate(X64CodeGenerator& code,
+                                  KeyRegister key,
+                                  KeyRegister scratch,
+                                  K value);
+
+        template <OpCode OP>
+        static void EmitImmediate(X64CodeGenerator& code,
+                                  KeyRegister key,
+                                  KeyRegister scratch,
+                                  K value,
+                                  std::false_type isQuadword);
+
+        template <OpCode OP>
+        static void EmitImmediate(X64CodeGenerator& code,
+                                  KeyRegister key,
+                                  KeyRegister scratch,
+                                  K value,
+                                  std::true_type isQuadword);
+
+        static bool IsScratchRequired(K value);
+
+        static void ZeroExtend(X64CodeGenerator& code,
+                               Register<8, false> dest,
+                               KeyRegister key,
+                               std::false_type isQuadword);
+
+        static void ZeroExtend(X64CodeGenerator& code,
+                               Register<8, false> dest,
+                               KeyRegister key,
+                               std::true_type isQuadword);
+
+        Node<K>& m_key;
+        Node<T>& m_defaultValue;
+
+        // Cases sorted by key, allocated from the tree's arena.
+        Case* m_cases;
+        unsigned m_caseCount;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for SwitchNode
+    //
+    //*************************************************************************
+    template <typename K, typename T>
+    SwitchNode<K, T>::SwitchNode(ExpressionTree& tree,
+                                 Node<K>& key,
+                                 K const * caseKeys,
+                                 Node<T>* const * caseValues,
+                                 unsigned caseCount,
+                                 Node<T>& defaultValue)
+        : Node<T>(tree),
+          m_key(key),
+          m_defaultValue(defaultValue),
+          m_cases(static_cast<Case*>(tree.GetAllocator().Allocate(sizeof(Case) * caseCount))),
+          m_caseCount(caseCount)
+    {
+        // The jump table needs several scratch registers.
+        this->MarkMayBumpRegisters();
+
+        m_key.IncrementParentCount(tree);
+        m_defaultValue.IncrementParentCount(tree);
+
+        for (unsigned i = 0; i < m_caseCount; ++i)
+        {
+            m_cases[i].m_key = caseKeys[i];
+            m_cases[i].m_value = caseValues[i];
+            m_cases[i].m_value->IncrementParentCount(tree);
+        }
+
+        std::sort(m_cases,
+                  m_cases + m_caseCount,
+                  [](Case const & left, Case const & right)
+                  {
+                      return left.m_key < right.m_key;
+                  });
+
+        for (unsigned i = 1; i < m_caseCount; ++i)
+        {
+            LogThrowAssert(m_cases[i - 1].m_key != m_cases[i].m_key,
+                           "Duplicate switch case key %lld",
+                           static_cast<long long>(m_cases[i].m_key));
+        }
+    }
+
+
+    template <typename K, typename T>
+    void SwitchNode<K, T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "SwitchNode");
+
+        out << ", key = " << m_key.GetId();
+
+        for (unsigned i = 0; i < m_caseCount; ++i)
+        {
+            out << ", case " << static_cast<int64_t>(m_cases[i].m_key)
+                << " = " << m_cases[i].m_value->GetId();
+        }
+
+        out << ", default = " << m_defaultValue.GetId();
+    }
+
+
+    template <typename K, typename T>
+    typename ExpressionTree::Storage<T> SwitchNode<K, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        // Like in ConditionalNode, all values are evaluated in advance of the
+        // dispatch so that the register allocation state is the same for all
+        // the branches once they converge. See the TODO note in
+        // ConditionalNode::CodeGenValue().
+        Storage<K> key = m_key.CodeGen(tree);
+
+        std::vector<Storage<T>> values;
+        values.reserve(m_caseCount);
+
+        for (unsigned i = 0; i < m_caseCount; ++i)
+        {
+            values.push_back(m_cases[i].m_value->CodeGen(tree));
+        }
+
+        Storage<T> defaultValue = m_defaultValue.CodeGen(tree);
+
+        const bool isDense = IsDense();
+
+        // All registers must be allocated before the first branch so that any
+        // spills apply to all of them.
+        auto keyRegister = key.ConvertToDirect(isDense);
+        ReferenceCounter keyPin = key.GetPin();
+
+        Storage<T> result = tree.Direct<T>();
+        ReferenceCounter resultPin = result.GetPin();
+
+        bool isScratchRequired = false;
+
+        for (unsigned i = 0; i < m_caseCount; ++i)
+        {
+            isScratchRequired |= IsScratchRequired(m_cases[i].m_key);
+        }
+
+        Storage<K> scratch;
+        ReferenceCounter scratchPin;
+
+        if (isScratchRequired)
+        {
+            scratch = tree.Direct<K>();
+            scratchPin = scratch.GetPin();
+        }
+
+        Storage<void*> table;
+        ReferenceCounter tablePin;
+
+        if (isDense)
+        {
+            table = tree.Direct<void*>();
+            tablePin = table.GetPin();
+        }
+
+        // Cases with the same value node share the code which loads it.
+        const Label defaultLabel = code.AllocateLabel();
+        const Label completed = code.AllocateLabel();
+        std::vector<Label> caseLabels;
+
+        for (unsigned i = 0; i < m_caseCount; ++i)
+        {
+            const unsigned first = FindFirstCaseWithValue(i);
+
+            if (m_cases[i].m_value == &m_defaultValue)
+            {
+                caseLabels.push_back(defaultLabel);
+            }
+            else if (first == i)
+            {
+                caseLabels.push_back(code.AllocateLabel());
+            }
+            else
+            {
+                caseLabels.push_back(caseLabels[first]);
+            }
+        }
+
+        const KeyRegister scratchRegister = isScratchRequired
+            ? scratch.GetDirectRegister()
+            : KeyRegister();
+
+        if (isDense)
+        {
+            EmitJumpTable(code,
+                          keyRegister,
+                          scratchRegister,
+                          table.GetDirectRegister(),
+                          caseLabels,
+                          defaultLabel);
+        }
+        else
+        {
+            EmitSearch(code,
+                       keyRegister,
+                       scratchRegister,
+                       0,
+                       m_caseCount,
+                       caseLabels,
+                       defaultLabel);
+        }
+
+        for (unsigned i = 0; i < m_caseCount; ++i)
+        {
+            if (m_cases[i].m_value != &m_defaultValue
+                && FindFirstCaseWithValue(i) == i)
+            {
+                code.PlaceLabel(caseLabels[i]);
+                CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), values[i]);
+                code.Jmp(completed);
+            }
+        }
+
+        code.PlaceLabel(defaultLabel);
+        CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), defaultValue);
+
+        code.PlaceLabel(completed);
+
+        return result;
+    }
+
+
+    template <typename K, typename T>
+    bool SwitchNode<K, T>::IsDense() const
+    {
+        if (m_caseCount < c_minJumpTableCaseCount)
+        {
+            return false;
+        }
+
+        // The difference is computed on the two's complement representation,
+        // which is exact for both signed and unsigned keys since the cases
+        // are sorted.
+        const uint64_t range = static_cast<uint64_t>(m_cases[m_caseCount - 1].m_key)
+                               - static_cast<uint64_t>(m_cases[0].m_key);
+
+        return range < static_cast<uint64_t>(m_caseCount) * c_maxJumpTableEntriesPerCase;
+    }
+
+
+    template <typename K, typename T>
+    unsigned SwitchNode<K, T>::FindFirstCaseWithValue(unsigned index) const
+    {
+        unsigned first = 0;
+
+        while (m_cases[first].m_value != m_cases[index].m_value)
+        {
+            ++first;
+        }
+
+        return first;
+    }
+
+
+    template <typename K, typename T>
+    void SwitchNode<K, T>::EmitSearch(X64CodeGenerator& code,
+                                      KeyRegister key,
+                                      KeyRegister scratch,
+                                      unsigned first,
+                                      unsigned last,
+                                      std::vector<Label> const & caseLabels,
+                                      Label defaultLabel) const
+    {
+        if (last - first < c_maxLinearSearchCaseCount)
+        {
+            for (unsigned i = first; i < last; ++i)
+            {
+                EmitImmediate<OpCode::Cmp>(code, key, scratch, m_cases[i].m_key);
+                code.EmitConditionalJump<JccType::JE>(caseLabels[i]);
+            }
+
+            code.Jmp(defaultLabel);
+        }
+        else
+        {
+            const unsigned middle = first + (last - first) / 2;
+            const Label isGreater = code.AllocateLabel();
+
+            EmitImmediate<OpCode::Cmp>(code, key, scratch, m_cases[middle].m_key);
+            code.EmitConditionalJump<JccType::JE>(caseLabels[middle]);
+
+            if (std::is_signed<K>::value)
+            {
+                code.EmitConditionalJump<JccType::JG>(isGreater);
+            }
+            else
+            {
+                code.EmitConditionalJump<JccType::JA>(isGreater);
+            }
+
+            EmitSearch(code, key, scratch, first, middle, caseLabels, defaultLabel);
+
+            code.PlaceLabel(isGreater);
+            EmitSearch(code, key, scratch, middle + 1, last, caseLabels, defaultLabel);
+        }
+    }
+
+
+    template <typename K, typename T>
+    void SwitchNode<K, T>::EmitJumpTable(X64CodeGenerator& code,
+                                         KeyRegister key,
+                                         KeyRegister scratch,
+                                         Register<8, false> table,
+                                         std::vector<Label> const & caseLabels,
+                                         Label defaultLabel) const
+    {
+        const K minKey = m_cases[0].m_key;
+        const K range = static_cast<K>(m_cases[m_caseCount - 1].m_key - minKey);
+
+        // Bias the key to a zero-based index. Keys below the minimum wrap
+        // around and are caught by the same unsigned comparison as the keys
+        // above the maximum.
+        if (minKey != 0)
+        {
+            EmitImmediate<OpCode::Sub>(code, key, scratch, minKey);
+        }
+
+        EmitImmediate<OpCode::Cmp>(code, key, scratch, range);
+        code.EmitConditionalJump<JccType::JA>(defaultLabel);
+
+        const Register<8, false> index(key);
+
+        ZeroExtend(code, index, key, IsQuadword());
+
+        // The table label is placed behind the first entry and each entry
+        // holds the distance from its end to the case label, so the end of
+        // the indexed entry is table + 4 * index and the target is that
+        // address plus the entry.
+        const Label tableLabel = code.AllocateLabel();
+
+        code.Lea(table, tableLabel);
+        code.EmitImmediate<OpCode::Shl>(index, static_cast<uint8_t>(2));
+        code.Emit<OpCode::Add>(index, table);
+        code.Emit<OpCode::MovSX, 8, false, 4, false>(table, index, -4);
+        code.Emit<OpCode::Add>(table, index);
+        code.Jmp(table);
+
+        unsigned caseIndex = 0;
+
+        for (uint64_t entry = 0; entry <= static_cast<uint64_t>(range); ++entry)
+        {
+            if (static_cast<K>(m_cases[caseIndex].m_key - minKey) == static_cast<K>(entry))
+            {
+                code.EmitLabelOffset(caseLabels[caseIndex++]);
+            }
+            else
+            {
+                code.EmitLabelOffset(defaultLabel);
+            }
+
+            if (entry == 0)
+            {
+                code.PlaceLabel(tableLabel);
+            }
+        }
+    }
+
+
+    template <typename K, typename T>
+    template <OpCode OP>
+    void SwitchNode<K, T>::EmitImmediate(X64CodeGenerator& code,
+                                         KeyRegister key,
+                                         KeyRegister scratch,
+                                         K value)
+    {
+        EmitImmediate<OP>(code, key, scratch, value, IsQuadword());
+    }
+
+
+    template <typename K, typename T>
+    template <OpCode OP>
+    void SwitchNode<K, T>::EmitImmediate(X64CodeGenerator& code,
+                                         KeyRegister key,
+                                         KeyRegister /* scratch */,
+                                         K value,
+                                         std::false_type /* isQuadword */)
+    {
+        code.EmitImmediate<OP>(key, value);
+    }
+
+
+    template <typename K, typename T>
+    template <OpCode OP>
+    void SwitchNode<K, T>::EmitImmediate(X64CodeGenerator& code,
+                                         KeyRegister key,
+                                         KeyRegister scratch,
+                                         K value,
+                                         std::true_type /* isQuadword */)
+    {
+        if (IsScratchRequired(value))
+        {
+            code.EmitImmediate<OpCode::Mov>(scratch, value);
+            code.Emit<OP>(key, scratch);
+        }
+        else
+        {
+            // The immediate is sign-extended to 64 bits, which reproduces the
+            // value regardless of the signedness of the key.
+            code.EmitImmediate<OP>(key, static_cast<int32_t>(value));
+        }
+    }
+
+
+    template <typename K, typename T>
+    bool SwitchNode<K, T>::IsScratchRequired(K value)
+    {
+        return sizeof(K) == 8
+            && static_cast<int64_t>(value) != static_cast<int32_t>(value);
+    }
+
+
+    template <typename K, typename T>
+    void SwitchNode<K, T>::ZeroExtend(X64CodeGenerator& code,
+                                      Register<8, false> dest,
+                                      KeyRegister key,
+                                      std::false_type /* isQuadword */)
+    {
+        code.Emit<OpCode::MovZX>(dest, key);
+    }
+
+
+    template <typename K, typename T>
+    void SwitchNode<K, T>::ZeroExtend(X64CodeGenerator& /* code */,
+                                      Register<8, false> /* dest */,
+                                      KeyRegister /* key */,
+                                      std::true_type /* isQuadword */)
+    {
+    }
+}
@@ -0,0 +1,700 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>          // For memcpy.
+#include <type_traits>
+#include <unordered_map>    // Embedded member.
+#include <utility>          // For std::index_sequence.
+#include <vector>           // Embedded member.
+
+#include "NativeJIT/ExpressionNodeFactory.h"
+#include "Temporary/Assert.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    //
+    // The serialized tree format is a compact, position independent encoding
+    // of the node DAG built through ExpressionNodeFactory. It consists of a
+    // header followed by one record per node in the order in which the nodes
+    // were created, so that each record can refer to its children by their
+    // record indexes. Shared nodes are recorded once and therefore remain
+    // shared when the tree is loaded.
+    //
+    //   header:  'N' 'J' 'T' 'S' version:u8 recordCount:varint
+    //   record:  kind:u8 type:u8 <kind-specific payload>
+    //   trailer: rootIndex:varint
+    //
+    // Unsigned integers are encoded as LEB128 varints, signed integers are
+    // zigzag encoded first. Immediates are stored as their raw little endian
+    // bytes. Functions called from the tree are stored by their symbolic ID
+    // from the CallTargetRegistry rather than by address.
+    //
+    // Only the types that carry meaning outside of the process that built
+    // the tree can be serialized: arithmetic types, pointers to them and
+    // pointers to structures. Structures are opaque in the serialized form,
+    // i.e. they are reduced to byte offsets of the fields that were accessed.
+    //
+    namespace Serialization
+    {
+        const uint8_t c_version = 1;
+
+        enum class NodeKind : uint8_t
+        {
+            Parameter,
+            Immediate,
+            Add,
+            And,
+            Mul,
+            Or,
+            Sub,
+            Rol,
+            Shl,
+            Shr,
+            Cast,
+            Deref,
+            FieldPointer,
+            Compare,
+            Conditional,
+            Call,
+            // The following value must be the last one.
+            KindCount
+        };
+
+
+        // Serialized scalar types. A pointer to one of them is encoded by
+        // combining the scalar type with c_pointerTo. Opaque stands for a
+        // pointer to any structure (or void), so Opaque | c_pointerTo is a
+        // pointer to such pointer.
+        enum class ScalarType : uint8_t
+        {
+            Bool,
+            Int8,
+            UInt8,
+            Int16,
+            UInt16,
+            Int32,
+            UInt32,
+            Int64,
+            UInt64,
+            Float,
+            Double,
+            Opaque,
+            // The following value must be the last one.
+            TypeCount
+        };
+
+        const uint8_t c_pointerTo = 0x80;
+
+
+        // The type used in place of opaque structures when a tree is loaded.
+        // It is never defined since only pointers to it are ever used.
+        struct OpaqueObject;
+
+
+        template <ScalarType TYPE>
+        using ScalarTypeCode = std::integral_constant<uint8_t, static_cast<uint8_t>(TYPE)>;
+
+        template <typename T> struct ScalarTypeOf;
+
+        template <> struct ScalarTypeOf<bool> : ScalarTypeCode<ScalarType::Bool> {};
+        template <> struct ScalarTypeOf<int8_t> : ScalarTypeCode<ScalarType::Int8> {};
+        template <> struct ScalarTypeOf<uint8_t> : ScalarTypeCode<ScalarType::UInt8> {};
+        template <> struct ScalarTypeOf<int16_t> : ScalarTypeCode<ScalarType::Int16> {};
+        template <> struct ScalarTypeOf<uint16_t> : ScalarTypeCode<ScalarType::UInt16> {};
+        template <> struct ScalarTypeOf<int32_t> : ScalarTypeCode<ScalarType::Int32> {};
+        template <> struct ScalarTypeOf<uint32_t> : ScalarTypeCode<ScalarType::UInt32> {};
+        template <> struct ScalarTypeOf<int64_t> : ScalarTypeCode<ScalarType::Int64> {};
+        template <> struct ScalarTypeOf<uint64_t> : ScalarTypeCode<ScalarType::UInt64> {};
+        template <> struct ScalarTypeOf<float> : ScalarTypeCode<ScalarType::Float> {};
+        template <> struct ScalarTypeOf<double> : ScalarTypeCode<ScalarType::Double> {};
+
+
+        // Specifies whether a pointer to T is serialized as an opaque pointer.
+        template <typename T>
+        struct IsOpaque
+            : std::integral_constant<bool,
+                                     std::is_class<T>::value
+                                     || std::is_void<T>::value>
+        {
+        };
+
+
+        // Maps a C++ type to its serialized type code. Unsupported types
+        // fail to compile because ScalarTypeOf is not defined for them.
+        template <typename T, typename ENABLE = void>
+        struct TypeCodeOf : ScalarTypeOf<T> {};
+
+        template <typename T>
+        struct TypeCodeOf<T*, typename std::enable_if<IsOpaque<T>::value>::type>
+            : ScalarTypeCode<ScalarType::Opaque>
+        {
+        };
+
+        template <typename T>
+        struct TypeCodeOf<T*, typename std::enable_if<!IsOpaque<T>::value
+                                                      && !std::is_pointer<T>::value>::type>
+            : std::integral_constant<uint8_t, c_pointerTo | ScalarTypeOf<T>::value>
+        {
+        };
+
+        template <typename T>
+        struct TypeCodeOf<T**, typename std::enable_if<IsOpaque<T>::value>::type>
+            : std::integral_constant<uint8_t, c_pointerTo | static_cast<uint8_t>(ScalarType::Opaque)>
+        {
+        };
+    }
+
+
+    // Maps the symbolic IDs used in serialized trees to the functions that
+    // the trees call. Both the writer and the reader must use registries that
+    // map the same IDs to functions with the same signatures.
+    class CallTargetRegistry : private NonCopyable
+    {
+    public:
+        // Creates the CallNode for the target with the given parameter nodes.
+        typedef NodeBase& (*CallBuilder)(ExpressionNodeFactory& factory,
+                                         void* function,
+                                         NodeBase* const * parameters);
+
+        // Calls take any number of parameters. The limit only sizes the fixed
+        // arrays used while registering and rebuilding the call targets.
+        static const unsigned c_maxParameters = 8;
+
+        struct Target
+        {
+            uint32_t m_id;
+            void* m_function;
+            uint8_t m_returnType;
+            unsigned m_parameterCount;
+            uint8_t m_parameterTypes[c_maxParameters];
+            CallBuilder m_builder;
+        };
+
+        template <typename R, typename... P>
+        void Register(uint32_t id, R (*function)(P...));
+
+        // Returns the target registered with the given ID or nullptr.
+        Target const * Find(uint32_t id) const;
+
+        // Returns the target registered for the given function or nullptr.
+        Target const * Find(void const * function) const;
+
+    private:
+        template <typename R, typename... P>
+        class Builder
+        {
+        public:
+            static NodeBase& Build(ExpressionNodeFactory& factory,
+                                   void* function,
+                                   NodeBase* const * parameters);
+
+        private:
+            template <size_t... INDEX>
+            static NodeBase& Build(ExpressionNodeFactory& factory,
+                                   void* function,
+                                   NodeBase* const * parameters,
+                                   std::index_sequence<INDEX...>);
+        };
+
+        void Register(Target const & target);
+
+        std::vector<Target> m_targets;
+    };
+
+
+    // TreeWriter builds an expression tree through ExpressionNodeFactory while
+    // recording each node it creates. The methods mirror the ones from
+    // ExpressionNodeFactory for the subset of nodes that can be serialized.
+    // All the nodes passed to TreeWriter must have been created by it, with
+    // the exception of the function's parameters which must be added through
+    // AddParameter() first.
+    class TreeWriter : private NonCopyable
+    {
+    public:
+        TreeWriter(ExpressionNodeFactory& factory, CallTargetRegistry const & registry);
+
+        template <typename T> ParameterNode<T>& AddParameter(ParameterNode<T>& parameter);
+
+        template <typename T> Node<T>& Immediate(T value);
+
+        template <typename T> Node<T>& Add(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& And(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& Mul(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& Or(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& Sub(Node<T>& left, Node<T>& right);
+
+        template <typename T> Node<T>& Rol(Node<T>& value, uint8_t bitCount);
+        template <typename T> Node<T>& Shl(Node<T>& value, uint8_t bitCount);
+        template <typename T> Node<T>& Shr(Node<T>& value, uint8_t bitCount);
+
+        template <typename TO, typename FROM> Node<TO>& Cast(Node<FROM>& value);
+
+        template <typename T> Node<T>& Deref(Node<T*>& pointer, int32_t index = 0);
+
+        template <typename OBJECT, typename FIELD, typename OBJECT1 = OBJECT>
+        Node<FIELD*>& FieldPointer(Node<OBJECT*>& object, FIELD OBJECT1::*field);
+
+        template <JccType JCC, typename T>
+        FlagExpressionNode<JCC>& Compare(Node<T>& left, Node<T>& right);
+
+        template <typename T, JccType JCC>
+        Node<T>& Conditional(FlagExpressionNode<JCC>& condition,
+                             Node<T>& trueValue,
+                             Node<T>& falseValue);
+
+        // The function must have been registered with the CallTargetRegistry.
+        template <typename R, typename... P>
+        Node<R>& Call(R (*function)(P...), Node<P>&... parameters);
+
+        // Appends the serialized tree with the given root to the output.
+        template <typename T>
+        void Serialize(Node<T>& root, std::vector<uint8_t>& output) const;
+
+    private:
+        void BeginRecord(Serialization::NodeKind kind, uint8_t type);
+        void EndRecord(NodeBase const & node);
+
+        void WriteChild(NodeBase const & child);
+        void WriteUnsigned(uint64_t value);
+        void WriteSigned(int64_t value);
+
+        void WriteTree(NodeBase const & root, std::vector<uint8_t>& output) const;
+
+        ExpressionNodeFactory& m_factory;
+        CallTargetRegistry const & m_registry;
+
+        // Serialized records and the mapping from node IDs to record indexes.
+        std::vector<uint8_t> m_records;
+        std::unordered_map<unsigned, unsigned> m_recordIndexes;
+    };
+
+
+    // TreeReader recreates a serialized tree in an ExpressionNodeFactory. The
+    // parameters of the function that the tree is loaded into must be added
+    // before calling Load().
+    class TreeReader : private NonCopyable
+    {
+    public:
+        TreeReader(ExpressionNodeFactory& factory, CallTargetRegistry const & registry);
+
+        template <typename T> void AddParameter(ParameterNode<T>& parameter);
+
+        // Loads the tree and returns its root, which must be of type T.
+        template <typename T>
+        Node<T>& Load(uint8_t const * data, size_t size);
+
+    private:
+        // Converts a parameter of an opaque pointer type to OpaqueObject*.
+        typedef NodeBase& (*ParameterConverter)(ExpressionNodeFactory& factory, NodeBase& parameter);
+
+        template <typename T>
+        static NodeBase& ConvertOpaqueParameter(ExpressionNodeFactory& factory, NodeBase& parameter);
+
+        template <typename T>
+        static ParameterConverter GetParameterConverter(std::true_type isOpaque);
+
+        template <typename T>
+        static ParameterConverter GetParameterConverter(std::false_type isOpaque);
+
+        void AddParameter(NodeBase& parameter,
+                          unsigned position,
+                          uint8_t type,
+                          ParameterConverter converter);
+
+        NodeBase& Load(uint8_t const * data, size_t size, uint8_t rootType);
+
+        struct ParameterEntry
+        {
+            NodeBase* m_node;
+            uint8_t m_type;
+            ParameterConverter m_converter;
+        };
+
+        ExpressionNodeFactory& m_factory;
+        CallTargetRegistry const & m_registry;
+        std::vector<ParameterEntry> m_parameters;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for CallTargetRegistry
+    //
+    //*************************************************************************
+    template <typename R, typename... P>
+    void CallTargetRegistry::Register(uint32_t id, R (*function)(P...))
+    {
+        static_assert(sizeof...(P) <= c_maxParameters, "Too many parameters.");
+
+        const uint8_t parameterTypes[] = { Serialization::TypeCodeOf<P>::value..., 0 };
+
+        Target target = Target();
+        target.m_id = id;
+        target.m_function = reinterpret_cast<void*>(function);
+        target.m_returnType = Serialization::TypeCodeOf<R>::value;
+        target.m_parameterCount = sizeof...(P);
+        std::memcpy(target.m_parameterTypes, parameterTypes, sizeof...(P));
+        target.m_builder = &Builder<R, P...>::Build;
+
+        Register(target);
+    }
+
+
+    template <typename R, typename... P>
+    NodeBase& CallTargetRegistry::Builder<R, P...>::Build(ExpressionNodeFactory& factory,
+                                                          void* function,
+                                                          NodeBase* const * parameters)
+    {
+        return Build(factory, function, parameters, std::index_sequence_for<P...>());
+    }
+
+
+    template <typename R, typename... P>
+    template <size_t... INDEX>
+    NodeBase& CallTargetRegistry::Builder<R, P...>::Build(ExpressionNodeFactory& factory,
+                                                          void* function,
+                                                          NodeBase* const * parameters,
+                                                          std::index_sequence<INDEX...>)
+    {
+        typedef R (*FunctionType)(P...);
+
+        // The parameters array is unused when there are no parameters.
+        (void)parameters;
+
+        auto & target = factory.Immediate(reinterpret_cast<FunctionType>(function));
+
+        return factory.Call(target, static_cast<Node<P>&>(*parameters[INDEX])...);
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for TreeWriter
+    //
+    //*************************************************************************
+    template <typename T>
+    ParameterNode<T>& TreeWriter::AddParameter(ParameterNode<T>& parameter)
+    {
+        BeginRecord(Serialization::NodeKind::Parameter, Serialization::TypeCodeOf<T>::value);
+        WriteUnsigned(parameter.GetPosition());
+        EndRecord(parameter);
+
+        return parameter;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Immediate(T value)
+    {
+        static_assert(std::is_arithmetic<T>::value, "Only arithmetic immediates can be serialized.");
+
+        auto & node = m_factory.Immediate(value);
+
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+
+        BeginRecord(Serialization::NodeKind::Immediate, Serialization::TypeCodeOf<T>::value);
+        m_records.insert(m_records.end(), bytes, bytes + sizeof(T));
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Add(Node<T>& left, Node<T>& right)
+    {
+        auto & node = m_factory.Add(left, right);
+
+        BeginRecord(Serialization::NodeKind::Add, Serialization::TypeCodeOf<T>::value);
+        WriteChild(left);
+        WriteChild(right);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::And(Node<T>& left, Node<T>& right)
+    {
+        auto & node = m_factory.And(left, right);
+
+        BeginRecord(Serialization::NodeKind::And, Serialization::TypeCodeOf<T>::value);
+        WriteChild(left);
+        WriteChild(right);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Mul(Node<T>& left, Node<T>& right)
+    {
+        auto & node = m_factory.Mul(left, right);
+
+        BeginRecord(Serialization::NodeKind::Mul, Serialization::TypeCodeOf<T>::value);
+        WriteChild(left);
+        WriteChild(right);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Or(Node<T>& left, Node<T>& right)
+    {
+        auto & node = m_factory.Or(left, right);
+
+        BeginRecord(Serialization::NodeKind::Or, Serialization::TypeCodeOf<T>::value);
+        WriteChild(left);
+        WriteChild(right);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Sub(Node<T>& left, Node<T>& right)
+    {
+        auto & node = m_factory.Sub(left, right);
+
+        BeginRecord(Serialization::NodeKind::Sub, Serialization::TypeCodeOf<T>::value);
+        WriteChild(left);
+        WriteChild(right);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Rol(Node<T>& value, uint8_t bitCount)
+    {
+        auto & node = m_factory.Rol(value, bitCount);
+
+        BeginRecord(Serialization::NodeKind::Rol, Serialization::TypeCodeOf<T>::value);
+        WriteChild(value);
+        m_records.push_back(bitCount);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Shl(Node<T>& value, uint8_t bitCount)
+    {
+        auto & node = m_factory.Shl(value, bitCount);
+
+        BeginRecord(Serialization::NodeKind::Shl, Serialization::TypeCodeOf<T>::value);
+        WriteChild(value);
+        m_records.push_back(bitCount);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Shr(Node<T>& value, uint8_t bitCount)
+    {
+        auto & node = m_factory.Shr(value, bitCount);
+
+        BeginRecord(Serialization::NodeKind::Shr, Serialization::TypeCodeOf<T>::value);
+        WriteChild(value);
+        m_records.push_back(bitCount);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename TO, typename FROM>
+    Node<TO>& TreeWriter::Cast(Node<FROM>& value)
+    {
+        auto & node = m_factory.Cast<TO>(value);
+
+        BeginRecord(Serialization::NodeKind::Cast, Serialization::TypeCodeOf<TO>::value);
+        m_records.push_back(Serialization::TypeCodeOf<FROM>::value);
+        WriteChild(value);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    Node<T>& TreeWriter::Deref(Node<T*>& pointer, int32_t index)
+    {
+        auto & node = m_factory.Deref(pointer, index);
+
+        BeginRecord(Serialization::NodeKind::Deref, Serialization::TypeCodeOf<T>::value);
+        WriteChild(pointer);
+        WriteSigned(index);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename OBJECT, typename FIELD, typename OBJECT1>
+    Node<FIELD*>& TreeWriter::FieldPointer(Node<OBJECT*>& object, FIELD OBJECT1::*field)
+    {
+        static_assert(Serialization::IsOpaque<OBJECT>::value, "OBJECT must be a structure.");
+
+        auto & node = m_factory.FieldPointer(object, field);
+
+        // Same calculation as in FieldPointerNode.
+        const int32_t offset = static_cast<int32_t>(
+            reinterpret_cast<uint64_t>(&((static_cast<OBJECT1*>(nullptr))->*field)));
+
+        BeginRecord(Serialization::NodeKind::FieldPointer, Serialization::TypeCodeOf<FIELD*>::value);
+        WriteChild(object);
+        WriteSigned(offset);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <JccType JCC, typename T>
+    FlagExpressionNode<JCC>& TreeWriter::Compare(Node<T>& left, Node<T>& right)
+    {
+        auto & node = m_factory.Compare<JCC>(left, right);
+
+        BeginRecord(Serialization::NodeKind::Compare, Serialization::TypeCodeOf<bool>::value);
+        m_records.push_back(static_cast<uint8_t>(JCC));
+        m_records.push_back(Serialization::TypeCodeOf<T>::value);
+        WriteChild(left);
+        WriteChild(right);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T, JccType JCC>
+    Node<T>& TreeWriter::Conditional(FlagExpressionNode<JCC>& condition,
+                                     Node<T>& trueValue,
+                                     Node<T>& falseValue)
+    {
+        auto & node = m_factory.Conditional(condition, trueValue, falseValue);
+
+        BeginRecord(Serialization::NodeKind::Conditional, Serialization::TypeCodeOf<T>::value);
+        m_records.push_back(static_cast<uint8_t>(JCC));
+        WriteChild(condition);
+        WriteChild(trueValue);
+        WriteChild(falseValue);
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename R, typename... P>
+    Node<R>& TreeWriter::Call(R (*function)(P...), Node<P>&... parameters)
+    {
+        auto target = m_registry.Find(reinterpret_cast<void const *>(function));
+        LogThrowAssert(target != nullptr, "Function is not in the call target registry");
+
+        auto & node = m_factory.Call(m_factory.Immediate(function), parameters...);
+
+        BeginRecord(Serialization::NodeKind::Call, Serialization::TypeCodeOf<R>::value);
+        WriteUnsigned(target->m_id);
+
+        NodeBase const * children[] = { &parameters..., nullptr };
+
+        for (NodeBase const * const * child = children; *child != nullptr; ++child)
+        {
+            WriteChild(**child);
+        }
+
+        EndRecord(node);
+
+        return node;
+    }
+
+
+    template <typename T>
+    void TreeWriter::Serialize(Node<T>& root, std::vector<uint8_t>& output) const
+    {
+        WriteTree(root, output);
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for TreeReader
+    //
+    //*************************************************************************
+    template <typename T>
+    void TreeReader::AddParameter(ParameterNode<T>& parameter)
+    {
+        const uint8_t type = Serialization::TypeCodeOf<T>::value;
+        typedef std::integral_constant<
+            bool,
+            type == static_cast<uint8_t>(Serialization::ScalarType::Opaque)> IsOpaque;
+
+        AddParameter(parameter,
+                     parameter.GetPosition(),
+                     type,
+                     GetParameterConverter<T>(IsOpaque()));
+    }
+
+
+    template <typename T>
+    Node<T>& TreeReader::Load(uint8_t const * data, size_t size)
+    {
+        return static_cast<Node<T>&>(Load(data, size, Serialization::TypeCodeOf<T>::value));
+    }
+
+
+    template <typename T>
+    NodeBase& TreeReader::ConvertOpaqueParameter(ExpressionNodeFactory& factory, NodeBase& parameter)
+    {
+        return factory.Cast<Serialization::OpaqueObject*>(static_cast<Node<T>&>(parameter));
+    }
+
+
+    template <typename T>
+    TreeReader::ParameterConverter TreeReader::GetParameterConverter(std::true_type /* isOpaque */)
+    {
+        return &ConvertOpaqueParameter<T>;
+    }
+
+
+    template <typename T>
+    TreeReader::ParameterConverter TreeReader::GetParameterConverter(std::false_type /* isOpaque */)
+    {
+        return nullptr;
+    }
+}
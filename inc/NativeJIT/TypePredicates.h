@@ -161,4 +161,23 @@ namespace NativeJIT
               || (std::is_pod<T>::value
                   && sizeof(T) <= RegisterBase::c_maxSize);
     };
+
+
+    // Specifies whether all types in a parameter pack are valid parameter
+    // types for a NativeJIT function or a call.
+    template <typename... P>
+    struct AreValidParameters;
+
+    template <>
+    struct AreValidParameters<>
+    {
+        static const bool c_value = true;
+    };
+
+    template <typename P, typename... REST>
+    struct AreValidParameters<P, REST...>
+    {
+        static const bool c_value = IsValidParameter<P>::c_value
+                                    && AreValidParameters<REST...>::c_value;
+    };
 }
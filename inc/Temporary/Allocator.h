@@ -24,6 +24,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "IAllocator.h"
 #include "Temporary/NonCopyable.h"
@@ -32,6 +33,13 @@
 namespace NativeJIT
 {
     // TODO: This should be a private header.
+    //
+    // An arena which hands out memory from a chain of blocks. The first block
+    // has the size passed to the constructor. When the current block can't
+    // satisfy an allocation, a new block at least twice as large is chained.
+    // Reset() keeps only the largest block, grown to the number of bytes
+    // allocated since the previous Reset() if necessary, so that a workload
+    // which repeats after each Reset() stops allocating system memory.
     class Allocator : public Allocators::IAllocator
     {
     public:
@@ -52,11 +60,36 @@ namespace NativeJIT
         // last call to Reset().
         virtual void Reset() override;
 
+        // Returns the number of bytes allocated since construction or the
+        // last call to Reset().
+        size_t GetBytesAllocated() const;
+
+        // Returns the largest value of GetBytesAllocated() since construction.
+        size_t GetHighWaterMark() const;
+
+        // Returns the total size of the blocks owned by the allocator.
+        size_t GetCapacity() const;
+
+        // Returns the number of blocks owned by the allocator.
+        size_t GetBlockCount() const;
+
     private:
-        void DebugInitialize();
+        struct Block
+        {
+            std::unique_ptr<char[]> m_buffer;
+            size_t m_size;
+            size_t m_bytesAllocated;
+        };
+
+        void AddBlock(size_t size);
+
+        void DebugInitialize(Block& block);
+
+        // The allocations are made from the last block.
+        std::vector<Block> m_blocks;
 
-        size_t m_bufferSize;
         size_t m_bytesAllocated;
-        std::unique_ptr<char[]> m_buffer;
+        size_t m_highWaterMark;
+        size_t m_capacity;
     };
 }
@@ -21,7 +21,9 @@
 // THE SOFTWARE.
 
 
+#include <algorithm>
 #include <cstring>
+#include <limits>
 
 #include "Temporary/Allocator.h"
 #include "Temporary/Assert.h"
@@ -35,11 +37,11 @@ namespace NativeJIT
     //
     //*************************************************************************
     Allocator::Allocator(size_t bufferSize)
-        : m_bufferSize(bufferSize),
-          m_bytesAllocated(0),
-          m_buffer(new char[bufferSize])
+        : m_bytesAllocated(0),
+          m_highWaterMark(0),
+          m_capacity(0)
     {
-        DebugInitialize();
+        AddBlock(bufferSize);
     }
 
 
@@ -50,10 +52,18 @@ namespace NativeJIT
 
     void* Allocator::Allocate(size_t size)
     {
-        LogThrowAssert(m_bytesAllocated + size <= m_bufferSize, "Out of memory");
+        if (m_blocks.back().m_bytesAllocated + size > m_blocks.back().m_size)
+        {
+            AddBlock((std::max)(size, 2 * m_blocks.back().m_size));
+        }
+
+        Block& block = m_blocks.back();
+
+        void* result = static_cast<void*>(block.m_buffer.get() + block.m_bytesAllocated);
+        block.m_bytesAllocated += size;
 
-        void* result = static_cast<void*>(m_buffer.get() + m_bytesAllocated);
         m_bytesAllocated += size;
+        m_highWaterMark = (std::max)(m_highWaterMark, m_bytesAllocated);
 
         return result;
     }
@@ -61,8 +71,15 @@ namespace NativeJIT
 
     void Allocator::Deallocate(void* block)
     {
-        LogThrowAssert(static_cast<char*>(block) >= m_buffer.get() &&
-                       static_cast<char*>(block) < m_buffer.get() + m_bytesAllocated,
+        char* const address = static_cast<char*>(block);
+
+        LogThrowAssert(std::any_of(m_blocks.begin(),
+                                   m_blocks.end(),
+                                   [address](Block const & b)
+                                   {
+                                       return address >= b.m_buffer.get()
+                                              && address < b.m_buffer.get() + b.m_bytesAllocated;
+                                   }),
                        "Attempting to deallocate memory not owned by this allocator.");
 
         // Intentional NOP
@@ -71,19 +88,66 @@ namespace NativeJIT
 
     size_t Allocator::MaxSize() const
     {
-        return m_bufferSize;
+        return (std::numeric_limits<size_t>::max)();
     }
 
 
     void Allocator::Reset()
     {
+        // The blocks grow, so the last one is the largest.
+        if (m_blocks.size() > 1)
+        {
+            const size_t size = (std::max)(m_blocks.back().m_size, m_bytesAllocated);
+
+            m_blocks.clear();
+            m_capacity = 0;
+            AddBlock(size);
+        }
+        else
+        {
+            m_blocks.back().m_bytesAllocated = 0;
+            DebugInitialize(m_blocks.back());
+        }
+
         m_bytesAllocated = 0;
-        DebugInitialize();
     }
 
 
-    void Allocator::DebugInitialize()
+    size_t Allocator::GetBytesAllocated() const
+    {
+        return m_bytesAllocated;
+    }
+
+
+    size_t Allocator::GetHighWaterMark() const
+    {
+        return m_highWaterMark;
+    }
+
+
+    size_t Allocator::GetCapacity() const
+    {
+        return m_capacity;
+    }
+
+
+    size_t Allocator::GetBlockCount() const
+    {
+        return m_blocks.size();
+    }
+
+
+    void Allocator::AddBlock(size_t size)
+    {
+        m_blocks.push_back(Block { std::unique_ptr<char[]>(new char[size]), size, 0 });
+        m_capacity += size;
+
+        DebugInitialize(m_blocks.back());
+    }
+
+
+    void Allocator::DebugInitialize(Block& block)
     {
-        memset(m_buffer.get(), 0xcc, m_bufferSize);
+        memset(block.m_buffer.get(), 0xcc, block.m_size);
     }
 }
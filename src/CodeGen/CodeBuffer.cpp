@@ -148,6 +148,26 @@ namespace NativeJIT
     }
 
 
+    void CodeBuffer::RemoveBytes(unsigned startPosition, unsigned length)
+    {
+        LogThrowAssert(startPosition + length <= CurrentPosition(),
+                       "Cannot remove parts of the buffer that have not been populated "
+                       "(populated: [0, %u), wanted [%u, %u))",
+                       CurrentPosition(),
+                       startPosition,
+                       startPosition + length);
+
+        uint8_t* const removedEnd = m_bufferStart + startPosition + length;
+
+        memmove(m_bufferStart + startPosition,
+                removedEnd,
+                m_current - removedEnd);
+        m_current -= length;
+
+        m_localJumpTable.Relocate(removedEnd, -static_cast<ptrdiff_t>(length));
+    }
+
+
     void CodeBuffer::PatchCallSites()
     {
         m_localJumpTable.PatchCallSites();
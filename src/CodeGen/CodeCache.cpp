@@ -0,0 +1,524 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "NativeJIT/CodeGen/CodeCache.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    namespace
+    {
+        const uint8_t c_magic[] = { 'N', 'J', 'C', 'C' };
+        const uint32_t c_version = 2;
+
+
+        // Layout of the start of a cache file. The relocations follow the
+        // header and the image starts at m_imageOffset.
+        struct CacheFileHeader
+        {
+            uint8_t m_magic[4];
+            uint32_t m_version;
+            uint64_t m_treeHash;
+            uint64_t m_cpuFeatures;
+            uint32_t m_imageOffset;
+            uint32_t m_imageSize;
+            uint32_t m_codeStartOffset;
+            uint32_t m_codeEndOffset;
+            uint32_t m_unwindInfoOffset;
+            uint32_t m_relocationCount;
+        };
+
+
+        // Absolute relocations hold the symbol's 64-bit address. Relative ones
+        // are the 32-bit displacements of direct branches to the symbol.
+        enum class RelocationType : uint32_t { Absolute, Relative };
+
+
+        struct CacheFileRelocation
+        {
+            uint32_t m_imageOffset;
+            uint32_t m_symbolId;
+            RelocationType m_type;
+        };
+
+
+        unsigned RoundUp(unsigned x, unsigned powerOfTwo)
+        {
+            return (x + powerOfTwo - 1) & ~(powerOfTwo - 1);
+        }
+
+
+        // Maps the file copy-on-write. Returns nullptr if the file does not
+        // exist.
+        uint8_t* MapFile(char const * path, size_t& size);
+
+        // Makes the specified range of a mapping readable and executable.
+        void ProtectExecutable(uint8_t* start, size_t size);
+
+        void UnmapFile(uint8_t* mapping, size_t size);
+
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        uint8_t* MapFile(char const * path, size_t& size)
+        {
+            HANDLE file = CreateFileA(path,
+                                      GENERIC_READ | GENERIC_EXECUTE,
+                                      FILE_SHARE_READ,
+                                      nullptr,
+                                      OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL,
+                                      nullptr);
+
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return nullptr;
+            }
+
+            LARGE_INTEGER fileSize;
+            const BOOL hasSize = GetFileSizeEx(file, &fileSize);
+
+            HANDLE mapping = hasSize
+                ? CreateFileMappingA(file, nullptr, PAGE_EXECUTE_WRITECOPY, 0, 0, nullptr)
+                : nullptr;
+            CloseHandle(file);
+
+            LogThrowAssert(mapping != nullptr, "Couldn't map code cache file %s", path);
+
+            void* view = MapViewOfFile(mapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0);
+            CloseHandle(mapping);
+
+            LogThrowAssert(view != nullptr, "Couldn't map code cache file %s", path);
+
+            size = static_cast<size_t>(fileSize.QuadPart);
+            return static_cast<uint8_t*>(view);
+        }
+
+
+        void ProtectExecutable(uint8_t* start, size_t size)
+        {
+            DWORD oldProtection;
+            LogThrowAssert(VirtualProtect(start, size, PAGE_EXECUTE_READ, &oldProtection) != 0,
+                           "Couldn't make cached code executable");
+        }
+
+
+        void UnmapFile(uint8_t* mapping, size_t /* size */)
+        {
+            UnmapViewOfFile(mapping);
+        }
+#else
+        uint8_t* MapFile(char const * path, size_t& size)
+        {
+            const int file = open(path, O_RDONLY);
+
+            if (file < 0)
+            {
+                return nullptr;
+            }
+
+            struct stat status;
+            void* mapping = MAP_FAILED;
+
+            if (fstat(file, &status) == 0 && status.st_size > 0)
+            {
+                size = static_cast<size_t>(status.st_size);
+                mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+            }
+
+            close(file);
+
+            LogThrowAssert(mapping != MAP_FAILED, "Couldn't map code cache file %s", path);
+
+            return static_cast<uint8_t*>(mapping);
+        }
+
+
+        void ProtectExecutable(uint8_t* start, size_t size)
+        {
+            LogThrowAssert(mprotect(start, size, PROT_READ | PROT_EXEC) == 0,
+                           "Couldn't make cached code executable");
+        }
+
+
+        void UnmapFile(uint8_t* mapping, size_t size)
+        {
+            munmap(mapping, size);
+        }
+#endif
+    }
+
+
+    //*************************************************************************
+    //
+    // CodeCacheKey
+    //
+    //*************************************************************************
+    CodeCacheKey CodeCacheKey::ForHost(uint64_t treeHash)
+    {
+        return { treeHash, GetHostCpuFeatures() };
+    }
+
+
+    uint64_t CodeCacheKey::HashBytes(void const * data, size_t size)
+    {
+        auto bytes = static_cast<uint8_t const *>(data);
+        uint64_t hash = 0xcbf29ce484222325ull;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+
+        return hash;
+    }
+
+
+    uint64_t CodeCacheKey::GetHostCpuFeatures()
+    {
+        // Feature flags from leaf 1 (ECX, EDX) and, if available, from
+        // leaf 7 (EBX, ECX) which covers AVX2, BMI etc.
+        unsigned features[4] = { 0, 0, 0, 0 };
+        unsigned registers[4];
+
+        CpuFeatures::Cpuid(0, 0, registers);
+        const unsigned maxLeaf = registers[0];
+
+        CpuFeatures::Cpuid(1, 0, registers);
+        features[0] = registers[2];
+        features[1] = registers[3];
+
+        if (maxLeaf >= 7)
+        {
+            CpuFeatures::Cpuid(7, 0, registers);
+            features[2] = registers[1];
+            features[3] = registers[2];
+        }
+
+        return HashBytes(features, sizeof(features));
+    }
+
+
+    //*************************************************************************
+    //
+    // SymbolTable
+    //
+    //*************************************************************************
+    void SymbolTable::Add(uint32_t id, void const * address)
+    {
+        void const * existingAddress;
+        uint32_t existingId;
+
+        LogThrowAssert(!TryGetAddress(id, existingAddress), "Symbol %u is already defined", id);
+        LogThrowAssert(!TryGetId(address, existingId),
+                       "Address of symbol %u is already defined as symbol %u",
+                       id,
+                       existingId);
+
+        m_symbols.push_back({ id, address });
+    }
+
+
+    bool SymbolTable::TryGetAddress(uint32_t id, void const *& address) const
+    {
+        for (auto & symbol : m_symbols)
+        {
+            if (symbol.m_id == id)
+            {
+                address = symbol.m_address;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    bool SymbolTable::TryGetId(void const * address, uint32_t& id) const
+    {
+        for (auto & symbol : m_symbols)
+        {
+            if (symbol.m_address == address)
+            {
+                id = symbol.m_id;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    //*************************************************************************
+    //
+    // CodeCache
+    //
+    //*************************************************************************
+    void CodeCache::Save(char const * path,
+                         CodeCacheKey const & key,
+                         FunctionBuffer const & code,
+                         SymbolTable const & symbols)
+    {
+        auto & relocations = code.GetAbsoluteAddressRelocations();
+
+        std::vector<CacheFileRelocation> fileRelocations;
+        fileRelocations.reserve(relocations.size());
+
+        for (auto offset : relocations)
+        {
+            uint64_t address;
+            std::memcpy(&address, code.BufferStart() + offset, sizeof(address));
+
+            uint32_t id = 0;
+            LogThrowAssert(symbols.TryGetId(reinterpret_cast<void const *>(address), id),
+                           "Address 0x%llx at offset %u is not in the symbol table",
+                           static_cast<unsigned long long>(address),
+                           offset);
+
+            fileRelocations.push_back({ offset, id, RelocationType::Absolute });
+        }
+
+        for (auto & site : code.GetDirectBranchSites())
+        {
+            uint32_t id = 0;
+            LogThrowAssert(symbols.TryGetId(site.m_target, id),
+                           "Direct branch target %p at offset %u is not in the symbol table",
+                           site.m_target,
+                           site.m_offset);
+
+            fileRelocations.push_back({ site.m_offset, id, RelocationType::Relative });
+        }
+
+        const unsigned tableSize = static_cast<unsigned>(
+            sizeof(CacheFileHeader) + fileRelocations.size() * sizeof(CacheFileRelocation));
+
+        CacheFileHeader header;
+        std::memcpy(header.m_magic, c_magic, sizeof(c_magic));
+        header.m_version = c_version;
+        header.m_treeHash = key.m_treeHash;
+        header.m_cpuFeatures = key.m_cpuFeatures;
+        header.m_imageOffset = RoundUp(tableSize, CodeCache::c_imageAlignment);
+        header.m_imageSize = code.CurrentPosition();
+        header.m_codeStartOffset = code.GetFunctionCodeStartOffset();
+        header.m_codeEndOffset = code.GetFunctionCodeEndOffset();
+        header.m_unwindInfoOffset = code.GetUnwindInfoStartOffset();
+        header.m_relocationCount = static_cast<uint32_t>(fileRelocations.size());
+
+        const std::vector<char> padding(header.m_imageOffset - tableSize, 0);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        file.write(reinterpret_cast<char const *>(fileRelocations.data()),
+                   fileRelocations.size() * sizeof(CacheFileRelocation));
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<char const *>(code.BufferStart()), header.m_imageSize);
+        file.close();
+
+        LogThrowAssert(file.good(), "Couldn't write code cache file %s", path);
+    }
+
+
+    //*************************************************************************
+    //
+    // CachedFunction
+    //
+    //*************************************************************************
+    CachedFunction::CachedFunction()
+        : m_mapping(nullptr),
+          m_mappingSize(0),
+          m_entryPoint(nullptr),
+          m_runtimeFunction()
+    {
+    }
+
+
+    CachedFunction::~CachedFunction()
+    {
+        Unload();
+    }
+
+
+    bool CachedFunction::Load(char const * path,
+                              CodeCacheKey const & key,
+                              SymbolTable const & symbols)
+    {
+        Unload();
+
+        size_t size = 0;
+        uint8_t* mapping = MapFile(path, size);
+
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+
+        m_mapping = mapping;
+        m_mappingSize = size;
+
+        CacheFileHeader header;
+        LogThrowAssert(size >= sizeof(header), "Code cache file %s is truncated", path);
+        std::memcpy(&header, mapping, sizeof(header));
+
+        LogThrowAssert(std::memcmp(header.m_magic, c_magic, sizeof(c_magic)) == 0,
+                       "%s is not a code cache file",
+                       path);
+
+        // Files from other versions of NativeJIT or for other trees or CPUs
+        // are cache misses rather than errors.
+        if (header.m_version != c_version
+            || header.m_treeHash != key.m_treeHash
+            || header.m_cpuFeatures != key.m_cpuFeatures)
+        {
+            Unload();
+            return false;
+        }
+
+        const uint64_t tableSize = sizeof(CacheFileHeader)
+                                   + uint64_t(header.m_relocationCount) * sizeof(CacheFileRelocation);
+
+        LogThrowAssert(header.m_imageOffset % CodeCache::c_imageAlignment == 0
+                       && tableSize <= header.m_imageOffset
+                       && uint64_t(header.m_imageOffset) + header.m_imageSize <= size
+                       && header.m_codeStartOffset < header.m_codeEndOffset
+                       && header.m_codeEndOffset <= header.m_imageSize,
+                       "Code cache file %s is corrupt",
+                       path);
+
+        uint8_t* image = mapping + header.m_imageOffset;
+        auto relocations = mapping + sizeof(CacheFileHeader);
+
+        for (uint32_t i = 0; i < header.m_relocationCount; ++i)
+        {
+            CacheFileRelocation relocation;
+            std::memcpy(&relocation,
+                        relocations + i * sizeof(CacheFileRelocation),
+                        sizeof(relocation));
+
+            const bool isRelative = relocation.m_type == RelocationType::Relative;
+            const unsigned valueSize = isRelative ? sizeof(int32_t) : sizeof(uint64_t);
+
+            LogThrowAssert((isRelative || relocation.m_type == RelocationType::Absolute)
+                           && uint64_t(relocation.m_imageOffset) + valueSize <= header.m_imageSize,
+                           "Invalid relocation at offset %u in code cache file %s",
+                           relocation.m_imageOffset,
+                           path);
+
+            void const * address = nullptr;
+            LogThrowAssert(symbols.TryGetAddress(relocation.m_symbolId, address),
+                           "Symbol %u referenced from code cache file %s is not defined",
+                           relocation.m_symbolId,
+                           path);
+
+            if (isRelative)
+            {
+                // The file may be mapped too far from the symbol for a direct
+                // branch, in which case the function has to be recompiled.
+                const int64_t displacement
+                    = reinterpret_cast<int64_t>(address)
+                      - reinterpret_cast<int64_t>(image + relocation.m_imageOffset + sizeof(int32_t));
+
+                if (displacement < (std::numeric_limits<int32_t>::min)()
+                    || displacement > (std::numeric_limits<int32_t>::max)())
+                {
+                    Unload();
+                    return false;
+                }
+
+                const int32_t value = static_cast<int32_t>(displacement);
+                std::memcpy(image + relocation.m_imageOffset, &value, sizeof(value));
+            }
+            else
+            {
+                const uint64_t value = reinterpret_cast<uint64_t>(address);
+                std::memcpy(image + relocation.m_imageOffset, &value, sizeof(value));
+            }
+        }
+
+        ProtectExecutable(image, header.m_imageSize);
+
+        m_runtimeFunction.BeginAddress = header.m_codeStartOffset;
+        m_runtimeFunction.EndAddress = header.m_codeEndOffset;
+        m_runtimeFunction.UnwindData = header.m_unwindInfoOffset;
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        LogThrowAssert(RtlAddFunctionTable(&m_runtimeFunction, 1, reinterpret_cast<DWORD64>(image)),
+                       "Couldn't register unwind information for %s",
+                       path);
+#endif
+
+        m_entryPoint = image + header.m_codeStartOffset;
+
+        return true;
+    }
+
+
+    void CachedFunction::Unload()
+    {
+        if (m_mapping != nullptr)
+        {
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+            if (m_entryPoint != nullptr)
+            {
+                RtlDeleteFunctionTable(&m_runtimeFunction);
+            }
+#endif
+
+            UnmapFile(m_mapping, m_mappingSize);
+        }
+
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+        m_entryPoint = nullptr;
+        m_runtimeFunction = {0, 0, 0};
+    }
+
+
+    bool CachedFunction::IsLoaded() const
+    {
+        return m_entryPoint != nullptr;
+    }
+
+
+    void const * CachedFunction::GetEntryPoint() const
+    {
+        LogThrowAssert(IsLoaded(), "No function has been loaded from the code cache");
+
+        return m_entryPoint;
+    }
+}
@@ -0,0 +1,172 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <cstring>
+
+#include "NativeJIT/CodeGen/ConstantPool.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    ConstantPool::ConstantPool(Allocators::IAllocator& allocator, FunctionBuffer& code)
+        : m_code(code),
+          m_stlAllocator(allocator),
+          m_entries(m_stlAllocator),
+          m_bucketAllocator(allocator),
+          m_buckets(m_bucketAllocator)
+    {
+    }
+
+
+    void ConstantPool::Clear()
+    {
+        m_entries.clear();
+        m_buckets.clear();
+    }
+
+
+    int32_t ConstantPool::Add(void const * data,
+                              unsigned size,
+                              unsigned alignment,
+                              bool isAbsoluteAddress)
+    {
+        LogThrowAssert(size > 0, "Empty constant");
+        LogThrowAssert(alignment > 0
+                       && alignment <= c_maxAlignment
+                       && (alignment & (alignment - 1)) == 0,
+                       "Invalid constant alignment %u",
+                       alignment);
+        LogThrowAssert(!isAbsoluteAddress || size == sizeof(void*),
+                       "Invalid size %u of an absolute address",
+                       size);
+
+        uint8_t const * bufferStart = m_code.BufferStart();
+        const uint32_t hash = Hash(data, size, isAbsoluteAddress);
+        const size_t mask = m_buckets.size() - 1;
+
+        // Entries with the same contents but insufficient alignment are
+        // skipped and probing continues.
+        for (size_t i = hash & mask; !m_buckets.empty() && m_buckets[i] != 0; i = (i + 1) & mask)
+        {
+            auto const & entry = m_entries[m_buckets[i] - 1];
+
+            if (entry.m_hash == hash
+                && entry.m_size == size
+                && entry.m_isAbsoluteAddress == isAbsoluteAddress
+                && entry.m_offset % alignment == 0
+                && memcmp(bufferStart + entry.m_offset, data, size) == 0)
+            {
+                return entry.m_offset;
+            }
+        }
+
+        while (m_code.CurrentPosition() % alignment != 0)
+        {
+            m_code.Emit8(0xaa);
+        }
+
+        const Entry entry = { hash, static_cast<int32_t>(m_code.CurrentPosition()), size, isAbsoluteAddress };
+
+        m_code.EmitBytes(static_cast<uint8_t const *>(data), size);
+        m_code.AddConstant(entry.m_offset, size, alignment);
+
+        if (isAbsoluteAddress)
+        {
+            m_code.AddAbsoluteAddressRelocation(entry.m_offset);
+        }
+
+        m_entries.push_back(entry);
+
+        if (m_entries.size() * 2 > m_buckets.size())
+        {
+            GrowIndex();
+        }
+        else
+        {
+            InsertIntoIndex(static_cast<unsigned>(m_entries.size() - 1));
+        }
+
+        return entry.m_offset;
+    }
+
+
+    unsigned ConstantPool::GetEntryCount() const
+    {
+        return static_cast<unsigned>(m_entries.size());
+    }
+
+
+    uint32_t ConstantPool::Hash(void const * data, unsigned size, bool isAbsoluteAddress)
+    {
+        // FNV-1a over the contents, seeded with the rest of the key.
+        uint64_t hash = 14695981039346656037ull ^ (size * 2 + (isAbsoluteAddress ? 1 : 0));
+
+        for (unsigned i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<uint8_t const *>(data)[i];
+            hash *= 1099511628211ull;
+        }
+
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+
+    void ConstantPool::InsertIntoIndex(unsigned entryIndex)
+    {
+        const size_t mask = m_buckets.size() - 1;
+        size_t i = m_entries[entryIndex].m_hash & mask;
+
+        while (m_buckets[i] != 0)
+        {
+            i = (i + 1) & mask;
+        }
+
+        m_buckets[i] = entryIndex + 1;
+    }
+
+
+    void ConstantPool::GrowIndex()
+    {
+        const size_t size = m_buckets.empty() ? 16 : m_buckets.size() * 2;
+
+        m_buckets.assign(size, 0);
+
+        for (unsigned i = 0; i < m_entries.size(); ++i)
+        {
+            InsertIntoIndex(i);
+        }
+    }
+
+
+    unsigned ConstantPool::GetNaturalAlignment(unsigned size)
+    {
+        LogThrowAssert(size > 0, "Empty constant");
+
+        const unsigned alignment = size & (~size + 1);
+
+        return alignment < c_maxAlignment ? alignment : c_maxAlignment;
+    }
+}
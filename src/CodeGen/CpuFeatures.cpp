@@ -0,0 +1,123 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <immintrin.h>  // For _xgetbv.
+#include <intrin.h>     // For __cpuidex.
+#else
+#include <cpuid.h>      // For __cpuid_count.
+#endif
+
+#include "NativeJIT/BitOperations.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+
+
+namespace NativeJIT
+{
+    namespace
+    {
+        // Bits in ECX of CPUID leaf 1.
+        const unsigned c_sse41Bit = 19;
+        const unsigned c_sse42Bit = 20;
+        const unsigned c_fmaBit = 12;
+        const unsigned c_osxsaveBit = 27;
+        const unsigned c_avxBit = 28;
+
+        // XCR0 bits for the SSE and AVX register state.
+        const uint64_t c_avxStateMask = 0x6;
+
+
+        unsigned GetLeaf1Ecx()
+        {
+            unsigned registers[4];
+            CpuFeatures::Cpuid(1, 0, registers);
+
+            return registers[2];
+        }
+
+
+        uint64_t GetXcr0()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t eax;
+            uint32_t edx;
+            __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+
+            return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+        }
+    }
+
+
+    void CpuFeatures::Cpuid(unsigned leaf, unsigned subleaf, unsigned (&registers)[4])
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            registers[i] = static_cast<unsigned>(info[i]);
+        }
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+
+    bool CpuFeatures::HasSSE41()
+    {
+        static const bool hasSSE41 = BitOp::TestBit(GetLeaf1Ecx(), c_sse41Bit);
+
+        return hasSSE41;
+    }
+
+
+    bool CpuFeatures::HasSSE42()
+    {
+        static const bool hasSSE42 = BitOp::TestBit(GetLeaf1Ecx(), c_sse42Bit);
+
+        return hasSSE42;
+    }
+
+
+    bool CpuFeatures::HasFMA()
+    {
+        static const bool hasFMA = []()
+        {
+            const unsigned ecx = GetLeaf1Ecx();
+
+            return BitOp::TestBit(ecx, c_fmaBit)
+                && BitOp::TestBit(ecx, c_avxBit)
+                && BitOp::TestBit(ecx, c_osxsaveBit)
+                && (GetXcr0() & c_avxStateMask) == c_avxStateMask;
+        }();
+
+        return hasFMA;
+    }
+}
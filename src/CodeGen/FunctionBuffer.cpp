@@ -21,10 +21,12 @@
 // THE SOFTWARE.
 
 
+#include <cstdio>       // For snprintf.
 #include <stdexcept>
 
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionSpecification.h"
+#include "NativeJIT/CodeGen/IFunctionListener.h"
 #include "UnwindCode.h"
 
 
@@ -72,7 +74,8 @@ namespace NativeJIT
           m_unwindInfoByteLength(0),
           m_prologStartOffset(0),
           m_prologLength(0),
-          m_isCodeGenerationCompleted(false)
+          m_isCodeGenerationCompleted(false),
+          m_listener(nullptr)
     {
         LogThrowAssert(reinterpret_cast<size_t>(&m_runtimeFunction) % sizeof(DWORD) == 0,
                        "RUNTIME_FUNCTION must be DWORD aligned");
@@ -104,6 +107,8 @@ namespace NativeJIT
         auto entry = reinterpret_cast<RUNTIME_FUNCTION*>(
             UnwindUtils::MakeFunctionTableIdentifier(this));
         RtlDeleteFunctionTable(entry);
+#else
+        DeregisterEhFrame();
 #endif
     }
 
@@ -192,6 +197,30 @@ namespace NativeJIT
                        spec.GetPrologLength(),
                        m_prologLength);
 
+        // Fill in the tail call epilogs. The epilog is the same except for the
+        // final RET which is replaced by the JMP that follows the reserved
+        // space. Start from the last one so that removing the unused space
+        // doesn't move the ones that are yet to be filled in.
+        const unsigned tailCallEpilogLength = spec.GetEpilogLength() - 1;
+
+        LogThrowAssert(spec.GetEpilogLength() > 0
+                       && spec.GetEpilog()[tailCallEpilogLength] == 0xc3,
+                       "Epilog must end with RET");
+
+        for (auto it = m_tailCallJumps.rbegin(); it != m_tailCallJumps.rend(); ++it)
+        {
+            LogThrowAssert(it->m_endOffset != 0,
+                           "Missing EndTailCallJump() for the tail call at offset %u",
+                           it->m_startOffset);
+
+            ReplaceBytes(it->m_startOffset, spec.GetEpilog(), tailCallEpilogLength);
+            RemoveBytes(it->m_startOffset + tailCallEpilogLength,
+                        FunctionSpecification::c_maxPrologOrEpilogSize - tailCallEpilogLength);
+
+            // The JMP follows the epilog.
+            it->m_startOffset += tailCallEpilogLength;
+        }
+
         // Write the unwind info to the buffer.
         // Note: alignment for start and max size of the target has already been
         // verified in BeginFunctionBodyGeneration().
@@ -200,17 +229,26 @@ namespace NativeJIT
                      spec.GetUnwindInfoByteLength());
         m_unwindInfoByteLength = spec.GetUnwindInfoByteLength();
 
-        // If more bytes was reserved than was needed for the prolog, adjust
-        // the offset and length so that the end of the prolog is adjascent to
-        // the beginning of the body of the function.
-        if (spec.GetPrologLength() < m_prologLength)
+        // If more bytes were reserved than were needed for the unwind info and
+        // the prolog, remove the unused bytes between them so that the prolog
+        // directly follows the unwind info and the end of the prolog is
+        // adjacent to the beginning of the body of the function. The body is
+        // moved towards the beginning of the buffer, together with its labels,
+        // call sites and RIP-relative displacements.
+        const unsigned unusedStart = m_unwindInfoStartOffset + m_unwindInfoByteLength;
+        const unsigned unusedLength = m_prologStartOffset
+                                      + m_prologLength
+                                      - spec.GetPrologLength()
+                                      - unusedStart;
+
+        if (unusedLength > 0)
         {
-            const unsigned delta = m_prologLength - spec.GetPrologLength();
-
-            m_prologStartOffset += delta;
-            m_prologLength -= delta;
+            RemoveBytes(unusedStart, unusedLength);
         }
 
+        m_prologStartOffset = unusedStart;
+        m_prologLength = spec.GetPrologLength();
+
         ReplaceBytes(m_prologStartOffset,
                      spec.GetProlog(),
                      spec.GetPrologLength());
@@ -227,11 +265,156 @@ namespace NativeJIT
         m_runtimeFunction.UnwindData = m_unwindInfoStartOffset;
 
         m_isCodeGenerationCompleted = true;
+
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        RegisterEhFrame();
+#endif
+
+        if (m_listener != nullptr)
+        {
+            m_listener->OnFunctionGenerated(*this);
+        }
+    }
+
+
+    void FunctionBuffer::AddAbsoluteAddressRelocation(unsigned offset)
+    {
+        LogThrowAssert(offset + sizeof(uint64_t) <= CurrentPosition(),
+                       "Relocation at offset %u is outside of the emitted code",
+                       offset);
+
+        m_absoluteAddressRelocations.push_back(offset);
+    }
+
+
+    std::vector<unsigned> const & FunctionBuffer::GetAbsoluteAddressRelocations() const
+    {
+        return m_absoluteAddressRelocations;
+    }
+
+
+    void FunctionBuffer::AddConstant(unsigned offset, unsigned size, unsigned alignment)
+    {
+        LogThrowAssert(offset + size <= CurrentPosition(),
+                       "Constant at offset %u is outside of the emitted code",
+                       offset);
+        LogThrowAssert(m_constants.empty()
+                       || m_constants.back().m_offset + m_constants.back().m_size <= offset,
+                       "Constant at offset %u overlaps the previous one",
+                       offset);
+
+        const Constant constant = { offset, size, alignment };
+        m_constants.push_back(constant);
+    }
+
+
+    std::vector<FunctionBuffer::Constant> const & FunctionBuffer::GetConstants() const
+    {
+        return m_constants;
+    }
+
+
+    void FunctionBuffer::ReserveTailCallEpilog()
+    {
+        LogThrowAssert(!m_isCodeGenerationCompleted, "Code generation has already been completed");
+
+        const TailCallJump jump = { CurrentPosition(), 0 };
+        m_tailCallJumps.push_back(jump);
+        Advance(FunctionSpecification::c_maxPrologOrEpilogSize);
+    }
+
+
+    void FunctionBuffer::EndTailCallJump()
+    {
+        LogThrowAssert(!m_tailCallJumps.empty() && m_tailCallJumps.back().m_endOffset == 0,
+                       "No tail call epilog has been reserved");
+        LogThrowAssert(CurrentPosition() > m_tailCallJumps.back().m_startOffset
+                                           + FunctionSpecification::c_maxPrologOrEpilogSize,
+                       "Missing JMP after the tail call epilog at offset %u",
+                       m_tailCallJumps.back().m_startOffset);
+
+        m_tailCallJumps.back().m_endOffset = CurrentPosition();
+    }
+
+
+    std::vector<FunctionBuffer::TailCallJump> const & FunctionBuffer::GetTailCallJumps() const
+    {
+        return m_tailCallJumps;
+    }
+
+
+    void FunctionBuffer::SetFunctionName(char const * name)
+    {
+        m_functionName = name;
+    }
+
+
+    std::string const & FunctionBuffer::GetFunctionName() const
+    {
+        return m_functionName;
+    }
+
+
+    std::string FunctionBuffer::GetSymbolName() const
+    {
+        if (!m_functionName.empty())
+        {
+            return m_functionName;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "NativeJIT_%p", GetEntryPoint());
+
+        return name;
+    }
+
+
+    void FunctionBuffer::SetListener(IFunctionListener* listener)
+    {
+        m_listener = listener;
+    }
+
+
+    bool FunctionBuffer::IsDebugInfoEnabled() const
+    {
+        return m_listener != nullptr && m_listener->IsDebugInfoRequested();
+    }
+
+
+    void FunctionBuffer::AddDebugInfo(unsigned offset, unsigned nodeId)
+    {
+        if (!IsDebugInfoEnabled())
+        {
+            return;
+        }
+
+        if (!m_debugInfo.empty() && m_debugInfo.back().m_offset == offset)
+        {
+            m_debugInfo.back().m_nodeId = nodeId;
+        }
+        else
+        {
+            LogThrowAssert(m_debugInfo.empty() || m_debugInfo.back().m_offset < offset,
+                           "Debug info offset %u precedes the previous entry",
+                           offset);
+
+            m_debugInfo.push_back({ offset, nodeId });
+        }
+    }
+
+
+    std::vector<FunctionBuffer::DebugInfoEntry> const & FunctionBuffer::GetDebugInfo() const
+    {
+        return m_debugInfo;
     }
 
 
     void FunctionBuffer::Reset()
     {
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        DeregisterEhFrame();
+#endif
+
         X64CodeGenerator::Reset();
 
         m_unwindInfoStartOffset
@@ -241,5 +424,68 @@ namespace NativeJIT
             = 0;
         m_isCodeGenerationCompleted = false;
         m_runtimeFunction = {0, 0, 0};
+        m_absoluteAddressRelocations.clear();
+        m_constants.clear();
+        m_tailCallJumps.clear();
+        m_debugInfo.clear();
     }
+
+
+    void FunctionBuffer::RemoveBytes(unsigned startPosition, unsigned length)
+    {
+        X64CodeGenerator::RemoveBytes(startPosition, length);
+
+        for (auto & offset : m_absoluteAddressRelocations)
+        {
+            if (offset >= startPosition)
+            {
+                LogThrowAssert(offset >= startPosition + length,
+                               "Cannot remove relocation at offset %u",
+                               offset);
+                offset -= length;
+            }
+        }
+
+        for (auto & jump : m_tailCallJumps)
+        {
+            if (jump.m_startOffset >= startPosition)
+            {
+                jump.m_startOffset -= length;
+            }
+
+            if (jump.m_endOffset >= startPosition)
+            {
+                jump.m_endOffset -= length;
+            }
+        }
+
+        for (auto & entry : m_debugInfo)
+        {
+            if (entry.m_offset >= startPosition)
+            {
+                entry.m_offset = entry.m_offset >= startPosition + length
+                                 ? entry.m_offset - length
+                                 : startPosition;
+            }
+        }
+    }
+
+
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+    void FunctionBuffer::RegisterEhFrame()
+    {
+        DeregisterEhFrame();
+
+        UnwindUtils::BuildEhFrame(*this,
+                                  reinterpret_cast<uint64_t>(BufferStart() + m_runtimeFunction.BeginAddress),
+                                  m_ehFrame);
+        UnwindUtils::RegisterEhFrame(m_ehFrame);
+    }
+
+
+    void FunctionBuffer::DeregisterEhFrame()
+    {
+        UnwindUtils::DeregisterEhFrame(m_ehFrame);
+    }
+#endif
 }
@@ -0,0 +1,394 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <algorithm>    // For std::upper_bound.
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "NativeJIT/CodeGen/ConstantPool.h"
+#include "NativeJIT/CodeGen/FunctionModule.h"
+#include "Temporary/IAllocator.h"
+#include "UnwindCode.h"
+
+
+namespace NativeJIT
+{
+    namespace
+    {
+        unsigned AlignUp(unsigned value, unsigned alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+    RUNTIME_FUNCTION*
+    FunctionModule::WindowsGetRuntimeFunctionCallback(DWORD64 controlPc, void* context)
+    {
+        auto const module = reinterpret_cast<FunctionModule*>(context);
+        auto const pc = reinterpret_cast<uint8_t const *>(controlPc);
+
+        if (pc < module->m_bufferStart)
+        {
+            return nullptr;
+        }
+
+        const DWORD offset = static_cast<DWORD>(pc - module->m_bufferStart);
+
+        // Find the last function which starts at or before the offset.
+        auto it = std::upper_bound(module->m_functions.begin(),
+                                   module->m_functions.end(),
+                                   offset,
+                                   [](DWORD value, RUNTIME_FUNCTION const & f)
+                                   {
+                                       return value < f.BeginAddress;
+                                   });
+
+        if (it == module->m_functions.begin())
+        {
+            return nullptr;
+        }
+
+        --it;
+
+        return offset < it->EndAddress ? &*it : nullptr;
+    }
+#endif
+
+
+    FunctionModule::FunctionModule(Allocators::IAllocator& codeAllocator,
+                                   unsigned capacity,
+                                   unsigned constantPoolCapacity)
+        : m_codeAllocator(codeAllocator),
+          m_capacity(capacity),
+          m_constantPoolCapacity(AlignUp(constantPoolCapacity, c_functionAlignment)),
+          m_bufferStart(nullptr),
+          m_constantPoolSize(0),
+          m_codeEnd(0)
+    {
+        LogThrowAssert(m_constantPoolCapacity <= capacity,
+                       "Constant pool capacity %u exceeds the total capacity %u",
+                       m_constantPoolCapacity,
+                       capacity);
+
+        m_bufferStart = static_cast<uint8_t*>(codeAllocator.Allocate(capacity));
+        m_codeEnd = m_constantPoolCapacity;
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        if (!RtlInstallFunctionTableCallback(UnwindUtils::MakeFunctionTableIdentifier(this),
+                                             reinterpret_cast<DWORD64>(m_bufferStart),
+                                             m_capacity,
+                                             &FunctionModule::WindowsGetRuntimeFunctionCallback,
+                                             this,
+                                             nullptr))
+        {
+            m_codeAllocator.Deallocate(m_bufferStart);
+            throw std::runtime_error("Couldn't install function table callback");
+        }
+#endif
+    }
+
+
+    FunctionModule::~FunctionModule()
+    {
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        auto entry = reinterpret_cast<RUNTIME_FUNCTION*>(
+            UnwindUtils::MakeFunctionTableIdentifier(this));
+        RtlDeleteFunctionTable(entry);
+#else
+        for (auto & ehFrame : m_ehFrames)
+        {
+            UnwindUtils::DeregisterEhFrame(ehFrame);
+        }
+#endif
+
+        m_codeAllocator.Deallocate(m_bufferStart);
+    }
+
+
+    unsigned FunctionModule::AddFunction(FunctionBuffer const & code)
+    {
+        // Source layout: [data][unwind info][prolog, body, epilog]. The unwind
+        // info directly precedes the function code and both are copied
+        // together, the data goes to the constant pool.
+        const unsigned dataLength = code.GetUnwindInfoStartOffset();
+        const unsigned unwindInfoLength = code.GetFunctionCodeStartOffset() - dataLength;
+        const unsigned codeLength = code.GetFunctionCodeEndOffset()
+                                    - code.GetFunctionCodeStartOffset();
+
+        uint8_t const * source = code.BufferStart();
+        auto const & constants = code.GetConstants();
+
+        // Returns the index of the recorded constant which contains the
+        // offset, or constants.size() if there is none.
+        auto findSourceConstant = [&](int64_t offset)
+        {
+            auto it = std::upper_bound(constants.begin(),
+                                       constants.end(),
+                                       offset,
+                                       [](int64_t value, FunctionBuffer::Constant const & c)
+                                       {
+                                           return value < c.m_offset;
+                                       });
+
+            if (it != constants.begin() && offset < (it - 1)->m_offset + (it - 1)->m_size)
+            {
+                return static_cast<size_t>(it - 1 - constants.begin());
+            }
+
+            return constants.size();
+        };
+
+        // The constants can be shared only if the code doesn't reference any
+        // other data.
+        bool shareConstants = true;
+
+        for (unsigned site : code.GetRIPRelativeSites())
+        {
+            LogThrowAssert(site >= dataLength && site < code.GetFunctionCodeEndOffset(),
+                           "RIP-relative displacement at offset %u is outside of the function",
+                           site);
+
+            int32_t displacement;
+            memcpy(&displacement, source + site, sizeof(displacement));
+
+            const int64_t target = static_cast<int64_t>(site) + sizeof(displacement) + displacement;
+
+            if (target < dataLength && findSourceConstant(target) == constants.size())
+            {
+                shareConstants = false;
+                break;
+            }
+        }
+
+        // Places the data in the constant pool. With shared constants, the
+        // new ones are appended to the pool and the rest is found in it.
+        // Otherwise all data is copied to dataStart.
+        std::vector<unsigned> constantOffsets;
+        std::vector<uint32_t> constantHashes;
+        unsigned dataStart = AlignUp(m_constantPoolSize, c_functionAlignment);
+        unsigned constantPoolSize = dataStart + dataLength;
+
+        if (shareConstants)
+        {
+            dataStart = m_constantPoolSize;
+            constantPoolSize = m_constantPoolSize;
+
+            for (auto const & constant : constants)
+            {
+                const uint32_t hash = ConstantPool::Hash(source + constant.m_offset,
+                                                         constant.m_size,
+                                                         false);
+                unsigned offset;
+
+                if (!FindConstant(source, hash, constant, offset))
+                {
+                    offset = AlignUp(constantPoolSize, constant.m_alignment);
+                    constantPoolSize = offset + constant.m_size;
+                }
+
+                constantOffsets.push_back(offset);
+                constantHashes.push_back(hash);
+            }
+        }
+
+        LogThrowAssert(constantPoolSize <= m_constantPoolCapacity,
+                       "Constant pool overflow, wanted %u bytes, only %u out of %u bytes available",
+                       constantPoolSize - m_constantPoolSize,
+                       m_constantPoolCapacity - m_constantPoolSize,
+                       m_constantPoolCapacity);
+
+        // Unwind info must be DWORD-aligned. Since its length is a multiple
+        // of DWORD size, that's guaranteed by aligning the entry point.
+        const unsigned entryPoint = AlignUp(m_codeEnd + unwindInfoLength, c_functionAlignment);
+        const unsigned unwindInfoStart = entryPoint - unwindInfoLength;
+        const unsigned codeEnd = entryPoint + codeLength;
+
+        LogThrowAssert(unwindInfoStart % sizeof(DWORD) == 0,
+                       "Unaligned unwind info at offset %u",
+                       unwindInfoStart);
+
+        LogThrowAssert(codeEnd <= m_capacity,
+                       "FunctionModule overflow, wanted %u bytes, only %u out of %u bytes available",
+                       codeEnd - m_codeEnd,
+                       m_capacity - m_codeEnd,
+                       m_capacity);
+
+        if (shareConstants)
+        {
+            for (size_t i = 0; i < constants.size(); ++i)
+            {
+                auto const & constant = constants[i];
+
+                // New constants are placed after the end of the pool.
+                if (constantOffsets[i] >= m_constantPoolSize)
+                {
+                    memcpy(m_bufferStart + constantOffsets[i],
+                           source + constant.m_offset,
+                           constant.m_size);
+
+                    const Constant entry = { constantOffsets[i], constant.m_size };
+                    m_constants.emplace(constantHashes[i], entry);
+                }
+            }
+        }
+        else
+        {
+            memcpy(m_bufferStart + dataStart, source, dataLength);
+        }
+
+        // Fill the alignment padding with int3.
+        memset(m_bufferStart + m_codeEnd, 0xcc, unwindInfoStart - m_codeEnd);
+        memcpy(m_bufferStart + unwindInfoStart,
+               source + dataLength,
+               unwindInfoLength + codeLength);
+
+        // Maps an offset within the source buffer to the offset in the module.
+        auto relocate = [&](int64_t offset) -> int64_t
+        {
+            if (offset >= dataLength)
+            {
+                return offset - dataLength + unwindInfoStart;
+            }
+            else if (shareConstants)
+            {
+                const size_t i = findSourceConstant(offset);
+                return constantOffsets[i] + (offset - constants[i].m_offset);
+            }
+            else
+            {
+                return offset + dataStart;
+            }
+        };
+
+        for (unsigned site : code.GetRIPRelativeSites())
+        {
+            int32_t displacement;
+            memcpy(&displacement, source + site, sizeof(displacement));
+
+            const int64_t target = static_cast<int64_t>(site) + sizeof(displacement) + displacement;
+            const int64_t newSite = relocate(site);
+            const int64_t newDisplacement = relocate(target) - newSite - sizeof(displacement);
+
+            // The module capacity is limited to 32 bits, so the displacement
+            // cannot overflow.
+            displacement = static_cast<int32_t>(newDisplacement);
+            memcpy(m_bufferStart + newSite, &displacement, sizeof(displacement));
+        }
+
+        // Direct branches to targets outside of the function need to be
+        // redirected from their new location.
+        for (auto const & site : code.GetDirectBranchSites())
+        {
+            const int64_t newSite = relocate(site.m_offset);
+            const int64_t newDisplacement
+                = reinterpret_cast<int64_t>(site.m_target)
+                  - reinterpret_cast<int64_t>(m_bufferStart + newSite + sizeof(int32_t));
+
+            LogThrowAssert(newDisplacement >= (std::numeric_limits<int32_t>::min)()
+                           && newDisplacement <= (std::numeric_limits<int32_t>::max)(),
+                           "Direct branch target %p is out of range of the FunctionModule",
+                           site.m_target);
+
+            const int32_t displacement = static_cast<int32_t>(newDisplacement);
+            memcpy(m_bufferStart + newSite, &displacement, sizeof(displacement));
+        }
+
+        RUNTIME_FUNCTION function;
+        function.BeginAddress = entryPoint;
+        function.EndAddress = codeEnd;
+        function.UnwindData = unwindInfoStart;
+
+        m_functions.push_back(function);
+        m_constantPoolSize = constantPoolSize;
+        m_codeEnd = codeEnd;
+
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        m_ehFrames.emplace_back();
+        UnwindUtils::BuildEhFrame(code,
+                                  reinterpret_cast<uint64_t>(m_bufferStart + entryPoint),
+                                  m_ehFrames.back());
+        UnwindUtils::RegisterEhFrame(m_ehFrames.back());
+#endif
+
+        return static_cast<unsigned>(m_functions.size() - 1);
+    }
+
+
+    bool FunctionModule::FindConstant(uint8_t const * data,
+                                      uint32_t hash,
+                                      FunctionBuffer::Constant const & constant,
+                                      unsigned& offset) const
+    {
+        auto range = m_constants.equal_range(hash);
+
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            auto const & entry = it->second;
+
+            if (entry.m_size == constant.m_size
+                && entry.m_offset % constant.m_alignment == 0
+                && memcmp(m_bufferStart + entry.m_offset,
+                          data + constant.m_offset,
+                          constant.m_size) == 0)
+            {
+                offset = entry.m_offset;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    unsigned FunctionModule::GetFunctionCount() const
+    {
+        return static_cast<unsigned>(m_functions.size());
+    }
+
+
+    void const * FunctionModule::GetEntryPoint(unsigned index) const
+    {
+        LogThrowAssert(index < m_functions.size(),
+                       "Invalid function index %u (total functions %u)",
+                       index,
+                       static_cast<unsigned>(m_functions.size()));
+
+        return m_bufferStart + m_functions[index].BeginAddress;
+    }
+
+
+    unsigned FunctionModule::GetConstantPoolSize() const
+    {
+        return m_constantPoolSize;
+    }
+
+
+    unsigned FunctionModule::GetCodeSize() const
+    {
+        return m_codeEnd - m_constantPoolCapacity;
+    }
+}
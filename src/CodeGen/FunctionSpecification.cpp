@@ -22,6 +22,7 @@
 
 
 #include <algorithm>    // For std::min.
+#include <limits>
 #include <stdexcept>
 
 #include "NativeJIT/BitOperations.h"
@@ -53,6 +54,26 @@ namespace NativeJIT
                                                  unsigned savedXmmNonVolatilesMask,
                                                  BaseRegisterType baseRegisterType,
                                                  std::ostream* diagnosticsStream)
+        : FunctionSpecification(allocator,
+                                maxFunctionCallParameters,
+                                localStackSlotCount,
+                                savedRxxNonVolatilesMask,
+                                savedXmmNonVolatilesMask,
+                                baseRegisterType,
+                                FrameType::Standard,
+                                diagnosticsStream)
+    {
+    }
+
+
+    FunctionSpecification::FunctionSpecification(Allocators::IAllocator& allocator,
+                                                 int maxFunctionCallParameters,
+                                                 unsigned localStackSlotCount,
+                                                 unsigned savedRxxNonVolatilesMask,
+                                                 unsigned savedXmmNonVolatilesMask,
+                                                 BaseRegisterType baseRegisterType,
+                                                 FrameType frameType,
+                                                 std::ostream* diagnosticsStream)
         : m_stlAllocator(allocator),
           m_unwindInfoBuffer(m_stlAllocator),
           m_prologCode(m_stlAllocator),
@@ -67,14 +88,28 @@ namespace NativeJIT
             code.EnableDiagnostics(*diagnosticsStream);
         }
 
-        BuildUnwindInfoAndProlog(maxFunctionCallParameters,
-                                 localStackSlotCount,
-                                 savedRxxNonVolatilesMask,
-                                 savedXmmNonVolatilesMask,
-                                 baseRegisterType,
-                                 code,
-                                 m_unwindInfoBuffer,
-                                 m_offsetToOriginalRsp);
+        if (frameType == FrameType::RedZone)
+        {
+            BuildRedZoneUnwindInfoAndProlog(maxFunctionCallParameters,
+                                            localStackSlotCount,
+                                            savedRxxNonVolatilesMask,
+                                            savedXmmNonVolatilesMask,
+                                            baseRegisterType,
+                                            code,
+                                            m_unwindInfoBuffer,
+                                            m_offsetToOriginalRsp);
+        }
+        else
+        {
+            BuildUnwindInfoAndProlog(maxFunctionCallParameters,
+                                     localStackSlotCount,
+                                     savedRxxNonVolatilesMask,
+                                     savedXmmNonVolatilesMask,
+                                     baseRegisterType,
+                                     code,
+                                     m_unwindInfoBuffer,
+                                     m_offsetToOriginalRsp);
+        }
 
         m_prologCode.assign(code.BufferStart(),
                             code.BufferStart() + code.CurrentPosition());
@@ -208,8 +243,7 @@ namespace NativeJIT
         // Need to use UWOP_ALLOC_SMALL for stack sizes from 8 to 128 bytes and
         // UWOP_ALLOC_LARGE otherwise. If using UWOP_ALLOC_LARGE, currently only
         // the version which uses two unwind codes is supported. That version
-        // can allocate almost 512 kB, which is far more than the 4 kB limit
-        // which would require a chkstk call.
+        // can allocate almost 512 kB, which is the c_maxStackSize limit.
         const bool isSmallStackAlloc = totalStackBytes <= 128;
 
         // Compute number of unwind codes needed. Each RXX/XMM save takes two
@@ -252,7 +286,14 @@ namespace NativeJIT
         UnwindCode* currUnwindCode = &unwindCodes[actualUnwindCodeCount - 1];
 
         // Start emitting the unwind codes and the opcodes for prolog. First,
-        // adjust the stack pointer.
+        // probe the stack if necessary, then adjust the stack pointer. The
+        // probe doesn't need any unwind codes since it doesn't modify RSP or
+        // the non-volatile registers.
+        if (totalStackBytes > c_stackProbePageSize)
+        {
+            EmitStackProbe(prologCode, totalStackBytes);
+        }
+
         prologCode.EmitImmediate<OpCode::Sub>(rsp, offsetToOriginalRsp);
 
         // Emit the matching unwind codes.
@@ -387,6 +428,158 @@ namespace NativeJIT
     }
 
 
+    void FunctionSpecification::EmitStackProbe(X64CodeGenerator& prologCode,
+                                               unsigned stackBytes)
+    {
+        // RAX and R11 are volatile and don't hold parameters in either
+        // calling convention, so they can be used freely in the prolog.
+        //
+        //     lea r11, [rsp - pageCount * pageSize]
+        //     mov rax, rsp
+        // probe:
+        //     sub rax, pageSize
+        //     cmp r11, [rax]
+        //     cmp rax, r11
+        //     jne probe
+        //
+        // The last page is only partially used by the frame and doesn't need
+        // to be probed, the same way as the frames smaller than a page.
+        const int32_t probedBytes
+            = static_cast<int32_t>(stackBytes / c_stackProbePageSize * c_stackProbePageSize);
+
+        Label probe = prologCode.AllocateLabel();
+
+        prologCode.Emit<OpCode::Lea>(r11, rsp, -probedBytes);
+        prologCode.Emit<OpCode::Mov>(rax, rsp);
+        prologCode.PlaceLabel(probe);
+        prologCode.EmitImmediate<OpCode::Sub>(rax, static_cast<int32_t>(c_stackProbePageSize));
+        prologCode.Emit<OpCode::Cmp>(r11, rax, 0);
+        prologCode.Emit<OpCode::Cmp>(rax, r11);
+        prologCode.EmitConditionalJump<JccType::JNE>(probe);
+
+        prologCode.PatchCallSites();
+    }
+
+
+    void FunctionSpecification::BuildRedZoneUnwindInfoAndProlog(int maxFunctionCallParameters,
+                                                                unsigned localStackSlotCount,
+                                                                unsigned savedRxxNonVolatilesMask,
+                                                                unsigned savedXmmNonVolatilesMask,
+                                                                BaseRegisterType baseRegisterType,
+                                                                X64CodeGenerator& prologCode,
+                                                                AllocatorVector<uint8_t>& unwindInfoBuffer,
+                                                                int32_t& offsetToOriginalRsp)
+    {
+        LogThrowAssert(maxFunctionCallParameters < 0,
+                       "Red zone frame cannot be used by functions which make calls");
+
+        LogThrowAssert((savedRxxNonVolatilesMask & ~CallingConvention::c_rxxWritableRegistersMask) == 0,
+                       "Saving/restoring of non-writable RXX registers is not allowed: 0x%Ix",
+                       savedRxxNonVolatilesMask & ~CallingConvention::c_rxxWritableRegistersMask);
+
+        // XMM saves require 16-byte alignment, which cannot be guaranteed
+        // below the unadjusted RSP.
+        LogThrowAssert(savedXmmNonVolatilesMask == 0,
+                       "Red zone frame cannot save XMM registers: 0x%Ix",
+                       savedXmmNonVolatilesMask);
+
+        // The stack pointer is not modified at all.
+        savedRxxNonVolatilesMask &= ~rsp.GetMask();
+
+        if (baseRegisterType == BaseRegisterType::SetRbpToOriginalRsp)
+        {
+            savedRxxNonVolatilesMask |= rbp.GetMask();
+        }
+
+        const unsigned codeStartPos = prologCode.CurrentPosition();
+        const unsigned rxxSavesCount = BitOp::GetNonZeroBitCount(savedRxxNonVolatilesMask);
+
+        // Stack layout after setup (no alignment is needed since RSP is not
+        // adjusted and nothing is called):
+        // [address 0] ---> [...]
+        //     ---> [registers saved by prolog]
+        //     ---> [local stack for temporaries etc]
+        // ---> [original RSP, unchanged; RBP points here if SetRbpToOriginalRsp]
+        //     ---> [return address and parameters to the function]
+        const unsigned totalStackBytes
+            = (localStackSlotCount + rxxSavesCount) * sizeof(void*);
+        offsetToOriginalRsp = 0;
+
+        LogThrowAssert(totalStackBytes <= c_redZoneSize,
+                       "Red zone frame overflow: %u bytes",
+                       totalStackBytes);
+
+        // Each RXX save takes two codes. There is no stack allocation code.
+        const unsigned actualUnwindCodeCount = rxxSavesCount * 2;
+
+        LogThrowAssert(actualUnwindCodeCount <= c_maxUnwindCodes,
+                       "Invalid number of unwind codes: %u",
+                       actualUnwindCodeCount);
+
+        // As in BuildUnwindInfoAndProlog(), the array of codes has an even
+        // number of entries. UnwindInfo already includes one unwind code, so
+        // two (unused) entries are allocated if there are no codes at all to
+        // keep the size of unwind info DWORD-aligned.
+        const unsigned alignedCodeCount
+            = (std::max)((actualUnwindCodeCount + 1) & ~1u, 2u);
+
+        unwindInfoBuffer.resize(sizeof(UnwindInfo)
+                                + (alignedCodeCount - 1)
+                                  * sizeof(UnwindCode));
+        UnwindInfo* unwindInfo = reinterpret_cast<UnwindInfo*>(unwindInfoBuffer.data());
+
+        unwindInfo->m_countOfCodes = static_cast<unsigned char>(actualUnwindCodeCount);
+        unwindInfo->m_version = 1;
+        unwindInfo->m_flags = 0;
+        unwindInfo->m_frameRegister = 0;
+        unwindInfo->m_frameOffset = 0;
+
+        UnwindCode* unwindCodes = &unwindInfo->m_firstUnwindCode;
+        UnwindCode* currUnwindCode = &unwindCodes[actualUnwindCodeCount] - 1;
+
+        // Save the registers right below the local stack slots. The frame
+        // offsets are negative and stored as two's complement.
+        int currStackSlotOffset = -static_cast<int>(localStackSlotCount) - 1;
+
+        unsigned regId = 0;
+        unsigned registersMask = savedRxxNonVolatilesMask;
+
+        while (BitOp::GetLowestBitSet(registersMask, &regId))
+        {
+            prologCode.Emit<OpCode::Mov>(rsp,
+                                         currStackSlotOffset * static_cast<int>(sizeof(void*)),
+                                         Register<8, false>(regId));
+
+            AddCodeAndBackDown(unwindCodes,
+                               currUnwindCode,
+                               prologCode.CurrentPosition() - codeStartPos,
+                               UnwindCodeOp::UWOP_SAVE_NONVOL,
+                               static_cast<uint8_t>(regId),
+                               static_cast<uint16_t>(static_cast<int16_t>(currStackSlotOffset)));
+
+            BitOp::ClearBit(&registersMask, regId);
+            currStackSlotOffset--;
+        }
+
+        LogThrowAssert(currUnwindCode + 1 == unwindCodes,
+                       "Mismatched count of unwind codes: %Id",
+                       currUnwindCode + 1 - unwindCodes);
+
+        if (baseRegisterType == BaseRegisterType::SetRbpToOriginalRsp)
+        {
+            prologCode.Emit<OpCode::Mov>(rbp, rsp);
+
+            // RBP was saved by the last recorded instruction, extend it to
+            // include the RBP setup (see BuildUnwindInfoAndProlog()).
+            unwindCodes[0].m_operation.m_codeOffset
+                = static_cast<uint8_t>(prologCode.CurrentPosition() - codeStartPos);
+        }
+
+        unwindInfo->m_sizeOfProlog
+            = static_cast<uint8_t>(prologCode.CurrentPosition() - codeStartPos);
+    }
+
+
     // A helper function to return the number of unwind codes for an opcode.
     static unsigned GetUnwindOpCodeCount(UnwindCode code)
     {
@@ -463,10 +656,15 @@ namespace NativeJIT
                 break;
 
             case UnwindCodeOp::UWOP_SAVE_NONVOL:
-                // The second code contains the offset in quadwords.
+                // The second code contains the offset in quadwords. The offset
+                // is negative for the red zone frames (see
+                // BuildRedZoneUnwindInfoAndProlog()); since the stack size is
+                // limited to c_maxStackSize, the regular offsets always fit
+                // into the positive range of int16_t.
                 epilogCode.Emit<OpCode::Mov>(Register<8, false>(unwindCode.m_operation.m_opInfo),
                                              rsp,
-                                             code2Offset * sizeof(void*));
+                                             static_cast<int16_t>(code2Offset)
+                                             * static_cast<int32_t>(sizeof(void*)));
                 break;
 
             case UnwindCodeOp::UWOP_SAVE_XMM128:
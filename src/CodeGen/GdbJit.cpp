@@ -0,0 +1,373 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/GdbJit.h"
+#include "Temporary/Assert.h"
+#include "UnwindCode.h"
+
+
+// Both symbols are weak so that they do not clash with the definitions of
+// other JIT compilers linked into the same process (e.g. LLVM). The linker
+// then keeps a single definition and all JITs share the list GDB reads.
+extern "C"
+{
+    __attribute__((weak)) jit_descriptor __jit_debug_descriptor = { 1, 0, nullptr, nullptr };
+
+
+    // GDB places a breakpoint here. The function must not be inlined or
+    // optimized away.
+    __attribute__((weak, noinline)) void __jit_debug_register_code()
+    {
+        __asm__ volatile("");
+    }
+}
+
+
+namespace NativeJIT
+{
+    namespace
+    {
+        enum JitAction : uint32_t
+        {
+            JIT_NOACTION = 0,
+            JIT_REGISTER_FN,
+            JIT_UNREGISTER_FN
+        };
+
+
+        // Protects __jit_debug_descriptor against concurrent updates from
+        // NativeJIT. Other JITs sharing the descriptor do not take this lock.
+        std::mutex g_descriptorLock;
+
+
+        //
+        // ELF64 definitions. Defined here rather than taken from <elf.h> since
+        // the header is not available on all POSIX platforms.
+        //
+        struct ElfHeader
+        {
+            uint8_t m_ident[16];
+            uint16_t m_type;
+            uint16_t m_machine;
+            uint32_t m_version;
+            uint64_t m_entry;
+            uint64_t m_programHeaderOffset;
+            uint64_t m_sectionHeaderOffset;
+            uint32_t m_flags;
+            uint16_t m_headerSize;
+            uint16_t m_programHeaderEntrySize;
+            uint16_t m_programHeaderCount;
+            uint16_t m_sectionHeaderEntrySize;
+            uint16_t m_sectionHeaderCount;
+            uint16_t m_sectionNameTableIndex;
+        };
+
+        static_assert(sizeof(ElfHeader) == 64, "Invalid ELF header size");
+
+
+        struct ElfSectionHeader
+        {
+            uint32_t m_name;
+            uint32_t m_type;
+            uint64_t m_flags;
+            uint64_t m_address;
+            uint64_t m_offset;
+            uint64_t m_size;
+            uint32_t m_link;
+            uint32_t m_info;
+            uint64_t m_alignment;
+            uint64_t m_entrySize;
+        };
+
+        static_assert(sizeof(ElfSectionHeader) == 64, "Invalid ELF section header size");
+
+
+        struct ElfSymbol
+        {
+            uint32_t m_name;
+            uint8_t m_info;
+            uint8_t m_other;
+            uint16_t m_sectionIndex;
+            uint64_t m_value;
+            uint64_t m_size;
+        };
+
+        static_assert(sizeof(ElfSymbol) == 24, "Invalid ELF symbol size");
+
+
+        const uint16_t c_elfTypeRelocatable = 1;
+        const uint16_t c_elfMachineX64 = 62;
+
+        const uint32_t c_sectionTypeProgBits = 1;
+        const uint32_t c_sectionTypeSymbolTable = 2;
+        const uint32_t c_sectionTypeStringTable = 3;
+        const uint32_t c_sectionTypeNoBits = 8;
+
+        const uint64_t c_sectionFlagAlloc = 0x2;
+        const uint64_t c_sectionFlagExecute = 0x4;
+
+        const uint8_t c_symbolGlobalFunction = (1 << 4) | 2;     // STB_GLOBAL, STT_FUNC.
+
+        enum Section : uint16_t
+        {
+            NullSection,
+            TextSection,
+            EhFrameSection,
+            SymbolTableSection,
+            StringTableSection,
+            SectionNameTableSection,
+            SectionCount
+        };
+
+
+        // Appends the string to the table and returns its offset.
+        uint32_t AddString(std::string& table, char const * value)
+        {
+            const uint32_t offset = static_cast<uint32_t>(table.size());
+            table.append(value);
+            table.push_back('\0');
+
+            return offset;
+        }
+
+
+        template <typename T>
+        size_t Append(std::vector<uint8_t>& out, T const * data, size_t count)
+        {
+            // Keep all sections pointer aligned.
+            out.resize((out.size() + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+
+            const size_t offset = out.size();
+            auto bytes = reinterpret_cast<uint8_t const *>(data);
+            out.insert(out.end(), bytes, bytes + count * sizeof(T));
+
+            return offset;
+        }
+
+
+        // Builds an ELF relocatable object which describes the function. The
+        // .text section does not contain the code, it only specifies the
+        // address of the code in memory.
+        void BuildSymbolFile(char const * name,
+                             uint64_t codeAddress,
+                             unsigned codeSize,
+                             std::vector<uint8_t> const & ehFrame,
+                             std::vector<uint8_t>& symbolFile)
+        {
+            std::string sectionNames(1, '\0');
+            std::string strings(1, '\0');
+
+            ElfSectionHeader sections[SectionCount];
+            std::memset(sections, 0, sizeof(sections));
+
+            ElfSymbol symbols[2];
+            std::memset(symbols, 0, sizeof(symbols));
+
+            // The symbol value is relative to the start of the .text section.
+            symbols[1].m_name = AddString(strings, name);
+            symbols[1].m_info = c_symbolGlobalFunction;
+            symbols[1].m_sectionIndex = TextSection;
+            symbols[1].m_value = 0;
+            symbols[1].m_size = codeSize;
+
+            symbolFile.clear();
+            symbolFile.resize(sizeof(ElfHeader));
+
+            auto & text = sections[TextSection];
+            text.m_name = AddString(sectionNames, ".text");
+            text.m_type = c_sectionTypeNoBits;
+            text.m_flags = c_sectionFlagAlloc | c_sectionFlagExecute;
+            text.m_address = codeAddress;
+            text.m_size = codeSize;
+            text.m_alignment = 16;
+
+            auto & ehFrameSection = sections[EhFrameSection];
+            ehFrameSection.m_name = AddString(sectionNames, ".eh_frame");
+            ehFrameSection.m_type = c_sectionTypeProgBits;
+            ehFrameSection.m_flags = c_sectionFlagAlloc;
+            ehFrameSection.m_offset = Append(symbolFile, ehFrame.data(), ehFrame.size());
+            ehFrameSection.m_size = ehFrame.size();
+            ehFrameSection.m_alignment = sizeof(uint64_t);
+
+            auto & symbolTable = sections[SymbolTableSection];
+            symbolTable.m_name = AddString(sectionNames, ".symtab");
+            symbolTable.m_type = c_sectionTypeSymbolTable;
+            symbolTable.m_offset = Append(symbolFile, symbols, 2);
+            symbolTable.m_size = sizeof(symbols);
+            symbolTable.m_link = StringTableSection;
+            symbolTable.m_info = 1;                 // Index of the first global symbol.
+            symbolTable.m_alignment = sizeof(uint64_t);
+            symbolTable.m_entrySize = sizeof(ElfSymbol);
+
+            auto & stringTable = sections[StringTableSection];
+            stringTable.m_name = AddString(sectionNames, ".strtab");
+            stringTable.m_type = c_sectionTypeStringTable;
+            stringTable.m_offset = Append(symbolFile, strings.data(), strings.size());
+            stringTable.m_size = strings.size();
+            stringTable.m_alignment = 1;
+
+            auto & sectionNameTable = sections[SectionNameTableSection];
+            sectionNameTable.m_name = AddString(sectionNames, ".shstrtab");
+            sectionNameTable.m_type = c_sectionTypeStringTable;
+            sectionNameTable.m_offset = Append(symbolFile, sectionNames.data(), sectionNames.size());
+            sectionNameTable.m_size = sectionNames.size();
+            sectionNameTable.m_alignment = 1;
+
+            ElfHeader header;
+            std::memset(&header, 0, sizeof(header));
+
+            const uint8_t ident[] = {
+                0x7f, 'E', 'L', 'F',
+                2,                                  // ELFCLASS64.
+                1,                                  // ELFDATA2LSB.
+                1                                   // EV_CURRENT.
+            };
+            std::memcpy(header.m_ident, ident, sizeof(ident));
+
+            header.m_type = c_elfTypeRelocatable;
+            header.m_machine = c_elfMachineX64;
+            header.m_version = 1;
+            header.m_sectionHeaderOffset = Append(symbolFile, sections, SectionCount);
+            header.m_headerSize = sizeof(ElfHeader);
+            header.m_sectionHeaderEntrySize = sizeof(ElfSectionHeader);
+            header.m_sectionHeaderCount = SectionCount;
+            header.m_sectionNameTableIndex = SectionNameTableSection;
+
+            std::memcpy(symbolFile.data(), &header, sizeof(header));
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // GdbJitListener
+    //
+    //*************************************************************************
+    GdbJitListener::GdbJitListener()
+    {
+    }
+
+
+    GdbJitListener::~GdbJitListener()
+    {
+        for (auto & registration : m_registrations)
+        {
+            Unregister(*registration);
+        }
+    }
+
+
+    void GdbJitListener::Unregister(FunctionBuffer const & code)
+    {
+        for (auto it = m_registrations.begin(); it != m_registrations.end(); ++it)
+        {
+            if ((*it)->m_code == &code)
+            {
+                Unregister(**it);
+                m_registrations.erase(it);
+                break;
+            }
+        }
+    }
+
+
+    bool GdbJitListener::IsDebugInfoRequested() const
+    {
+        return false;
+    }
+
+
+    void GdbJitListener::OnFunctionGenerated(FunctionBuffer const & code)
+    {
+        Unregister(code);
+
+        const unsigned start = code.GetFunctionCodeStartOffset();
+        const unsigned size = code.GetFunctionCodeEndOffset() - start;
+        const uint64_t address = reinterpret_cast<uint64_t>(code.BufferStart() + start);
+
+        std::vector<uint8_t> ehFrame;
+        UnwindUtils::BuildEhFrame(code, address, ehFrame);
+
+        std::unique_ptr<Registration> registration(new Registration());
+        registration->m_code = &code;
+        BuildSymbolFile(code.GetSymbolName().c_str(),
+                        address,
+                        size,
+                        ehFrame,
+                        registration->m_symbolFile);
+
+        jit_code_entry& entry = registration->m_entry;
+        entry.symfile_addr = reinterpret_cast<char const *>(registration->m_symbolFile.data());
+        entry.symfile_size = registration->m_symbolFile.size();
+        entry.prev_entry = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(g_descriptorLock);
+
+            entry.next_entry = __jit_debug_descriptor.first_entry;
+
+            if (entry.next_entry != nullptr)
+            {
+                entry.next_entry->prev_entry = &entry;
+            }
+
+            __jit_debug_descriptor.first_entry = &entry;
+            __jit_debug_descriptor.relevant_entry = &entry;
+            __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+            __jit_debug_register_code();
+        }
+
+        m_registrations.push_back(std::move(registration));
+    }
+
+
+    void GdbJitListener::Unregister(Registration& registration)
+    {
+        std::lock_guard<std::mutex> lock(g_descriptorLock);
+
+        jit_code_entry& entry = registration.m_entry;
+
+        if (entry.prev_entry != nullptr)
+        {
+            entry.prev_entry->next_entry = entry.next_entry;
+        }
+        else
+        {
+            __jit_debug_descriptor.first_entry = entry.next_entry;
+        }
+
+        if (entry.next_entry != nullptr)
+        {
+            entry.next_entry->prev_entry = entry.prev_entry;
+        }
+
+        __jit_debug_descriptor.relevant_entry = &entry;
+        __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+        __jit_debug_register_code();
+    }
+}
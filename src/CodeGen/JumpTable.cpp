@@ -131,6 +131,27 @@ namespace NativeJIT
         }
     }
 
+    void JumpTable::Relocate(uint8_t const * start, ptrdiff_t delta)
+    {
+        for (auto & label : m_labels)
+        {
+            if (label != nullptr && label >= start)
+            {
+                label += delta;
+            }
+        }
+
+        for (auto & site : m_callSites)
+        {
+            if (site.Site() >= start)
+            {
+                site = CallSite(site.GetLabel(),
+                                static_cast<unsigned>(site.Size()),
+                                site.Site() + delta);
+            }
+        }
+    }
+
     //*************************************************************************
     //
     // CallSite
@@ -0,0 +1,323 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cinttypes>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/PerfMap.h"
+#include "Temporary/Assert.h"
+
+
+// jitdump format specification:
+// https://github.com/torvalds/linux/blob/master/tools/perf/Documentation/jitdump-specification.txt
+
+namespace NativeJIT
+{
+    namespace
+    {
+        std::string GetPidFilePath(char const * directory,
+                                   char const * prefix,
+                                   char const * extension)
+        {
+            return std::string(directory)
+                   + "/" + prefix + std::to_string(getpid()) + extension;
+        }
+
+
+        uint64_t GetTimestamp()
+        {
+            // perf record -k mono uses CLOCK_MONOTONIC.
+            timespec time;
+            clock_gettime(CLOCK_MONOTONIC, &time);
+
+            return static_cast<uint64_t>(time.tv_sec) * 1000000000ull
+                   + static_cast<uint64_t>(time.tv_nsec);
+        }
+
+
+        uint32_t GetThreadId()
+        {
+#ifdef SYS_gettid
+            return static_cast<uint32_t>(syscall(SYS_gettid));
+#else
+            return static_cast<uint32_t>(getpid());
+#endif
+        }
+
+
+        const uint32_t c_jitDumpMagic = 0x4A695444;
+        const uint32_t c_jitDumpVersion = 1;
+        const uint32_t c_elfMachineX64 = 62;
+
+        enum JitDumpRecordId : uint32_t
+        {
+            JitCodeLoad = 0,
+            JitCodeDebugInfo = 2
+        };
+
+
+        struct JitDumpFileHeader
+        {
+            uint32_t m_magic;
+            uint32_t m_version;
+            uint32_t m_totalSize;
+            uint32_t m_elfMachine;
+            uint32_t m_padding;
+            uint32_t m_pid;
+            uint64_t m_timestamp;
+            uint64_t m_flags;
+        };
+
+
+        struct JitDumpRecordHeader
+        {
+            uint32_t m_id;
+            uint32_t m_totalSize;
+            uint64_t m_timestamp;
+        };
+
+
+        // Followed by the zero terminated function name and the code.
+        struct JitDumpCodeLoad
+        {
+            uint32_t m_pid;
+            uint32_t m_tid;
+            uint64_t m_vma;
+            uint64_t m_codeAddress;
+            uint64_t m_codeSize;
+            uint64_t m_codeIndex;
+        };
+
+
+        // Followed by m_entryCount entries.
+        struct JitDumpDebugInfo
+        {
+            uint64_t m_codeAddress;
+            uint64_t m_entryCount;
+        };
+
+
+        // Followed by the zero terminated file name.
+        struct JitDumpDebugEntry
+        {
+            uint64_t m_codeAddress;
+            uint32_t m_line;
+            uint32_t m_discriminator;
+        };
+    }
+
+
+    //*************************************************************************
+    //
+    // PerfMapWriter
+    //
+    //*************************************************************************
+    PerfMapWriter::PerfMapWriter(char const * directory)
+        : m_path(GetPidFilePath(directory, "perf-", ".map")),
+          m_file(fopen(m_path.c_str(), "a"))
+    {
+        LogThrowAssert(m_file != nullptr, "Couldn't open %s", m_path.c_str());
+    }
+
+
+    PerfMapWriter::~PerfMapWriter()
+    {
+        fclose(m_file);
+    }
+
+
+    std::string const & PerfMapWriter::GetPath() const
+    {
+        return m_path;
+    }
+
+
+    bool PerfMapWriter::IsDebugInfoRequested() const
+    {
+        return false;
+    }
+
+
+    void PerfMapWriter::OnFunctionGenerated(FunctionBuffer const & code)
+    {
+        // Format: <start address> <size> <symbol name>, numbers in hex.
+        const unsigned start = code.GetFunctionCodeStartOffset();
+        const unsigned size = code.GetFunctionCodeEndOffset() - start;
+
+        fprintf(m_file,
+                "%" PRIxPTR " %x %s\n",
+                reinterpret_cast<uintptr_t>(code.BufferStart() + start),
+                size,
+                code.GetSymbolName().c_str());
+
+        // Flush so that the entry is not lost if the process is killed
+        // while being profiled.
+        fflush(m_file);
+    }
+
+
+    //*************************************************************************
+    //
+    // JitDumpWriter
+    //
+    //*************************************************************************
+    JitDumpWriter::JitDumpWriter(bool includeDebugInfo, char const * directory)
+        : m_includeDebugInfo(includeDebugInfo),
+          m_path(GetPidFilePath(directory, "jit-", ".dump")),
+          m_file(open(m_path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666)),
+          m_marker(MAP_FAILED),
+          m_markerSize(static_cast<size_t>(sysconf(_SC_PAGESIZE))),
+          m_codeIndex(0)
+    {
+        LogThrowAssert(m_file >= 0, "Couldn't open %s", m_path.c_str());
+
+        m_marker = mmap(nullptr, m_markerSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, m_file, 0);
+        LogThrowAssert(m_marker != MAP_FAILED, "Couldn't map %s", m_path.c_str());
+
+        JitDumpFileHeader header;
+        header.m_magic = c_jitDumpMagic;
+        header.m_version = c_jitDumpVersion;
+        header.m_totalSize = sizeof(header);
+        header.m_elfMachine = c_elfMachineX64;
+        header.m_padding = 0;
+        header.m_pid = static_cast<uint32_t>(getpid());
+        header.m_timestamp = GetTimestamp();
+        header.m_flags = 0;
+
+        Write(&header, sizeof(header));
+    }
+
+
+    JitDumpWriter::~JitDumpWriter()
+    {
+        munmap(m_marker, m_markerSize);
+        close(m_file);
+    }
+
+
+    std::string const & JitDumpWriter::GetPath() const
+    {
+        return m_path;
+    }
+
+
+    bool JitDumpWriter::IsDebugInfoRequested() const
+    {
+        return m_includeDebugInfo;
+    }
+
+
+    void JitDumpWriter::OnFunctionGenerated(FunctionBuffer const & code)
+    {
+        const unsigned start = code.GetFunctionCodeStartOffset();
+        const unsigned end = code.GetFunctionCodeEndOffset();
+        const uint64_t startAddress = reinterpret_cast<uint64_t>(code.BufferStart() + start);
+        const std::string name = code.GetSymbolName();
+
+        // Debug info must precede the code load record it applies to. The
+        // entries that precede the start of the function are skipped.
+        auto & debugInfo = code.GetDebugInfo();
+
+        if (m_includeDebugInfo && !debugInfo.empty())
+        {
+            uint64_t entryCount = 0;
+
+            for (auto & entry : debugInfo)
+            {
+                entryCount += (entry.m_offset >= start && entry.m_offset < end);
+            }
+
+            const size_t entrySize = sizeof(JitDumpDebugEntry) + name.size() + 1;
+
+            WriteRecordHeader(JitCodeDebugInfo,
+                              sizeof(JitDumpDebugInfo) + entryCount * entrySize);
+
+            const JitDumpDebugInfo info = { startAddress, entryCount };
+            Write(&info, sizeof(info));
+
+            for (auto & entry : debugInfo)
+            {
+                if (entry.m_offset >= start && entry.m_offset < end)
+                {
+                    const JitDumpDebugEntry debugEntry = {
+                        reinterpret_cast<uint64_t>(code.BufferStart() + entry.m_offset),
+                        entry.m_nodeId,
+                        0
+                    };
+
+                    Write(&debugEntry, sizeof(debugEntry));
+                    Write(name.c_str(), name.size() + 1);
+                }
+            }
+        }
+
+        WriteRecordHeader(JitCodeLoad,
+                          sizeof(JitDumpCodeLoad) + name.size() + 1 + (end - start));
+
+        const JitDumpCodeLoad load = {
+            static_cast<uint32_t>(getpid()),
+            GetThreadId(),
+            startAddress,
+            startAddress,
+            end - start,
+            m_codeIndex++
+        };
+
+        Write(&load, sizeof(load));
+        Write(name.c_str(), name.size() + 1);
+        Write(code.BufferStart() + start, end - start);
+    }
+
+
+    void JitDumpWriter::Write(void const * data, size_t size)
+    {
+        auto bytes = static_cast<char const *>(data);
+
+        while (size > 0)
+        {
+            const ssize_t written = write(m_file, bytes, size);
+            LogThrowAssert(written > 0, "Couldn't write to %s", m_path.c_str());
+
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+
+    void JitDumpWriter::WriteRecordHeader(uint32_t id, size_t totalSize)
+    {
+        const JitDumpRecordHeader header = {
+            id,
+            static_cast<uint32_t>(sizeof(JitDumpRecordHeader) + totalSize),
+            GetTimestamp()
+        };
+
+        Write(&header, sizeof(header));
+    }
+}
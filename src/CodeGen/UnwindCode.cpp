@@ -21,10 +21,19 @@
 // THE SOFTWARE.
 
 
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/CodeGen/Register.h"
+#include "Temporary/Assert.h"
 #include "UnwindCode.h"
 
 
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+// Provided by the unwinder (libgcc or libunwind).
+extern "C" void __register_frame(void* begin);
+extern "C" void __deregister_frame(void* begin);
+#endif
+
+
 namespace NativeJIT
 {
     //*************************************************************************
@@ -55,6 +64,137 @@ namespace NativeJIT
         m_operation.m_opInfo = info;
     }
 
+    //*************************************************************************
+    //
+    // DWARF call frame information helpers.
+    // Specification: http://refspecs.linuxfoundation.org/LSB_5.0.0/LSB-Core-generic/LSB-Core-generic/ehframechpt.html
+    //
+    //*************************************************************************
+    namespace
+    {
+        enum DwarfCfa : uint8_t
+        {
+            DW_CFA_nop = 0x00,
+            DW_CFA_advance_loc1 = 0x02,
+            DW_CFA_advance_loc2 = 0x03,
+            DW_CFA_advance_loc4 = 0x04,
+            DW_CFA_remember_state = 0x0a,
+            DW_CFA_restore_state = 0x0b,
+            DW_CFA_def_cfa = 0x0c,
+            DW_CFA_def_cfa_offset = 0x0e,
+            DW_CFA_advance_loc = 0x40,      // Delta in the low 6 bits.
+            DW_CFA_offset = 0x80            // Register in the low 6 bits.
+        };
+
+
+        const uint8_t c_dwarfRsp = 7;
+        const uint8_t c_dwarfReturnAddress = 16;
+        const uint8_t c_ehPointerEncodingAbsolute = 0x00;
+
+
+        // Converts the register ID used in x64 instruction encoding to the
+        // DWARF register number.
+        uint8_t GetDwarfRegister(unsigned id)
+        {
+            // RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI map to 0, 2, 1, 3, 7, 6, 4, 5
+            // whereas R8-R15 keep their numbers.
+            static const uint8_t c_lowRegisters[] = { 0, 2, 1, 3, 7, 6, 4, 5 };
+
+            return id < 8 ? c_lowRegisters[id] : static_cast<uint8_t>(id);
+        }
+
+
+        void AppendUnsigned(std::vector<uint8_t>& out, uint64_t value)
+        {
+            do
+            {
+                const uint8_t byte = value & 0x7f;
+                value >>= 7;
+                out.push_back(value != 0 ? (byte | 0x80) : byte);
+            }
+            while (value != 0);
+        }
+
+
+        void AppendSigned(std::vector<uint8_t>& out, int64_t value)
+        {
+            bool more = true;
+
+            while (more)
+            {
+                const uint8_t byte = value & 0x7f;
+                value >>= 7;
+                more = !((value == 0 && (byte & 0x40) == 0)
+                         || (value == -1 && (byte & 0x40) != 0));
+                out.push_back(more ? (byte | 0x80) : byte);
+            }
+        }
+
+
+        template <typename T>
+        void AppendFixed(std::vector<uint8_t>& out, T value)
+        {
+            for (unsigned i = 0; i < sizeof(T); ++i)
+            {
+                out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+
+        void PatchLength(std::vector<uint8_t>& out, size_t lengthOffset)
+        {
+            // Pad with DW_CFA_nop so that the entry is pointer aligned. The
+            // length does not include the length field itself.
+            while ((out.size() - lengthOffset) % sizeof(uint64_t) != 0)
+            {
+                out.push_back(DW_CFA_nop);
+            }
+
+            const uint32_t length = static_cast<uint32_t>(out.size() - lengthOffset - sizeof(uint32_t));
+
+            for (unsigned i = 0; i < sizeof(length); ++i)
+            {
+                out[lengthOffset + i] = static_cast<uint8_t>(length >> (8 * i));
+            }
+        }
+
+
+        void AdvanceLocation(std::vector<uint8_t>& out, unsigned& location, unsigned target)
+        {
+            LogThrowAssert(target >= location,
+                           "Unwind codes are out of order at offset %u",
+                           target);
+
+            const unsigned delta = target - location;
+
+            if (delta == 0)
+            {
+            }
+            else if (delta < 0x40)
+            {
+                out.push_back(static_cast<uint8_t>(DW_CFA_advance_loc | delta));
+            }
+            else if (delta <= 0xff)
+            {
+                out.push_back(DW_CFA_advance_loc1);
+                AppendFixed(out, static_cast<uint8_t>(delta));
+            }
+            else if (delta <= 0xffff)
+            {
+                out.push_back(DW_CFA_advance_loc2);
+                AppendFixed(out, static_cast<uint16_t>(delta));
+            }
+            else
+            {
+                out.push_back(DW_CFA_advance_loc4);
+                AppendFixed(out, static_cast<uint32_t>(delta));
+            }
+
+            location = target;
+        }
+    }
+
+
     namespace UnwindUtils
     {
         DWORD64 MakeFunctionTableIdentifier(void* objectAddress)
@@ -63,5 +203,200 @@ namespace NativeJIT
             // "The two low-order bits must be set. For example, BaseAddress|0x3."
             return reinterpret_cast<DWORD64>(objectAddress) | 3;
         }
+
+
+        void BuildEhFrame(FunctionBuffer const & code,
+                          uint64_t codeAddress,
+                          std::vector<uint8_t>& ehFrame)
+        {
+            auto const & unwindInfo = *reinterpret_cast<UnwindInfo const *>(
+                code.BufferStart() + code.GetUnwindInfoStartOffset());
+            const unsigned codeStart = code.GetFunctionCodeStartOffset();
+            const unsigned codeSize = code.GetFunctionCodeEndOffset() - codeStart;
+
+            //
+            // CIE: the state at the function entry, CFA = RSP + 8 and the
+            // return address stored at CFA - 8.
+            //
+            const size_t cieOffset = ehFrame.size();
+            AppendFixed<uint32_t>(ehFrame, 0);              // Length, patched below.
+            AppendFixed<uint32_t>(ehFrame, 0);              // CIE ID.
+            ehFrame.push_back(1);                           // Version.
+            ehFrame.push_back('z');                         // Augmentation string.
+            ehFrame.push_back('R');
+            ehFrame.push_back(0);
+            AppendUnsigned(ehFrame, 1);                     // Code alignment factor.
+            AppendSigned(ehFrame, -8);                      // Data alignment factor.
+            AppendUnsigned(ehFrame, c_dwarfReturnAddress);
+            AppendUnsigned(ehFrame, 1);                     // Augmentation data length.
+            ehFrame.push_back(c_ehPointerEncodingAbsolute);
+
+            ehFrame.push_back(DW_CFA_def_cfa);
+            AppendUnsigned(ehFrame, c_dwarfRsp);
+            AppendUnsigned(ehFrame, sizeof(void*));
+            ehFrame.push_back(DW_CFA_offset | c_dwarfReturnAddress);
+            AppendUnsigned(ehFrame, 1);
+
+            PatchLength(ehFrame, cieOffset);
+
+            //
+            // FDE.
+            //
+            const size_t fdeOffset = ehFrame.size();
+            AppendFixed<uint32_t>(ehFrame, 0);              // Length, patched below.
+            AppendFixed<uint32_t>(ehFrame,                  // Distance to the CIE.
+                                  static_cast<uint32_t>(ehFrame.size() - cieOffset));
+            AppendFixed<uint64_t>(ehFrame, codeAddress);
+            AppendFixed<uint64_t>(ehFrame, codeSize);
+            AppendUnsigned(ehFrame, 0);                     // Augmentation data length.
+
+            // The unwind codes are stored in the reverse (epilog) order, so
+            // collect the indices of the operations first.
+            UnwindCode const * codes = &unwindInfo.m_firstUnwindCode;
+            unsigned operations[256];
+            unsigned operationCount = 0;
+
+            for (unsigned i = 0; i < unwindInfo.m_countOfCodes; ++operationCount)
+            {
+                operations[operationCount] = i;
+
+                switch (static_cast<UnwindCodeOp>(codes[i].m_operation.m_unwindOp))
+                {
+                case UnwindCodeOp::UWOP_ALLOC_SMALL:
+                    i += 1;
+                    break;
+
+                case UnwindCodeOp::UWOP_ALLOC_LARGE:
+                case UnwindCodeOp::UWOP_SAVE_NONVOL:
+                case UnwindCodeOp::UWOP_SAVE_XMM128:
+                    i += 2;
+                    break;
+
+                default:
+                    LogThrowAbort("Unsupported unwind operation %u", codes[i].m_operation.m_unwindOp);
+                    break;
+                }
+            }
+
+            unsigned location = 0;
+            unsigned stackBytes = 0;
+
+            while (operationCount > 0)
+            {
+                const UnwindCode unwindCode = codes[operations[--operationCount]];
+                const unsigned info = unwindCode.m_operation.m_opInfo;
+
+                AdvanceLocation(ehFrame, location, unwindCode.m_operation.m_codeOffset);
+
+                switch (static_cast<UnwindCodeOp>(unwindCode.m_operation.m_unwindOp))
+                {
+                case UnwindCodeOp::UWOP_ALLOC_SMALL:
+                    stackBytes = (info + 1) * sizeof(void*);
+                    ehFrame.push_back(DW_CFA_def_cfa_offset);
+                    AppendUnsigned(ehFrame, stackBytes + sizeof(void*));
+                    break;
+
+                case UnwindCodeOp::UWOP_ALLOC_LARGE:
+                    stackBytes = codes[operations[operationCount] + 1].m_frameOffset * sizeof(void*);
+                    ehFrame.push_back(DW_CFA_def_cfa_offset);
+                    AppendUnsigned(ehFrame, stackBytes + sizeof(void*));
+                    break;
+
+                case UnwindCodeOp::UWOP_SAVE_NONVOL:
+                    {
+                        // The register is saved at RSP + slot * 8, i.e. at
+                        // CFA - (stackBytes + 8) + slot * 8. The offset is
+                        // factored by the data alignment factor of -8. The
+                        // slot is negative for red zone frames.
+                        const int slot = static_cast<int16_t>(codes[operations[operationCount] + 1].m_frameOffset);
+
+                        ehFrame.push_back(DW_CFA_offset | GetDwarfRegister(info));
+                        AppendUnsigned(ehFrame,
+                                       static_cast<int>((stackBytes + sizeof(void*)) / sizeof(void*)) - slot);
+                    }
+                    break;
+
+                case UnwindCodeOp::UWOP_SAVE_XMM128:
+                    // System V treats all XMM registers as volatile, so the
+                    // saves are not needed for unwinding.
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            // The epilog restores the registers from the stack before the
+            // stack pointer is adjusted, so only the final RET instruction
+            // executes with CFA = RSP + 8. The same holds for the JMP which
+            // follows a tail call epilog, but the code after it runs with the
+            // frame in place, so the state is saved and restored around it.
+            for (auto const & jump : code.GetTailCallJumps())
+            {
+                AdvanceLocation(ehFrame, location, jump.m_startOffset - codeStart);
+                ehFrame.push_back(DW_CFA_remember_state);
+                ehFrame.push_back(DW_CFA_def_cfa_offset);
+                AppendUnsigned(ehFrame, sizeof(void*));
+
+                AdvanceLocation(ehFrame, location, jump.m_endOffset - codeStart);
+                ehFrame.push_back(DW_CFA_restore_state);
+            }
+
+            LogThrowAssert(codeSize > location, "Function is not longer than its prolog");
+            AdvanceLocation(ehFrame, location, codeSize - 1);
+            ehFrame.push_back(DW_CFA_def_cfa_offset);
+            AppendUnsigned(ehFrame, sizeof(void*));
+
+            PatchLength(ehFrame, fdeOffset);
+
+            // Zero length terminates the section.
+            AppendFixed<uint32_t>(ehFrame, 0);
+        }
+
+
+        unsigned GetEhFrameFdeOffset(std::vector<uint8_t> const & ehFrame)
+        {
+            LogThrowAssert(ehFrame.size() >= sizeof(uint32_t), "Missing CIE");
+
+            uint32_t cieLength = 0;
+
+            for (unsigned i = 0; i < sizeof(cieLength); ++i)
+            {
+                cieLength |= static_cast<uint32_t>(ehFrame[i]) << (8 * i);
+            }
+
+            return sizeof(cieLength) + cieLength;
+        }
+
+
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        void RegisterEhFrame(std::vector<uint8_t> const & ehFrame)
+        {
+            // libgcc expects a pointer to the whole .eh_frame section whereas
+            // libunwind (used on OS X) registers a single FDE, which follows
+            // the CIE.
+            uint8_t* data = const_cast<uint8_t*>(ehFrame.data());
+
+#ifdef __APPLE__
+            __register_frame(data + GetEhFrameFdeOffset(ehFrame));
+#else
+            __register_frame(data);
+#endif
+        }
+
+
+        void DeregisterEhFrame(std::vector<uint8_t>& ehFrame)
+        {
+            if (!ehFrame.empty())
+            {
+#ifdef __APPLE__
+                __deregister_frame(ehFrame.data() + GetEhFrameFdeOffset(ehFrame));
+#else
+                __deregister_frame(ehFrame.data());
+#endif
+                ehFrame.clear();
+            }
+        }
+#endif
     }
 }
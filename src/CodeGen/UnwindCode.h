@@ -26,6 +26,7 @@
 #include <cstdint>
 #include <ostream>
 #include <type_traits>
+#include <vector>
 
 // _M_X64 is defined by VC, as well as icc on Windows.
 // __amd64__ is defined by gcc/clang.
@@ -42,6 +43,8 @@ typedef uint64_t DWORD64;
 
 namespace NativeJIT
 {
+    class FunctionBuffer;
+
     //*************************************************************************
     //
     // Windows unwind structure definitions.
@@ -132,5 +135,30 @@ namespace NativeJIT
         // function code. Some examples include the address of the buffer itself
         // or the address of a class instance that owns the buffer.
         DWORD64 MakeFunctionTableIdentifier(void* objectAddress);
+
+        // Appends the contents of an .eh_frame section describing a single
+        // function, i.e. a CIE, an FDE and the zero terminator, to ehFrame.
+        // The function is the one generated in the code buffer, placed at
+        // codeAddress, which may differ from its location in the buffer. The
+        // DWARF call frame information is derived from the unwind codes of
+        // the function's prolog and from the locations of its epilogs: the
+        // final one and the ones in front of the tail call jumps. Addresses
+        // are encoded as absolute pointers.
+        void BuildEhFrame(FunctionBuffer const & code,
+                          uint64_t codeAddress,
+                          std::vector<uint8_t>& ehFrame);
+
+        // Returns the offset of the FDE in the data built by BuildEhFrame(),
+        // i.e. the size of the CIE that precedes it.
+        unsigned GetEhFrameFdeOffset(std::vector<uint8_t> const & ehFrame);
+
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        // Registers the data built by BuildEhFrame() with the unwinder, which
+        // uses it in place, so it must not be modified until it's deregistered
+        // by DeregisterEhFrame(). DeregisterEhFrame() also clears ehFrame and
+        // does nothing if it's empty.
+        void RegisterEhFrame(std::vector<uint8_t> const & ehFrame);
+        void DeregisterEhFrame(std::vector<uint8_t>& ehFrame);
+#endif
     }
 }
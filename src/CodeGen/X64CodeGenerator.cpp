@@ -21,8 +21,10 @@
 // THE SOFTWARE.
 
 
+#include <cstring>      // For memcpy.
 #include <iomanip>
 #include <iostream>
+#include <limits>
 
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"
 
@@ -86,6 +88,106 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::RemoveBytes(unsigned startPosition, unsigned length)
+    {
+        const unsigned removedEnd = startPosition + length;
+
+        for (auto & site : m_ripRelativeSites)
+        {
+            if (site < startPosition)
+            {
+                continue;
+            }
+
+            LogThrowAssert(site >= removedEnd,
+                           "Cannot remove RIP-relative displacement at offset %u",
+                           site);
+
+            // The displacement is relative to the end of its field (see
+            // EmitModRMOffset()). Targets before the removed bytes get closer
+            // to the moved instruction, targets after them move along.
+            int32_t displacement;
+            memcpy(&displacement, BufferStart() + site, sizeof(displacement));
+
+            const int64_t target = static_cast<int64_t>(site) + sizeof(displacement) + displacement;
+
+            if (target < startPosition)
+            {
+                displacement += static_cast<int32_t>(length);
+                memcpy(BufferStart() + site, &displacement, sizeof(displacement));
+            }
+
+            site -= length;
+        }
+
+        for (auto & site : m_directBranchSites)
+        {
+            if (site.m_offset < startPosition)
+            {
+                continue;
+            }
+
+            LogThrowAssert(site.m_offset >= removedEnd,
+                           "Cannot remove direct branch displacement at offset %u",
+                           site.m_offset);
+
+            // The target stays in place while the instruction moves towards
+            // it by the removed length.
+            int32_t displacement;
+            memcpy(&displacement, BufferStart() + site.m_offset, sizeof(displacement));
+
+            const int64_t newDisplacement = static_cast<int64_t>(displacement) + length;
+
+            LogThrowAssert(newDisplacement <= (std::numeric_limits<int32_t>::max)(),
+                           "Direct branch at offset %u is out of range after removing bytes",
+                           site.m_offset);
+
+            displacement = static_cast<int32_t>(newDisplacement);
+            memcpy(BufferStart() + site.m_offset, &displacement, sizeof(displacement));
+
+            site.m_offset -= length;
+        }
+
+        CodeBuffer::RemoveBytes(startPosition, length);
+    }
+
+
+    void X64CodeGenerator::Reset()
+    {
+        CodeBuffer::Reset();
+        m_ripRelativeSites.clear();
+        m_directBranchSites.clear();
+    }
+
+
+    std::vector<unsigned> const & X64CodeGenerator::GetRIPRelativeSites() const
+    {
+        return m_ripRelativeSites;
+    }
+
+
+    std::vector<X64CodeGenerator::DirectBranchSite> const &
+    X64CodeGenerator::GetDirectBranchSites() const
+    {
+        return m_directBranchSites;
+    }
+
+
+    bool X64CodeGenerator::IsInDirectBranchRange(void const * target) const
+    {
+        // Check against both ends of the buffer so that the result doesn't
+        // depend on where in the buffer the branch ends up.
+        const int64_t address = reinterpret_cast<int64_t>(target);
+        const int64_t start = reinterpret_cast<int64_t>(BufferStart());
+        const int64_t end = start + GetCapacity();
+
+        return address - start >= (std::numeric_limits<int32_t>::min)()
+               && address - start <= (std::numeric_limits<int32_t>::max)()
+               && address - end >= (std::numeric_limits<int32_t>::min)()
+               && address - end <= (std::numeric_limits<int32_t>::max)();
+    }
+
+
     void X64CodeGenerator::Call(Label label)
     {
         CodePrinter printer(*this);
@@ -108,14 +210,82 @@ namespace NativeJIT
     }
 
 
-    void X64CodeGenerator::Jmp(void* functionPtr)
+    void X64CodeGenerator::Call(void const * target)
+    {
+        CodePrinter printer(*this);
+
+        Emit8(0xe8);
+        EmitDirectBranchSite(target);
+
+        printer.PrintCall(target);
+    }
+
+
+    void X64CodeGenerator::Jmp(void const * target)
     {
         CodePrinter printer(*this);
 
         Emit8(0xe9);
-        Emit64(reinterpret_cast<uint64_t>(functionPtr));
+        EmitDirectBranchSite(target);
+
+        printer.PrintJump(target);
+    }
+
+
+    void X64CodeGenerator::Jmp(Register<8, false> r)
+    {
+        CodePrinter printer(*this);
+
+        // Like CALL, this instruction defaults to 64-bit operands.
+        if (r.IsExtended())
+        {
+            Emit8(0x41);
+        }
+        Emit8(0xff);
+        Emit8(0xE0 | r.GetId8());
+
+        printer.PrintJump(r);
+    }
+
+
+    void X64CodeGenerator::Lea(Register<8, false> dest, Label label)
+    {
+        CodePrinter printer(*this);
+
+        // REX.W, LEA, ModRM with mod = 00 and r/m = 101 (RIP + disp32). The
+        // displacement is relative to the end of the instruction, which is
+        // also the end of the call site.
+        Emit8(dest.IsExtended() ? 0x4c : 0x48);
+        Emit8(0x8d);
+        Emit8(0x05 | (dest.GetId8() << 3));
+        EmitCallSite(label, 4);
+
+        printer.PrintLea(dest, label);
+    }
+
+
+    void X64CodeGenerator::EmitLabelOffset(Label label)
+    {
+        CodePrinter printer(*this);
+
+        EmitCallSite(label, 4);
+
+        printer.PrintLabelOffset(label);
+    }
+
+
+    void X64CodeGenerator::EmitDirectBranchSite(void const * target)
+    {
+        LogThrowAssert(IsInDirectBranchRange(target),
+                       "Direct branch target %p is out of range",
+                       target);
+
+        // The displacement is relative to the end of the instruction.
+        const int64_t displacement = reinterpret_cast<int64_t>(target)
+                                     - reinterpret_cast<int64_t>(BufferStart() + CurrentPosition() + 4);
 
-        printer.PrintJump(functionPtr);
+        m_directBranchSites.push_back({ CurrentPosition(), target });
+        Emit32(static_cast<int32_t>(displacement));
     }
 
 
@@ -132,29 +302,43 @@ namespace NativeJIT
             "bts",
             "call",
             "cmp",
+            "crc32",
             "cvtfp2fp",
             "cvtfp2si",
             "cvtsi2fp",
             "dec",
+            "div",
+            "fmadd",
+            "idiv",
             "imul",
             "inc",
             "lea",
+            "max",
+            "min",
             "mov",
             "movsx",
             "movzx",
             "movap",
+            "mul",
             "neg",
             "nop",
             "not",
             "or",
             "pop",
+            "prefetchnta",
+            "prefetcht0",
+            "prefetcht1",
+            "prefetcht2",
             "push",
             "rep",
             "ret",
             "rol",
+            "round",
+            "sar",
             "shl",
             "shld",
             "shr",
+            "sqrt",
             "stosq",
             "sub",
             "xor",
@@ -236,6 +420,15 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::Prefetch(uint8_t hint, Register<8, false> base, int32_t offset)
+    {
+        EmitRexIndirect<4, false>(base);
+        Emit8(0x0f);
+        Emit8(0x18);
+        EmitModRMOffset(Register<8, false>(hint), base, offset);
+    }
+
+
     void X64CodeGenerator::Push(Register<8, false> r)
     {
         // EmitRex() would set REX.W, but this instruction defaults to
@@ -412,7 +605,7 @@ namespace NativeJIT
     }
 
 
-    void X64CodeGenerator::CodePrinter::PrintJump(void* function)
+    void X64CodeGenerator::CodePrinter::PrintJump(void const * function)
     {
         if (m_out != nullptr)
         {
@@ -425,6 +618,52 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::CodePrinter::PrintCall(void const * function)
+    {
+        if (m_out != nullptr)
+        {
+            IosMiniStateRestorer state(*m_out);
+
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << "call " << std::uppercase << std::hex << function << 'h' << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::CodePrinter::PrintJump(Register<8, false> r)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << "jmp " << r.GetName() << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::CodePrinter::PrintLea(Register<8, false> dest, Label label)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << "lea " << dest.GetName() << ", [L" << label.GetId() << "]" << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::CodePrinter::PrintLabelOffset(Label label)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << "dd L" << label.GetId() << " - $ - 4" << std::endl;
+        }
+    }
+
+
     void X64CodeGenerator::CodePrinter::Print(OpCode op)
     {
         if (m_out != nullptr)
@@ -37,6 +37,8 @@ namespace NativeJIT
     SaveRestoreVolatilesHelper::SaveRestoreVolatilesHelper(Allocators::IAllocator& allocator)
         : m_rxxCallExclusiveRegisterMask(0),
           m_xmmCallExclusiveRegisterMask(0),
+          m_rxxSavedRegisterMask(0),
+          m_xmmSavedRegisterMask(0),
           m_preservationStorage(Allocators::StlAllocator<void*>(allocator))
     {
         m_preservationStorage.reserve(RegisterBase::c_maxIntegerRegisterID + 1
@@ -72,40 +74,65 @@ namespace NativeJIT
     {
         auto & code = tree.GetCodeGenerator();
 
+        // Values in the registers which aren't pinned are moved out of the
+        // volatile registers for good rather than saved and restored. They
+        // are reloaded only if and when they are used, so a sequence of calls
+        // doesn't reload and save them again around each call. The registers
+        // pinned by the staging of the call need to be restored since they
+        // are referenced by the call's children.
         unsigned rxxVolatiles = GetRegistersToPreserve<false>(tree);
+        m_rxxSavedRegisterMask = 0;
 
         unsigned r = 0;
         while (BitOp::GetLowestBitSet(rxxVolatiles, &r))
         {
-            m_preservationStorage.push_back(tree.Temporary<void*>());
-            auto const & s = m_preservationStorage.back();
-
-            code.Emit<OpCode::Mov>(s.GetBaseRegister(),
-                                   s.GetOffset(),
-                                   Register<8, false>(r));
+            if (!tree.IsPinned(Register<8, false>(r)))
+            {
+                tree.EvictVolatileRegister<false>(r);
+            }
+            else
+            {
+                m_preservationStorage.push_back(tree.Temporary<void*>());
+                auto const & s = m_preservationStorage.back();
+
+                code.Emit<OpCode::Mov>(s.GetBaseRegister(),
+                                       s.GetOffset(),
+                                       Register<8, false>(r));
+
+                BitOp::SetBit(&m_rxxSavedRegisterMask, r);
+            }
 
             BitOp::ClearBit(&rxxVolatiles, r);
         }
 
         unsigned xmmVolatiles = GetRegistersToPreserve<true>(tree);
+        m_xmmSavedRegisterMask = 0;
 
         while (BitOp::GetLowestBitSet(xmmVolatiles, &r))
         {
-            // DESIGN NOTE: This preserves only the lower 64 bits of the XMM register.
-            // That is currently fine as NativeJIT only uses floats and doubles
-            // which don't overlap with the upper 64-bits. Also, the full 128
-            // bits of XMM nonvolatiles are preserved in the function prolog
-            // by FunctionBuffer. To be fully correct, this should preserve
-            // all 128 bits (f. ex. allow Temporary() to return 16-byte
-            // aligned 16-byte space and use movaps to save the whole register).
-            // RestoreVolatiles() needs to be modified accordingly as well.
-            m_preservationStorage.push_back(tree.Temporary<void*>());
-            auto const & s = m_preservationStorage.back();
-
-            code.Emit<OpCode::Mov>(s.GetBaseRegister(),
-                                   s.GetOffset(),
-                                   Register<8, true>(r));
-
+            if (!tree.IsPinned(Register<8, true>(r)))
+            {
+                tree.EvictVolatileRegister<true>(r);
+            }
+            else
+            {
+                // DESIGN NOTE: This preserves only the lower 64 bits of the XMM register.
+                // That is currently fine as NativeJIT only uses floats and doubles
+                // which don't overlap with the upper 64-bits. Also, the full 128
+                // bits of XMM nonvolatiles are preserved in the function prolog
+                // by FunctionBuffer. To be fully correct, this should preserve
+                // all 128 bits (f. ex. allow Temporary() to return 16-byte
+                // aligned 16-byte space and use movaps to save the whole register).
+                // RestoreVolatiles() needs to be modified accordingly as well.
+                m_preservationStorage.push_back(tree.Temporary<void*>());
+                auto const & s = m_preservationStorage.back();
+
+                code.Emit<OpCode::Mov>(s.GetBaseRegister(),
+                                       s.GetOffset(),
+                                       Register<8, true>(r));
+
+                BitOp::SetBit(&m_xmmSavedRegisterMask, r);
+            }
 
             BitOp::ClearBit(&xmmVolatiles, r);
         }
@@ -117,7 +144,7 @@ namespace NativeJIT
         auto & code = tree.GetCodeGenerator();
 
         // Do everything in the reverse order, including popping XMM registers first.
-        unsigned xmmVolatiles = GetRegistersToPreserve<true>(tree);
+        unsigned xmmVolatiles = m_xmmSavedRegisterMask;
 
         unsigned r = 0;
         while (BitOp::GetHighestBitSet(xmmVolatiles, &r))
@@ -133,7 +160,7 @@ namespace NativeJIT
             BitOp::ClearBit(&xmmVolatiles, r);
         }
 
-        unsigned rxxVolatiles = GetRegistersToPreserve<false>(tree);
+        unsigned rxxVolatiles = m_rxxSavedRegisterMask;
 
         while (BitOp::GetHighestBitSet(rxxVolatiles, &r))
         {
@@ -28,7 +28,14 @@ namespace NativeJIT
 {
     ExpressionNodeFactory::ExpressionNodeFactory(Allocators::IAllocator& allocator,
                                                  FunctionBuffer& code)
-        : ExpressionTree(allocator, code)
+        : ExpressionTree(allocator, code),
+          m_intrinsics(nullptr)
     {
     }
+
+
+    void ExpressionNodeFactory::SetIntrinsics(IntrinsicRegistry const & intrinsics)
+    {
+        m_intrinsics = &intrinsics;
+    }
 }
@@ -21,6 +21,9 @@
 // THE SOFTWARE.
 
 
+#include <algorithm>          // For std::find.
+
+#include "NativeJIT/BitOperations.h"
 #include "NativeJIT/CodeGen/CallingConvention.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionSpecification.h"
@@ -45,7 +48,9 @@ namespace NativeJIT
           m_topologicalSort(m_stlAllocator),
           m_parameters(m_stlAllocator),
           m_ripRelatives(m_stlAllocator),
+          m_constantPool(allocator, code),
           m_preconditionTests(m_stlAllocator),
+          m_guardTests(m_stlAllocator),
           m_rxxFreeList(allocator),
           m_xmmFreeList(allocator),
           m_reservedRxxRegisterStorages(m_stlAllocator),
@@ -53,7 +58,17 @@ namespace NativeJIT
           m_reservedRegistersPins(m_stlAllocator),
           m_temporaryCount(0),
           m_temporaries(m_stlAllocator),
+          m_nodeCodeGenStack(m_stlAllocator),
           m_maxFunctionCallParameters(-1),
+          m_functionCallCount(0),
+          m_hasStackParameters(false),
+          m_hasStackVariables(false),
+          m_loopDepth(0),
+          m_hasLocalVariables(false),
+          m_conditionalCodeRegions(m_stlAllocator),
+          m_conditionalCodeRegionCount(0),
+          m_noBumpRegions(m_stlAllocator),
+          m_conditionalCaches(m_stlAllocator),
           m_basePointer(rbp)
           // m_startOfEpilogue intentionally left uninitialized, see Compile().
     {
@@ -105,6 +120,12 @@ namespace NativeJIT
     }
 
 
+    ConstantPool& ExpressionTree::GetConstantPool()
+    {
+        return m_constantPool;
+    }
+
+
     void ExpressionTree::EnableDiagnostics(std::ostream& out)
     {
         m_diagnosticsStream = &out;
@@ -201,12 +222,218 @@ namespace NativeJIT
     }
 
 
+    void ExpressionTree::AddGuardTest(ExecutionPreconditionTest& test)
+    {
+        // Pass2 evaluates the nodes in the loop bodies and the nodes which
+        // may read local variables in their parents' order rather than in
+        // m_topologicalSort order, so there's no position for the test.
+        LogThrowAssert(m_loopDepth == 0, "Guards cannot be placed inside loop bodies");
+        LogThrowAssert(!m_hasLocalVariables, "Guards cannot be used together with local variables");
+
+        m_guardTests.push_back(std::make_pair(static_cast<unsigned>(m_topologicalSort.size()), &test));
+    }
+
+
     void ExpressionTree::ReportFunctionCallNode(unsigned parameterCount)
     {
         if (static_cast<int>(parameterCount) > m_maxFunctionCallParameters)
         {
             m_maxFunctionCallParameters = parameterCount;
         }
+
+        m_functionCallCount++;
+    }
+
+
+    void ExpressionTree::ReportStackParameter()
+    {
+        m_hasStackParameters = true;
+    }
+
+
+    void ExpressionTree::ReportStackVariable()
+    {
+        m_hasStackVariables = true;
+    }
+
+
+    bool ExpressionTree::HasStackVariables() const
+    {
+        return m_hasStackVariables;
+    }
+
+
+    void ExpressionTree::BeginLoopBody()
+    {
+        ++m_loopDepth;
+    }
+
+
+    void ExpressionTree::EndLoopBody()
+    {
+        LogThrowAssert(m_loopDepth > 0, "No loop body to end");
+        --m_loopDepth;
+    }
+
+
+    unsigned ExpressionTree::GetLoopDepth() const
+    {
+        return m_loopDepth;
+    }
+
+
+    void ExpressionTree::ReportLocalVariable()
+    {
+        m_hasLocalVariables = true;
+    }
+
+
+    bool ExpressionTree::HasLocalVariables() const
+    {
+        return m_hasLocalVariables;
+    }
+
+
+    void ExpressionTree::ReportChild(NodeBase const & child)
+    {
+        LogThrowAssert(!m_topologicalSort.empty(), "Node %u has no parent", child.GetId());
+
+        NodeBase& parent = *m_topologicalSort.back();
+
+        if (child.IsSequenced())
+        {
+            parent.MarkSequenced();
+        }
+
+        if (child.MayBumpRegisters())
+        {
+            parent.MarkMayBumpRegisters();
+        }
+    }
+
+
+    void ExpressionTree::BeginConditionalCode(bool canBumpRegisters)
+    {
+        m_conditionalCodeRegions.push_back(++m_conditionalCodeRegionCount);
+
+        if (!canBumpRegisters)
+        {
+            m_noBumpRegions.push_back(m_conditionalCodeRegionCount);
+        }
+    }
+
+
+    void ExpressionTree::EndConditionalCode()
+    {
+        LogThrowAssert(!m_conditionalCodeRegions.empty(), "No conditional code to end");
+
+        // The values of the nodes evaluated in the region are not available
+        // after it if the region was skipped at runtime.
+        while (!m_conditionalCaches.empty()
+               && m_conditionalCaches.back().first == m_conditionalCodeRegions.size())
+        {
+            const NodeBase& node = *m_conditionalCaches.back().second;
+
+            LogThrowAssert(!node.IsCached(),
+                           "Node %u is used both inside and outside of the conditional code "
+                           "it was evaluated in",
+                           node.GetId());
+            m_conditionalCaches.pop_back();
+        }
+
+        if (!m_noBumpRegions.empty()
+            && m_noBumpRegions.back() == m_conditionalCodeRegions.back())
+        {
+            m_noBumpRegions.pop_back();
+        }
+
+        m_conditionalCodeRegions.pop_back();
+    }
+
+
+    bool ExpressionTree::IsInConditionalCode() const
+    {
+        return !m_conditionalCodeRegions.empty();
+    }
+
+
+    bool ExpressionTree::CanBumpRegisters() const
+    {
+        return m_noBumpRegions.empty();
+    }
+
+
+    bool ExpressionTree::HasFreeRegisters(unsigned count) const
+    {
+        return m_rxxFreeList.GetFreeCount() >= count
+               && m_xmmFreeList.GetFreeCount() >= count;
+    }
+
+
+    unsigned ExpressionTree::GetConditionalCodeRegion() const
+    {
+        return m_conditionalCodeRegions.empty() ? 0 : m_conditionalCodeRegions.back();
+    }
+
+
+    bool ExpressionTree::IsInConditionalCodeRegion(unsigned region) const
+    {
+        return region == 0
+               || std::find(m_conditionalCodeRegions.begin(),
+                            m_conditionalCodeRegions.end(),
+                            region) != m_conditionalCodeRegions.end();
+    }
+
+
+    void ExpressionTree::ReportConditionalCache(NodeBase& node)
+    {
+        LogThrowAssert(IsInConditionalCode(), "Expected to be in conditional code");
+        m_conditionalCaches.push_back(
+            std::make_pair(static_cast<unsigned>(m_conditionalCodeRegions.size()), &node));
+    }
+
+
+    void ExpressionTree::SpillAllRegisters()
+    {
+        for (unsigned i = 0 ; i <= RegisterBase::c_maxIntegerRegisterID; ++i)
+        {
+            if (!m_rxxFreeList.IsAvailable(i) && !m_rxxFreeList.IsPinned(i))
+            {
+                BumpRegister<void*>(PointerRegister(i), BumpDestination::Temporary);
+            }
+        }
+
+        for (unsigned i = 0 ; i <= RegisterBase::c_maxFloatRegisterID; ++i)
+        {
+            if (!m_xmmFreeList.IsAvailable(i) && !m_xmmFreeList.IsPinned(i))
+            {
+                BumpRegister<double>(Register<8, true>(i), BumpDestination::Temporary);
+            }
+        }
+    }
+
+
+    void ExpressionTree::BeginNodeCodeGen(NodeBase const & node)
+    {
+        if (m_code.IsDebugInfoEnabled())
+        {
+            m_nodeCodeGenStack.push_back(node.GetId());
+            m_code.AddDebugInfo(m_code.CurrentPosition(), node.GetId());
+        }
+    }
+
+
+    void ExpressionTree::EndNodeCodeGen()
+    {
+        if (m_code.IsDebugInfoEnabled())
+        {
+            m_nodeCodeGenStack.pop_back();
+
+            if (!m_nodeCodeGenStack.empty())
+            {
+                m_code.AddDebugInfo(m_code.CurrentPosition(), m_nodeCodeGenStack.back());
+            }
+        }
     }
 
 
@@ -215,11 +442,22 @@ namespace NativeJIT
         // Note: the call to Reset() clears all allocated labels, so start of
         // epilogue label must be allocated after that point.
         m_code.Reset();
+        m_constantPool.Clear();
         m_startOfEpilogue = m_code.AllocateLabel();
+        m_nodeCodeGenStack.clear();
 
         // Generate constants.
         Pass0();
 
+        // Values live across several calls are better kept in non-volatile
+        // registers. With a single call, preserving the live volatiles
+        // around it costs about the same as saving the non-volatiles.
+        if (m_functionCallCount > 1)
+        {
+            m_rxxFreeList.PreferNonVolatiles();
+            m_xmmFreeList.PreferNonVolatiles();
+        }
+
         // Generate code.
         m_code.BeginFunctionBodyGeneration();
 
@@ -228,16 +466,47 @@ namespace NativeJIT
         Print();
         Pass3();
 
+        unsigned savedRxxMask = m_rxxFreeList.GetLifetimeUsedMask()
+                                & CallingConvention::c_rxxNonVolatileRegistersMask
+                                & CallingConvention::c_rxxWritableRegistersMask;
+        const unsigned savedXmmMask = m_xmmFreeList.GetLifetimeUsedMask()
+                                      & CallingConvention::c_xmmNonVolatileRegistersMask
+                                      & CallingConvention::c_xmmWritableRegistersMask;
+
+        // The base pointer is only used to access the temporaries and the
+        // stack parameters, so there is no need to set it up (and save it)
+        // if there are none.
+        auto baseRegisterType = FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp;
+        const bool isBasePointerUsed = m_temporaryCount > 0 || m_hasStackParameters;
+
+        if (!isBasePointerUsed)
+        {
+            baseRegisterType = FunctionSpecification::BaseRegisterType::Unused;
+            savedRxxMask &= ~m_basePointer.GetMask();
+        }
+
+        // Leaf functions keep their temporaries and register saves below RSP
+        // if they fit into the red zone. Since RBP is then equal to RSP, the
+        // addressing of temporaries in the already generated code is the same
+        // for both frame types.
+        const unsigned redZoneSlotCount
+            = m_temporaryCount
+              + BitOp::GetNonZeroBitCount(savedRxxMask & ~m_basePointer.GetMask())
+              + (isBasePointerUsed ? 1 : 0);
+        const bool isRedZoneFrame
+            = m_maxFunctionCallParameters < 0
+              && savedXmmMask == 0
+              && redZoneSlotCount * sizeof(void*) <= FunctionSpecification::c_redZoneSize;
+
         const FunctionSpecification spec(m_allocator,
                                          m_maxFunctionCallParameters,
                                          m_temporaryCount,
-                                         m_rxxFreeList.GetLifetimeUsedMask()
-                                            & CallingConvention::c_rxxNonVolatileRegistersMask
-                                            & CallingConvention::c_rxxWritableRegistersMask,
-                                         m_xmmFreeList.GetLifetimeUsedMask()
-                                            & CallingConvention::c_xmmNonVolatileRegistersMask
-                                            & CallingConvention::c_xmmWritableRegistersMask,
-                                         FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp,
+                                         savedRxxMask,
+                                         savedXmmMask,
+                                         baseRegisterType,
+                                         isRedZoneFrame
+                                         ? FunctionSpecification::FrameType::RedZone
+                                         : FunctionSpecification::FrameType::Standard,
                                          m_code.IsDiagnosticsStreamAvailable()
                                          ? &m_code.GetDiagnosticsStream()
                                          : nullptr);
@@ -309,12 +578,6 @@ namespace NativeJIT
             GetDiagnosticsStream() << "=== Pass0 ===" << std::endl;
         }
 
-        // Emit RIP-relative constants.
-        for (unsigned i = 0 ; i < m_ripRelatives.size(); ++i)
-        {
-            m_ripRelatives[i]->EmitStaticData(*this);
-        }
-
         // Walk the nodes in reverse order of creation (i.e. in potential order
         // of execution) to see whether they can be optimized away.
         //
@@ -348,6 +611,12 @@ namespace NativeJIT
                 node->ReleaseReferencesToChildren();
             }
         }
+
+        // Emit RIP-relative constants once it's known which nodes are used.
+        for (unsigned i = 0 ; i < m_ripRelatives.size(); ++i)
+        {
+            m_ripRelatives[i]->EmitStaticData(*this);
+        }
     }
 
 
@@ -382,15 +651,32 @@ namespace NativeJIT
             GetDiagnosticsStream() << "=== Pass2 ===" << std::endl;
         }
 
+        unsigned guard = 0;
+
         for (unsigned i = 0 ; i < m_topologicalSort.size(); ++i)
         {
+            // Return early as soon as the nodes created before the guard
+            // (and thus all the nodes its condition depends on) are available.
+            for (; guard < m_guardTests.size() && m_guardTests[guard].first == i; ++guard)
+            {
+                m_guardTests[guard].second->Evaluate(*this);
+            }
+
             NodeBase& node = *m_topologicalSort[i];
 
-            if (node.GetParentCount() > 1 && !node.HasBeenEvaluated())
+            if (node.GetParentCount() > 1
+                && !node.HasBeenEvaluated()
+                && !node.IsInLoopBody()
+                && !node.IsSequenced())
             {
                 node.CodeGenCache(*this);
             }
         }
+
+        for (; guard < m_guardTests.size(); ++guard)
+        {
+            m_guardTests[guard].second->Evaluate(*this);
+        }
     }
 
 
@@ -468,11 +754,11 @@ namespace NativeJIT
                                PointerRegister base,
                                int32_t offset)
         : m_tree(tree),
-          m_storageClass(StorageClass::Indirect),
+          m_storageClass(static_cast<unsigned>(StorageClass::Indirect)),
           m_isFloat(base.c_isFloat),
           m_registerId(base.GetId()),
-          m_offset(offset),
-          m_refCount(0)
+          m_refCount(0),
+          m_offset(offset)
     {
         NotifyDataRegisterChange(RegisterChangeType::Initialize);
     }
@@ -486,7 +772,7 @@ namespace NativeJIT
 
     StorageClass ExpressionTree::Data::GetStorageClass() const
     {
-        return m_storageClass;
+        return static_cast<StorageClass>(m_storageClass);
     }
 
 
@@ -498,35 +784,35 @@ namespace NativeJIT
 
     int32_t ExpressionTree::Data::GetOffset() const
     {
-        LogThrowAssert(m_storageClass == StorageClass::Indirect, "StorageClass must be Indirect, found %u", m_storageClass);
+        LogThrowAssert(GetStorageClass() == StorageClass::Indirect, "StorageClass must be Indirect, found %u", m_storageClass);
         return m_offset;
     }
 
 
     void ExpressionTree::Data::ConvertDirectToIndirect(int32_t offset)
     {
-        LogThrowAssert(m_storageClass == StorageClass::Direct,
+        LogThrowAssert(GetStorageClass() == StorageClass::Direct,
                        "StorageClass must be Direct, found %u",
                        m_storageClass);
         LogThrowAssert(!IsSharedBaseRegister(),
                        "Cannot change type of shared register %u from direct to indirect",
                        m_registerId);
 
-        m_storageClass = StorageClass::Indirect;
+        m_storageClass = static_cast<unsigned>(StorageClass::Indirect);
         m_offset = offset;
     }
 
 
     void ExpressionTree::Data::ConvertIndirectToDirect()
     {
-        LogThrowAssert(m_storageClass == StorageClass::Indirect,
+        LogThrowAssert(GetStorageClass() == StorageClass::Indirect,
                        "StorageClass must be Indirect, found %u",
                        m_storageClass);
         LogThrowAssert(!IsSharedBaseRegister(),
                        "Cannot change type of shared register %u from indirect to direct",
                        m_registerId);
 
-        m_storageClass = StorageClass::Direct;
+        m_storageClass = static_cast<unsigned>(StorageClass::Direct);
         m_offset = 0;
     }
 
@@ -554,11 +840,21 @@ namespace NativeJIT
 
     void ExpressionTree::Data::SwapContents(Data* other)
     {
-        std::swap(m_storageClass, other->m_storageClass);
-        std::swap(m_isFloat, other->m_isFloat);
-        std::swap(m_registerId, other->m_registerId);
-        std::swap(m_offset, other->m_offset);
+        // Bit fields cannot be bound to references, so std::swap() is not
+        // an option for them.
+        const unsigned storageClass = m_storageClass;
+        const unsigned isFloat = m_isFloat;
+        const unsigned registerId = m_registerId;
+
+        m_storageClass = other->m_storageClass;
+        m_isFloat = other->m_isFloat;
+        m_registerId = other->m_registerId;
+
+        other->m_storageClass = storageClass;
+        other->m_isFloat = isFloat;
+        other->m_registerId = registerId;
 
+        // Swapping the immediate also swaps the offset which shares its storage.
         std::swap(m_immediate, other->m_immediate);
 
         // Both Data objects keep their m_refCount.
@@ -570,7 +866,7 @@ namespace NativeJIT
 
     void ExpressionTree::Data::NotifyDataRegisterChange(RegisterChangeType type)
     {
-        if (m_storageClass != StorageClass::Immediate)
+        if (GetStorageClass() != StorageClass::Immediate)
         {
             if (m_isFloat)
             {
@@ -586,7 +882,7 @@ namespace NativeJIT
 
     bool ExpressionTree::Data::IsSharedBaseRegister() const
     {
-        return m_storageClass != StorageClass::Immediate
+        return GetStorageClass() != StorageClass::Immediate
             && !m_isFloat
             && m_tree.IsAnySharedBaseRegister(PointerRegister(m_registerId));
     }
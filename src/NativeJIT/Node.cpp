@@ -37,8 +37,11 @@ namespace NativeJIT
     NodeBase::NodeBase(ExpressionTree& tree)
         : m_id(tree.AddNode(*this)),
           m_parentCount(0),
+          m_isInLoopBody(tree.GetLoopDepth() > 0),
           m_isReferenced(false),
-          m_hasBeenEvaluated(false)
+          m_hasBeenEvaluated(false),
+          m_isSequenced(false),
+          m_mayBumpRegisters(false)
     {
     }
 
@@ -49,12 +52,20 @@ namespace NativeJIT
     }
 
 
-    void NodeBase::IncrementParentCount()
+    void NodeBase::IncrementParentCount(ExpressionTree& tree)
     {
         LogThrowAssert(!HasBeenEvaluated(), "Cannot change the parent count after the node was evaluated");
+        LogThrowAssert(m_parentCount < c_maxParentCount,
+                       "Node %u has too many parents",
+                       GetId());
 
         ++m_parentCount;
         MarkReferenced();
+
+        if (IsSequenced() || MayBumpRegisters())
+        {
+            tree.ReportChild(*this);
+        }
     }
 
 
@@ -76,7 +87,7 @@ namespace NativeJIT
 
     bool NodeBase::HasBeenEvaluated() const
     {
-        return m_hasBeenEvaluated;
+        return m_hasBeenEvaluated != 0;
     }
 
 
@@ -88,7 +99,7 @@ namespace NativeJIT
 
     bool NodeBase::IsReferenced() const
     {
-        return m_isReferenced;
+        return m_isReferenced != 0;
     }
 
 
@@ -104,6 +115,46 @@ namespace NativeJIT
     }
 
 
+    bool NodeBase::IsInLoopBody() const
+    {
+        return m_isInLoopBody != 0;
+    }
+
+
+    bool NodeBase::IsSequenced() const
+    {
+        return m_isSequenced != 0;
+    }
+
+
+    void NodeBase::MarkSequenced()
+    {
+        m_isSequenced = true;
+    }
+
+
+    bool NodeBase::MayBumpRegisters() const
+    {
+        return m_mayBumpRegisters != 0;
+    }
+
+
+    void NodeBase::MarkMayBumpRegisters()
+    {
+        m_mayBumpRegisters = true;
+    }
+
+
+    unsigned NodeBase::ReleaseCacheReference()
+    {
+        LogThrowAssert(HasBeenEvaluated() && m_parentCount > 0,
+                       "Unexpected release of the cache of node %u",
+                       GetId());
+
+        return --m_parentCount;
+    }
+
+
     void NodeBase::CompileAsRoot(ExpressionTree& /*tree*/)
     {
         LogThrowAbort("Root of ExpressionTree must be a ReturnNode node.");
@@ -127,4 +178,16 @@ namespace NativeJIT
     {
         return false;
     }
+
+
+    bool NodeBase::GetConstantAddress(void const *& /* address */) const
+    {
+        return false;
+    }
+
+
+    bool NodeBase::CompileAsTailCall(ExpressionTree& /* tree */)
+    {
+        return false;
+    }
 }
@@ -0,0 +1,1151 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cinttypes>     // For PRIu64.
+#include <limits>
+
+#include "NativeJIT/TreeSerializer.h"
+
+
+namespace NativeJIT
+{
+    using Serialization::c_pointerTo;
+    using Serialization::NodeKind;
+    using Serialization::OpaqueObject;
+    using Serialization::ScalarType;
+
+    namespace
+    {
+        const uint8_t c_magic[] = { 'N', 'J', 'T', 'S' };
+
+
+        //*********************************************************************
+        //
+        // Helpers for mapping the serialized types back to C++ types.
+        //
+        //*********************************************************************
+
+        template <typename T>
+        struct TypeTag
+        {
+        };
+
+
+        template <JccType JCC>
+        using JccTag = std::integral_constant<JccType, JCC>;
+
+
+        template <typename T>
+        struct IsInteger
+            : std::integral_constant<bool,
+                                     std::is_integral<T>::value
+                                     && !std::is_same<T, bool>::value>
+        {
+        };
+
+
+        template <typename T>
+        struct IsNumber
+            : std::integral_constant<bool,
+                                     std::is_arithmetic<T>::value
+                                     && !std::is_same<T, bool>::value>
+        {
+        };
+
+
+        // IMul has no 8-bit form.
+        template <typename T>
+        struct CanMultiply
+            : std::integral_constant<bool, IsNumber<T>::value && (sizeof(T) > 1)>
+        {
+        };
+
+
+        uint8_t Code(ScalarType type)
+        {
+            return static_cast<uint8_t>(type);
+        }
+
+
+        bool IsPointer(uint8_t type)
+        {
+            return type == Code(ScalarType::Opaque) || (type & c_pointerTo) != 0;
+        }
+
+
+        // Calls visitor.Visit(TypeTag<T>()) where T is the scalar type with
+        // the given code.
+        template <typename VISITOR>
+        NodeBase* VisitScalar(uint8_t type, VISITOR const & visitor)
+        {
+            switch (static_cast<ScalarType>(type))
+            {
+            case ScalarType::Bool:
+                return visitor.Visit(TypeTag<bool>());
+            case ScalarType::Int8:
+                return visitor.Visit(TypeTag<int8_t>());
+            case ScalarType::UInt8:
+                return visitor.Visit(TypeTag<uint8_t>());
+            case ScalarType::Int16:
+                return visitor.Visit(TypeTag<int16_t>());
+            case ScalarType::UInt16:
+                return visitor.Visit(TypeTag<uint16_t>());
+            case ScalarType::Int32:
+                return visitor.Visit(TypeTag<int32_t>());
+            case ScalarType::UInt32:
+                return visitor.Visit(TypeTag<uint32_t>());
+            case ScalarType::Int64:
+                return visitor.Visit(TypeTag<int64_t>());
+            case ScalarType::UInt64:
+                return visitor.Visit(TypeTag<uint64_t>());
+            case ScalarType::Float:
+                return visitor.Visit(TypeTag<float>());
+            case ScalarType::Double:
+                return visitor.Visit(TypeTag<double>());
+            default:
+                LogThrowAbort("Invalid scalar type %u", type);
+                return nullptr;
+            }
+        }
+
+
+        // Calls visitor.Visit(TypeTag<T>()) where T is the type pointed to by
+        // the pointer type with the given code.
+        template <typename VISITOR>
+        NodeBase* VisitPointee(uint8_t type, VISITOR const & visitor)
+        {
+            if (type == Code(ScalarType::Opaque))
+            {
+                return visitor.Visit(TypeTag<OpaqueObject>());
+            }
+            else if (type == (c_pointerTo | Code(ScalarType::Opaque)))
+            {
+                return visitor.Visit(TypeTag<OpaqueObject*>());
+            }
+            else if ((type & c_pointerTo) != 0)
+            {
+                return VisitScalar(type & ~c_pointerTo, visitor);
+            }
+
+            LogThrowAbort("Type %u is not a pointer", type);
+            return nullptr;
+        }
+
+
+        template <typename VISITOR>
+        class PointerVisitor
+        {
+        public:
+            PointerVisitor(VISITOR const & visitor)
+                : m_visitor(visitor)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                return m_visitor.Visit(TypeTag<T*>());
+            }
+
+        private:
+            VISITOR const & m_visitor;
+        };
+
+
+        // Calls visitor.Visit(TypeTag<T>()) where T is the type with the given code.
+        template <typename VISITOR>
+        NodeBase* VisitType(uint8_t type, VISITOR const & visitor)
+        {
+            return IsPointer(type)
+                ? VisitPointee(type, PointerVisitor<VISITOR>(visitor))
+                : VisitScalar(type, visitor);
+        }
+
+
+        // Calls visitor.Visit(JccTag<JCC>()) for the relational JccType with
+        // the given value.
+        template <typename VISITOR>
+        NodeBase* VisitJcc(uint8_t jcc, VISITOR const & visitor)
+        {
+            switch (static_cast<JccType>(jcc))
+            {
+            case JccType::JB:
+                return visitor.Visit(JccTag<JccType::JB>());
+            case JccType::JAE:
+                return visitor.Visit(JccTag<JccType::JAE>());
+            case JccType::JE:
+                return visitor.Visit(JccTag<JccType::JE>());
+            case JccType::JNE:
+                return visitor.Visit(JccTag<JccType::JNE>());
+            case JccType::JBE:
+                return visitor.Visit(JccTag<JccType::JBE>());
+            case JccType::JA:
+                return visitor.Visit(JccTag<JccType::JA>());
+            case JccType::JL:
+                return visitor.Visit(JccTag<JccType::JL>());
+            case JccType::JGE:
+                return visitor.Visit(JccTag<JccType::JGE>());
+            case JccType::JLE:
+                return visitor.Visit(JccTag<JccType::JLE>());
+            case JccType::JG:
+                return visitor.Visit(JccTag<JccType::JG>());
+            default:
+                LogThrowAbort("Unsupported condition %u", jcc);
+                return nullptr;
+            }
+        }
+
+
+        //*********************************************************************
+        //
+        // Visitors that create the nodes for each record kind.
+        //
+        //*********************************************************************
+
+        class ImmediateVisitor
+        {
+        public:
+            ImmediateVisitor(ExpressionNodeFactory& factory,
+                             uint8_t const * data,
+                             size_t size)
+                : m_factory(factory),
+                  m_data(data),
+                  m_size(size)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                LogThrowAssert(m_size == sizeof(T), "Invalid immediate size %zu", m_size);
+
+                T value;
+                std::memcpy(&value, m_data, sizeof(T));
+
+                return &m_factory.Immediate(value);
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            uint8_t const * m_data;
+            size_t m_size;
+        };
+
+
+        // Creates Add, Mul and Sub for numbers and And and Or for integers.
+        // Mul is not available for 8-bit types.
+        class BinaryVisitor
+        {
+        public:
+            BinaryVisitor(ExpressionNodeFactory& factory,
+                          NodeKind kind,
+                          NodeBase& left,
+                          NodeBase& right)
+                : m_factory(factory),
+                  m_kind(kind),
+                  m_left(left),
+                  m_right(right)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                if (m_kind == NodeKind::And || m_kind == NodeKind::Or)
+                {
+                    return Bitwise<T>(IsInteger<T>());
+                }
+                else if (m_kind == NodeKind::Mul)
+                {
+                    return Multiply<T>(CanMultiply<T>());
+                }
+                else
+                {
+                    return Arithmetic<T>(IsNumber<T>());
+                }
+            }
+
+        private:
+            template <typename T>
+            NodeBase* Arithmetic(std::true_type) const
+            {
+                auto & left = static_cast<Node<T>&>(m_left);
+                auto & right = static_cast<Node<T>&>(m_right);
+
+                return m_kind == NodeKind::Add
+                    ? &m_factory.Add(left, right)
+                    : &m_factory.Sub(left, right);
+            }
+
+
+            template <typename T>
+            NodeBase* Arithmetic(std::false_type) const
+            {
+                LogThrowAbort("Arithmetic operation %u on a non-numeric type", static_cast<unsigned>(m_kind));
+                return nullptr;
+            }
+
+
+            template <typename T>
+            NodeBase* Multiply(std::true_type) const
+            {
+                return &m_factory.Mul(static_cast<Node<T>&>(m_left),
+                                      static_cast<Node<T>&>(m_right));
+            }
+
+
+            template <typename T>
+            NodeBase* Multiply(std::false_type) const
+            {
+                LogThrowAbort("Multiplication is not supported for the type");
+                return nullptr;
+            }
+
+
+            template <typename T>
+            NodeBase* Bitwise(std::true_type) const
+            {
+                auto & left = static_cast<Node<T>&>(m_left);
+                auto & right = static_cast<Node<T>&>(m_right);
+
+                return m_kind == NodeKind::And
+                    ? &m_factory.And(left, right)
+                    : &m_factory.Or(left, right);
+            }
+
+
+            template <typename T>
+            NodeBase* Bitwise(std::false_type) const
+            {
+                LogThrowAbort("Bitwise operation %u on a non-integer type", static_cast<unsigned>(m_kind));
+                return nullptr;
+            }
+
+            ExpressionNodeFactory& m_factory;
+            NodeKind m_kind;
+            NodeBase& m_left;
+            NodeBase& m_right;
+        };
+
+
+        class ShiftVisitor
+        {
+        public:
+            ShiftVisitor(ExpressionNodeFactory& factory,
+                         NodeKind kind,
+                         NodeBase& value,
+                         uint8_t bitCount)
+                : m_factory(factory),
+                  m_kind(kind),
+                  m_value(value),
+                  m_bitCount(bitCount)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                return Shift<T>(IsInteger<T>());
+            }
+
+        private:
+            template <typename T>
+            NodeBase* Shift(std::true_type) const
+            {
+                auto & value = static_cast<Node<T>&>(m_value);
+
+                switch (m_kind)
+                {
+                case NodeKind::Rol:
+                    return &m_factory.Rol(value, m_bitCount);
+                case NodeKind::Shl:
+                    return &m_factory.Shl(value, m_bitCount);
+                case NodeKind::Shr:
+                    return &m_factory.Shr(value, m_bitCount);
+                default:
+                    LogThrowAbort("Invalid shift operation %u", static_cast<unsigned>(m_kind));
+                    return nullptr;
+                }
+            }
+
+
+            template <typename T>
+            NodeBase* Shift(std::false_type) const
+            {
+                LogThrowAbort("Shift operation %u on a non-integer type", static_cast<unsigned>(m_kind));
+                return nullptr;
+            }
+
+            ExpressionNodeFactory& m_factory;
+            NodeKind m_kind;
+            NodeBase& m_value;
+            uint8_t m_bitCount;
+        };
+
+
+        // Casts are supported between any two scalar types and between any
+        // two pointer types.
+        template <typename FROM>
+        class CastToVisitor
+        {
+        public:
+            CastToVisitor(ExpressionNodeFactory& factory, NodeBase& value)
+                : m_factory(factory),
+                  m_value(value)
+            {
+            }
+
+
+            template <typename TO>
+            NodeBase* Visit(TypeTag<TO>) const
+            {
+                typedef std::integral_constant<
+                    bool,
+                    std::is_pointer<TO>::value == std::is_pointer<FROM>::value> IsSupported;
+
+                return Cast<TO>(IsSupported());
+            }
+
+        private:
+            template <typename TO>
+            NodeBase* Cast(std::true_type) const
+            {
+                return &m_factory.Cast<TO>(static_cast<Node<FROM>&>(m_value));
+            }
+
+
+            template <typename TO>
+            NodeBase* Cast(std::false_type) const
+            {
+                LogThrowAbort("Unsupported cast between scalar and pointer types");
+                return nullptr;
+            }
+
+            ExpressionNodeFactory& m_factory;
+            NodeBase& m_value;
+        };
+
+
+        class CastFromVisitor
+        {
+        public:
+            CastFromVisitor(ExpressionNodeFactory& factory, NodeBase& value, uint8_t toType)
+                : m_factory(factory),
+                  m_value(value),
+                  m_toType(toType)
+            {
+            }
+
+
+            template <typename FROM>
+            NodeBase* Visit(TypeTag<FROM>) const
+            {
+                return VisitType(m_toType, CastToVisitor<FROM>(m_factory, m_value));
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            NodeBase& m_value;
+            uint8_t m_toType;
+        };
+
+
+        class DerefVisitor
+        {
+        public:
+            DerefVisitor(ExpressionNodeFactory& factory, NodeBase& pointer, int32_t index)
+                : m_factory(factory),
+                  m_pointer(pointer),
+                  m_index(index)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                return &m_factory.Deref(static_cast<Node<T*>&>(m_pointer), m_index);
+            }
+
+
+            NodeBase* Visit(TypeTag<OpaqueObject>) const
+            {
+                LogThrowAbort("Cannot dereference an opaque pointer");
+                return nullptr;
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            NodeBase& m_pointer;
+            int32_t m_index;
+        };
+
+
+        class FieldPointerVisitor
+        {
+        public:
+            FieldPointerVisitor(ExpressionNodeFactory& factory, NodeBase& object, int32_t offset)
+                : m_factory(factory),
+                  m_object(object),
+                  m_offset(offset)
+            {
+            }
+
+
+            template <typename FIELD>
+            NodeBase* Visit(TypeTag<FIELD>) const
+            {
+                return &m_factory.PlacementConstruct<FieldPointerNode<OpaqueObject, FIELD>>(
+                    m_factory,
+                    static_cast<Node<OpaqueObject*>&>(m_object),
+                    m_offset);
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            NodeBase& m_object;
+            int32_t m_offset;
+        };
+
+
+        template <typename T>
+        class CompareVisitor
+        {
+        public:
+            CompareVisitor(ExpressionNodeFactory& factory, NodeBase& left, NodeBase& right)
+                : m_factory(factory),
+                  m_left(left),
+                  m_right(right)
+            {
+            }
+
+
+            template <JccType JCC>
+            NodeBase* Visit(JccTag<JCC>) const
+            {
+                return &m_factory.Compare<JCC>(static_cast<Node<T>&>(m_left),
+                                               static_cast<Node<T>&>(m_right));
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            NodeBase& m_left;
+            NodeBase& m_right;
+        };
+
+
+        class CompareTypeVisitor
+        {
+        public:
+            CompareTypeVisitor(ExpressionNodeFactory& factory,
+                               uint8_t jcc,
+                               NodeBase& left,
+                               NodeBase& right)
+                : m_factory(factory),
+                  m_jcc(jcc),
+                  m_left(left),
+                  m_right(right)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                return VisitJcc(m_jcc, CompareVisitor<T>(m_factory, m_left, m_right));
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            uint8_t m_jcc;
+            NodeBase& m_left;
+            NodeBase& m_right;
+        };
+
+
+        template <typename T>
+        class ConditionalVisitor
+        {
+        public:
+            ConditionalVisitor(ExpressionNodeFactory& factory,
+                               NodeBase& condition,
+                               NodeBase& trueValue,
+                               NodeBase& falseValue)
+                : m_factory(factory),
+                  m_condition(condition),
+                  m_trueValue(trueValue),
+                  m_falseValue(falseValue)
+            {
+            }
+
+
+            template <JccType JCC>
+            NodeBase* Visit(JccTag<JCC>) const
+            {
+                return &m_factory.Conditional(static_cast<FlagExpressionNode<JCC>&>(m_condition),
+                                              static_cast<Node<T>&>(m_trueValue),
+                                              static_cast<Node<T>&>(m_falseValue));
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            NodeBase& m_condition;
+            NodeBase& m_trueValue;
+            NodeBase& m_falseValue;
+        };
+
+
+        class ConditionalTypeVisitor
+        {
+        public:
+            ConditionalTypeVisitor(ExpressionNodeFactory& factory,
+                                   uint8_t jcc,
+                                   NodeBase& condition,
+                                   NodeBase& trueValue,
+                                   NodeBase& falseValue)
+                : m_factory(factory),
+                  m_jcc(jcc),
+                  m_condition(condition),
+                  m_trueValue(trueValue),
+                  m_falseValue(falseValue)
+            {
+            }
+
+
+            template <typename T>
+            NodeBase* Visit(TypeTag<T>) const
+            {
+                return VisitJcc(m_jcc,
+                                ConditionalVisitor<T>(m_factory,
+                                                      m_condition,
+                                                      m_trueValue,
+                                                      m_falseValue));
+            }
+
+        private:
+            ExpressionNodeFactory& m_factory;
+            uint8_t m_jcc;
+            NodeBase& m_condition;
+            NodeBase& m_trueValue;
+            NodeBase& m_falseValue;
+        };
+
+
+        //*********************************************************************
+        //
+        // InputStream
+        //
+        //*********************************************************************
+
+        // Reads the serialized data, verifying that reads stay within bounds.
+        class InputStream
+        {
+        public:
+            InputStream(uint8_t const * data, size_t size)
+                : m_current(data),
+                  m_end(data + size)
+            {
+            }
+
+
+            uint8_t ReadByte()
+            {
+                LogThrowAssert(m_current < m_end, "Unexpected end of serialized tree");
+                return *m_current++;
+            }
+
+
+            uint64_t ReadUnsigned()
+            {
+                uint64_t value = 0;
+                unsigned shift = 0;
+                uint8_t byte;
+
+                do
+                {
+                    LogThrowAssert(shift < 64, "Invalid varint in serialized tree");
+                    byte = ReadByte();
+                    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                    shift += 7;
+                } while ((byte & 0x80) != 0);
+
+                return value;
+            }
+
+
+            int64_t ReadSigned()
+            {
+                const uint64_t zigzag = ReadUnsigned();
+
+                return static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+            }
+
+
+            int32_t ReadInt32()
+            {
+                const int64_t value = ReadSigned();
+                LogThrowAssert(value >= (std::numeric_limits<int32_t>::min)()
+                               && value <= (std::numeric_limits<int32_t>::max)(),
+                               "Value out of range in serialized tree");
+
+                return static_cast<int32_t>(value);
+            }
+
+
+            uint8_t const * ReadBytes(size_t count)
+            {
+                LogThrowAssert(static_cast<size_t>(m_end - m_current) >= count,
+                               "Unexpected end of serialized tree");
+                auto bytes = m_current;
+                m_current += count;
+
+                return bytes;
+            }
+
+
+            bool IsAtEnd() const
+            {
+                return m_current == m_end;
+            }
+
+        private:
+            uint8_t const * m_current;
+            uint8_t const * m_end;
+        };
+
+
+        // A node recreated from a record.
+        struct LoadedNode
+        {
+            NodeBase* m_node;
+            uint8_t m_type;
+            NodeKind m_kind;
+            uint8_t m_jcc;
+        };
+
+
+        // Reads a child reference and verifies that it refers to an already
+        // loaded node of the expected type.
+        NodeBase& ReadChild(InputStream& input,
+                            std::vector<LoadedNode> const & nodes,
+                            uint8_t expectedType)
+        {
+            const uint64_t index = input.ReadUnsigned();
+            LogThrowAssert(index < nodes.size(), "Invalid child index %" PRIu64, index);
+
+            auto & child = nodes[static_cast<size_t>(index)];
+            LogThrowAssert(child.m_type == expectedType,
+                           "Child type %u does not match the expected type %u",
+                           child.m_type,
+                           expectedType);
+
+            return *child.m_node;
+        }
+
+
+        // Appends the value encoded as a LEB128 varint.
+        void AppendUnsigned(std::vector<uint8_t>& output, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                output.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+
+            output.push_back(static_cast<uint8_t>(value));
+        }
+
+
+        // Returns the size of the immediate for the scalar type with the given code.
+        size_t GetScalarSize(uint8_t type)
+        {
+            switch (static_cast<ScalarType>(type))
+            {
+            case ScalarType::Bool:
+                return sizeof(bool);
+            case ScalarType::Int8:
+            case ScalarType::UInt8:
+                return 1;
+            case ScalarType::Int16:
+            case ScalarType::UInt16:
+                return 2;
+            case ScalarType::Int32:
+            case ScalarType::UInt32:
+            case ScalarType::Float:
+                return 4;
+            case ScalarType::Int64:
+            case ScalarType::UInt64:
+            case ScalarType::Double:
+                return 8;
+            default:
+                LogThrowAbort("Invalid immediate type %u", type);
+                return 0;
+            }
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // CallTargetRegistry
+    //
+    //*************************************************************************
+    CallTargetRegistry::Target const * CallTargetRegistry::Find(uint32_t id) const
+    {
+        for (auto & target : m_targets)
+        {
+            if (target.m_id == id)
+            {
+                return &target;
+            }
+        }
+
+        return nullptr;
+    }
+
+
+    CallTargetRegistry::Target const * CallTargetRegistry::Find(void const * function) const
+    {
+        for (auto & target : m_targets)
+        {
+            if (target.m_function == function)
+            {
+                return &target;
+            }
+        }
+
+        return nullptr;
+    }
+
+
+    void CallTargetRegistry::Register(Target const & target)
+    {
+        LogThrowAssert(Find(target.m_id) == nullptr,
+                       "Call target ID %u is already registered",
+                       target.m_id);
+        LogThrowAssert(Find(target.m_function) == nullptr,
+                       "Function for call target ID %u is already registered",
+                       target.m_id);
+
+        m_targets.push_back(target);
+    }
+
+
+    //*************************************************************************
+    //
+    // TreeWriter
+    //
+    //*************************************************************************
+    TreeWriter::TreeWriter(ExpressionNodeFactory& factory, CallTargetRegistry const & registry)
+        : m_factory(factory),
+          m_registry(registry)
+    {
+    }
+
+
+    void TreeWriter::BeginRecord(NodeKind kind, uint8_t type)
+    {
+        m_records.push_back(static_cast<uint8_t>(kind));
+        m_records.push_back(type);
+    }
+
+
+    void TreeWriter::EndRecord(NodeBase const & node)
+    {
+        const unsigned index = static_cast<unsigned>(m_recordIndexes.size());
+        const bool inserted = m_recordIndexes.insert(std::make_pair(node.GetId(), index)).second;
+
+        LogThrowAssert(inserted, "Node %u has already been serialized", node.GetId());
+    }
+
+
+    void TreeWriter::WriteChild(NodeBase const & child)
+    {
+        auto it = m_recordIndexes.find(child.GetId());
+        LogThrowAssert(it != m_recordIndexes.end(),
+                       "Node %u was not created through TreeWriter",
+                       child.GetId());
+
+        WriteUnsigned(it->second);
+    }
+
+
+    void TreeWriter::WriteUnsigned(uint64_t value)
+    {
+        AppendUnsigned(m_records, value);
+    }
+
+
+    void TreeWriter::WriteSigned(int64_t value)
+    {
+        // Zigzag encoding keeps small negative values short.
+        AppendUnsigned(m_records,
+                       (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+
+    void TreeWriter::WriteTree(NodeBase const & root, std::vector<uint8_t>& output) const
+    {
+        auto it = m_recordIndexes.find(root.GetId());
+        LogThrowAssert(it != m_recordIndexes.end(),
+                       "Root node %u was not created through TreeWriter",
+                       root.GetId());
+
+        output.insert(output.end(), c_magic, c_magic + sizeof(c_magic));
+        output.push_back(Serialization::c_version);
+        AppendUnsigned(output, m_recordIndexes.size());
+        output.insert(output.end(), m_records.begin(), m_records.end());
+        AppendUnsigned(output, it->second);
+    }
+
+
+    //*************************************************************************
+    //
+    // TreeReader
+    //
+    //*************************************************************************
+    TreeReader::TreeReader(ExpressionNodeFactory& factory, CallTargetRegistry const & registry)
+        : m_factory(factory),
+          m_registry(registry)
+    {
+    }
+
+
+    void TreeReader::AddParameter(NodeBase& parameter,
+                                  unsigned position,
+                                  uint8_t type,
+                                  ParameterConverter converter)
+    {
+        if (m_parameters.size() <= position)
+        {
+            m_parameters.resize(position + 1, ParameterEntry());
+        }
+
+        LogThrowAssert(m_parameters[position].m_node == nullptr,
+                       "Parameter %u is already added",
+                       position);
+
+        m_parameters[position].m_node = &parameter;
+        m_parameters[position].m_type = type;
+        m_parameters[position].m_converter = converter;
+    }
+
+
+    NodeBase& TreeReader::Load(uint8_t const * data, size_t size, uint8_t rootType)
+    {
+        InputStream input(data, size);
+
+        LogThrowAssert(std::memcmp(input.ReadBytes(sizeof(c_magic)), c_magic, sizeof(c_magic)) == 0,
+                       "Data is not a serialized tree");
+
+        const uint8_t version = input.ReadByte();
+        LogThrowAssert(version == Serialization::c_version,
+                       "Unsupported serialized tree version %u",
+                       version);
+
+        const uint64_t recordCount = input.ReadUnsigned();
+        LogThrowAssert(recordCount <= size, "Invalid record count %" PRIu64, recordCount);
+
+        std::vector<LoadedNode> nodes;
+        nodes.reserve(static_cast<size_t>(recordCount));
+
+        for (uint64_t i = 0; i < recordCount; ++i)
+        {
+            const uint8_t kindCode = input.ReadByte();
+            LogThrowAssert(kindCode < static_cast<uint8_t>(NodeKind::KindCount),
+                           "Invalid node kind %u",
+                           kindCode);
+
+            LoadedNode loaded = { nullptr, input.ReadByte(), static_cast<NodeKind>(kindCode), 0 };
+            const uint8_t type = loaded.m_type;
+
+            switch (loaded.m_kind)
+            {
+            case NodeKind::Parameter:
+                {
+                    const uint64_t position = input.ReadUnsigned();
+                    LogThrowAssert(position < m_parameters.size()
+                                   && m_parameters[static_cast<size_t>(position)].m_node != nullptr,
+                                   "Parameter %" PRIu64 " has not been added",
+                                   position);
+
+                    auto & parameter = m_parameters[static_cast<size_t>(position)];
+                    LogThrowAssert(parameter.m_type == type,
+                                   "Parameter %" PRIu64 " type %u does not match the serialized type %u",
+                                   position,
+                                   parameter.m_type,
+                                   type);
+
+                    // Opaque parameters are converted on first use so that
+                    // unused parameters don't get extra nodes.
+                    if (parameter.m_converter != nullptr)
+                    {
+                        parameter.m_node = &parameter.m_converter(m_factory, *parameter.m_node);
+                        parameter.m_converter = nullptr;
+                    }
+
+                    loaded.m_node = parameter.m_node;
+                }
+                break;
+
+            case NodeKind::Immediate:
+                {
+                    const size_t immediateSize = GetScalarSize(type);
+                    auto bytes = input.ReadBytes(immediateSize);
+
+                    loaded.m_node = VisitScalar(type, ImmediateVisitor(m_factory, bytes, immediateSize));
+                }
+                break;
+
+            case NodeKind::Add:
+            case NodeKind::And:
+            case NodeKind::Mul:
+            case NodeKind::Or:
+            case NodeKind::Sub:
+                {
+                    auto & left = ReadChild(input, nodes, type);
+                    auto & right = ReadChild(input, nodes, type);
+
+                    loaded.m_node = VisitScalar(type, BinaryVisitor(m_factory, loaded.m_kind, left, right));
+                }
+                break;
+
+            case NodeKind::Rol:
+            case NodeKind::Shl:
+            case NodeKind::Shr:
+                {
+                    auto & value = ReadChild(input, nodes, type);
+                    const uint8_t bitCount = input.ReadByte();
+
+                    loaded.m_node = VisitScalar(type, ShiftVisitor(m_factory, loaded.m_kind, value, bitCount));
+                }
+                break;
+
+            case NodeKind::Cast:
+                {
+                    const uint8_t fromType = input.ReadByte();
+                    auto & value = ReadChild(input, nodes, fromType);
+
+                    loaded.m_node = VisitType(fromType, CastFromVisitor(m_factory, value, type));
+                }
+                break;
+
+            case NodeKind::Deref:
+                {
+                    LogThrowAssert((type & c_pointerTo) == 0, "Cannot dereference to type %u", type);
+
+                    auto & pointer = ReadChild(input, nodes, c_pointerTo | type);
+                    const int32_t index = input.ReadInt32();
+
+                    loaded.m_node = VisitPointee(c_pointerTo | type, DerefVisitor(m_factory, pointer, index));
+                }
+                break;
+
+            case NodeKind::FieldPointer:
+                {
+                    auto & object = ReadChild(input, nodes, Code(ScalarType::Opaque));
+                    const int32_t offset = input.ReadInt32();
+
+                    loaded.m_node = VisitPointee(type, FieldPointerVisitor(m_factory, object, offset));
+                }
+                break;
+
+            case NodeKind::Compare:
+                {
+                    LogThrowAssert(type == Code(ScalarType::Bool), "Invalid compare type %u", type);
+
+                    loaded.m_jcc = input.ReadByte();
+                    const uint8_t operandType = input.ReadByte();
+                    auto & left = ReadChild(input, nodes, operandType);
+                    auto & right = ReadChild(input, nodes, operandType);
+
+                    loaded.m_node = VisitScalar(operandType,
+                                                CompareTypeVisitor(m_factory, loaded.m_jcc, left, right));
+                }
+                break;
+
+            case NodeKind::Conditional:
+                {
+                    const uint8_t jcc = input.ReadByte();
+                    const uint64_t conditionIndex = input.ReadUnsigned();
+                    LogThrowAssert(conditionIndex < nodes.size()
+                                   && nodes[static_cast<size_t>(conditionIndex)].m_kind == NodeKind::Compare
+                                   && nodes[static_cast<size_t>(conditionIndex)].m_jcc == jcc,
+                                   "Invalid condition for conditional node");
+
+                    auto & condition = *nodes[static_cast<size_t>(conditionIndex)].m_node;
+                    auto & trueValue = ReadChild(input, nodes, type);
+                    auto & falseValue = ReadChild(input, nodes, type);
+
+                    loaded.m_node = VisitScalar(type,
+                                                ConditionalTypeVisitor(m_factory,
+                                                                       jcc,
+                                                                       condition,
+                                                                       trueValue,
+                                                                       falseValue));
+                }
+                break;
+
+            case NodeKind::Call:
+                {
+                    const uint64_t id = input.ReadUnsigned();
+                    auto target = id <= (std::numeric_limits<uint32_t>::max)()
+                        ? m_registry.Find(static_cast<uint32_t>(id))
+                        : nullptr;
+
+                    LogThrowAssert(target != nullptr, "Unknown call target %" PRIu64, id);
+                    LogThrowAssert(target->m_returnType == type,
+                                   "Return type %u of call target %" PRIu64 " does not match %u",
+                                   target->m_returnType,
+                                   id,
+                                   type);
+
+                    NodeBase* parameters[CallTargetRegistry::c_maxParameters];
+
+                    for (unsigned p = 0; p < target->m_parameterCount; ++p)
+                    {
+                        parameters[p] = &ReadChild(input, nodes, target->m_parameterTypes[p]);
+                    }
+
+                    loaded.m_node = &target->m_builder(m_factory, target->m_function, parameters);
+                }
+                break;
+
+            default:
+                LogThrowAbort("Invalid node kind %u", kindCode);
+                break;
+            }
+
+            nodes.push_back(loaded);
+        }
+
+        auto & root = ReadChild(input, nodes, rootType);
+        LogThrowAssert(input.IsAtEnd(), "Unexpected data after the serialized tree");
+
+        return root;
+    }
+}
@@ -0,0 +1,126 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+
+#include <cstdint>
+#include <cstring>
+
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace AllocatorUnitTest
+    {
+        TEST(Allocator, SingleBlock)
+        {
+            Allocator allocator(100);
+
+            char* a = static_cast<char*>(allocator.Allocate(40));
+            char* b = static_cast<char*>(allocator.Allocate(60));
+
+            ASSERT_EQ(a + 40, b);
+            ASSERT_EQ(100u, allocator.GetBytesAllocated());
+            ASSERT_EQ(100u, allocator.GetCapacity());
+            ASSERT_EQ(1u, allocator.GetBlockCount());
+
+            allocator.Deallocate(b);
+
+            allocator.Reset();
+
+            ASSERT_EQ(0u, allocator.GetBytesAllocated());
+            ASSERT_EQ(100u, allocator.GetHighWaterMark());
+            ASSERT_EQ(a, allocator.Allocate(10));
+        }
+
+
+        TEST(Allocator, Growth)
+        {
+            Allocator allocator(100);
+
+            allocator.Allocate(60);
+
+            // Doesn't fit in the first block, a block twice as large is chained.
+            char* a = static_cast<char*>(allocator.Allocate(60));
+            memset(a, 1, 60);
+
+            ASSERT_EQ(2u, allocator.GetBlockCount());
+            ASSERT_EQ(300u, allocator.GetCapacity());
+
+            // Larger than twice the current block.
+            char* b = static_cast<char*>(allocator.Allocate(1000));
+            memset(b, 2, 1000);
+
+            ASSERT_EQ(3u, allocator.GetBlockCount());
+            ASSERT_EQ(1300u, allocator.GetCapacity());
+            ASSERT_EQ(1120u, allocator.GetBytesAllocated());
+
+            // Memory from all the blocks belongs to the allocator.
+            allocator.Deallocate(a);
+            allocator.Deallocate(b + 999);
+
+            char outside;
+            ASSERT_THROW(allocator.Deallocate(&outside), std::runtime_error);
+        }
+
+
+        TEST(Allocator, ResetKeepsLargestBlock)
+        {
+            Allocator allocator(64);
+
+            for (unsigned i = 0; i < 10; ++i)
+            {
+                allocator.Allocate(50);
+            }
+
+            ASSERT_EQ(500u, allocator.GetBytesAllocated());
+            ASSERT_GT(allocator.GetBlockCount(), 1u);
+
+            // The retained block holds everything allocated before the reset,
+            // so repeating the same allocations uses a single block.
+            allocator.Reset();
+
+            ASSERT_EQ(1u, allocator.GetBlockCount());
+            ASSERT_GE(allocator.GetCapacity(), 500u);
+
+            const size_t capacity = allocator.GetCapacity();
+
+            for (unsigned round = 0; round < 3; ++round)
+            {
+                for (unsigned i = 0; i < 10; ++i)
+                {
+                    allocator.Allocate(50);
+                }
+
+                ASSERT_EQ(1u, allocator.GetBlockCount());
+                ASSERT_EQ(capacity, allocator.GetCapacity());
+
+                allocator.Reset();
+            }
+
+            ASSERT_EQ(500u, allocator.GetHighWaterMark());
+        }
+    }
+}
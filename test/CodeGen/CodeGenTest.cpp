@@ -714,6 +714,48 @@ namespace NativeJIT
             buffer.Emit<OpCode::Shld>(r12, rbp);
             buffer.Emit<OpCode::Shld>(rbp, r12);
 
+            buffer.Emit<OpCode::Sar>(r12);
+            buffer.EmitImmediate<OpCode::Sar>(eax, static_cast<uint8_t>(5));
+
+            // Multiplication and division with implicit rax/rdx operands.
+            buffer.Emit<OpCode::Mul>(rcx);
+            buffer.Emit<OpCode::IMul>(r9);
+            buffer.Emit<OpCode::Div>(ebx);
+            buffer.Emit<OpCode::IDiv>(r12);
+            buffer.Emit<OpCode::IDiv, 4>(rcx, 0x12);
+            buffer.Emit<OpCode::Div, 8>(r9, 0x34);
+
+            // Floating point division - divss and divsd.
+            buffer.Emit<OpCode::Div>(xmm1s, xmm2s);
+            buffer.Emit<OpCode::Div>(xmm9, rcx, 0x20);
+
+            // Floating point intrinsics.
+            buffer.Emit<OpCode::Sqrt>(xmm1s, xmm2s);
+            buffer.Emit<OpCode::Sqrt>(xmm9, rcx, 0x20);
+            buffer.Emit<OpCode::Max>(xmm0s, xmm15s);
+            buffer.Emit<OpCode::Min>(xmm3, xmm4);
+            buffer.Emit<OpCode::And>(xmm1s, xmm2s);
+            buffer.Emit<OpCode::And>(xmm8, xmm1);
+            buffer.EmitImmediate<OpCode::Round>(xmm1s, xmm2s, static_cast<uint8_t>(9));
+            buffer.EmitImmediate<OpCode::Round>(xmm10, xmm3, static_cast<uint8_t>(1));
+            buffer.Emit<OpCode::FMAdd>(xmm1s, xmm2s, xmm3s);
+            buffer.Emit<OpCode::FMAdd>(xmm9, xmm10, xmm11);
+
+            // Prefetch.
+            buffer.Emit<OpCode::PrefetchT0, 1>(rax, 0);
+            buffer.Emit<OpCode::PrefetchNTA, 1>(r12, 0x10);
+            buffer.Emit<OpCode::PrefetchT1, 1>(rbp, 0x100);
+            buffer.Emit<OpCode::PrefetchT2, 1>(r13, 0);
+
+            // CRC32.
+            buffer.Emit<OpCode::Crc32>(eax, cl);
+            buffer.Emit<OpCode::Crc32>(r9d, r10w);
+            buffer.Emit<OpCode::Crc32>(ecx, edx);
+            buffer.Emit<OpCode::Crc32>(rax, r8);
+            buffer.Emit<OpCode::Crc32, 4, false, 4, false>(eax, rcx, 0x10);
+            buffer.Emit<OpCode::Crc32, 8, false, 8, false>(r11, rsp, 8);
+            buffer.Emit<OpCode::Crc32>(edx, sil);
+
             // floating point
             // signed
 
@@ -1601,7 +1643,66 @@ namespace NativeJIT
                 " 0000068E  66| 0F A5 D8         shld ax, bx, cl                                                    \n"
                 " 00000692  0F A5 F2             shld edx, esi, cl                                                  \n"
                 " 00000695  49/ 0F A5 EC         shld r12, rbp, cl                                                  \n"
-                " 00000699  4C/ 0F A5 E5         shld rbp, r12, cl                                                  \n";
+                " 00000699  4C/ 0F A5 E5         shld rbp, r12, cl                                                  \n"
+                "                                                                                                   \n"
+                " 0000069D  49/ D3 FC            sar r12, cl                                                        \n"
+                " 000006A0  C1 F8 05             sar eax, 5                                                         \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Mul, imul, div and idiv with implicit rax/rdx operands           \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006A3  48/ F7 E1            mul rcx                                                            \n"
+                " 000006A6  49/ F7 E9            imul r9                                                            \n"
+                " 000006A9  F7 F3                div ebx                                                            \n"
+                " 000006AB  49/ F7 FC            idiv r12                                                           \n"
+                " 000006AE  F7 79 12             idiv dword ptr [rcx + 12h]                                         \n"
+                " 000006B1  49/ F7 71 34         div qword ptr [r9 + 34h]                                           \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Floating point division, divss and divsd                         \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006B5  F3/ 0F 5E CA         divss xmm1, xmm2                                                   \n"
+                " 000006B9  F2/ 44/ 0F 5E 49     divsd xmm9, qword ptr [rcx + 20h]                                  \n"
+                "           20                                                                                      \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Floating point intrinsics                                        \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006BF  F3/ 0F 51 CA         sqrtss xmm1, xmm2                                                  \n"
+                " 000006C3  F2/ 44/ 0F 51 49     sqrtsd xmm9, qword ptr [rcx + 20h]                                 \n"
+                "           20                                                                                      \n"
+                " 000006C9  F3/ 41/ 0F 5F C7     maxss xmm0, xmm15                                                  \n"
+                " 000006CE  F2/ 0F 5D DC         minsd xmm3, xmm4                                                   \n"
+                " 000006D2  0F 54 CA             andps xmm1, xmm2                                                   \n"
+                " 000006D5  66| 44/ 0F 54 C1     andpd xmm8, xmm1                                                   \n"
+                " 000006DA  66| 0F 3A 0A CA      roundss xmm1, xmm2, 9                                              \n"
+                "           09                                                                                      \n"
+                " 000006E0  66| 44/ 0F 3A 0B     roundsd xmm10, xmm3, 1                                             \n"
+                "           D3 01                                                                                   \n"
+                " 000006E7  C4 E2 69 B9 CB       vfmadd231ss xmm1, xmm2, xmm3                                       \n"
+                " 000006EC  C4 42 A9 B9 CB       vfmadd231sd xmm9, xmm10, xmm11                                     \n"
+                "                                ; Prefetch                                                         \n"
+                " 000006F1  0F 18 08             prefetcht0 byte ptr [rax]                                          \n"
+                " 000006F4  41/ 0F 18 44 24      prefetchnta byte ptr [r12 + 10h]                                   \n"
+                "           10                                                                                      \n"
+                " 000006FA  0F 18 95 00000100    prefetcht1 byte ptr [rbp + 100h]                                   \n"
+                " 00000701  41/ 0F 18 5D 00      prefetcht2 byte ptr [r13]                                          \n"
+                "                                ; CRC32                                                            \n"
+                " 00000706  F2/ 0F 38 F0 C1      crc32 eax, cl                                                      \n"
+                " 0000070B  66| F2/ 45/ 0F 38    crc32 r9d, r10w                                                    \n"
+                "           F1 CA                                                                                   \n"
+                " 00000712  F2/ 0F 38 F1 CA      crc32 ecx, edx                                                     \n"
+                " 00000717  F2/ 49/ 0F 38 F1     crc32 rax, r8                                                      \n"
+                "           C0                                                                                      \n"
+                " 0000071D  F2/ 0F 38 F1 41      crc32 eax, dword ptr [rcx + 10h]                                   \n"
+                "           10                                                                                      \n"
+                " 00000723  F2/ 4C/ 0F 38 F1     crc32 r11, qword ptr [rsp + 8h]                                    \n"
+                "           5C 24 08                                                                                \n"
+                " 0000072B  F2/ 40/ 0F 38 F0     crc32 edx, sil                                                     \n"
+                "           D6                                                                                      \n";
 
             ML64Verifier v(ml64Output.c_str(), start);
         }
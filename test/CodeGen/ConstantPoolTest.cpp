@@ -0,0 +1,153 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <cstring>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ConstantPool.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionSpecification.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace ConstantPoolUnitTest
+    {
+        TEST_FIXTURE_START(ConstantPoolTest)
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(ConstantPoolTest, Deduplication)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            ConstantPool pool(setup->GetAllocator(), code);
+
+            code.Reset();
+
+            const int32_t one = pool.Add(1.0);
+            const int32_t oneFloat = pool.Add(1.0f);
+            const int32_t two = pool.Add(2.0);
+
+            ASSERT_EQ(one, pool.Add(1.0));
+            ASSERT_EQ(oneFloat, pool.Add(1.0f));
+            ASSERT_EQ(two, pool.Add(2.0));
+            ASSERT_NE(one, oneFloat);
+            ASSERT_NE(one, two);
+            ASSERT_EQ(3u, pool.GetEntryCount());
+
+            ASSERT_EQ(0u, one % sizeof(double));
+            ASSERT_EQ(0u, oneFloat % sizeof(float));
+            ASSERT_EQ(0u, two % sizeof(double));
+
+            // The same bits as an absolute address are kept separately since
+            // they need a relocation.
+            const uint64_t bits = 0x1234;
+            const int32_t value = pool.Add(bits);
+            const int32_t address = pool.Add(bits, true);
+
+            ASSERT_NE(value, address);
+            ASSERT_EQ(address, pool.Add(reinterpret_cast<void*>(bits)));
+            ASSERT_EQ(1u, code.GetAbsoluteAddressRelocations().size());
+            ASSERT_EQ(static_cast<unsigned>(address), code.GetAbsoluteAddressRelocations()[0]);
+
+            // After clearing, the constants are emitted again.
+            const unsigned position = code.CurrentPosition();
+            pool.Clear();
+            ASSERT_TRUE(pool.Add(1.0) >= static_cast<int32_t>(position));
+        }
+
+
+        TEST_F(ConstantPoolTest, PackedConstant)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            ConstantPool pool(setup->GetAllocator(), code);
+
+            code.Reset();
+
+            // Misalign the current position.
+            pool.Add(static_cast<uint8_t>(1));
+
+            const double packed[2] = { 3.25, -1.5 };
+            const int32_t offset = pool.Add(packed,
+                                            sizeof(packed),
+                                            ConstantPool::GetNaturalAlignment(sizeof(packed)),
+                                            false);
+
+            ASSERT_EQ(16u, ConstantPool::GetNaturalAlignment(sizeof(packed)));
+            ASSERT_EQ(0, offset % 16);
+            ASSERT_EQ(offset, pool.Add(packed, sizeof(packed), 16, false));
+
+            // Load the whole vector with an aligned load and return its
+            // lower half.
+            FunctionSpecification spec(setup->GetAllocator(), -1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, nullptr);
+            code.BeginFunctionBodyGeneration(spec);
+            code.Emit<OpCode::MovAP>(xmm0s, rip, offset);
+            code.EndFunctionBodyGeneration(spec);
+
+            auto function = reinterpret_cast<double (*)()>(const_cast<void*>(code.GetEntryPoint()));
+            ASSERT_EQ(3.25, function());
+        }
+
+
+        TEST_F(ConstantPoolTest, ManyConstants)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            ConstantPool pool(setup->GetAllocator(), code);
+
+            code.Reset();
+
+            // Enough entries for the hash index to grow several times.
+            const unsigned count = 100;
+            std::vector<int32_t> offsets;
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                offsets.push_back(pool.Add(static_cast<uint64_t>(i) * 0x10001));
+            }
+
+            ASSERT_EQ(count, pool.GetEntryCount());
+
+            for (unsigned i = 0; i < count; ++i)
+            {
+                ASSERT_EQ(offsets[i], pool.Add(static_cast<uint64_t>(i) * 0x10001)) << "i = " << i;
+            }
+
+            // A constant with matching contents but insufficient alignment
+            // is emitted again.
+            pool.Add(static_cast<uint8_t>(1));
+            const uint32_t value = 0x87654321;
+            const int32_t unaligned = pool.Add(&value, sizeof(value), 1, false);
+            const int32_t aligned = pool.Add(&value, sizeof(value), 4, false);
+
+            ASSERT_NE(0, unaligned % 4);
+            ASSERT_EQ(0, aligned % 4);
+            ASSERT_EQ(aligned, pool.Add(value));
+            ASSERT_EQ(count + 3, pool.GetEntryCount());
+        }
+    }
+}
@@ -22,9 +22,11 @@
 
 
 #include <algorithm>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <random>
+#include <stdexcept>
 
 #include "NativeJIT/CodeGen/CallingConvention.h"
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
@@ -528,10 +530,89 @@ namespace NativeJIT
         }
 
 
-#ifdef NATIVEJIT_PLATFORM_WINDOWS
-        // NativeJIT only implements stack unwinding on Windows.
-        // Therefore, the exception propagation unit test must be
-        // disabled for other operating systems.
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        TEST_F(FunctionBufferTest, RedZone)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            // A leaf function with 2 local slots for variables, RBX explicitly
+            // and RBP implicitly saved. The stack pointer is not adjusted,
+            // the saves are placed right below the 2 variable slots.
+            FunctionSpecification spec(setup->GetAllocator(),
+                                        -1,
+                                        2,
+                                        rbx.GetMask(),
+                                        0,
+                                        FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp,
+                                        FunctionSpecification::FrameType::RedZone,
+                                        GetDiagnosticsStream());
+            ASSERT_NO_FATAL_FAILURE(ValidateUnwindInfo(spec));
+
+            ASSERT_EQ(0, spec.GetOffsetToOriginalRsp());
+
+            // Verify prolog.
+            std::vector<uint8_t> offsets;
+
+            code.Reset();
+
+            EmitAndRecordOffset(code,
+                                [](FunctionBuffer& f) { f.Emit<OpCode::Mov>(rsp, -24, rbx); },
+                                offsets);
+            EmitAndRecordOffset(code,
+                                [](FunctionBuffer& f)
+                                {
+                                    f.Emit<OpCode::Mov>(rsp, -32, rbp);
+                                    f.Emit<OpCode::Mov>(rbp, rsp);
+                                },
+                                offsets);
+
+            ASSERT_NO_FATAL_FAILURE(VerifyProlog(spec, code));
+
+            // Verify unwind info.
+            auto & unwindInfo = *reinterpret_cast<UnwindInfo const *>(spec.GetUnwindInfoBuffer());
+            auto unwindCodes = &unwindInfo.m_firstUnwindCode;
+
+            std::reverse(offsets.begin(), offsets.end());
+
+            ASSERT_EQ(4, unwindInfo.m_countOfCodes);
+            ASSERT_EQ_UNWIND_CODE2(UnwindCode(offsets.at(1), UnwindCodeOp::UWOP_SAVE_NONVOL, static_cast<uint8_t>(rbx.GetId())),
+                                 UnwindCode(static_cast<uint16_t>(-3)), // Negative quadword offset off rsp.
+                                 unwindCodes[2],
+                                 unwindCodes[3]);
+            ASSERT_EQ_UNWIND_CODE2(UnwindCode(offsets.at(0), UnwindCodeOp::UWOP_SAVE_NONVOL, static_cast<uint8_t>(rbp.GetId())),
+                                 UnwindCode(static_cast<uint16_t>(-4)),
+                                 unwindCodes[0],
+                                 unwindCodes[1]);
+
+            // Verify epilog.
+            code.Reset();
+
+            code.Emit<OpCode::Mov>(rbp, rsp, -32);
+            code.Emit<OpCode::Mov>(rbx, rsp, -24);
+            code.Emit<OpCode::Ret>();
+
+            VerifyEpilog(spec, code);
+        }
+#endif
+
+
+        TEST_F(FunctionBufferTest, RedZoneOverflow)
+        {
+            auto setup = GetSetup();
+
+            // The slots and the saves don't fit into the red zone.
+            ASSERT_THROW(FunctionSpecification(setup->GetAllocator(),
+                                               -1,
+                                               FunctionSpecification::c_redZoneSize / sizeof(void*),
+                                               rbx.GetMask(),
+                                               0,
+                                               FunctionSpecification::BaseRegisterType::Unused,
+                                               FunctionSpecification::FrameType::RedZone,
+                                               GetDiagnosticsStream()),
+                         std::runtime_error);
+        }
+
 
         static void ThrowTestException()
         {
@@ -591,7 +672,155 @@ namespace NativeJIT
 
             ASSERT_TRUE(exceptionCaught);
         }
-#endif
+
+
+        static bool s_throwAfterTailCall;
+
+
+        static void DoNothing()
+        {
+        }
+
+
+        // Verifies that the code after a tail call epilog in the middle of the
+        // function can be unwound, i.e. that the unwind information describes
+        // the frame as released only for the tail call's JMP.
+        TEST_F(FunctionBufferTest, CodeAfterTailCall)
+        {
+            auto setup = GetSetup();
+
+            FunctionSpecification spec(setup->GetAllocator(),
+                                        -1,
+                                        12, // Stack slots
+                                        c_rxxWritableNonVolatilesMask,
+                                        0,
+                                        FunctionSpecification::BaseRegisterType::Unused,
+                                        GetDiagnosticsStream());
+
+            auto & code = setup->GetCode();
+
+            code.Reset();
+            code.BeginFunctionBodyGeneration(spec);
+
+            Label throwLabel = code.AllocateLabel();
+
+            code.EmitImmediate<OpCode::Mov>(rax, &s_throwAfterTailCall);
+            code.Emit<OpCode::Mov>(al, rax, 0);
+            code.Emit<OpCode::Or>(al, al);
+            code.EmitConditionalJump<JccType::JNZ>(throwLabel);
+
+            code.EmitImmediate<OpCode::Mov>(rax, &DoNothing);
+            code.ReserveTailCallEpilog();
+            code.Jmp(rax);
+            code.EndTailCallJump();
+
+            code.PlaceLabel(throwLabel);
+            ASSERT_NO_FATAL_FAILURE(FillAllWritableRegistersWithGarbage(code));
+            code.EmitImmediate<OpCode::Mov>(rax, &ThrowTestException);
+            code.Emit<OpCode::Call>(rax);
+
+            code.EndFunctionBodyGeneration(spec);
+
+            ASSERT_EQ(1u, code.GetTailCallJumps().size());
+
+            auto const & jump = code.GetTailCallJumps()[0];
+            ASSERT_TRUE(jump.m_startOffset > code.GetFunctionCodeStartOffset());
+            ASSERT_EQ(0, memcmp(code.BufferStart() + jump.m_startOffset - (spec.GetEpilogLength() - 1),
+                                spec.GetEpilog(),
+                                spec.GetEpilogLength() - 1));
+            ASSERT_TRUE(jump.m_endOffset < code.GetFunctionCodeEndOffset());
+
+            auto func = reinterpret_cast<void (*)()>(const_cast<void*>(code.GetEntryPoint()));
+
+            s_throwAfterTailCall = false;
+            func();
+
+            s_throwAfterTailCall = true;
+            ASSERT_THROW(func(), std::runtime_error);
+        }
+
+
+        // Verifies that the space reserved when the function specification is
+        // not known in advance is reclaimed and that the moved body still
+        // reaches its RIP-relative data and jump targets.
+        TEST_F(FunctionBufferTest, CompactLayout)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            const uint64_t value = 0x0123456789abcdefull;
+
+            code.Reset();
+
+            // Data placed in front of the function, referenced RIP-relative.
+            const unsigned dataOffset = code.CurrentPosition();
+            code.EmitBytes(value);
+
+            code.BeginFunctionBodyGeneration();
+
+            Label skip = code.AllocateLabel();
+            code.Emit<OpCode::Mov>(rax, rip, dataOffset);
+            code.Jmp(skip);
+            code.EmitImmediate<OpCode::Mov>(rax, 0);
+            code.PlaceLabel(skip);
+
+            FunctionSpecification spec(setup->GetAllocator(), -1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, GetDiagnosticsStream());
+            code.EndFunctionBodyGeneration(spec);
+
+            // Unwind info, prolog, body and epilog are contiguous.
+            ASSERT_EQ(code.GetUnwindInfoStartOffset() + spec.GetUnwindInfoByteLength(),
+                      code.GetFunctionCodeStartOffset());
+            ASSERT_EQ(code.CurrentPosition(), code.GetFunctionCodeEndOffset());
+            ASSERT_EQ(0, memcmp(code.BufferStart() + code.GetFunctionCodeStartOffset(),
+                                spec.GetProlog(),
+                                spec.GetPrologLength()));
+
+            auto func = reinterpret_cast<uint64_t (*)()>(const_cast<void*>(code.GetEntryPoint()));
+            ASSERT_EQ(value, func());
+        }
+
+
+        // Verifies that frames larger than a page are probed and can be both
+        // used and unwound.
+        TEST_F(FunctionBufferTest, LargeStack)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            const unsigned slotCount = 10000;
+
+            // 4 slots for calls, 1 for RBP and 10000 for variables, already odd.
+            FunctionSpecification spec(setup->GetAllocator(),
+                                       0,
+                                       slotCount,
+                                       0,
+                                       0,
+                                       FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp,
+                                       GetDiagnosticsStream());
+            ASSERT_NO_FATAL_FAILURE(ValidateUnwindInfo(spec));
+            ASSERT_EQ(80040, spec.GetOffsetToOriginalRsp());
+
+            // The stack allocation needs the two-code UWOP_ALLOC_LARGE.
+            auto & unwindInfo = *reinterpret_cast<UnwindInfo const *>(spec.GetUnwindInfoBuffer());
+            auto unwindCodes = &unwindInfo.m_firstUnwindCode;
+
+            ASSERT_EQ(4, unwindInfo.m_countOfCodes);
+            ASSERT_EQ(static_cast<uint8_t>(UnwindCodeOp::UWOP_ALLOC_LARGE), unwindCodes[2].m_operation.m_unwindOp);
+            ASSERT_EQ(80040 / 8, unwindCodes[3].m_frameOffset);
+
+            code.Reset();
+            code.BeginFunctionBodyGeneration(spec);
+
+            // Use the lowest variable slot, then call a function which throws.
+            code.EmitImmediate<OpCode::Mov>(rax, 12345);
+            code.Emit<OpCode::Mov>(rbp, -static_cast<int32_t>(slotCount * sizeof(void*)), rax);
+            code.EmitImmediate<OpCode::Mov>(rax, &ThrowTestException);
+            code.Emit<OpCode::Call>(rax);
+
+            code.EndFunctionBodyGeneration(spec);
+
+            auto func = reinterpret_cast<void (*)()>(const_cast<void*>(code.GetEntryPoint()));
+
+            ASSERT_THROW(func(), std::runtime_error);
+        }
 
 
         // This tests that, FunctionSpecification correctly drives non-volatile
@@ -0,0 +1,167 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "NativeJIT/CodeGen/CodeCache.h"
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace CodeCacheUnitTest
+    {
+        TEST_FIXTURE_START(CodeCacheTest)
+
+        protected:
+            static int32_t Twice(int32_t value)
+            {
+                return 2 * value;
+            }
+
+
+            static int32_t Thrice(int32_t value)
+            {
+                return 3 * value;
+            }
+
+
+            // Compiles p1 + f(p1) + *offset and saves it to the cache.
+            void SaveFunction(std::string const & path,
+                              CodeCacheKey const & key,
+                              SymbolTable const & symbols)
+            {
+                auto setup = GetSetup();
+                Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & call = expression.Call(expression.Immediate(&Twice), expression.GetP1());
+                auto & offset = expression.Deref(expression.Immediate(&s_offset));
+
+                auto function = expression.Compile(
+                    expression.Add(expression.Add(expression.GetP1(), call), offset));
+                ASSERT_EQ(3 + 6 + s_offset, function(3));
+
+                ASSERT_EQ(2u, setup->GetCode().GetAbsoluteAddressRelocations().size());
+
+                CodeCache::Save(path.c_str(), key, setup->GetCode(), symbols);
+            }
+
+
+            static int32_t s_offset;
+            static int32_t s_otherOffset;
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        int32_t CodeCacheTest::s_offset = 1000;
+        int32_t CodeCacheTest::s_otherOffset = 5000;
+
+
+        TEST_F(CodeCacheTest, SaveAndLoad)
+        {
+            const std::string path = "NativeJITCodeCacheTest.bin";
+            const CodeCacheKey key = CodeCacheKey::ForHost(CodeCacheKey::HashBytes("p1+f(p1)+*c", 11));
+
+            {
+                SymbolTable symbols;
+                symbols.Add(1, reinterpret_cast<void const *>(&Twice));
+                symbols.Add(2, &s_offset);
+
+                SaveFunction(path, key, symbols);
+            }
+
+            // Load with the same symbols, then with the symbols bound to
+            // other objects to verify that the relocations are applied.
+            {
+                SymbolTable symbols;
+                symbols.Add(1, reinterpret_cast<void const *>(&Twice));
+                symbols.Add(2, &s_offset);
+
+                CachedFunction cached;
+                ASSERT_TRUE(cached.Load(path.c_str(), key, symbols));
+
+                auto function = cached.GetEntryPoint<int32_t (*)(int32_t)>();
+                ASSERT_EQ(5 + 10 + 1000, function(5));
+            }
+
+            {
+                SymbolTable symbols;
+                symbols.Add(1, reinterpret_cast<void const *>(&Thrice));
+                symbols.Add(2, &s_otherOffset);
+
+                CachedFunction cached;
+                ASSERT_TRUE(cached.Load(path.c_str(), key, symbols));
+
+                auto function = cached.GetEntryPoint<int32_t (*)(int32_t)>();
+                ASSERT_EQ(5 + 15 + 5000, function(5));
+
+                cached.Unload();
+                ASSERT_FALSE(cached.IsLoaded());
+            }
+
+            std::remove(path.c_str());
+        }
+
+
+        TEST_F(CodeCacheTest, Misses)
+        {
+            const std::string path = "NativeJITCodeCacheMissTest.bin";
+            const CodeCacheKey key = CodeCacheKey::ForHost(1234);
+
+            SymbolTable symbols;
+            symbols.Add(1, reinterpret_cast<void const *>(&Twice));
+            symbols.Add(2, &s_offset);
+
+            std::remove(path.c_str());
+
+            CachedFunction cached;
+            ASSERT_FALSE(cached.Load(path.c_str(), key, symbols));
+
+            SaveFunction(path, key, symbols);
+
+            CodeCacheKey otherTree = key;
+            ++otherTree.m_treeHash;
+            ASSERT_FALSE(cached.Load(path.c_str(), otherTree, symbols));
+
+            CodeCacheKey otherCpu = key;
+            ++otherCpu.m_cpuFeatures;
+            ASSERT_FALSE(cached.Load(path.c_str(), otherCpu, symbols));
+
+            ASSERT_TRUE(cached.Load(path.c_str(), key, symbols));
+            ASSERT_EQ(1 + 2 + 1000, cached.GetEntryPoint<int32_t (*)(int32_t)>()(1));
+
+            // Symbols must be defined both when saving and when loading.
+            SymbolTable incomplete;
+            incomplete.Add(1, reinterpret_cast<void const *>(&Twice));
+            ASSERT_THROW(cached.Load(path.c_str(), key, incomplete), std::runtime_error);
+            ASSERT_THROW(SaveFunction(path, key, incomplete), std::runtime_error);
+
+            std::remove(path.c_str());
+        }
+    }
+}
@@ -135,6 +135,319 @@ namespace NativeJIT
             ASSERT_EQ(expected, observed);
         }
 
+
+        //
+        // Switch
+        //
+
+        TEST_F(Conditional, SwitchDense)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // Key 6 is a hole in the jump table and key 7 shares the value of key 3.
+            auto & sum = e.Add(e.GetP2(), e.Immediate(100));
+            int32_t keys[] = { 3, 4, 5, 7, 8, 9 };
+            Node<int32_t>* values[] = { &sum,
+                                        &e.Immediate(40),
+                                        &e.Immediate(50),
+                                        &sum,
+                                        &e.Immediate(80),
+                                        &e.GetP2() };
+
+            auto & test = e.Switch(e.GetP1(), keys, values, e.Immediate(-1));
+            auto function = e.Compile(test);
+
+            ASSERT_EQ(-1, function(-5, 1));
+            ASSERT_EQ(-1, function(2, 1));
+            ASSERT_EQ(101, function(3, 1));
+            ASSERT_EQ(40, function(4, 1));
+            ASSERT_EQ(50, function(5, 1));
+            ASSERT_EQ(-1, function(6, 1));
+            ASSERT_EQ(102, function(7, 2));
+            ASSERT_EQ(80, function(8, 1));
+            ASSERT_EQ(7, function(9, 7));
+            ASSERT_EQ(-1, function(10, 1));
+            ASSERT_EQ(-1, function(0x7fffffff, 1));
+        }
+
+
+        TEST_F(Conditional, SwitchDenseByteKey)
+        {
+            auto setup = GetSetup();
+
+            Function<double, uint8_t> e(setup->GetAllocator(), setup->GetCode());
+
+            uint8_t keys[] = { 250, 251, 252, 253 };
+            Node<double>* values[] = { &e.Immediate(0.5),
+                                       &e.Immediate(1.5),
+                                       &e.Immediate(2.5),
+                                       &e.Immediate(3.5) };
+
+            auto & test = e.Switch(e.GetP1(), keys, values, e.Immediate(-1.0));
+            auto function = e.Compile(test);
+
+            ASSERT_EQ(-1.0, function(0));
+            ASSERT_EQ(-1.0, function(249));
+            ASSERT_EQ(0.5, function(250));
+            ASSERT_EQ(2.5, function(252));
+            ASSERT_EQ(3.5, function(253));
+            ASSERT_EQ(-1.0, function(254));
+        }
+
+
+        TEST_F(Conditional, SwitchSparse)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // Includes keys which do not fit into sign-extended 32-bit immediates.
+            const int64_t keys[] = { 1000,
+                                     -7,
+                                     0x123456789,
+                                     -0x100000000,
+                                     42,
+                                     1,
+                                     300000,
+                                     99 };
+            const unsigned caseCount = sizeof(keys) / sizeof(keys[0]);
+            Node<int64_t>* values[caseCount];
+
+            for (unsigned i = 0; i < caseCount; ++i)
+            {
+                values[i] = &e.Immediate(static_cast<int64_t>(i + 1));
+            }
+
+            auto & test = e.Switch(e.GetP1(), keys, values, caseCount, e.Immediate(static_cast<int64_t>(0)));
+            auto function = e.Compile(test);
+
+            for (unsigned i = 0; i < caseCount; ++i)
+            {
+                ASSERT_EQ(static_cast<int64_t>(i + 1), function(keys[i]));
+                ASSERT_EQ(0, function(keys[i] + 1));
+                ASSERT_EQ(0, function(keys[i] - 1));
+            }
+        }
+
+
+        //
+        // Short-circuit logical operators
+        //
+
+        static unsigned s_expensiveCheckCalls;
+
+        static int32_t ExpensiveCheck(int32_t value)
+        {
+            ++s_expensiveCheckCalls;
+
+            return value % 2 == 0;
+        }
+
+
+        TEST_F(Conditional, LogicalAndShortCircuit)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & cheap = e.Compare<JccType::JG>(e.GetP1(), e.Immediate(0));
+            auto & expensive = e.Compare<JccType::JNE>(e.Call(e.Immediate(ExpensiveCheck), e.GetP1()),
+                                                       e.Immediate(0));
+            auto & test = e.Conditional(e.LogicalAnd(cheap, expensive),
+                                        e.GetP2(),
+                                        e.Immediate(-1));
+            auto function = e.Compile(test);
+
+            s_expensiveCheckCalls = 0;
+            ASSERT_EQ(-1, function(-4, 10));
+            ASSERT_EQ(-1, function(0, 10));
+            ASSERT_EQ(0u, s_expensiveCheckCalls);
+
+            ASSERT_EQ(10, function(4, 10));
+            ASSERT_EQ(-1, function(3, 10));
+            ASSERT_EQ(2u, s_expensiveCheckCalls);
+        }
+
+
+        TEST_F(Conditional, LogicalOrValue)
+        {
+            auto setup = GetSetup();
+
+            Function<bool, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & test = e.LogicalOr(e.Compare<JccType::JE>(e.GetP1(), e.Immediate<int64_t>(0)),
+                                      e.Compare<JccType::JL>(e.GetP2(), e.GetP1()));
+            auto function = e.Compile(test);
+
+            for (int64_t p1 = -2; p1 <= 2; ++p1)
+            {
+                for (int64_t p2 = -2; p2 <= 2; ++p2)
+                {
+                    ASSERT_EQ(p1 == 0 || p2 < p1, function(p1, p2)) << p1 << ", " << p2;
+                }
+            }
+        }
+
+
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        // Verify that the registers aren't spilled for a right condition which
+        // doesn't bump registers, so the leaf function needs no frame.
+        TEST_F(Conditional, LogicalAndNoSpill)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & sum = e.Add(e.GetP1(), e.GetP2());
+            auto & difference = e.Sub(e.GetP1(), e.GetP2());
+            auto & test = e.LogicalAnd(e.Compare<JccType::JG>(e.GetP1(), e.Immediate<int64_t>(0)),
+                                       e.Compare<JccType::JG>(e.GetP2(), e.Immediate<int64_t>(1)));
+            auto function = e.Compile(e.Conditional(test, sum, difference));
+
+            for (int64_t p1 = -2; p1 <= 2; ++p1)
+            {
+                for (int64_t p2 = -2; p2 <= 3; ++p2)
+                {
+                    const bool expectedTest = p1 > 0 && p2 > 1;
+
+                    ASSERT_EQ(expectedTest ? p1 + p2 : p1 - p2, function(p1, p2)) << p1 << ", " << p2;
+                }
+            }
+
+            // The prolog must not save RBP, i.e. mov [rsp + disp8], rbp can't
+            // be the first instruction.
+            auto entry = reinterpret_cast<uint8_t const *>(function);
+
+            ASSERT_FALSE(entry[0] == 0x48
+                         && entry[1] == 0x89
+                         && entry[2] == 0x6c
+                         && entry[3] == 0x24);
+        }
+#endif
+
+
+        TEST_F(Conditional, LogicalOrSameCondition)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // Both conditions use JL, so the flags of the one which decides
+            // the result are used by the Conditional directly.
+            auto & test = e.LogicalOr(e.Compare<JccType::JL>(e.GetP1(), e.Immediate<int64_t>(0)),
+                                      e.Compare<JccType::JL>(e.GetP2(), e.GetP1()));
+            auto function = e.Compile(e.Conditional(test, e.GetP1(), e.GetP2()));
+
+            for (int64_t p1 = -2; p1 <= 2; ++p1)
+            {
+                for (int64_t p2 = -2; p2 <= 2; ++p2)
+                {
+                    ASSERT_EQ(p1 < 0 || p2 < p1 ? p1 : p2, function(p1, p2)) << p1 << ", " << p2;
+                }
+            }
+        }
+
+
+        TEST_F(Conditional, LogicalNestedWithSharedValue)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // The scaled value is used both in the right conditions, which may
+            // be skipped, and in the result.
+            auto & scaled = e.Mul(e.GetP1(), e.Immediate<int64_t>(3));
+
+            auto & inRange = e.LogicalAnd(e.Compare<JccType::JGE>(e.GetP2(), e.Immediate<int64_t>(0)),
+                                          e.Compare<JccType::JL>(scaled, e.Immediate<int64_t>(30)));
+            auto & test = e.LogicalOr(e.Compare<JccType::JE>(e.GetP1(), e.GetP2()), inRange);
+            auto function = e.Compile(e.Conditional(test, e.Add(scaled, e.GetP2()), scaled));
+
+            for (int64_t p1 = -12; p1 <= 12; p1 += 3)
+            {
+                for (int64_t p2 = -3; p2 <= 3; ++p2)
+                {
+                    const bool expectedTest = p1 == p2 || (p2 >= 0 && p1 * 3 < 30);
+
+                    ASSERT_EQ(expectedTest ? p1 * 3 + p2 : p1 * 3, function(p1, p2)) << p1 << ", " << p2;
+                }
+            }
+        }
+
+
+        TEST_F(Conditional, LogicalWithLocalVariable)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & limit = e.Local<int64_t>();
+            auto & init = e.Assign(limit, e.Immediate<int64_t>(30));
+
+            // The scaled value doesn't read the local variable, so it is
+            // evaluated before the right condition which may be skipped.
+            auto & scaled = e.Mul(e.GetP1(), e.Immediate<int64_t>(3));
+            auto & test = e.LogicalAnd(e.Compare<JccType::JGE>(e.GetP2(), e.Immediate<int64_t>(0)),
+                                       e.Compare<JccType::JL>(scaled, e.Load(limit)));
+            auto function = e.Compile(e.Sequence(init, e.Conditional(test, e.Add(scaled, e.GetP2()), scaled)));
+
+            for (int64_t p1 = -12; p1 <= 12; p1 += 3)
+            {
+                for (int64_t p2 = -3; p2 <= 3; ++p2)
+                {
+                    const bool expectedTest = p2 >= 0 && p1 * 3 < 30;
+
+                    ASSERT_EQ(expectedTest ? p1 * 3 + p2 : p1 * 3, function(p1, p2)) << p1 << ", " << p2;
+                }
+            }
+        }
+
+
+        TEST_F(Conditional, LogicalSharedLocalVariableLoad)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & limit = e.Local<int64_t>();
+            auto & init = e.Assign(limit, e.GetP2());
+
+            // The load can't be evaluated ahead of the LogicalOr, so it would
+            // be first evaluated by the right condition and then used after it.
+            auto & load = e.Load(limit);
+            auto & test = e.LogicalOr(e.Compare<JccType::JE>(e.GetP1(), e.Immediate<int64_t>(0)),
+                                      e.Compare<JccType::JL>(e.GetP1(), load));
+
+            auto & result = e.Conditional(test, e.Immediate<int64_t>(10), e.Immediate<int64_t>(20));
+
+            ASSERT_THROW(e.Compile(e.Sequence(init, e.Sequence(result, load))),
+                         std::runtime_error);
+        }
+
+
+        TEST_F(Conditional, LogicalAssignmentInRightCondition)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & value = e.Local<int64_t>();
+            auto & init = e.Assign(value, e.Immediate<int64_t>(1));
+
+            // The assignment is skipped at runtime when the left condition
+            // decides the result, so the variable can't be read after it.
+            auto & update = e.Assign(value, e.GetP1());
+            auto & test = e.LogicalAnd(e.Compare<JccType::JG>(e.GetP1(), e.Immediate<int64_t>(0)),
+                                       e.Compare<JccType::JNE>(update, e.Immediate<int64_t>(0)));
+            auto & result = e.Conditional(test, e.Immediate<int64_t>(10), e.Immediate<int64_t>(20));
+
+            ASSERT_THROW(e.Compile(e.Sequence(init, e.Sequence(result, e.Load(value)))),
+                         std::runtime_error);
+        }
+
+
         TEST_CASES_END
     }
 }
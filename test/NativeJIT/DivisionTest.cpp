@@ -0,0 +1,286 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace DivisionUnitTest
+    {
+        TEST_FIXTURE_START(Division)
+
+        protected:
+            // Returns the interesting dividends for the divisor: the limits
+            // of the type, the multiples of the divisor and their neighbours,
+            // and a few pseudorandom values.
+            template <typename T>
+            static std::vector<T> GetDividends(T divisor)
+            {
+                std::vector<T> dividends = {
+                    0,
+                    1,
+                    2,
+                    3,
+                    7,
+                    100,
+                    static_cast<T>(-1),
+                    static_cast<T>(-100),
+                    std::numeric_limits<T>::min(),
+                    static_cast<T>(std::numeric_limits<T>::min() + 1),
+                    std::numeric_limits<T>::max(),
+                    static_cast<T>(std::numeric_limits<T>::max() - 1)
+                };
+
+                for (int64_t multiple = -3; multiple <= 3; ++multiple)
+                {
+                    for (int64_t delta = -1; delta <= 1; ++delta)
+                    {
+                        dividends.push_back(
+                            static_cast<T>(static_cast<uint64_t>(divisor) * static_cast<uint64_t>(multiple)
+                                           + static_cast<uint64_t>(delta)));
+                    }
+                }
+
+                uint64_t random = 12345;
+
+                for (unsigned i = 0; i < 100; ++i)
+                {
+                    random = random * 6364136223846793005ull + 1442695040888963407ull;
+                    dividends.push_back(static_cast<T>(random >> (i % 48)));
+                }
+
+                return dividends;
+            }
+
+
+            // The only division whose result doesn't fit into the type.
+            template <typename T>
+            static bool IsOverflow(T dividend, T divisor)
+            {
+                return std::is_signed<T>::value
+                    && sizeof(T) >= 4
+                    && dividend == std::numeric_limits<T>::min()
+                    && divisor == static_cast<T>(-1);
+            }
+
+
+            template <typename T>
+            void VerifyImmediateDivisor(T divisor)
+            {
+                const std::vector<T> dividends = GetDividends(divisor);
+
+                {
+                    auto setup = GetSetup();
+                    Function<T, T> e(setup->GetAllocator(), setup->GetCode());
+                    auto function = e.Compile(e.DivImmediate(e.GetP1(), divisor));
+
+                    for (auto dividend : dividends)
+                    {
+                        if (!IsOverflow(dividend, divisor))
+                        {
+                            ASSERT_EQ(static_cast<T>(dividend / divisor), function(dividend))
+                                << +dividend << " / " << +divisor;
+                        }
+                    }
+                }
+
+                {
+                    auto setup = GetSetup();
+                    Function<T, T> e(setup->GetAllocator(), setup->GetCode());
+                    auto function = e.Compile(e.ModImmediate(e.GetP1(), divisor));
+
+                    for (auto dividend : dividends)
+                    {
+                        if (!IsOverflow(dividend, divisor))
+                        {
+                            ASSERT_EQ(static_cast<T>(dividend % divisor), function(dividend))
+                                << +dividend << " % " << +divisor;
+                        }
+                    }
+                }
+            }
+
+
+            template <typename T>
+            void VerifyRegisterDivisors(std::vector<T> const & divisors)
+            {
+                auto setup = GetSetup();
+                Function<T, T, T> e(setup->GetAllocator(), setup->GetCode());
+
+                // Returns quotient * 3 + remainder, both computed by the
+                // hardware division.
+                auto & quotient = e.Div(e.GetP1(), e.GetP2());
+                auto & remainder = e.Mod(e.GetP1(), e.GetP2());
+                auto function = e.Compile(e.Add(e.Add(quotient, quotient), e.Add(quotient, remainder)));
+
+                for (auto divisor : divisors)
+                {
+                    for (auto dividend : GetDividends(divisor))
+                    {
+                        if (!IsOverflow(dividend, divisor))
+                        {
+                            const T expected = static_cast<T>(static_cast<T>(dividend / divisor) * 3
+                                                              + static_cast<T>(dividend % divisor));
+                            ASSERT_EQ(expected, function(dividend, divisor))
+                                << +dividend << ", " << +divisor;
+                        }
+                    }
+                }
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(Division, RegisterSigned)
+        {
+            VerifyRegisterDivisors<int32_t>({ 1, -1, 2, 3, -7, 1000, std::numeric_limits<int32_t>::min() });
+            VerifyRegisterDivisors<int64_t>({ 1, -1, 3, -7, 1ll << 40, std::numeric_limits<int64_t>::max() });
+        }
+
+
+        TEST_F(Division, RegisterUnsigned)
+        {
+            VerifyRegisterDivisors<uint32_t>({ 1, 2, 7, 1000, 0x80000000u, 0xffffffffu });
+            VerifyRegisterDivisors<uint64_t>({ 1, 3, 1ull << 40, 0xffffffffffffffffull });
+        }
+
+
+        TEST_F(Division, RegisterNarrow)
+        {
+            VerifyRegisterDivisors<int8_t>({ 1, -1, 3, -128, 127 });
+            VerifyRegisterDivisors<uint16_t>({ 1, 7, 1000, 0xffff });
+        }
+
+
+        TEST_F(Division, DivisorInMemory)
+        {
+            auto setup = GetSetup();
+            Function<int64_t, int64_t, int64_t*> e(setup->GetAllocator(), setup->GetCode());
+
+            auto function = e.Compile(e.Mod(e.GetP1(), e.Deref(e.GetP2())));
+
+            int64_t divisor = -7;
+            ASSERT_EQ(-100 % -7, function(-100, &divisor));
+            ASSERT_EQ(100 % -7, function(100, &divisor));
+        }
+
+
+        TEST_F(Division, OperandsInDivisionRegisters)
+        {
+            auto setup = GetSetup();
+            Function<int32_t, int32_t, int32_t, int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // All the parameters are live across both divisions, so the ones
+            // passed in rdx (the second on Windows, the third on Linux) need
+            // to be moved aside.
+            auto & first = e.Div(e.GetP1(), e.GetP2());
+            auto & second = e.Mod(e.GetP3(), e.GetP4());
+            auto & sum = e.Add(e.Add(e.GetP1(), e.GetP2()), e.Add(e.GetP3(), e.GetP4()));
+            auto function = e.Compile(e.Add(e.Add(first, second), sum));
+
+            ASSERT_EQ(100 / 7 + 50 % 9 + 100 + 7 + 50 + 9, function(100, 7, 50, 9));
+            ASSERT_EQ(-100 / 7 + 50 % -9 - 100 + 7 + 50 - 9, function(-100, 7, 50, -9));
+        }
+
+
+        TEST_F(Division, ImmediateSigned)
+        {
+            const int32_t divisors32[] = {
+                1, -1, 2, -2, 3, -3, 5, 6, 7, -7, 10, 16, -16, 25, 125, 641,
+                -1000, 65537, 1 << 30, std::numeric_limits<int32_t>::max(),
+                std::numeric_limits<int32_t>::min() + 1, std::numeric_limits<int32_t>::min()
+            };
+
+            for (auto divisor : divisors32)
+            {
+                VerifyImmediateDivisor(divisor);
+            }
+
+            const int64_t divisors64[] = {
+                1, -1, 3, 7, -7, 10, 1000000007, -6700417, 1ll << 40,
+                std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min()
+            };
+
+            for (auto divisor : divisors64)
+            {
+                VerifyImmediateDivisor(divisor);
+            }
+        }
+
+
+        TEST_F(Division, ImmediateUnsigned)
+        {
+            const uint32_t divisors32[] = {
+                1, 2, 3, 5, 6, 7, 10, 11, 16, 25, 641, 1000000007,
+                0x7fffffffu, 0x80000000u, 0xffffffffu
+            };
+
+            for (auto divisor : divisors32)
+            {
+                VerifyImmediateDivisor(divisor);
+            }
+
+            const uint64_t divisors64[] = {
+                1, 3, 7, 10, 1000000007, 0x100000001ull, 1ull << 40,
+                0x8000000000000000ull, 0xffffffffffffffffull
+            };
+
+            for (auto divisor : divisors64)
+            {
+                VerifyImmediateDivisor(divisor);
+            }
+        }
+
+
+        TEST_F(Division, ImmediateNarrow)
+        {
+            VerifyImmediateDivisor<int8_t>(3);
+            VerifyImmediateDivisor<int8_t>(-7);
+            VerifyImmediateDivisor<int8_t>(-128);
+            VerifyImmediateDivisor<uint16_t>(7);
+            VerifyImmediateDivisor<uint16_t>(1000);
+        }
+
+
+        TEST_F(Division, FloatingPoint)
+        {
+            auto setup = GetSetup();
+            Function<double, double, double> e(setup->GetAllocator(), setup->GetCode());
+
+            auto function = e.Compile(e.Div(e.GetP1(), e.GetP2()));
+
+            ASSERT_EQ(2.5, function(10.0, 4.0));
+            ASSERT_EQ(-0.5, function(1.0, -2.0));
+        }
+    }
+}
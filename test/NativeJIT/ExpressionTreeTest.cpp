@@ -22,6 +22,7 @@
 
 
 #include <iostream>
+#include <vector>
 
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
@@ -146,7 +147,7 @@ namespace NativeJIT
 
             auto & structNode = e.Immediate(&testStruct);
             auto & indirectNode = e.Deref(e.FieldPointer(structNode, &Test::m_dummy));
-            indirectNode.IncrementParentCount();
+            indirectNode.IncrementParentCount(e);
 
             structNode.CodeGenCache(e);
             indirectNode.CodeGenCache(e);
@@ -197,7 +198,7 @@ namespace NativeJIT
 
             auto & structNode = e.Immediate(&testStruct);
             auto & indirectNode = e.Deref(e.FieldPointer(structNode, &Test::m_dummy));
-            indirectNode.IncrementParentCount();
+            indirectNode.IncrementParentCount(e);
 
             structNode.CodeGenCache(e);
             indirectNode.CodeGenCache(e);
@@ -325,6 +326,72 @@ namespace NativeJIT
         }
 
 
+#ifndef NATIVEJIT_PLATFORM_WINDOWS
+        // Verify that a function which makes no calls keeps RSP unchanged and
+        // places the spilled registers and the register saves in the red zone.
+        TEST_F(ExpressionTree, RedZoneLeafFunction)
+        {
+            auto setup = GetSetup();
+            Function<int64_t, int64_t*> e(setup->GetAllocator(), setup->GetCode());
+
+            // Each value is used twice and all of them are live after the first
+            // sum is computed, so some of them need to be spilled.
+            const unsigned valueCount = 14;
+            std::vector<Node<int64_t>*> values;
+
+            for (unsigned i = 0; i < valueCount; ++i)
+            {
+                values.push_back(&e.Deref(e.GetP1(), i));
+            }
+
+            Node<int64_t>* first = values[0];
+            Node<int64_t>* second = values[valueCount - 1];
+
+            for (unsigned i = 1; i < valueCount; ++i)
+            {
+                first = &e.Add(*first, *values[i]);
+                second = &e.Add(*second, *values[valueCount - 1 - i]);
+            }
+
+            auto function = e.Compile(e.Add(*first, *second));
+
+            int64_t data[valueCount];
+            int64_t expected = 0;
+
+            for (unsigned i = 0; i < valueCount; ++i)
+            {
+                data[i] = i * 1000 + 7;
+                expected += 2 * data[i];
+            }
+
+            ASSERT_EQ(expected, function(data));
+
+            // The prolog must not adjust the stack pointer, i.e. neither
+            // sub rsp, imm8 nor sub rsp, imm32 can be the first instruction.
+            auto entry = reinterpret_cast<uint8_t const *>(function);
+
+            ASSERT_FALSE(entry[0] == 0x48
+                         && (entry[1] == 0x83 || entry[1] == 0x81)
+                         && entry[2] == 0xec);
+        }
+#endif
+
+
+        // Verify that equal RIP-relative immediates share a constant pool entry.
+        TEST_F(ExpressionTree, ConstantPoolDeduplication)
+        {
+            auto setup = GetSetup();
+            Function<double, double> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & sum = e.Add(e.Add(e.GetP1(), e.Immediate(1.5)),
+                               e.Add(e.Immediate(1.5), e.Immediate(2.0)));
+            auto function = e.Compile(e.Mul(sum, e.Immediate(1.5)));
+
+            ASSERT_EQ((4.0 + 1.5 + 1.5 + 2.0) * 1.5, function(4.0));
+            ASSERT_EQ(2u, e.GetConstantPool().GetEntryCount());
+        }
+
+
         TEST_F(ExpressionTree, RegisterSpillingFloat)
         {
             auto setup = GetSetup();
@@ -22,6 +22,10 @@
 
 
 
+#include <cmath>
+#include <limits>
+
+#include "NativeJIT/CodeGen/CpuFeatures.h"
 #include "NativeJIT/Function.h"
 #include "TestSetup.h"
 
@@ -165,6 +169,133 @@ namespace NativeJIT
             }
         }
 
+        TEST_F(FloatingPoint, Sqrt)
+        {
+            auto setup = GetSetup();
+
+            Function<double, double, double*> expression(setup->GetAllocator(), setup->GetCode());
+
+            // One operand in a register, the other one read from memory.
+            auto & a = expression.Sqrt(expression.GetP1());
+            auto & b = expression.Sqrt(expression.Deref(expression.GetP2()));
+            auto function = expression.Compile(expression.Add(a, b));
+
+            double value = 9.0;
+
+            ASSERT_EQ(sqrt(2.0) + 3.0, function(2.0, &value));
+            ASSERT_EQ(0.0 + 3.0, function(0.0, &value));
+        }
+
+
+        TEST_F(FloatingPoint, MinMax)
+        {
+            auto setup = GetSetup();
+
+            Function<float, float, float> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & min = expression.Min(expression.GetP1(), expression.GetP2());
+            auto & max = expression.Max(expression.GetP1(), expression.GetP2());
+            auto function = expression.Compile(expression.Sub(max, expression.Mul(min, expression.Immediate(2.0f))));
+
+            ASSERT_EQ(5.0f - 2.0f * -1.5f, function(5.0f, -1.5f));
+            ASSERT_EQ(5.0f - 2.0f * -1.5f, function(-1.5f, 5.0f));
+            ASSERT_EQ(2.0f - 2.0f * 2.0f, function(2.0f, 2.0f));
+        }
+
+
+        TEST_F(FloatingPoint, Abs)
+        {
+            auto setup = GetSetup();
+
+            Function<double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto function = expression.Compile(expression.Abs(expression.GetP1()));
+
+            ASSERT_EQ(2.5, function(-2.5));
+            ASSERT_EQ(2.5, function(2.5));
+            ASSERT_EQ(std::numeric_limits<double>::infinity(),
+                      function(-std::numeric_limits<double>::infinity()));
+
+            // The sign bit of negative zero is cleared as well.
+            ASSERT_FALSE(std::signbit(function(-0.0)));
+        }
+
+
+        TEST_F(FloatingPoint, AbsFloatSharedMask)
+        {
+            auto setup = GetSetup();
+
+            Function<float, float, float> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & sum = expression.Add(expression.Abs(expression.GetP1()),
+                                        expression.Abs(expression.GetP2()));
+            auto function = expression.Compile(sum);
+
+            // Both nodes load the same aligned mask from the constant pool.
+            ASSERT_EQ(1u, expression.GetConstantPool().GetEntryCount());
+
+            ASSERT_EQ(4.0f, function(-1.5f, 2.5f));
+            ASSERT_EQ(4.0f, function(1.5f, -2.5f));
+            ASSERT_FALSE(std::signbit(function(-0.0f, -0.0f)));
+        }
+
+
+        TEST_F(FloatingPoint, Round)
+        {
+            auto setup = GetSetup();
+
+            if (!CpuFeatures::HasSSE41())
+            {
+                return;
+            }
+
+            const RoundingMode modes[] = { RoundingMode::Nearest,
+                                           RoundingMode::Down,
+                                           RoundingMode::Up,
+                                           RoundingMode::Truncate };
+            const float values[] = { 2.5f, 3.5f, -2.5f, -0.75f, 1.25f };
+
+            for (auto mode : modes)
+            {
+                Function<float, float> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto function = expression.Compile(expression.Round(expression.GetP1(), mode));
+
+                for (auto value : values)
+                {
+                    float expected = mode == RoundingMode::Nearest ? nearbyintf(value)
+                        : mode == RoundingMode::Down ? floorf(value)
+                        : mode == RoundingMode::Up ? ceilf(value)
+                        : truncf(value);
+
+                    ASSERT_EQ(expected, function(value))
+                        << "mode = " << static_cast<unsigned>(mode) << ", value = " << value;
+                }
+            }
+        }
+
+
+        TEST_F(FloatingPoint, MulAdd)
+        {
+            auto setup = GetSetup();
+
+            Function<double, double, double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & product = expression.MulAdd(expression.GetP1(), expression.GetP2(), expression.GetP3());
+            auto function = expression.Compile(product);
+
+            ASSERT_EQ(2.0 * 3.0 + 4.0, function(2.0, 3.0, 4.0));
+            ASSERT_EQ(-1.5 * 4.0 + 0.25, function(-1.5, 4.0, 0.25));
+
+            if (CpuFeatures::HasFMA())
+            {
+                // The fused operation doesn't round the product: with
+                // x = 1 + 2^-30, x * x - (1 + 2^-29) is exactly 2^-60.
+                const double x = 1.0 + ldexp(1.0, -30);
+                ASSERT_EQ(ldexp(1.0, -60), function(x, x, -(1.0 + ldexp(1.0, -29))));
+            }
+        }
+
         TEST_CASES_END
     }
 }
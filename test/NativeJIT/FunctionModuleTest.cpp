@@ -0,0 +1,284 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <stdexcept>
+#include <string>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionModule.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace FunctionModuleUnitTest
+    {
+        TEST_FIXTURE_START(FunctionModuleTest)
+
+        protected:
+            static int64_t Throw(int64_t value)
+            {
+                throw std::runtime_error(std::to_string(value));
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(FunctionModuleTest, MultipleFunctions)
+        {
+            auto setup = GetSetup();
+            ExecutionBuffer codeAllocator(16384);
+            FunctionModule module(codeAllocator, 8192, 1024);
+
+            typedef Function<double, double> DoubleFunction;
+            typedef Function<int64_t, int64_t> IntFunction;
+
+            // Both functions use RIP-relative immediates. They're compiled into
+            // the same buffer, one after another.
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(
+                    expression.Add(expression.Mul(expression.GetP1(), expression.Immediate(2.5)),
+                                   expression.Immediate(0.25)));
+                ASSERT_EQ(0u, module.AddFunction(setup->GetCode()));
+            }
+
+            {
+                IntFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(
+                    expression.Add(expression.GetP1(),
+                                   expression.Immediate<int64_t>(0x123456789ll)));
+                ASSERT_EQ(1u, module.AddFunction(setup->GetCode()));
+            }
+
+            ASSERT_EQ(2u, module.GetFunctionCount());
+
+            auto first = module.GetFunction<DoubleFunction::FunctionType>(0);
+            auto second = module.GetFunction<IntFunction::FunctionType>(1);
+
+            ASSERT_EQ(10.25, first(4.0));
+            ASSERT_EQ(0x123456789ll + 5, second(5));
+
+            for (unsigned i = 0; i < module.GetFunctionCount(); ++i)
+            {
+                ASSERT_EQ(0u, reinterpret_cast<size_t>(module.GetEntryPoint(i))
+                              % FunctionModule::c_functionAlignment);
+            }
+
+            ASSERT_TRUE(module.GetConstantPoolSize() > 0);
+            ASSERT_TRUE(module.GetCodeSize() > 0);
+        }
+
+
+        TEST_F(FunctionModuleTest, SharedConstants)
+        {
+            auto setup = GetSetup();
+            ExecutionBuffer codeAllocator(16384);
+            FunctionModule module(codeAllocator, 8192, 1024);
+
+            typedef Function<double, double> DoubleFunction;
+
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(
+                    expression.Add(expression.Mul(expression.GetP1(), expression.Immediate(2.5)),
+                                   expression.Immediate(0.25)));
+                module.AddFunction(setup->GetCode());
+            }
+
+            const unsigned poolSize = module.GetConstantPoolSize();
+            ASSERT_EQ(2 * sizeof(double), poolSize);
+
+            // Uses the same constants in the opposite order.
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(
+                    expression.Mul(expression.Add(expression.GetP1(), expression.Immediate(0.25)),
+                                   expression.Immediate(2.5)));
+                module.AddFunction(setup->GetCode());
+            }
+
+            ASSERT_EQ(poolSize, module.GetConstantPoolSize());
+
+            // Only the new constant is added.
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(
+                    expression.Sub(expression.GetP1(), expression.Immediate(2.5)));
+                module.AddFunction(setup->GetCode());
+            }
+
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(
+                    expression.Sub(expression.GetP1(), expression.Immediate(0.5)));
+                module.AddFunction(setup->GetCode());
+            }
+
+            ASSERT_EQ(poolSize + sizeof(double), module.GetConstantPoolSize());
+
+            ASSERT_EQ(10.25, module.GetFunction<DoubleFunction::FunctionType>(0)(4.0));
+            ASSERT_EQ(10.625, module.GetFunction<DoubleFunction::FunctionType>(1)(4.0));
+            ASSERT_EQ(1.5, module.GetFunction<DoubleFunction::FunctionType>(2)(4.0));
+            ASSERT_EQ(3.5, module.GetFunction<DoubleFunction::FunctionType>(3)(4.0));
+        }
+
+
+        TEST_F(FunctionModuleTest, Exception)
+        {
+            auto setup = GetSetup();
+            ExecutionBuffer codeAllocator(16384);
+            FunctionModule module(codeAllocator, 8192, 1024);
+
+            typedef Function<int64_t, int64_t> IntFunction;
+
+            for (unsigned i = 0; i < 2; ++i)
+            {
+                IntFunction expression(setup->GetAllocator(), setup->GetCode());
+                auto & call = expression.Call(expression.Immediate(&Throw),
+                                              expression.Add(expression.GetP1(),
+                                                             expression.Immediate<int64_t>(i)));
+                expression.Compile(call);
+                module.AddFunction(setup->GetCode());
+            }
+
+            // The unwind information must be registered for the new location.
+            for (unsigned i = 0; i < module.GetFunctionCount(); ++i)
+            {
+                try
+                {
+                    module.GetFunction<IntFunction::FunctionType>(i)(10);
+                    FAIL() << "Should not have reached here";
+                }
+                catch (std::runtime_error const & e)
+                {
+                    ASSERT_EQ(std::to_string(10 + i), std::string(e.what()));
+                }
+            }
+        }
+
+
+        // Calls to functions within the reach of a rel32 displacement are
+        // emitted as direct calls and jumps, which must be re-patched when
+        // the code is moved into the module.
+        TEST_F(FunctionModuleTest, DirectCall)
+        {
+            auto setup = GetSetup();
+            ExecutionBuffer codeAllocator(16384);
+            FunctionModule module(codeAllocator, 8192, 1024);
+
+            typedef Function<int64_t, int64_t> IntFunction;
+
+            {
+                IntFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(expression.Mul(expression.GetP1(),
+                                                  expression.Immediate<int64_t>(3)));
+                module.AddFunction(setup->GetCode());
+            }
+
+            auto target = module.GetFunction<IntFunction::FunctionType>(0);
+            const bool isDirect = setup->GetCode().IsInDirectBranchRange(reinterpret_cast<void const *>(target));
+
+            // The result of the call is returned directly: tail call.
+            {
+                IntFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(expression.Call(expression.Immediate(target),
+                                                   expression.Add(expression.GetP1(),
+                                                                  expression.Immediate<int64_t>(1))));
+                ASSERT_EQ(isDirect ? 1u : 0u, setup->GetCode().GetDirectBranchSites().size());
+                module.AddFunction(setup->GetCode());
+            }
+
+            // Regular call.
+            {
+                IntFunction expression(setup->GetAllocator(), setup->GetCode());
+                auto & call = expression.Call(expression.Immediate(target), expression.GetP1());
+                expression.Compile(expression.Add(call, expression.Immediate<int64_t>(2)));
+                ASSERT_EQ(isDirect ? 1u : 0u, setup->GetCode().GetDirectBranchSites().size());
+                module.AddFunction(setup->GetCode());
+            }
+
+            ASSERT_EQ(30, module.GetFunction<IntFunction::FunctionType>(0)(10));
+            ASSERT_EQ(33, module.GetFunction<IntFunction::FunctionType>(1)(10));
+            ASSERT_EQ(32, module.GetFunction<IntFunction::FunctionType>(2)(10));
+        }
+
+
+        TEST_F(FunctionModuleTest, Overflow)
+        {
+            auto setup = GetSetup();
+            ExecutionBuffer codeAllocator(16384);
+            FunctionModule module(codeAllocator, 256, 64);
+
+            typedef Function<double, double> DoubleFunction;
+
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                auto & sum = expression.Add(expression.GetP1(), expression.Immediate(1.5));
+                expression.Compile(expression.Add(sum, expression.Immediate(2.5)));
+            }
+
+            ASSERT_EQ(0u, module.AddFunction(setup->GetCode()));
+
+            // The constants of another copy are shared, but the code part of
+            // the module holds at most three cache line aligned functions.
+            unsigned count = 1;
+            while (count < 4)
+            {
+                try
+                {
+                    module.AddFunction(setup->GetCode());
+                    ++count;
+                }
+                catch (std::runtime_error const &)
+                {
+                    break;
+                }
+            }
+
+            ASSERT_TRUE(count < 4);
+            ASSERT_EQ(16u, module.GetConstantPoolSize());
+
+            // Not enough space left in the constant pool for new constants.
+            {
+                DoubleFunction expression(setup->GetAllocator(), setup->GetCode());
+                Node<double>* sum = &expression.GetP1();
+
+                for (unsigned i = 0; i < 7; ++i)
+                {
+                    sum = &expression.Add(*sum, expression.Immediate(10.5 + i));
+                }
+
+                expression.Compile(*sum);
+            }
+
+            ASSERT_THROW(module.AddFunction(setup->GetCode()), std::runtime_error);
+            ASSERT_EQ(count, module.GetFunctionCount());
+            ASSERT_EQ(16u, module.GetConstantPoolSize());
+            ASSERT_EQ(5.0, module.GetFunction<DoubleFunction::FunctionType>(0)(1.0));
+        }
+    }
+}
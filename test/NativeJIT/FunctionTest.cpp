@@ -23,6 +23,8 @@
 
 #include <cmath>        // For float std::abs(float).
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
@@ -108,6 +110,23 @@ namespace NativeJIT
             }
 
 
+            static int64_t SampleFunction8(int64_t p1, int64_t p2, int64_t p3, int64_t p4,
+                                           int64_t p5, int64_t p6, int64_t p7, int64_t p8)
+            {
+                ++s_sampleFunctionCalls;
+                return ((((((p1 * 10 + p2) * 10 + p3) * 10 + p4) * 10 + p5) * 10 + p6) * 10 + p7) * 10 + p8;
+            }
+
+
+            static double SampleFunction10Mixed(double p1, int32_t p2, double p3, double p4, double p5,
+                                                double p6, double p7, double p8, float p9, double p10)
+            {
+                ++s_sampleFunctionCalls;
+                return (((((((((p1 * 10 + p2) * 10 + p3) * 10 + p4) * 10 + p5) * 10 + p6) * 10 + p7) * 10
+                          + p8) * 10 + p9) * 10 + p10);
+            }
+
+
             // These helper functions are used to overwrite the EAX/XMM0s
             // registers with a specific value, different than some special value
             // that other functions return.
@@ -395,6 +414,67 @@ namespace NativeJIT
         }
 
 
+        // Parameters beyond the ones passed in registers are read from the
+        // caller's frame. Horner's scheme is used to verify that each
+        // parameter is read from the correct slot.
+        TEST_F(FunctionTest, FunctionEightParameters)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t>
+                    expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & ten = expression.Immediate<int64_t>(10);
+                Node<int64_t>* value = &expression.GetP1();
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetP2());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetP3());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetP4());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<4>());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<5>());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<6>());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<7>());
+
+                auto function = expression.Compile(*value);
+
+                EXPECT_EQ(12345678, function(1, 2, 3, 4, 5, 6, 7, 8));
+            }
+        }
+
+
+        // On System V, floating point and integer parameters are assigned to
+        // the stack independently, and the stack slots are shared by both.
+        // On Windows, the parameters after the fourth all go to the stack.
+        TEST_F(FunctionTest, FunctionTenMixedParameters)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double, double, double, double, double, double, double, double, float, int32_t>
+                    expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & ten = expression.Immediate<double>(10.0);
+                Node<double>* value = &expression.GetP1();
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetP2());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetP3());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetP4());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<4>());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<5>());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<6>());
+                value = &expression.Add(expression.Mul(*value, ten), expression.GetParameter<7>());
+                value = &expression.Add(expression.Mul(*value, ten),
+                                        expression.Cast<double>(expression.GetParameter<8>()));
+                value = &expression.Add(expression.Mul(*value, ten),
+                                        expression.Cast<double>(expression.GetParameter<9>()));
+
+                auto function = expression.Compile(*value);
+
+                EXPECT_EQ(1234567890.0, function(1, 2, 3, 4, 5, 6, 7, 8, 9.0f, 0));
+                EXPECT_EQ(9876543210.0, function(9, 8, 7, 6, 5, 4, 3, 2, 1.0f, 0));
+            }
+        }
+
+
         //
         // Calling C functions with 0, 1, 2, 3, and 4 parameters.
         //
@@ -480,82 +560,72 @@ namespace NativeJIT
         }
 
 
-        // WARNING: These tests are disabled due to a long-standing NativeJIT
-        // bug having to do with the function passing ABI. Mike has had a fix
-        // for this in mind since 11/2016, but hasn't had time to implement the
-        // fix. Having these flaky failing tests checked in has prevented us
-        // from enabling MacOS CI for 5 months and counting, so I'm disabling
-        // these because I believe the lesser of two evils to not have a test
-        // for this and have MacOS CI for our other tests. See
-        // https://github.com/BitFunnel/BitFunnel/issues/298 for further
-        // discussion.
-
-        // TEST_F(FunctionTest, CallTwoParametersDifferentTypes)
-        // {
-        //     auto setup = GetSetup();
+        TEST_F(FunctionTest, CallTwoParametersDifferentTypes)
+        {
+            auto setup = GetSetup();
 
-        //     {
-        //         Function<int, int, char> expression(setup->GetAllocator(), setup->GetCode());
+            {
+                Function<int, int, char> expression(setup->GetAllocator(), setup->GetCode());
 
-        //         typedef int (*F)(char, int);
-        //         auto & sampleFunction = expression.Immediate<F>(SampleFunction2DifferentTypes);
-        //         auto & a = expression.Call(sampleFunction, expression.GetP2(), expression.GetP1());
-        //         auto function = expression.Compile(a);
+                typedef int (*F)(char, int);
+                auto & sampleFunction = expression.Immediate<F>(SampleFunction2DifferentTypes);
+                auto & a = expression.Call(sampleFunction, expression.GetP2(), expression.GetP1());
+                auto function = expression.Compile(a);
 
-        //         const char p1 = 0x74;
-        //         const int p2 = 5678;
+                const char p1 = 0x74;
+                const int p2 = 5678;
 
-        //         auto expected = SampleFunction2DifferentTypes(p1, p2);
+                auto expected = SampleFunction2DifferentTypes(p1, p2);
 
-        //         // Anything other than p1/p2 will do.
-        //         s_charParameter1 = p1 + 1;
-        //         s_intParameter2 = p2 + 1;
-        //         s_sampleFunctionCalls = 0;
-        //         auto observed = function(p2, p1);
+                // Anything other than p1/p2 will do.
+                s_charParameter1 = p1 + 1;
+                s_intParameter2 = p2 + 1;
+                s_sampleFunctionCalls = 0;
+                auto observed = function(p2, p1);
 
-        //         EXPECT_EQ(expected, observed);
-        //         EXPECT_EQ(1, s_sampleFunctionCalls);
-        //         EXPECT_EQ(s_charParameter1, p1);
-        //         EXPECT_EQ(s_intParameter2, p2);
-        //     }
-        // }
+                EXPECT_EQ(expected, observed);
+                EXPECT_EQ(1, s_sampleFunctionCalls);
+                EXPECT_EQ(s_charParameter1, p1);
+                EXPECT_EQ(s_intParameter2, p2);
+            }
+        }
 
 
-        // TEST_F(FunctionTest, CallThreeParameters)
-        // {
-        //     auto setup = GetSetup();
+        TEST_F(FunctionTest, CallThreeParameters)
+        {
+            auto setup = GetSetup();
 
-        //     {
-        //         Function<int64_t, int64_t, int, char> expression(setup->GetAllocator(), setup->GetCode());
+            {
+                Function<int64_t, int64_t, int, char> expression(setup->GetAllocator(), setup->GetCode());
 
-        //         typedef int64_t (*F)(char, int, int64_t);
-        //         auto & sampleFunction = expression.Immediate<F>(SampleFunction3);
-        //         auto & a = expression.Call(sampleFunction,
-        //                                     expression.GetP3(),
-        //                                     expression.GetP2(),
-        //                                     expression.GetP1());
-        //         auto function = expression.Compile(a);
+                typedef int64_t (*F)(char, int, int64_t);
+                auto & sampleFunction = expression.Immediate<F>(SampleFunction3);
+                auto & a = expression.Call(sampleFunction,
+                                            expression.GetP3(),
+                                            expression.GetP2(),
+                                            expression.GetP1());
+                auto function = expression.Compile(a);
 
-        //         const char p1 = 0x73;
-        //         const int p2 = 5678;
-        //         const int64_t p3 = 12340000ll;
+                const char p1 = 0x73;
+                const int p2 = 5678;
+                const int64_t p3 = 12340000ll;
 
-        //         auto expected = SampleFunction3(p1, p2, p3);
+                auto expected = SampleFunction3(p1, p2, p3);
 
-        //         // Anything other than p1/p2/p3 will do.
-        //         s_charParameter1 = p1 + 1;
-        //         s_intParameter2 = p2 + 1;
-        //         s_int64Parameter3 = p3 + 1;
-        //         s_sampleFunctionCalls = 0;
-        //         auto observed = function(p3, p2, p1);
+                // Anything other than p1/p2/p3 will do.
+                s_charParameter1 = p1 + 1;
+                s_intParameter2 = p2 + 1;
+                s_int64Parameter3 = p3 + 1;
+                s_sampleFunctionCalls = 0;
+                auto observed = function(p3, p2, p1);
 
-        //         EXPECT_EQ(expected, observed);
-        //         EXPECT_EQ(1, s_sampleFunctionCalls);
-        //         EXPECT_EQ(s_charParameter1, p1);
-        //         EXPECT_EQ(s_intParameter2, p2);
-        //         EXPECT_EQ(s_int64Parameter3, p3);
-        //     }
-        // }
+                EXPECT_EQ(expected, observed);
+                EXPECT_EQ(1, s_sampleFunctionCalls);
+                EXPECT_EQ(s_charParameter1, p1);
+                EXPECT_EQ(s_intParameter2, p2);
+                EXPECT_EQ(s_int64Parameter3, p3);
+            }
+        }
 
 
         TEST_F(FunctionTest, CallFourParameters)
@@ -599,6 +669,142 @@ namespace NativeJIT
         }
 
 
+        // The parameters after the ones passed in registers are stored into
+        // the outgoing parameter area at the bottom of the stack frame.
+        TEST_F(FunctionTest, CallEightParameters)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int64_t, int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                typedef int64_t (*F)(int64_t, int64_t, int64_t, int64_t,
+                                     int64_t, int64_t, int64_t, int64_t);
+                auto & sampleFunction = expression.Immediate<F>(SampleFunction8);
+                auto & a = expression.Call(sampleFunction,
+                                           expression.GetP1(),
+                                           expression.GetP2(),
+                                           expression.Immediate<int64_t>(3),
+                                           expression.Immediate<int64_t>(4),
+                                           expression.Add(expression.GetP1(), expression.Immediate<int64_t>(4)),
+                                           expression.Immediate<int64_t>(6),
+                                           expression.Immediate<int64_t>(7),
+                                           expression.Add(expression.GetP2(), expression.Immediate<int64_t>(6)));
+                auto function = expression.Compile(expression.Add(a, expression.Immediate<int64_t>(1)));
+
+                s_sampleFunctionCalls = 0;
+
+                EXPECT_EQ(12345679, function(1, 2));
+                EXPECT_EQ(1, s_sampleFunctionCalls);
+            }
+        }
+
+
+        // On System V, the floating point and integer parameters are assigned
+        // to registers independently, so only the last double is passed on
+        // the stack. On Windows, everything after the fourth one is.
+        TEST_F(FunctionTest, CallTenMixedParameters)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                typedef double (*F)(double, int32_t, double, double, double,
+                                    double, double, double, float, double);
+                auto & sampleFunction = expression.Immediate<F>(SampleFunction10Mixed);
+                auto & a = expression.Call(sampleFunction,
+                                           expression.GetP1(),
+                                           expression.GetP2(),
+                                           expression.Immediate(3.0),
+                                           expression.Immediate(4.0),
+                                           expression.Immediate(5.0),
+                                           expression.Immediate(6.0),
+                                           expression.Immediate(7.0),
+                                           expression.Immediate(8.0),
+                                           expression.Immediate(9.0f),
+                                           expression.Cast<double>(expression.GetP2()));
+                auto function = expression.Compile(a);
+
+                s_sampleFunctionCalls = 0;
+
+                EXPECT_EQ(1234567892.0, function(1.0, 2));
+                EXPECT_EQ(1, s_sampleFunctionCalls);
+            }
+        }
+
+
+        // A call whose result is returned directly is compiled as a jump after
+        // the epilog. The function pointer comes from a parameter here, so the
+        // jump goes through a register.
+        TEST_F(FunctionTest, TailCall)
+        {
+            auto setup = GetSetup();
+
+            {
+                typedef int64_t (*F)(char, int, int64_t, bool);
+                Function<int64_t, F, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Call(expression.GetP1(),
+                                           expression.Immediate<char>(3),
+                                           expression.Immediate<int>(20),
+                                           expression.GetP2(),
+                                           expression.Immediate(true));
+                auto function = expression.Compile(a);
+
+                s_sampleFunctionCalls = 0;
+
+                EXPECT_EQ(3 + 20 + 100 + 123, function(SampleFunction4, 100));
+                EXPECT_EQ(1, s_sampleFunctionCalls);
+                EXPECT_EQ(s_int64Parameter3, 100);
+            }
+        }
+
+
+        static int ThrowIfNegative(int value)
+        {
+            if (value < 0)
+            {
+                throw std::runtime_error("Negative value");
+            }
+
+            return value;
+        }
+
+
+        // Verifies that the generated function can be unwound, i.e. that
+        // exceptions thrown by call targets propagate through it.
+        TEST_F(FunctionTest, CallPropagatesException)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int, int> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & call = expression.Call(expression.Immediate(ThrowIfNegative),
+                                              expression.GetP1());
+                auto function = expression.Compile(expression.Add(expression.GetP1(), call));
+
+                EXPECT_EQ(10, function(5));
+
+                bool exceptionCaught = false;
+
+                try
+                {
+                    function(-5);
+                }
+                catch (std::runtime_error const & e)
+                {
+                    EXPECT_EQ(std::string("Negative value"), e.what());
+                    exceptionCaught = true;
+                }
+
+                EXPECT_TRUE(exceptionCaught);
+                EXPECT_EQ(20, function(10));
+            }
+        }
+
+
         // Verifies that the references to stack variables are in a sane
         // memory range.
         // The *Internal method is needed because GTest requires a void method
@@ -667,6 +873,77 @@ namespace NativeJIT
         }
 
 
+        TEST_F(FunctionTest, LocalVariableAssignment)
+        {
+            auto setup = GetSetup();
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & total = e.Local<int64_t>();
+
+            auto & init = e.Assign(total, e.GetP1());
+            auto & add = e.Assign(total, e.Add(e.Load(total), e.GetP2()));
+            auto & square = e.Load(total);
+            auto & mul = e.Assign(total, e.Mul(square, square));
+            auto & result = e.Sub(e.Load(total), e.GetP1());
+
+            auto & sequence = e.Sequence(init,
+                                         e.Sequence(add,
+                                                    e.Sequence(mul, result)));
+
+            auto function = e.Compile(sequence);
+
+            auto expected = [](int64_t p1, int64_t p2) { return (p1 + p2) * (p1 + p2) - p1; };
+
+            EXPECT_EQ(expected(3, 4), function(3, 4));
+            EXPECT_EQ(expected(-10, 2), function(-10, 2));
+        }
+
+
+        TEST_F(FunctionTest, LocalVariableLoadBeforeAssignment)
+        {
+            auto setup = GetSetup();
+            Function<int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & value = e.Local<int32_t>();
+
+            auto & init = e.Assign(value, e.GetP1());
+            auto & previous = e.Load(value);
+            auto & update = e.Assign(value, e.Immediate(100));
+
+            // The shared load observes the value it had when it was first
+            // evaluated, i.e. before the update.
+            auto & sum = e.Add(previous,
+                               e.Sequence(update, e.Add(previous, e.Load(value))));
+
+            auto function = e.Compile(e.Sequence(init, sum));
+
+            EXPECT_EQ(7 + 7 + 100, function(7));
+        }
+
+
+        static float Halve(float value)
+        {
+            return value / 2;
+        }
+
+
+        TEST_F(FunctionTest, LocalVariableAcrossCall)
+        {
+            auto setup = GetSetup();
+            Function<float, float, float> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & scale = e.Local<float>();
+
+            auto & init = e.Assign(scale, e.Mul(e.GetP1(), e.GetP2()));
+            auto & halved = e.Call(e.Immediate(Halve), e.GetP2());
+            auto & update = e.Assign(scale, e.Add(e.Load(scale), halved));
+
+            auto function = e.Compile(e.Sequence(init, e.Sequence(update, e.Load(scale))));
+
+            EXPECT_EQ(3.0f * 4.0f + 2.0f, function(3.0f, 4.0f));
+        }
+
+
         // Verifies that pointer and reference arguments refer to the same
         // memory location and that it contains the expected value.
         // The *Internal method is needed because GTest requires a void method
@@ -849,6 +1126,62 @@ namespace NativeJIT
         }
 
 
+        static int64_t Negate(int64_t value)
+        {
+            return -value;
+        }
+
+
+        static double Half(double value)
+        {
+            return value / 2;
+        }
+
+
+        // Values live across several calls are kept in non-volatile registers
+        // if available and moved to temporaries otherwise (floating point
+        // values on System V). Either way they must survive all the calls.
+        TEST_F(FunctionTest, IntValuesLiveAcrossCalls)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+                auto & product = e.Mul(e.GetP1(), e.GetP2());
+                auto & negated1 = e.Call(e.Immediate(Negate), e.GetP1());
+                auto & negated2 = e.Call(e.Immediate(Negate), e.GetP2());
+                auto & negated3 = e.Call(e.Immediate(Negate), product);
+                auto & sum = e.Add(e.Add(e.Add(product, negated1), e.Add(negated2, negated3)),
+                                   e.Add(e.GetP1(), e.GetP2()));
+                auto function = e.Compile(sum);
+
+                EXPECT_EQ(0, function(3, 5));
+                EXPECT_EQ(0, function(-7, 11));
+            }
+        }
+
+
+        TEST_F(FunctionTest, FloatValuesLiveAcrossCalls)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double, double> e(setup->GetAllocator(), setup->GetCode());
+
+                auto & product = e.Mul(e.GetP1(), e.GetP2());
+                auto & half1 = e.Call(e.Immediate(Half), e.GetP1());
+                auto & half2 = e.Call(e.Immediate(Half), e.GetP2());
+                auto & half3 = e.Call(e.Immediate(Half), product);
+                auto & sum = e.Add(e.Add(e.Add(product, half1), e.Add(half2, half3)),
+                                   e.Add(e.GetP1(), e.GetP2()));
+                auto function = e.Compile(sum);
+
+                EXPECT_EQ(15.0 + 1.5 + 2.5 + 7.5 + 8.0, function(3.0, 5.0));
+            }
+        }
+
+
         // These two functions are used to ensure zero is placed inside
         // ECX/XMM1s when they are called. It is important that they
         // are not inlined to achieve this.
@@ -994,6 +1327,82 @@ namespace NativeJIT
             EXPECT_EQ(0.0f, observed);
         }
 
+
+        static unsigned s_guardedSquareCalls;
+
+        static int64_t GuardedSquare(int64_t value)
+        {
+            ++s_guardedSquareCalls;
+
+            return value * value;
+        }
+
+
+        TEST_F(FunctionTest, GuardStatements)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // The first guard depends on a computed intermediate value and
+            // must reject the input before the call below is made.
+            auto & shard = e.And(e.GetP1(), e.Immediate<int64_t>(7));
+            e.AddGuardStatement(e.Compare<JccType::JB>(shard, e.Immediate<int64_t>(4)),
+                                e.Immediate<int64_t>(-1));
+
+            auto & square = e.Call(e.Immediate(GuardedSquare), shard);
+            e.AddGuardStatement(e.Compare<JccType::JL>(square, e.GetP2()),
+                                e.Immediate<int64_t>(-2));
+
+            auto function = e.Compile(e.Add(square, shard));
+
+            s_guardedSquareCalls = 0;
+            EXPECT_EQ(-1, function(5, 100));
+            EXPECT_EQ(-1, function(15, 100));
+            EXPECT_EQ(0u, s_guardedSquareCalls);
+
+            EXPECT_EQ(2 * 2 + 2, function(10, 100));
+            EXPECT_EQ(-2, function(3, 5));
+            EXPECT_EQ(2u, s_guardedSquareCalls);
+        }
+
+
+        TEST_F(FunctionTest, Prefetch)
+        {
+            struct Record
+            {
+                int64_t m_key;
+                int64_t m_padding[15];
+                int64_t m_value;
+            };
+
+            const PrefetchHint hints[] = { PrefetchHint::NonTemporal,
+                                           PrefetchHint::T0,
+                                           PrefetchHint::T1,
+                                           PrefetchHint::T2 };
+
+            for (auto hint : hints)
+            {
+                auto setup = GetSetup();
+
+                Function<int64_t, Record*, Record*> e(setup->GetAllocator(), setup->GetCode());
+
+                // The prefetch of the second record is issued before the
+                // first one is read. Prefetching an invalid address doesn't
+                // fault.
+                auto & prefetch = e.Prefetch(e.FieldPointer(e.GetP2(), &Record::m_value), hint);
+                auto & invalid = e.Prefetch(e.Immediate<Record*>(nullptr), hint);
+                auto & key = e.Deref(e.FieldPointer(e.GetP1(), &Record::m_key));
+                auto & value = e.Deref(prefetch);
+                auto function = e.Compile(e.Sequence(invalid, e.Add(key, value)));
+
+                Record first = { 3, {}, 0 };
+                Record second = { 0, {}, 4 };
+
+                EXPECT_EQ(7, function(&first, &second));
+            }
+        }
+
         TEST_CASES_END
 
         int FunctionTest::s_sampleFunctionCalls;
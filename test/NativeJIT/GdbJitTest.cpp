@@ -0,0 +1,114 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstring>
+#include <string>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/GdbJit.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace GdbJitUnitTest
+    {
+        TEST_FIXTURE_START(GdbJit)
+
+        protected:
+            static unsigned GetEntryCount()
+            {
+                unsigned count = 0;
+
+                for (auto entry = __jit_debug_descriptor.first_entry;
+                     entry != nullptr;
+                     entry = entry->next_entry)
+                {
+                    ++count;
+                }
+
+                return count;
+            }
+
+
+            // Compiles p1 + (p1 * p2) + p2 into the code buffer.
+            static void Compile(Allocators::IAllocator& allocator, FunctionBuffer& code)
+            {
+                Function<int64_t, int64_t, int64_t> expression(allocator, code);
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+                auto function = expression.Compile(
+                    expression.Add(expression.Add(p1, expression.Mul(p1, p2)), p2));
+
+                ASSERT_EQ(3 + 12 + 4, function(3, 4));
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(GdbJit, Registration)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            const unsigned initialCount = GetEntryCount();
+
+            {
+                GdbJitListener listener;
+
+                code.SetFunctionName("Scorer");
+                code.SetListener(&listener);
+                Compile(setup->GetAllocator(), code);
+
+                ASSERT_EQ(initialCount + 1, GetEntryCount());
+                ASSERT_EQ(1u, __jit_debug_descriptor.action_flag);  // JIT_REGISTER_FN.
+
+                auto entry = __jit_debug_descriptor.relevant_entry;
+                ASSERT_EQ(__jit_debug_descriptor.first_entry, entry);
+
+                // The symbol file is an ELF object and contains the symbol name.
+                const std::string symbolFile(entry->symfile_addr, entry->symfile_size);
+                ASSERT_EQ(0, symbolFile.compare(0, 4, "\x7f" "ELF"));
+                ASSERT_NE(std::string::npos, symbolFile.find(std::string("Scorer") + '\0'));
+
+                // Compiling into the same buffer replaces the registration.
+                Compile(setup->GetAllocator(), code);
+                ASSERT_EQ(initialCount + 1, GetEntryCount());
+
+                listener.Unregister(code);
+                ASSERT_EQ(initialCount, GetEntryCount());
+                ASSERT_EQ(2u, __jit_debug_descriptor.action_flag);  // JIT_UNREGISTER_FN.
+
+                Compile(setup->GetAllocator(), code);
+                ASSERT_EQ(initialCount + 1, GetEntryCount());
+
+                code.SetListener(nullptr);
+            }
+
+            // The destructor unregisters the remaining functions.
+            ASSERT_EQ(initialCount, GetEntryCount());
+        }
+    }
+}
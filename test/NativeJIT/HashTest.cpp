@@ -0,0 +1,207 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+
+#include <cstdint>
+#include <vector>
+
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace HashUnitTest
+    {
+        TEST_FIXTURE_START(HashTest)
+
+        protected:
+            struct TermSlot
+            {
+                uint64_t m_term;
+                float m_frequency;
+            };
+
+
+            // Slots are 12 bytes, so the address of a slot is computed with
+            // a multiplication.
+            struct MarketSlot
+            {
+                uint32_t m_languageHash;
+                uint32_t m_locationHash;
+                int32_t m_boost;
+            };
+
+
+            // Inserts the slot with linear probing, the way HashLookupNode
+            // probes the table.
+            template <typename SLOT, typename KEY>
+            static void Insert(std::vector<SLOT>& table,
+                               KEY SLOT::*keyField,
+                               uint64_t hash,
+                               SLOT const & slot)
+            {
+                const uint64_t slotMask = table.size() - 1;
+                uint64_t index = hash & slotMask;
+
+                while (table[index].*keyField != 0)
+                {
+                    index = (index + 1) & slotMask;
+                }
+
+                table[index] = slot;
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(HashTest, Crc32)
+        {
+            if (!CpuFeatures::HasSSE42())
+            {
+                return;
+            }
+
+            auto setup = GetSetup();
+
+            Function<uint32_t, uint32_t, uint8_t, uint16_t, uint64_t*> e(setup->GetAllocator(), setup->GetCode());
+
+            // One value of each size, the last one read from memory.
+            auto & crc1 = e.Crc32(e.GetP1(), e.GetP2());
+            auto & crc2 = e.Crc32(crc1, e.GetP3());
+            auto & crc3 = e.Crc32(crc2, e.Immediate(0x12345678u));
+            auto & crc4 = e.Crc32(crc3, e.Deref(e.GetP4()));
+            auto function = e.Compile(crc4);
+
+            const uint64_t values[] = { 0, 1, 0xfedcba9876543210ull };
+
+            for (auto value : values)
+            {
+                uint64_t memory = value;
+
+                uint32_t expected = Hashing::Crc32(0xffffffffu, static_cast<uint8_t>(value));
+                expected = Hashing::Crc32(expected, static_cast<uint16_t>(value >> 8));
+                expected = Hashing::Crc32(expected, 0x12345678u);
+                expected = Hashing::Crc32(expected, value);
+
+                ASSERT_EQ(expected,
+                          function(0xffffffffu,
+                                   static_cast<uint8_t>(value),
+                                   static_cast<uint16_t>(value >> 8),
+                                   &memory));
+            }
+        }
+
+
+        TEST_F(HashTest, MultiplyXorShift)
+        {
+            auto setup = GetSetup();
+
+            Function<uint64_t, uint64_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & hash1 = e.MultiplyXorShiftHash(e.GetP1());
+            auto & hash2 = e.MultiplyXorShiftHash(e.GetP2());
+            auto function = e.Compile(e.Xor(hash1, hash2));
+
+            ASSERT_EQ(0u, Hashing::MultiplyXorShift(0));
+            ASSERT_EQ(Hashing::MultiplyXorShift(0x5236264) ^ Hashing::MultiplyXorShift(static_cast<uint64_t>(-7)),
+                      function(0x5236264, -7));
+            ASSERT_EQ(Hashing::MultiplyXorShift(0x3475897234ull) ^ Hashing::MultiplyXorShift(42),
+                      function(0x3475897234ull, 42));
+        }
+
+
+        TEST_F(HashTest, LookupTerms)
+        {
+            auto setup = GetSetup();
+
+            // The keys of the first two terms collide.
+            std::vector<TermSlot> table(8, TermSlot { 0, 0.0f });
+            const TermSlot terms[] = { { 7, 1.5f }, { 15, 2.5f }, { 0x5236264, 3.5f }, { 6, 4.5f } };
+
+            for (auto const & term : terms)
+            {
+                Insert(table, &TermSlot::m_term, term.m_term, term);
+            }
+
+            Function<float, TermSlot const *, uint64_t, uint64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & slot = e.HashLookup(e.GetP1(), e.GetP2(), &TermSlot::m_term, 0, e.GetP3(), e.GetP3());
+            auto & frequency = e.Conditional(e.Compare<JccType::JNE>(slot, e.Immediate<TermSlot const *>(nullptr)),
+                                             e.Deref(e.FieldPointer(slot, &TermSlot::m_frequency)),
+                                             e.Immediate(-1.0f));
+            auto function = e.Compile(frequency);
+
+            for (auto const & term : terms)
+            {
+                ASSERT_EQ(term.m_frequency, function(table.data(), table.size() - 1, term.m_term));
+            }
+
+            // The probe for 23 wraps around from the last slot.
+            ASSERT_EQ(-1.0f, function(table.data(), table.size() - 1, 23));
+            ASSERT_EQ(-1.0f, function(table.data(), table.size() - 1, 1));
+        }
+
+
+        TEST_F(HashTest, LookupMarkets)
+        {
+            auto setup = GetSetup();
+
+            std::vector<MarketSlot> table(16, MarketSlot { 0, 0, 0 });
+
+            for (uint32_t i = 1; i <= 10; ++i)
+            {
+                const uint32_t language = i * 0x9e3779b9u;
+                Insert(table,
+                       &MarketSlot::m_languageHash,
+                       Hashing::MultiplyXorShift(language),
+                       MarketSlot { language, i, static_cast<int32_t>(i * 10) });
+            }
+
+            Function<int32_t, MarketSlot*, uint32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & slotMask = e.Immediate<uint64_t>(table.size() - 1);
+            auto & slot = e.HashLookup(e.GetP1(),
+                                       slotMask,
+                                       &MarketSlot::m_languageHash,
+                                       0,
+                                       e.GetP2(),
+                                       e.MultiplyXorShiftHash(e.GetP2()));
+            auto & boost = e.Conditional(e.Compare<JccType::JNE>(slot, e.Immediate<MarketSlot*>(nullptr)),
+                                         e.Deref(e.FieldPointer(slot, &MarketSlot::m_boost)),
+                                         e.Immediate(-1));
+            auto function = e.Compile(boost);
+
+            for (uint32_t i = 1; i <= 10; ++i)
+            {
+                ASSERT_EQ(static_cast<int32_t>(i * 10), function(table.data(), i * 0x9e3779b9u)) << "i = " << i;
+            }
+
+            ASSERT_EQ(-1, function(table.data(), 12345));
+        }
+    }
+}
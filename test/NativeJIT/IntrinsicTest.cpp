@@ -0,0 +1,167 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <cstdint>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/IntrinsicRegistry.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace IntrinsicUnitTest
+    {
+        TEST_FIXTURE_START(IntrinsicTest)
+
+        protected:
+            static int32_t Clamp(int32_t value, int32_t low, int32_t high)
+            {
+                ++s_calls;
+                return value < low ? low : (value > high ? high : value);
+            }
+
+
+            static Node<int32_t>& ExpandClamp(ExpressionNodeFactory& e,
+                                              Node<int32_t>& value,
+                                              Node<int32_t>& low,
+                                              Node<int32_t>& high)
+            {
+                auto & atLeastLow = e.Conditional(e.Compare<JccType::JL>(value, low), low, value);
+                return e.Conditional(e.Compare<JccType::JG>(atLeastLow, high), high, atLeastLow);
+            }
+
+
+            static uint64_t HashCombine(uint64_t seed, uint64_t value)
+            {
+                ++s_calls;
+                return seed * 0x9e3779b97f4a7c15ull + value;
+            }
+
+
+            static int64_t Twice(int64_t value)
+            {
+                ++s_calls;
+                return 2 * value;
+            }
+
+
+            static unsigned s_calls;
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        unsigned IntrinsicTest::s_calls;
+
+
+        TEST_F(IntrinsicTest, ExpandedCall)
+        {
+            auto setup = GetSetup();
+
+            IntrinsicRegistry intrinsics;
+            intrinsics.Register(Clamp, ExpandClamp);
+
+            Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+            expression.SetIntrinsics(intrinsics);
+
+            // The parameter is used twice by the expansion.
+            auto & clamped = expression.Call(expression.Immediate(&Clamp),
+                                             expression.GetP1(),
+                                             expression.Immediate<int32_t>(-5),
+                                             expression.Immediate<int32_t>(10));
+            auto function = expression.Compile(clamped);
+
+            s_calls = 0;
+
+            EXPECT_EQ(-5, function(-100));
+            EXPECT_EQ(3, function(3));
+            EXPECT_EQ(10, function(100));
+            EXPECT_EQ(0u, s_calls);
+
+            // The unused function pointer is not emitted.
+            EXPECT_EQ(0u, setup->GetCode().GetAbsoluteAddressRelocations().size());
+        }
+
+
+        TEST_F(IntrinsicTest, Lambda)
+        {
+            auto setup = GetSetup();
+
+            IntrinsicRegistry intrinsics;
+            intrinsics.Register(HashCombine,
+                                [](ExpressionNodeFactory& e,
+                                   Node<uint64_t>& seed,
+                                   Node<uint64_t>& value) -> Node<uint64_t>&
+                                {
+                                    auto & mixed = e.Mul(seed, e.Immediate<uint64_t>(0x9e3779b97f4a7c15ull));
+                                    return e.Add(mixed, value);
+                                });
+
+            Function<uint64_t, uint64_t, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+            expression.SetIntrinsics(intrinsics);
+
+            // Nested expansions share the common subexpression p1.
+            auto & inner = expression.Call(HashCombine, expression.GetP1(), expression.GetP2());
+            auto & outer = expression.Call(HashCombine, inner, expression.GetP1());
+            auto function = expression.Compile(outer);
+
+            const uint64_t expected = HashCombine(HashCombine(17, 42), 17);
+            s_calls = 0;
+
+            EXPECT_EQ(expected, function(17, 42));
+            EXPECT_EQ(0u, s_calls);
+        }
+
+
+        // Functions which are not in the registry are still called.
+        TEST_F(IntrinsicTest, NotRegistered)
+        {
+            auto setup = GetSetup();
+
+            IntrinsicRegistry intrinsics;
+            intrinsics.Register(Clamp, ExpandClamp);
+
+            Function<int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+            expression.SetIntrinsics(intrinsics);
+
+            auto function = expression.Compile(expression.Call(Twice, expression.GetP1()));
+
+            s_calls = 0;
+
+            EXPECT_EQ(14, function(7));
+            EXPECT_EQ(1u, s_calls);
+        }
+
+
+        TEST_F(IntrinsicTest, DuplicateRegistration)
+        {
+            IntrinsicRegistry intrinsics;
+            intrinsics.Register(Clamp, ExpandClamp);
+
+            EXPECT_THROW(intrinsics.Register(Clamp, ExpandClamp), std::runtime_error);
+        }
+    }
+}
@@ -0,0 +1,340 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+
+#include <cstdint>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace LoopUnitTest
+    {
+        TEST_FIXTURE_START(LoopTest)
+
+        protected:
+            static int32_t Accumulate(int32_t value)
+            {
+                s_total += value;
+                return s_total;
+            }
+
+
+            static int32_t s_total;
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        int32_t LoopTest::s_total;
+
+
+        TEST_F(LoopTest, Sum)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t const *, uint32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & sum = e.Reduce(e.GetP1(),
+                                  e.GetP2(),
+                                  e.Immediate(0),
+                                  [&e](Node<int32_t>& accumulator, Node<int32_t>& element) -> Node<int32_t>&
+                                  {
+                                      return e.Add(accumulator, element);
+                                  });
+            auto function = e.Compile(sum);
+
+            const int32_t values[] = { 1, 2, 3, 4, 5 };
+
+            ASSERT_EQ(0, function(values, 0));
+            ASSERT_EQ(1, function(values, 1));
+            ASSERT_EQ(15, function(values, 5));
+        }
+
+
+        TEST_F(LoopTest, UnrolledWithRemainder)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t*, int64_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // The order of the elements matters: acc = 3 * acc + element.
+            auto & hash = e.Reduce(e.GetP1(),
+                                   e.GetP2(),
+                                   e.Immediate<int64_t>(7),
+                                   [&e](Node<int64_t>& accumulator, Node<int64_t>& element) -> Node<int64_t>&
+                                   {
+                                       return e.Add(e.Mul(accumulator, e.Immediate<int64_t>(3)), element);
+                                   },
+                                   4);
+            auto function = e.Compile(hash);
+
+            int64_t values[] = { 5, -1, 8, 2, 9, 4, -6, 3, 7, 1, 0 };
+
+            for (int64_t count = -1; count <= 11; ++count)
+            {
+                int64_t expected = 7;
+
+                for (int64_t i = 0; i < count; ++i)
+                {
+                    expected = 3 * expected + values[i];
+                }
+
+                ASSERT_EQ(expected, function(values, count)) << "count = " << count;
+            }
+        }
+
+
+        TEST_F(LoopTest, MultipleAccumulators)
+        {
+            auto setup = GetSetup();
+
+            Function<double, double const *, int32_t, double> e(setup->GetAllocator(), setup->GetCode());
+
+            // A scaled sum with the scale parameter used inside the loop.
+            auto add = [&e](Node<double>& left, Node<double>& right) -> Node<double>&
+            {
+                return e.Add(left, right);
+            };
+            auto & sum = e.Reduce(e.GetP1(),
+                                  e.GetP2(),
+                                  e.Immediate(0.5),
+                                  e.Immediate(0.0),
+                                  [&e](Node<double>& accumulator, Node<double>& element) -> Node<double>&
+                                  {
+                                      return e.Add(accumulator, e.Mul(element, e.GetP3()));
+                                  },
+                                  add,
+                                  2,
+                                  4);
+            auto function = e.Compile(e.Add(sum, e.GetP3()));
+
+            const double values[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+            for (int32_t count = 0; count <= 9; ++count)
+            {
+                double expected = 0.5;
+
+                for (int32_t i = 0; i < count; ++i)
+                {
+                    expected += values[i] * 2;
+                }
+
+                ASSERT_EQ(expected + 2, function(values, count, 2)) << "count = " << count;
+            }
+        }
+
+
+        TEST_F(LoopTest, WeightedLookup)
+        {
+            auto setup = GetSetup();
+
+            Function<float, uint32_t const *, uint64_t, float const *> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & score = e.Reduce(e.GetP1(),
+                                    e.GetP2(),
+                                    e.Immediate(0.0f),
+                                    [&e](Node<float>& accumulator, Node<uint32_t>& term) -> Node<float>&
+                                    {
+                                        return e.Add(accumulator, e.Deref(e.Add(e.GetP3(), term)));
+                                    },
+                                    2);
+            auto function = e.Compile(score);
+
+            const float weights[] = { 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+            const uint32_t terms[] = { 4, 0, 2, 2, 1 };
+
+            ASSERT_EQ(0.0f, function(terms, 0, weights));
+            ASSERT_EQ(8.5f, function(terms, 2, weights));
+            ASSERT_EQ(13.5f, function(terms, 5, weights));
+        }
+
+
+        TEST_F(LoopTest, PrefetchRecords)
+        {
+            struct Document
+            {
+                int64_t m_padding[8];
+                int64_t m_score;
+            };
+
+            std::vector<Document> documents(11);
+            std::vector<Document const *> pointers;
+
+            for (size_t i = 0; i < documents.size(); ++i)
+            {
+                documents[i].m_score = static_cast<int64_t>(i * i);
+                pointers.push_back(&documents[i]);
+            }
+
+            // Both the unrolled main loop and the remainder loop prefetch
+            // and must stop before the end of the array.
+            for (unsigned unrollCount = 1; unrollCount <= 4; unrollCount *= 2)
+            {
+                auto setup = GetSetup();
+
+                Function<int64_t, Document const * const *, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+                auto & sum = e.Reduce(e.GetP1(),
+                                      e.GetP2(),
+                                      e.Immediate<int64_t>(0),
+                                      [&e](Node<int64_t>& accumulator, Node<Document const *>& document) -> Node<int64_t>&
+                                      {
+                                          return e.Add(accumulator, e.Deref(e.FieldPointer(document, &Document::m_score)));
+                                      },
+                                      unrollCount,
+                                      3);
+                auto function = e.Compile(sum);
+
+                for (int32_t count = 0; count <= 11; ++count)
+                {
+                    int64_t expected = 0;
+
+                    for (int32_t i = 0; i < count; ++i)
+                    {
+                        expected += i * i;
+                    }
+
+                    ASSERT_EQ(expected, function(pointers.data(), count))
+                        << "unroll = " << unrollCount << ", count = " << count;
+                }
+            }
+        }
+
+
+        TEST_F(LoopTest, PrefetchValues)
+        {
+            auto setup = GetSetup();
+
+            Function<double, double const *, uint32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            auto & sum = e.Reduce(e.GetP1(),
+                                  e.GetP2(),
+                                  e.Immediate(0.0),
+                                  [&e](Node<double>& accumulator, Node<double>& element) -> Node<double>&
+                                  {
+                                      return e.Add(accumulator, element);
+                                  },
+                                  4,
+                                  64);
+            auto function = e.Compile(sum);
+
+            const double values[] = { 1, 2, 3, 4, 5, 6, 7 };
+
+            ASSERT_EQ(0.0, function(values, 0));
+            ASSERT_EQ(28.0, function(values, 7));
+        }
+
+
+        TEST_F(LoopTest, ForEachWithCall)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t*, int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // The offset is live across the loop and the calls in it.
+            auto & offset = e.Add(e.GetP3(), e.Immediate(1));
+            auto & last = e.ForEach(e.GetP1(),
+                                    e.GetP2(),
+                                    e.Immediate(-1),
+                                    [&e, &offset](Node<int32_t>& element) -> Node<int32_t>&
+                                    {
+                                        return e.Call(Accumulate, e.Add(element, offset));
+                                    });
+            auto function = e.Compile(e.Add(last, offset));
+
+            int32_t values[] = { 10, 20, 30 };
+
+            s_total = 0;
+            ASSERT_EQ(-1 + 6, function(values, 0, 5));
+            ASSERT_EQ(0, s_total);
+
+            ASSERT_EQ(78 + 6, function(values, 3, 5));
+            ASSERT_EQ(78, s_total);
+        }
+
+
+        TEST_F(LoopTest, ForEachWithCallAndLocalVariable)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t*, int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // The offset doesn't read the local variable, so it is still
+            // evaluated before the loop even though it is created after the
+            // variable.
+            auto & bias = e.Local<int32_t>();
+            auto & init = e.Assign(bias, e.GetP3());
+
+            auto & offset = e.Add(e.GetP3(), e.Immediate(1));
+            auto & last = e.ForEach(e.GetP1(),
+                                    e.GetP2(),
+                                    e.Immediate(-1),
+                                    [&e, &offset](Node<int32_t>& element) -> Node<int32_t>&
+                                    {
+                                        return e.Call(Accumulate, e.Add(element, offset));
+                                    });
+            auto function = e.Compile(e.Sequence(init, e.Add(e.Add(last, offset), e.Load(bias))));
+
+            int32_t values[] = { 10, 20, 30 };
+
+            s_total = 0;
+            ASSERT_EQ(-1 + 6 + 5, function(values, 0, 5));
+            ASSERT_EQ(0, s_total);
+
+            ASSERT_EQ(78 + 6 + 5, function(values, 3, 5));
+            ASSERT_EQ(78, s_total);
+        }
+
+
+        TEST_F(LoopTest, SharedValueWithZeroIterations)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t*, int32_t, int32_t> e(setup->GetAllocator(), setup->GetCode());
+
+            // The limit is spilled before the loop and loaded into a register
+            // by the comparison in its body. When the body doesn't run, the
+            // use after the loop must still find the limit where it was spilled.
+            auto & limit = e.Add(e.GetP3(), e.Immediate(1));
+            auto & last = e.ForEach(e.GetP1(),
+                                    e.GetP2(),
+                                    e.Immediate(-1),
+                                    [&e, &limit](Node<int32_t>& element) -> Node<int32_t>&
+                                    {
+                                        return e.Conditional(e.Compare<JccType::JG>(limit, element), element, limit);
+                                    });
+            auto function = e.Compile(e.Add(last, limit));
+
+            int32_t values[] = { 10, 20, 30 };
+
+            ASSERT_EQ(-1 + 25, function(values, 0, 24));
+            ASSERT_EQ(25 + 25, function(values, 3, 24));
+            ASSERT_EQ(30 + 41, function(values, 3, 40));
+        }
+    }
+}
@@ -0,0 +1,183 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/PerfMap.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace PerfMapUnitTest
+    {
+        TEST_FIXTURE_START(PerfMap)
+
+        protected:
+            static std::vector<char> ReadFile(std::string const & path)
+            {
+                std::ifstream file(path, std::ios::binary);
+                return std::vector<char>(std::istreambuf_iterator<char>(file),
+                                         std::istreambuf_iterator<char>());
+            }
+
+
+            template <typename T>
+            static T ReadAt(std::vector<char> const & data, size_t offset)
+            {
+                T value;
+                std::memcpy(&value, data.data() + offset, sizeof(T));
+
+                return value;
+            }
+
+
+            // Compiles (p1 * 3) + p1 with the listener attached.
+            void Compile(IFunctionListener& listener, char const * name)
+            {
+                auto setup = GetSetup();
+                auto & code = setup->GetCode();
+                Function<int64_t, int64_t> expression(setup->GetAllocator(), code);
+
+                code.SetFunctionName(name);
+                code.SetListener(&listener);
+
+                auto & p1 = expression.GetP1();
+                auto function = expression.Compile(
+                    expression.Add(expression.Mul(p1, expression.Immediate<int64_t>(3)), p1));
+
+                code.SetListener(nullptr);
+
+                ASSERT_EQ(20, function(5));
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(PerfMap, PerfMapEntry)
+        {
+            std::string path;
+
+            {
+                PerfMapWriter writer(".");
+                path = writer.GetPath();
+
+                Compile(writer, "Scorer");
+            }
+
+            // The map is opened for appending, so the entry is on the last line.
+            auto contents = ReadFile(path);
+            std::istringstream lines(std::string(contents.begin(), contents.end()));
+
+            std::string line;
+            std::string lastLine;
+
+            while (std::getline(lines, line))
+            {
+                lastLine = line;
+            }
+
+            std::istringstream fields(lastLine);
+            std::string address;
+            std::string size;
+            std::string name;
+            fields >> address >> size >> name;
+
+            EXPECT_FALSE(address.empty());
+            EXPECT_NE(0u, std::stoul(size, nullptr, 16));
+            EXPECT_EQ("Scorer", name);
+
+            std::remove(path.c_str());
+        }
+
+
+        TEST_F(PerfMap, JitDumpRecords)
+        {
+            std::string path;
+
+            {
+                JitDumpWriter writer(true, ".");
+                path = writer.GetPath();
+
+                Compile(writer, "Scorer");
+            }
+
+            auto dump = ReadFile(path);
+
+            // File header: magic, version, size, machine, padding, pid,
+            // timestamp and flags.
+            ASSERT_LE(40u, dump.size());
+            EXPECT_EQ(0x4A695444u, ReadAt<uint32_t>(dump, 0));
+            EXPECT_EQ(40u, ReadAt<uint32_t>(dump, 8));
+            EXPECT_EQ(62u, ReadAt<uint32_t>(dump, 12));
+
+            // The debug info record precedes the code load record.
+            size_t offset = 40;
+            ASSERT_EQ(2u, ReadAt<uint32_t>(dump, offset));
+
+            const uint64_t codeAddress = ReadAt<uint64_t>(dump, offset + 16);
+            const uint64_t entryCount = ReadAt<uint64_t>(dump, offset + 24);
+            EXPECT_LT(0u, entryCount);
+
+            size_t entry = offset + 32;
+            uint64_t previousAddress = 0;
+
+            for (uint64_t i = 0; i < entryCount; ++i)
+            {
+                const uint64_t address = ReadAt<uint64_t>(dump, entry);
+                EXPECT_LT(previousAddress, address);
+                EXPECT_LE(codeAddress, address);
+                EXPECT_STREQ("Scorer", dump.data() + entry + 16);
+
+                previousAddress = address;
+                entry += 16 + sizeof("Scorer");
+            }
+
+            offset += ReadAt<uint32_t>(dump, offset + 4);
+            ASSERT_EQ(entry, offset);
+
+            // Code load record.
+            ASSERT_EQ(0u, ReadAt<uint32_t>(dump, offset));
+            EXPECT_EQ(codeAddress, ReadAt<uint64_t>(dump, offset + 24));
+            const uint64_t codeSize = ReadAt<uint64_t>(dump, offset + 40);
+            EXPECT_STREQ("Scorer", dump.data() + offset + 56);
+
+            const size_t codeOffset = offset + 56 + sizeof("Scorer");
+            ASSERT_EQ(dump.size(), codeOffset + codeSize);
+            EXPECT_EQ(0, std::memcmp(reinterpret_cast<void const *>(codeAddress),
+                                     dump.data() + codeOffset,
+                                     codeSize));
+
+            std::remove(path.c_str());
+        }
+    }
+}
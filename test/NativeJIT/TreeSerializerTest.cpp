@@ -0,0 +1,219 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <stdexcept>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/TreeSerializer.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace TreeSerializerUnitTest
+    {
+        TEST_FIXTURE_START(TreeSerializer)
+
+        protected:
+            struct Document
+            {
+                int32_t m_clicks;
+                float m_weight;
+                Document* m_next;
+            };
+
+
+            static int32_t Clamp(int32_t value, int32_t limit)
+            {
+                return value < limit ? value : limit;
+            }
+
+
+            static int32_t Twice(int32_t value)
+            {
+                return 2 * value;
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(TreeSerializer, ArithmeticAndConditional)
+        {
+            CallTargetRegistry registry;
+            std::vector<uint8_t> serialized;
+            std::vector<int32_t> expected;
+
+            const int32_t inputs[] = { -7, 0, 3, 100 };
+
+            {
+                auto setup = GetSetup();
+                Function<int32_t, int32_t, float> expression(setup->GetAllocator(), setup->GetCode());
+                TreeWriter writer(expression, registry);
+
+                auto & p1 = writer.AddParameter(expression.GetP1());
+                auto & p2 = writer.AddParameter(expression.GetP2());
+
+                // (p1 * 3 + int(p2)) is shared by both branches.
+                auto & shared = writer.Add(writer.Mul(p1, writer.Immediate(3)),
+                                           writer.Cast<int32_t>(p2));
+                auto & condition = writer.Compare<JccType::JG>(p1, writer.Immediate(0));
+                auto & root = writer.Conditional(condition,
+                                                 writer.Shl(shared, 2),
+                                                 writer.Sub(shared, writer.Immediate(-5)));
+
+                writer.Serialize(root, serialized);
+                auto function = expression.Compile(root);
+
+                for (auto input : inputs)
+                {
+                    expected.push_back(function(input, 1.5f));
+                }
+            }
+
+            {
+                auto setup = GetSetup();
+                Function<int32_t, int32_t, float> expression(setup->GetAllocator(), setup->GetCode());
+                TreeReader reader(expression, registry);
+
+                reader.AddParameter(expression.GetP1());
+                reader.AddParameter(expression.GetP2());
+
+                auto & root = reader.Load<int32_t>(serialized.data(), serialized.size());
+                auto function = expression.Compile(root);
+
+                for (unsigned i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i)
+                {
+                    EXPECT_EQ(expected[i], function(inputs[i], 1.5f));
+                }
+            }
+        }
+
+
+        TEST_F(TreeSerializer, FieldsAndCalls)
+        {
+            CallTargetRegistry writerRegistry;
+            writerRegistry.Register(1, Clamp);
+            writerRegistry.Register(2, Twice);
+
+            std::vector<uint8_t> serialized;
+
+            Document second = { 20, 0.5f, nullptr };
+            Document first = { 7, 2.0f, &second };
+
+            {
+                auto setup = GetSetup();
+                Function<int32_t, Document*> expression(setup->GetAllocator(), setup->GetCode());
+                TreeWriter writer(expression, writerRegistry);
+
+                auto & document = writer.AddParameter(expression.GetP1());
+                auto & next = writer.Deref(writer.FieldPointer(document, &Document::m_next));
+                auto & nextClicks = writer.Deref(writer.FieldPointer(next, &Document::m_clicks));
+                auto & weight = writer.Deref(writer.FieldPointer(document, &Document::m_weight));
+                auto & root = writer.Call(Clamp,
+                                          writer.Call(Twice, nextClicks),
+                                          writer.Cast<int32_t>(writer.Mul(weight, writer.Immediate(10.0f))));
+
+                writer.Serialize(root, serialized);
+                auto function = expression.Compile(root);
+
+                EXPECT_EQ(20, function(&first));
+            }
+
+            // The reader's registry maps the same IDs to the same functions,
+            // registered in a different order.
+            CallTargetRegistry readerRegistry;
+            readerRegistry.Register(2, Twice);
+            readerRegistry.Register(1, Clamp);
+
+            {
+                auto setup = GetSetup();
+                Function<int32_t, Document*> expression(setup->GetAllocator(), setup->GetCode());
+                TreeReader reader(expression, readerRegistry);
+
+                reader.AddParameter(expression.GetP1());
+
+                auto & root = reader.Load<int32_t>(serialized.data(), serialized.size());
+                auto function = expression.Compile(root);
+
+                EXPECT_EQ(20, function(&first));
+
+                first.m_weight = 10.0f;
+                EXPECT_EQ(40, function(&first));
+            }
+        }
+
+
+        TEST_F(TreeSerializer, InvalidInput)
+        {
+            CallTargetRegistry registry;
+            registry.Register(1, Twice);
+
+            std::vector<uint8_t> serialized;
+
+            {
+                auto setup = GetSetup();
+                Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+                TreeWriter writer(expression, registry);
+
+                auto & root = writer.Call(Twice, writer.AddParameter(expression.GetP1()));
+                writer.Serialize(root, serialized);
+            }
+
+            auto setup = GetSetup();
+
+            // Truncated data.
+            {
+                Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+                TreeReader reader(expression, registry);
+                reader.AddParameter(expression.GetP1());
+
+                EXPECT_THROW(reader.Load<int32_t>(serialized.data(), serialized.size() - 1),
+                             std::runtime_error);
+            }
+
+            // Mismatched root type.
+            {
+                Function<int64_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+                TreeReader reader(expression, registry);
+                reader.AddParameter(expression.GetP1());
+
+                EXPECT_THROW(reader.Load<int64_t>(serialized.data(), serialized.size()),
+                             std::runtime_error);
+            }
+
+            // Unknown call target.
+            {
+                CallTargetRegistry emptyRegistry;
+                Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+                TreeReader reader(expression, emptyRegistry);
+                reader.AddParameter(expression.GetP1());
+
+                EXPECT_THROW(reader.Load<int32_t>(serialized.data(), serialized.size()),
+                             std::runtime_error);
+            }
+        }
+    }
+}